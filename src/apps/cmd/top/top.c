@@ -0,0 +1,229 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Samples /dev/schedstat at an interval and lists threads by how much cpu they have taken in between
+// usage: top [-d interval in ms] [-n number of samples]
+// build: i386-mos-gcc top.c -o top
+
+#define SCHEDSTAT_PATH "/dev/schedstat"
+#define SCHEDSTAT_BUFFER_SIZE 0x4000
+#define MAX_THREADS 256
+#define DEFAULT_INTERVAL_MS 1000
+
+struct thread_sample
+{
+	int pid, tid;
+	char state;
+	int policy, prio, cpu;
+	uint64_t runtime, wait;
+	unsigned int nvcsw, nivcsw;
+	char name[32];
+};
+
+struct snapshot
+{
+	unsigned int nr_switches, nr_irqs, nr_softirqs;
+	uint64_t idle, tsc, tsc_khz;
+	uint64_t hardirq_max, irqoff_max;
+	int nr_threads;
+	struct thread_sample threads[MAX_THREADS];
+};
+
+// delta between two snapshots, it is what is listed
+struct thread_usage
+{
+	struct thread_sample *sample;
+	uint64_t runtime, wait;
+	unsigned int nvcsw, nivcsw;
+};
+
+static char text[SCHEDSTAT_BUFFER_SIZE];
+static struct snapshot snapshots[2];
+static struct thread_usage usages[MAX_THREADS];
+
+static const char *policy_names[] = {"kernel", "system", "app"};
+
+static uint64_t header_field(const char *line, const char *field)
+{
+	char *p = strstr(line, field);
+	return p ? strtoull(p + strlen(field), NULL, 10) : 0;
+}
+
+static void parse_thread(char *line, struct thread_sample *th)
+{
+	char *p = line;
+	th->pid = strtol(p, &p, 10);
+	th->tid = strtol(p, &p, 10);
+	p = skip_spaces(p);
+	th->state = *p++;
+	th->policy = strtol(p, &p, 10);
+	th->prio = strtol(p, &p, 10);
+	th->cpu = strtol(p, &p, 10);
+	th->runtime = strtoull(p, &p, 10);
+	th->wait = strtoull(p, &p, 10);
+	th->nvcsw = strtoul(p, &p, 10);
+	th->nivcsw = strtoul(p, &p, 10);
+	p = skip_spaces(p);
+
+	int len = strcspn(p, "\n");
+	if (len >= (int)sizeof(th->name))
+		len = sizeof(th->name) - 1;
+	memcpy(th->name, p, len);
+	th->name[len] = 0;
+}
+
+static int read_snapshot(struct snapshot *snap)
+{
+	int fd = open(SCHEDSTAT_PATH, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	// kernel takes a snapshot at each read, the whole text has to come out of one
+	int len = read(fd, text, sizeof(text) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	text[len] = 0;
+
+	char *line = text;
+	snap->nr_switches = header_field(line, "switches ");
+	snap->nr_irqs = header_field(line, "irqs ");
+	snap->idle = header_field(line, "idle ");
+	snap->tsc = header_field(line, "tsc ");
+	snap->tsc_khz = header_field(line, "tsc_khz ");
+	snap->nr_softirqs = header_field(line, "softirq ");
+	snap->hardirq_max = header_field(line, "hardirq_max ");
+	snap->irqoff_max = header_field(line, "irqoff_max ");
+
+	snap->nr_threads = 0;
+	// first line is system wide, second one is column names
+	for (int i = 0; (line = strchr(line, '\n')) && *++line && snap->nr_threads < MAX_THREADS; ++i)
+	{
+		if (i > 0)
+			parse_thread(line, &snap->threads[snap->nr_threads++]);
+	}
+	return 0;
+}
+
+static struct thread_sample *find_sample(struct snapshot *snap, int tid)
+{
+	for (int i = 0; i < snap->nr_threads; ++i)
+		if (snap->threads[i].tid == tid)
+			return &snap->threads[i];
+	return NULL;
+}
+
+static int compare_usage(const void *a, const void *b)
+{
+	const struct thread_usage *ua = a, *ub = b;
+	if (ua->runtime != ub->runtime)
+		return ua->runtime > ub->runtime ? -1 : 1;
+	return ua->sample->tid - ub->sample->tid;
+}
+
+// per mille of elapsed tsc, printed as a percentage with one decimal
+static unsigned int permille(uint64_t part, uint64_t total)
+{
+	return total ? (unsigned int)(part * 1000 / total) : 0;
+}
+
+static uint64_t ticks_to_ms(uint64_t ticks, uint64_t tsc_khz)
+{
+	return tsc_khz ? ticks / tsc_khz : 0;
+}
+
+static uint64_t ticks_to_us(uint64_t ticks, uint64_t tsc_khz)
+{
+	return tsc_khz ? ticks * 1000 / tsc_khz : 0;
+}
+
+static void print_usage(struct snapshot *prev, struct snapshot *curr)
+{
+	uint64_t elapsed = curr->tsc - prev->tsc;
+	uint64_t elapsed_ms = ticks_to_ms(elapsed, curr->tsc_khz);
+	unsigned int idle = permille(curr->idle - prev->idle, elapsed);
+	unsigned int switches = curr->nr_switches - prev->nr_switches;
+	unsigned int irqs = curr->nr_irqs - prev->nr_irqs;
+
+	printf("cpu: %u.%u%% busy %u.%u%% idle, %u switches %u irqs %u softirqs in %llums, %d threads\n",
+		   (1000 - idle) / 10, (1000 - idle) % 10, idle / 10, idle % 10, switches, irqs,
+		   curr->nr_softirqs - prev->nr_softirqs, elapsed_ms, curr->nr_threads);
+	printf("irqs off: worst %lluus in hard irq, %lluus with scheduler locked (since boot)\n",
+		   ticks_to_us(curr->hardirq_max, curr->tsc_khz), ticks_to_us(curr->irqoff_max, curr->tsc_khz));
+
+	for (int i = 0; i < curr->nr_threads; ++i)
+	{
+		struct thread_sample *th = &curr->threads[i];
+		struct thread_sample *before = find_sample(prev, th->tid);
+		usages[i] = (struct thread_usage){
+			.sample = th,
+			.runtime = th->runtime - (before ? before->runtime : 0),
+			.wait = th->wait - (before ? before->wait : 0),
+			.nvcsw = th->nvcsw - (before ? before->nvcsw : 0),
+			.nivcsw = th->nivcsw - (before ? before->nivcsw : 0),
+		};
+	}
+	qsort(usages, curr->nr_threads, sizeof(struct thread_usage), compare_usage);
+
+	printf("%5s %5s %s %6s %6s %3s %6s %6s %10s %6s %6s %s\n",
+		   "PID", "TID", "S", "POLICY", "PRIO", "CPU", "%CPU", "%WAIT", "TIME(ms)", "VCSW", "IVCSW", "NAME");
+	for (int i = 0; i < curr->nr_threads; ++i)
+	{
+		struct thread_usage *u = &usages[i];
+		struct thread_sample *th = u->sample;
+		unsigned int cpu = permille(u->runtime, elapsed);
+		unsigned int wait = permille(u->wait, elapsed);
+		const char *policy = th->policy >= 0 && th->policy < 3 ? policy_names[th->policy] : "?";
+
+		printf("%5d %5d %c %6s %6d %3d %4u.%u %4u.%u %10llu %6u %6u %s\n",
+			   th->pid, th->tid, th->state, policy, th->prio, th->cpu, cpu / 10, cpu % 10, wait / 10, wait % 10,
+			   ticks_to_ms(th->runtime, curr->tsc_khz), u->nvcsw, u->nivcsw, th->name);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int interval = DEFAULT_INTERVAL_MS;
+	int nr_samples = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:n:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			interval = atoi(optarg);
+			break;
+		case 'n':
+			nr_samples = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d interval_ms] [-n samples]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (read_snapshot(&snapshots[0]) < 0)
+	{
+		fprintf(stderr, "top: cannot read %s\n", SCHEDSTAT_PATH);
+		return 1;
+	}
+
+	for (int i = 1; !nr_samples || i <= nr_samples; ++i)
+	{
+		poll(NULL, 0, interval);
+
+		struct snapshot *prev = &snapshots[(i - 1) % 2];
+		struct snapshot *curr = &snapshots[i % 2];
+		if (read_snapshot(curr) < 0)
+			return 1;
+		print_usage(prev, curr);
+	}
+	return 0;
+}
@@ -1,13 +1,116 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Checks symbols are resolved by /lib/ld.so when linked against libc.so (calls are bound lazily through PLT,
+// libc's variables are copied into program by R_386_COPY, libc calls back into program)
+// then compares disk size and exec time of dynamic (/bin/ld) and static (/bin/ld-static) builds of this program
+// build: i386-mos-gcc ld.c -o ld && i386-mos-gcc -static ld.c -o ld-static
+
+#define NR_EXECS 50
+#define DYNAMIC_PATH "/bin/ld"
+#define STATIC_PATH "/bin/ld-static"
+
+static uint64_t now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int compare_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static int check_symbols()
+{
+	int failures = 0;
+
+	// first call goes through _dl_runtime_resolve, second one jumps straight to libc
+	for (int i = 0; i < 2; ++i)
+	{
+		char buf[32];
+		if (strlen("dynamic") != 7 || snprintf(buf, sizeof(buf), "%s-%d", "ld", 42) != 5 || strcmp(buf, "ld-42"))
+		{
+			printf("plt: libc functions return wrong values\n");
+			failures++;
+		}
+	}
+
+	// errno is defined in libc.so, program and libc have to see the same variable
+	errno = 0;
+	if (open("/nonexistent", O_RDONLY) >= 0 || errno != ENOENT)
+	{
+		printf("copy relocation: errno set by libc is not visible in program\n");
+		failures++;
+	}
+
+	if (!stdout || setenv("LD_TEST", "resolved", 1) || !getenv("LD_TEST") || strcmp(getenv("LD_TEST"), "resolved"))
+	{
+		printf("data: libc's globals are not shared with program\n");
+		failures++;
+	}
+
+	// libc calls back into program
+	int values[] = {5, 3, 9, 1, 7};
+	qsort(values, 5, sizeof(int), compare_int);
+	for (int i = 1; i < 5; ++i)
+	{
+		if (values[i - 1] > values[i])
+		{
+			printf("callback: qsort with program's comparator is not sorted\n");
+			failures++;
+			break;
+		}
+	}
+	return failures;
+}
+
+static int bench_exec(const char *path)
+{
+	struct stat st;
+	if (stat(path, &st))
+	{
+		printf("%s is missing\n", path);
+		return 1;
+	}
+
+	char *argv[] = {(char *)path, "child", NULL};
+	int failures = 0;
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_EXECS; ++i)
+	{
+		pid_t pid;
+		int status;
+		if (posix_spawn(&pid, path, NULL, NULL, argv, NULL) || waitpid(pid, &status, 0) != pid ||
+			!WIFEXITED(status) || ((status >> 8) & 0xff) != 0)
+			failures++;
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	printf("%s: %d bytes on disk, %d launches in %dms, %dus per launch\n", path, (int)st.st_size, NR_EXECS,
+		   (int)elapsed, (int)(elapsed * 1000 / NR_EXECS));
+	return failures;
+}
 
 int main(int argc, char *argv[])
 {
-	printf("hi, what is your name? ");
-	fflush(stdout);
+	if (argc > 1 && !strcmp(argv[1], "child"))
+		return 0;
 
-	char name[100] = {0};
-	scanf("%s", name);
-	printf("\nyour name is %s\n", name);
+	int failures = check_symbols();
+	failures += bench_exec(DYNAMIC_PATH);
+	failures += bench_exec(STATIC_PATH);
 
-	return 0;
+	printf("ld: %s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
 }
@@ -51,7 +51,8 @@ static void init_terminal_tab_dev(struct terminal_tab *tab)
 	tab->fd_ptm = fdm;
 	tab->fd_pts = fds;
 
-	int pid = fork();
+	// child only does syscalls before execve, no need to copy terminal's address space
+	int pid = vfork();
 
 	if (!pid)
 	{
@@ -63,6 +64,7 @@ static void init_terminal_tab_dev(struct terminal_tab *tab)
 		setsid();
 		ioctl(fds, TIOCSCTTY, 0);
 		execve("/bin/bash", NULL, NULL);
+		_exit(127);
 	}
 	else
 	{
@@ -7,6 +7,7 @@
 #include <libgui/bmp.h>
 #include <libgui/psf.h>
 #include <mqueue.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
@@ -432,7 +433,8 @@ void handle_mouse_event(struct mouse_event *mevent)
 				if (icon->active)
 				{
 					icon->active = false;
-					posix_spawn(icon->exec_path);
+					char *argv[] = {icon->exec_path, NULL};
+					posix_spawn(NULL, icon->exec_path, NULL, NULL, argv, NULL);
 				}
 				else
 					icon->active = true;
@@ -0,0 +1,14 @@
+#!/bin/bash
+set -Eeuo pipefail
+
+# check disk image after mOS has written to it (shut it down first, dirty buffers are written back within seconds)
+# -f forces the check of a clean marked filesystem, -n opens it read-only and answers no to every fix
+# exit status is 0 only if there is nothing to fix
+IMAGE="${1:-hdd.img}"
+
+unamestr=`uname`
+if [[ "$unamestr" == 'Darwin' ]]; then
+  $(brew --prefix e2fsprogs)/sbin/e2fsck -fn "$IMAGE"
+else
+  e2fsck -fn "$IMAGE"
+fi
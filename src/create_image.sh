@@ -5,6 +5,10 @@ unamestr=`uname`
 
 cd libraries/libc && make clean && make
 cd ../..
+cd libraries/libgui && make clean && make
+cd ../..
+cd libraries/ld && make clean && make
+cd ../..
 
 if [[ "$unamestr" == 'Linux' ]]; then
   dd if=/dev/zero of=hdd.img count=819200 bs=512
@@ -37,7 +41,7 @@ if [[ "$unamestr" == 'Linux' ]]; then
   cd ../..
   cd apps/calculator && make clean && make
   cd ../..
-  cd apps/ld && rm -f ld && i386-mos-gcc -g ld.c -o ld
+  cd apps/ld && rm -f ld ld-static && i386-mos-gcc -g ld.c -o ld && i386-mos-gcc -g -static ld.c -o ld-static
   cd ../..
 
   for dir in apps/cmd/*
@@ -54,6 +58,12 @@ if [[ "$unamestr" == 'Linux' ]]; then
   sudo cp apps/host/host "/mnt/${DISK_NAME}/bin"
   sudo cp apps/calculator/calculator "/mnt/${DISK_NAME}/bin"
   sudo cp apps/ld/ld "/mnt/${DISK_NAME}/bin"
+  sudo cp apps/ld/ld-static "/mnt/${DISK_NAME}/bin"
+
+  sudo mkdir "/mnt/${DISK_NAME}/lib"
+  sudo cp libraries/ld/ld.so "/mnt/${DISK_NAME}/lib"
+  sudo cp libraries/libc/libc.so "/mnt/${DISK_NAME}/lib"
+  sudo cp libraries/libgui/libgui.so "/mnt/${DISK_NAME}/lib"
 
   sudo mkdir "/mnt/${DISK_NAME}/etc"
   sudo cp assets/passwd "/mnt/${DISK_NAME}/etc"
@@ -66,6 +76,8 @@ if [[ "$unamestr" == 'Linux' ]]; then
   sudo mkdir "/mnt/${DISK_NAME}/tmp"
   sudo cp assets/book.txt "/mnt/${DISK_NAME}/tmp"
   sudo cp assets/sample.txt "/mnt/${DISK_NAME}/tmp"
+  # 64MiB file for block map and readahead tests, it is mapped through double indirect blocks
+  sudo dd if=/dev/urandom of="/mnt/${DISK_NAME}/tmp/large.bin" bs=1M count=64
 
   sudo umount "/mnt/${DISK_NAME}"
   sudo rm -rf "/mnt/${DISK_NAME}"
@@ -100,6 +112,11 @@ elif [[ "$unamestr" == 'Darwin' ]]; then
   cp apps/calculator/calculator "/Volumes/${VOLUME_NAME}/bin"
   cp apps/ld/ld "/Volumes/${VOLUME_NAME}/bin"
 
+  mkdir "/Volumes/${VOLUME_NAME}/lib"
+  cp libraries/ld/ld.so "/Volumes/${VOLUME_NAME}/lib"
+  cp libraries/libc/libc.so "/Volumes/${VOLUME_NAME}/lib"
+  cp libraries/libgui/libgui.so "/Volumes/${VOLUME_NAME}/lib"
+
   mkdir "/Volumes/${VOLUME_NAME}/etc"
   cp apps/window_server/desktop.ini "/Volumes/${VOLUME_NAME}/etc"
 
@@ -0,0 +1,234 @@
+#include "fpu.h"
+
+#include <cpu/hal.h>
+#include <cpu/idt.h>
+#include <ipc/signal.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <utils/debug.h>
+#include <utils/string.h>
+
+// thread whose fpu/sse registers are currently loaded in cpu, NULL if nobody owns them
+static struct thread *fpu_owner = NULL;
+static bool fpu_has_fxsr = false;
+static struct fpu_state fpu_initial_state;
+
+static __inline uint32_t read_cr0()
+{
+	uint32_t cr0;
+	__asm__ __volatile__("mov %%cr0, %0"
+						 : "=r"(cr0));
+	return cr0;
+}
+
+static __inline void write_cr0(uint32_t cr0)
+{
+	__asm__ __volatile__("mov %0, %%cr0" ::"r"(cr0));
+}
+
+static __inline uint32_t read_cr4()
+{
+	uint32_t cr4;
+	__asm__ __volatile__("mov %%cr4, %0"
+						 : "=r"(cr4));
+	return cr4;
+}
+
+static __inline void write_cr4(uint32_t cr4)
+{
+	__asm__ __volatile__("mov %0, %%cr4" ::"r"(cr4));
+}
+
+static __inline void clts()
+{
+	__asm__ __volatile__("clts");
+}
+
+static __inline void stts()
+{
+	write_cr0(read_cr0() | CR0_TS);
+}
+
+static void fpu_save_area(uint8_t *area)
+{
+	if (fpu_has_fxsr)
+		__asm__ __volatile__("fxsave (%0)" ::"r"(area)
+							 : "memory");
+	else
+		// fnsave reinitializes fpu, callers treat registers as gone after saving
+		__asm__ __volatile__("fnsave (%0)" ::"r"(area)
+							 : "memory");
+}
+
+static void fpu_restore_area(uint8_t *area)
+{
+	if (fpu_has_fxsr)
+		__asm__ __volatile__("fxrstor (%0)" ::"r"(area)
+							 : "memory");
+	else
+		__asm__ __volatile__("frstor (%0)" ::"r"(area)
+							 : "memory");
+}
+
+static struct fpu_state *fpu_alloc_state()
+{
+	void *unaligned = kcalloc(1, sizeof(struct fpu_state) + 15);
+	struct fpu_state *state = (struct fpu_state *)(((uint32_t)unaligned + 15) & ~15);
+	state->unaligned = unaligned;
+	return state;
+}
+
+// Must be called with TS cleared
+static void fpu_load(struct thread *th)
+{
+	if (fpu_owner == th)
+		return;
+
+	if (fpu_owner)
+		fpu_save_area(fpu_owner->fpu->area);
+
+	// the first time a thread touches fpu, it starts from clean state (fninit + default mxcsr)
+	if (!th->fpu)
+	{
+		th->fpu = fpu_alloc_state();
+		memcpy(th->fpu->area, fpu_initial_state.area, FPU_STATE_SIZE);
+	}
+	fpu_restore_area(th->fpu->area);
+
+	fpu_owner = th;
+	th->fpu_counter++;
+	th->flags |= TIF_FPU_USED;
+}
+
+/*
+ * Called on every context switch with scheduler locked
+ * - previous thread keeps its registers in cpu (we don't save here), fpu_owner tells who they belong to
+ * - next thread which uses fpu frequently gets its state restored eagerly to avoid the #NM round-trip
+ * - otherwise TS is set and the first fpu/sse instruction of next thread traps into `fpu_not_available`
+ */
+void fpu_switch(struct thread *prev, struct thread *next)
+{
+	if (prev)
+	{
+		if (!(prev->flags & TIF_FPU_USED))
+			prev->fpu_counter = 0;
+		prev->flags &= ~TIF_FPU_USED;
+	}
+
+	if (next->fpu && next->fpu_counter > FPU_EAGER_THRESHOLD)
+	{
+		clts();
+		if (fpu_owner == next)
+		{
+			next->fpu_counter++;
+			next->flags |= TIF_FPU_USED;
+		}
+		else
+			fpu_load(next);
+	}
+	else if (fpu_owner == next)
+		clts();
+	else
+		stts();
+}
+
+void fpu_fork(struct thread *parent, struct thread *child)
+{
+	if (!parent->fpu)
+		return;
+
+	child->fpu = fpu_alloc_state();
+	if (fpu_owner == parent)
+	{
+		uint32_t cr0 = read_cr0();
+		clts();
+		fpu_save_area(parent->fpu->area);
+		if (!fpu_has_fxsr)
+			fpu_restore_area(parent->fpu->area);
+		write_cr0(cr0);
+	}
+	memcpy(child->fpu->area, parent->fpu->area, FPU_STATE_SIZE);
+}
+
+void fpu_release(struct thread *th)
+{
+	if (fpu_owner == th)
+	{
+		fpu_owner = NULL;
+		if (th == current_thread)
+			stts();
+	}
+
+	if (th->fpu)
+	{
+		kfree(th->fpu->unaligned);
+		th->fpu = NULL;
+	}
+	th->fpu_counter = 0;
+	th->flags &= ~TIF_FPU_USED;
+}
+
+// #NM
+static int32_t fpu_not_available(struct interrupt_registers *regs)
+{
+	clts();
+	fpu_load(current_thread);
+
+	return IRQ_HANDLER_STOP;
+}
+
+// #MF and #XM, kernel doesn't use fpu so fault from kernel falls through to panic in exception.c
+static int32_t fpu_math_fault(struct interrupt_registers *regs)
+{
+	if (regs->cs != 0x1B)
+		return IRQ_HANDLER_CONTINUE;
+
+	log("FPU: Math fault %d from %s(p%d)", regs->int_no, current_process->name, current_process->pid);
+	if (regs->int_no == 16)
+		__asm__ __volatile__("fnclex");
+	do_kill(current_process->pid, SIGFPE);
+
+	return IRQ_HANDLER_STOP;
+}
+
+void fpu_init()
+{
+	log("FPU: Initializing");
+
+	uint32_t eax, edx;
+	cpuid(1, &eax, &edx);
+	if (!(edx & CPUID_FEAT_EDX_FPU))
+	{
+		err("FPU: x87 is not supported");
+		return;
+	}
+
+	write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+
+	fpu_has_fxsr = edx & CPUID_FEAT_EDX_FXSR;
+	if (fpu_has_fxsr)
+	{
+		uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+		if (edx & CPUID_FEAT_EDX_SSE)
+			cr4 |= CR4_OSXMMEXCPT;
+		write_cr4(cr4);
+	}
+	log("FPU: fxsr=%d sse=%d", fpu_has_fxsr, (edx & CPUID_FEAT_EDX_SSE) != 0);
+
+	__asm__ __volatile__("fninit");
+	if (edx & CPUID_FEAT_EDX_SSE)
+	{
+		uint32_t mxcsr = MXCSR_DEFAULT;
+		__asm__ __volatile__("ldmxcsr %0" ::"m"(mxcsr));
+	}
+	fpu_save_area(fpu_initial_state.area);
+
+	register_interrupt_handler(7, fpu_not_available);
+	register_interrupt_handler(16, fpu_math_fault);
+	register_interrupt_handler(19, fpu_math_fault);
+
+	// nobody owns fpu, the first user traps into #NM
+	stts();
+
+	log("FPU: Done");
+}
@@ -0,0 +1,40 @@
+#ifndef CPU_FPU_H
+#define CPU_FPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CR0_MP 0x00000002  // monitor coprocessor, wait/fwait honors TS
+#define CR0_EM 0x00000004  // x87 emulation
+#define CR0_TS 0x00000008  // task switched, next fpu/sse instruction raises #NM
+#define CR0_NE 0x00000020  // native x87 error reporting via #MF
+
+#define CR4_OSFXSR 0x00000200	   // os supports fxsave/fxrstor and sse
+#define CR4_OSXMMEXCPT 0x00000400  // os handles unmasked sse exceptions via #XM
+
+#define CPUID_FEAT_EDX_FPU (1 << 0)
+#define CPUID_FEAT_EDX_FXSR (1 << 24)
+#define CPUID_FEAT_EDX_SSE (1 << 25)
+
+#define FPU_STATE_SIZE 512
+#define MXCSR_DEFAULT 0x1F80
+
+// a thread which has used fpu in more than FPU_EAGER_THRESHOLD consecutive slices gets its fpu state restored on switch
+// instead of taking #NM, `fpu_counter` is 8-bit so it wraps around and the thread goes back to lazy mode once a while
+#define FPU_EAGER_THRESHOLD 5
+
+struct thread;
+
+// fxsave/fxrstor require 16-byte alignment, kcalloc doesn't guarantee it -> keep the raw pointer for kfree
+struct fpu_state
+{
+	uint8_t area[FPU_STATE_SIZE] __attribute__((aligned(16)));
+	void *unaligned;
+};
+
+void fpu_init();
+void fpu_switch(struct thread *prev, struct thread *next);
+void fpu_fork(struct thread *parent, struct thread *child);
+void fpu_release(struct thread *th);
+
+#endif
@@ -28,6 +28,32 @@ void gdt_set_descriptor(uint32_t i, uint64_t base, uint64_t limit, uint8_t acces
 	_gdt[i].grand |= grand & 0xf0;
 }
 
+// thread without tls gets flat user data segment, so loading GDT_TLS_SELECTOR into gs is always valid
+void gdt_set_tls(struct user_desc *desc)
+{
+	if (!desc || (!desc->base_addr && !desc->limit))
+	{
+		gdt_set_descriptor(GDT_ENTRY_TLS, 0, 0xffffffff,
+						   I86_GDT_DESC_READWRITE | I86_GDT_DESC_CODEDATA | I86_GDT_DESC_MEMORY | I86_GDT_DESC_DPL,
+						   I86_GDT_GRAND_4K | I86_GDT_GRAND_32BIT | I86_GDT_GRAND_LIMITHI_MASK);
+		return;
+	}
+
+	uint8_t access = I86_GDT_DESC_CODEDATA | I86_GDT_DESC_DPL;
+	if (!desc->read_exec_only)
+		access |= I86_GDT_DESC_READWRITE;
+	if (!desc->seg_not_present)
+		access |= I86_GDT_DESC_MEMORY;
+
+	uint8_t grand = 0;
+	if (desc->limit_in_pages)
+		grand |= I86_GDT_GRAND_4K;
+	if (desc->seg_32bit)
+		grand |= I86_GDT_GRAND_32BIT;
+
+	gdt_set_descriptor(GDT_ENTRY_TLS, desc->base_addr, desc->limit, access, grand);
+}
+
 void gdt_init()
 {
 	log("GDT: Initializing");
@@ -60,6 +86,9 @@ void gdt_init()
 						   I86_GDT_DESC_DPL,
 					   I86_GDT_GRAND_4K | I86_GDT_GRAND_32BIT | I86_GDT_GRAND_LIMITHI_MASK);
 
+	//! set default thread local storage descriptor
+	gdt_set_tls(NULL);
+
 	gdt_flush((uint32_t)&_gdtr);
 
 	log("GDT: Done");
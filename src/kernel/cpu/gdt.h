@@ -4,7 +4,11 @@
 #include <stdint.h>
 
 //! maximum amount of descriptors allowed
-#define MAX_DESCRIPTORS 6
+#define MAX_DESCRIPTORS 7
+
+//! per-thread tls descriptor, reloaded on every context switch
+#define GDT_ENTRY_TLS 6
+#define GDT_TLS_SELECTOR ((GDT_ENTRY_TLS << 3) | 3)
 
 /***	 gdt descriptor access bit flags.	***/
 
@@ -67,7 +71,22 @@ struct __attribute__((packed)) gdtr
 	uint32_t base;
 };
 
+// same layout as linux's `struct user_desc` (set_thread_area, clone with CLONE_SETTLS)
+struct user_desc
+{
+	uint32_t entry_number;
+	uint32_t base_addr;
+	uint32_t limit;
+	uint32_t seg_32bit : 1;
+	uint32_t contents : 2;
+	uint32_t read_exec_only : 1;
+	uint32_t limit_in_pages : 1;
+	uint32_t seg_not_present : 1;
+	uint32_t useable : 1;
+};
+
 void gdt_init();
 void gdt_set_descriptor(uint32_t i, uint64_t base, uint64_t limit, uint8_t access, uint8_t grand);
+void gdt_set_tls(struct user_desc *desc);
 
 #endif
@@ -26,6 +26,34 @@ static __inline void disable_interrupts()
 	__asm__ __volatile__("cli");
 }
 
+//! disable hardware interrupts and return eflags to restore them later (section can be nested in another one)
+static __inline uint32_t save_interrupts()
+{
+	uint32_t eflags;
+	__asm__ __volatile__("pushf\n"
+						 "pop %0\n"
+						 "cli"
+						 : "=r"(eflags)
+						 :
+						 : "memory");
+	return eflags;
+}
+
+static __inline void restore_interrupts(uint32_t eflags)
+{
+	if (eflags & 0x200)
+		enable_interrupts();
+}
+
+//! time stamp counter, ticks at a constant rate on anything newer than pentium 4
+static __inline uint64_t rdtsc()
+{
+	uint64_t tsc;
+	__asm__ __volatile__("rdtsc"
+						 : "=A"(tsc));
+	return tsc;
+}
+
 static __inline void halt()
 {
 	__asm__ __volatile__("hlt");
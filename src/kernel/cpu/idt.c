@@ -1,7 +1,10 @@
 #include "idt.h"
 
+#include <cpu/hal.h>
 #include <include/list.h>
 #include <memory/vmm.h>
+#include <proc/task.h>
+#include <system/softirq.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
@@ -11,6 +14,8 @@ extern void idt_flush(uint32_t);
 
 static struct idt_descriptor _idt[I86_MAX_INTERRUPTS];
 static struct idtr _idtr;
+// handler can turn interrupts on (unlock_scheduler) -> another irq is nested in it
+static volatile uint32_t irq_nesting;
 
 struct interrupt_handler
 {
@@ -164,6 +169,10 @@ static void handle_interrupt(struct interrupt_registers *regs)
 void isr_handler(struct interrupt_registers *reg)
 {
 	handle_interrupt(reg);
+
+	// returning from syscall/exception, it is not done inside irq (e.g. kernel faulting in a handler)
+	if (!irq_nesting)
+		preempt_schedule();
 }
 
 void irq_ack(uint32_t irq_number)
@@ -175,5 +184,20 @@ void irq_ack(uint32_t irq_number)
 
 void irq_handler(struct interrupt_registers *reg)
 {
+	uint64_t start = rdtsc();
+	irq_nesting++;
+	sched_stat.nr_irqs++;
 	handle_interrupt(reg);
+	irq_nesting--;
+
+	uint64_t elapsed = rdtsc() - start;
+	if (elapsed > sched_stat.hardirq_max)
+		sched_stat.hardirq_max = elapsed;
+
+	// all handlers have acked, deferred work runs with interrupts on then thread which is interrupted can be switched out
+	if (!irq_nesting)
+	{
+		do_softirq();
+		preempt_schedule();
+	}
 }
@@ -44,8 +44,8 @@ static int32_t pit_interrupt_handler(struct interrupt_registers *regs)
 
 // NOTE: MQ 2020-07-17
 // Prefer using rtc instead of pit for scheduling stuffs which don't require much accuracy
-// (timer_list for example), because we allow overhead and latency in rtc irq
-// pit should only be used for keeping track of time precision
+// because we allow overhead and latency in rtc irq
+// pit should only be used for keeping track of time precision and expiring timer_list (which is cheap when nothing is due)
 void pit_init()
 {
 	log("PIT: Initializing");
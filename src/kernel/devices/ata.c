@@ -3,15 +3,43 @@
 #include <cpu/hal.h>
 #include <cpu/idt.h>
 #include <include/errno.h>
+#include <devices/pci.h>
+#include <fs/buffer.h>
+#include <locking/mutex.h>
 #include <memory/vmm.h>
+#include <proc/task.h>
+#include <proc/wait.h>
+#include <utils/math.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
 #define MAX_ATA_DEVICE 4
+// a command transfers at most 256 sectors of (merged) buffers, each 1KiB buffer can straddle two pages
+#define ATA_MAX_PRDS 512
 
 static struct ata_device devices[MAX_ATA_DEVICE];
 static uint8_t number_of_actived_devices = 0;
 static volatile bool ata_irq_called;
+// pio transfer runs with interrupts on and can be preempted
+// master and slave share registers of their channel -> a command is issued and drained under channel's lock
+struct ata_channel
+{
+	struct mutex lock;
+	uint16_t bmide;	 // 0 if there is no bus master
+	struct ata_prd *prdt;
+	volatile bool dma_done;
+	uint8_t dma_status;
+	struct wait_queue_head wait;  // dma issuer sleeps here until completion irq
+};
+
+static struct ata_channel channels[2];
+// single page -> never crosses 64KiB boundary
+static struct ata_prd prd_tables[2][ATA_MAX_PRDS] __attribute__((aligned(PMM_FRAME_SIZE)));
+
+static struct ata_channel *ata_channel(struct ata_device *device)
+{
+	return &channels[device->io_base == ATA1_IO_ADDR1];
+}
 
 static void ata_400ns_delays(struct ata_device *device)
 {
@@ -69,6 +97,20 @@ static uint8_t ata_polling_identify(struct ata_device *device)
 static int32_t ata_irq(struct interrupt_registers *regs)
 {
 	ata_irq_called = true;
+
+	struct ata_channel *channel = &channels[regs->int_no == IRQ15];
+	if (channel->bmide)
+	{
+		uint8_t status = inportb(channel->bmide + ATA_BM_STATUS);
+		if (status & ATA_BM_STATUS_IRQ)
+		{
+			// status bits are cleared by writing 1
+			outportb(channel->bmide + ATA_BM_STATUS, status);
+			channel->dma_status = status;
+			channel->dma_done = true;
+			wake_up(&channel->wait);
+		}
+	}
 	irq_ack(regs->int_no);
 
 	return IRQ_HANDLER_CONTINUE;
@@ -103,6 +145,11 @@ static uint8_t ata_identify(struct ata_device *device)
 		uint16_t buffer[256];
 
 		inportsw(device->io_base, buffer, 256);
+		device->lba48 = buffer[ATA_IDENT_COMMAND_SETS] & ATA_IDENT_LBA48;
+		if (device->lba48)
+			device->nr_sectors = *(uint32_t *)&buffer[ATA_IDENT_MAX_LBA48];
+		else
+			device->nr_sectors = *(uint32_t *)&buffer[ATA_IDENT_MAX_LBA];
 
 		return ATA_IDENTIFY_SUCCESS;
 	}
@@ -131,6 +178,8 @@ static uint8_t atapi_identify(struct ata_device *device)
 	return ATA_IDENTIFY_ERR;
 }
 
+static int ata_request(struct block_device *bdev, struct request *rq);
+
 static struct ata_device *ata_detect(uint16_t io_addr1, uint16_t io_addr2, uint8_t irq, bool is_master, char *dev_name)
 {
 	struct ata_device *device = kcalloc(1, sizeof(struct ata_device));
@@ -144,8 +193,19 @@ static struct ata_device *ata_detect(uint16_t io_addr1, uint16_t io_addr2, uint8
 		log("ATA: Identified %s", dev_name);
 		device->is_harddisk = true;
 		device->dev_name = dev_name;
-		devices[number_of_actived_devices++] = *device;
-		return device;
+		device->dma = ata_channel(device)->bmide != 0;
+
+		struct ata_device *disk = &devices[number_of_actived_devices++];
+		*disk = *device;
+		disk->bdev = (struct block_device){
+			.name = dev_name,
+			.nr_sectors = disk->nr_sectors,
+			.mode = disk->dma ? "dma" : "pio",
+			.private = disk,
+			.request_fn = ata_request,
+		};
+		register_blkdev(&disk->bdev);
+		return disk;
 	}
 	else if (atapi_identify(device) == ATA_IDENTIFY_SUCCESS)
 	{
@@ -158,59 +218,166 @@ static struct ata_device *ata_detect(uint16_t io_addr1, uint16_t io_addr2, uint8
 	return 0;
 }
 
-int8_t ata_read(struct ata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer)
+// describe request's buffers by their physical regions, contiguous pages are merged up to 64KiB boundary
+static int ata_build_prdt(struct ata_channel *channel, struct request *rq)
 {
-	outportb(device->io_base + 6, (device->is_master ? 0xE0 : 0xF0) | ((lba >> 24) & 0x0F));
-	ata_400ns_delays(device);
+	int nr = 0;
+	uint32_t last_end = 0, last_size = 0;
+	struct buffer_head *bh;
+	list_for_each_entry(bh, &rq->bhs, b_reqlist)
+	{
+		// bus master transfers words
+		if ((uint32_t)bh->b_data & 1)
+			return -EINVAL;
+
+		char *buf = bh->b_data;
+		for (uint32_t size = buffer_sectors(bh) * BYTES_PER_SECTOR; size;)
+		{
+			uint32_t vaddr = (uint32_t)buf;
+			uint32_t paddr = vmm_get_physical_address(vaddr, false);
+			uint32_t len = min(size, PMM_FRAME_SIZE - (vaddr & (PMM_FRAME_SIZE - 1)));
+
+			if (nr && paddr == last_end && (paddr & (ATA_PRD_BOUNDARY - 1)))
+			{
+				last_size += len;
+				channel->prdt[nr - 1].count = last_size;
+			}
+			else
+			{
+				if (nr == ATA_MAX_PRDS)
+					return -ENOMEM;
+				last_size = len;
+				channel->prdt[nr++] = (struct ata_prd){.addr = paddr, .count = len, .flags = 0};
+			}
+
+			last_end = paddr + len;
+			buf += len;
+			size -= len;
+		}
+	}
+	channel->prdt[nr - 1].flags = ATA_PRD_EOT;
+	return nr;
+}
+
+// sector count 0 means 256 (lba28) or 65536 (lba48), high order bytes of lba48 go first into the same registers
+static void ata_setup_command(struct ata_device *device, sector_t lba, uint32_t n_sectors, bool lba48, uint8_t command)
+{
+	if (lba48)
+	{
+		outportb(device->io_base + 6, device->is_master ? 0x40 : 0x50);
+		ata_400ns_delays(device);
+
+		outportb(device->io_base + 1, 0x00);
+		outportb(device->io_base + 2, (uint8_t)(n_sectors >> 8));
+		outportb(device->io_base + 3, (uint8_t)(lba >> 24));
+		// sector_t is 32-bit
+		outportb(device->io_base + 4, 0);
+		outportb(device->io_base + 5, 0);
+	}
+	else
+	{
+		outportb(device->io_base + 6, (device->is_master ? 0xE0 : 0xF0) | ((lba >> 24) & 0x0F));
+		ata_400ns_delays(device);
 
-	outportb(device->io_base + 1, 0x00);
-	outportb(device->io_base + 2, n_sectors);
+		outportb(device->io_base + 1, 0x00);
+	}
+	outportb(device->io_base + 2, (uint8_t)n_sectors);
 	outportb(device->io_base + 3, (uint8_t)lba);
 	outportb(device->io_base + 4, (uint8_t)(lba >> 8));
 	outportb(device->io_base + 5, (uint8_t)(lba >> 16));
-	outportb(device->io_base + 7, 0x20);
-
-	if (ata_polling(device) == ATA_POLLING_ERR)
-		return -ENXIO;
+	outportb(device->io_base + 7, command);
+}
 
-	for (int i = 0; i < n_sectors; ++i)
+// issue dma command and sleep until the completion irq, called with channel's lock held
+static int ata_dma_transfer(struct ata_device *device, struct request *rq, bool lba48)
+{
+	struct ata_channel *channel = ata_channel(device);
+	int nr_prds = ata_build_prdt(channel, rq);
+	if (nr_prds < 0)
+		return nr_prds;
+
+	bool write = rq->rw == WRITE;
+	uint8_t bm_command = write ? 0 : ATA_BM_CMD_READ;
+	outportb(channel->bmide + ATA_BM_COMMAND, bm_command);
+	outportl(channel->bmide + ATA_BM_PRDT, vmm_get_physical_address((uint32_t)channel->prdt, false));
+	outportb(channel->bmide + ATA_BM_STATUS, ATA_BM_STATUS_ERR | ATA_BM_STATUS_IRQ);
+
+	channel->dma_done = false;
+	uint8_t command = lba48 ? (write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT)
+							: (write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+	ata_setup_command(device, rq->sector, rq->nr_sectors, lba48, command);
+	outportb(channel->bmide + ATA_BM_COMMAND, bm_command | ATA_BM_CMD_START);
+
+	// irq can come before schedule, thread is READY again then and schedule returns right away
+	DEFINE_WAIT(wait);
+	while (true)
 	{
-		inportsw(device->io_base, buffer + i * 256, 256);
-		ata_400ns_delays(device);
-
-		if (ata_polling(device) == ATA_POLLING_ERR)
-			return -ENXIO;
+		prepare_to_wait(&channel->wait, &wait);
+		if (channel->dma_done)
+			break;
+		schedule();
 	}
+	finish_wait(&channel->wait, &wait);
+
+	outportb(channel->bmide + ATA_BM_COMMAND, 0);
+	// reading status register acknowledges device's interrupt
+	uint8_t status = inportb(device->io_base + 7);
+	if ((channel->dma_status & ATA_BM_STATUS_ERR) || (status & (ATA_SREG_ERR | ATA_SREG_DF)))
+		return -EIO;
 	return 0;
 }
 
-int8_t ata_write(struct ata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer)
+static int ata_pio_transfer(struct ata_device *device, struct request *rq, bool lba48)
 {
-	outportb(device->io_base + 6, (device->is_master ? 0xE0 : 0xF0) | ((lba >> 24) & 0x0F));
-	ata_400ns_delays(device);
-
-	outportb(device->io_base + 1, 0x00);
-	outportb(device->io_base + 2, n_sectors);
-	outportb(device->io_base + 3, (uint8_t)lba);
-	outportb(device->io_base + 4, (uint8_t)(lba >> 8));
-	outportb(device->io_base + 5, (uint8_t)(lba >> 16));
-	outportb(device->io_base + 7, 0x30);
+	bool write = rq->rw == WRITE;
+	uint8_t command = lba48 ? (write ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_READ_PIO_EXT)
+							: (write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO);
+	ata_setup_command(device, rq->sector, rq->nr_sectors, lba48, command);
 
 	if (ata_polling(device) == ATA_POLLING_ERR)
 		return -ENXIO;
 
-	for (int i = 0; i < n_sectors; ++i)
+	struct buffer_head *bh;
+	list_for_each_entry(bh, &rq->bhs, b_reqlist)
 	{
-		outportsw(device->io_base, buffer + i * 256, 256);
-		outportw(device->io_base + 7, 0xE7);
-		ata_400ns_delays(device);
-
-		if (ata_polling(device) == ATA_POLLING_ERR)
-			return -ENXIO;
+		for (uint32_t i = 0, nr_sectors = buffer_sectors(bh); i < nr_sectors; ++i)
+		{
+			uint16_t *sector = (uint16_t *)(bh->b_data + i * BYTES_PER_SECTOR);
+			if (write)
+			{
+				outportsw(device->io_base, sector, 256);
+				outportw(device->io_base + 7, 0xE7);
+			}
+			else
+				inportsw(device->io_base, sector, 256);
+			ata_400ns_delays(device);
+
+			if (ata_polling(device) == ATA_POLLING_ERR)
+				return -ENXIO;
+		}
 	}
 	return 0;
 }
 
+// dma failure (unaligned buffer, too many regions, device error) is retried in pio mode
+static int ata_request(struct block_device *bdev, struct request *rq)
+{
+	struct ata_device *device = bdev->private;
+	bool lba48 = rq->sector + rq->nr_sectors > ATA_LBA28_MAX_SECTORS;
+	if (lba48 && !device->lba48)
+		return -EINVAL;
+
+	struct mutex *lock = &ata_channel(device)->lock;
+	mutex_lock(lock);
+
+	int ret = device->dma ? ata_dma_transfer(device, rq, lba48) : -ENODEV;
+	if (ret < 0)
+		ret = ata_pio_transfer(device, rq, lba48);
+
+	mutex_unlock(lock);
+	return ret;
+}
+
 int8_t atapi_read(struct ata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer)
 {
 	uint8_t packet[12] = {0xA8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
@@ -256,12 +423,48 @@ struct ata_device *get_ata_device(char *dev_name)
 	return NULL;
 }
 
+// piix/ich ide controller (qemu default) has one bus master for both channels, its registers are in io space
+static void ata_dma_init()
+{
+	struct pci_device *dev = get_pci_class_device(PCI_CLASS_CODE_MASS_STORAGE, PCI_SUBCLASS_IDE);
+	if (!dev || !(pci_get_prog_if(dev->address) & PCI_PROG_IF_IDE_BUS_MASTER))
+	{
+		log("ATA: No bus master, transfer in pio mode");
+		return;
+	}
+
+	uint32_t bar4 = pci_read_field(dev->address, PCI_BAR4);
+	if (!(bar4 & 1))
+		return;
+
+	uint32_t command_reg = pci_read_field(dev->address, PCI_COMMAND);
+	if (!(command_reg & PCI_COMMAND_REG_BUS_MASTER))
+	{
+		command_reg |= PCI_COMMAND_REG_BUS_MASTER;
+		pci_write_field(dev->address, PCI_COMMAND, command_reg);
+	}
+
+	uint16_t bmide = bar4 & 0xFFFC;
+	channels[0].bmide = bmide;
+	channels[1].bmide = bmide + ATA_BM_CHANNEL_SIZE;
+	log("ATA: Bus master at 0x%x", bmide);
+}
+
 uint8_t ata_init()
 {
 	log("ATA: Initializing");
 
 	register_interrupt_handler(IRQ14, ata_irq);
 	register_interrupt_handler(IRQ15, ata_irq);
+	for (int i = 0; i < 2; ++i)
+	{
+		mutex_init(&channels[i].lock);
+		INIT_LIST_HEAD(&channels[i].wait.list);
+		channels[i].prdt = prd_tables[i];
+	}
+#ifdef ATA_DMA
+	ata_dma_init();
+#endif
 
 	ata_detect(ATA0_IO_ADDR1, ATA0_IO_ADDR2, ATA0_IRQ, true, "/dev/hda");
 	ata_detect(ATA0_IO_ADDR1, ATA0_IO_ADDR2, ATA0_IRQ, false, "/dev/hdb");
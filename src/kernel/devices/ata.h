@@ -1,6 +1,7 @@
 #ifndef DEVICE_ATA_H
 #define DEVICE_ATA_H
 
+#include <fs/block_dev.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -29,6 +30,50 @@
 #define ATA_IDENTIFY_SUCCESS 1
 #define ATA_IDENTIFY_NOT_FOUND 2
 
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_READ_PIO_EXT 0x24
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+
+// words of identify data
+#define ATA_IDENT_MAX_LBA 60
+#define ATA_IDENT_COMMAND_SETS 83
+#define ATA_IDENT_MAX_LBA48 100
+#define ATA_IDENT_LBA48 (1 << 10)
+
+#define ATA_LBA28_MAX_SECTORS 0x10000000
+
+// bus master ide registers (pci bar4), secondary channel's are at +8
+#define ATA_BM_COMMAND 0x00
+#define ATA_BM_STATUS 0x02
+#define ATA_BM_PRDT 0x04
+#define ATA_BM_CHANNEL_SIZE 0x08
+
+#define ATA_BM_CMD_START 0x01
+#define ATA_BM_CMD_READ 0x08  // device -> memory
+#define ATA_BM_STATUS_ACTIVE 0x01
+#define ATA_BM_STATUS_ERR 0x02
+#define ATA_BM_STATUS_IRQ 0x04
+
+#define ATA_PRD_EOT 0x8000
+#define ATA_PRD_BOUNDARY 0x10000
+
+// Disk transfers go through bus master dma when ide controller supports it, pio is only the fallback
+// comment out to always use pio (e.g. to compare throughput and cpu usage of both modes)
+#define ATA_DMA 1
+
+// physical region descriptor, a region must not cross 64KiB boundary and its byte count 0 means 64KiB
+struct ata_prd
+{
+	uint32_t addr;
+	uint16_t count;
+	uint16_t flags;
+} __attribute__((packed));
+
 struct ata_device
 {
 	uint16_t io_base;
@@ -37,11 +82,13 @@ struct ata_device
 	char *dev_name;
 	bool is_master;
 	bool is_harddisk;
+	bool dma;
+	bool lba48;
+	sector_t nr_sectors;
+	struct block_device bdev;
 };
 
 uint8_t ata_init();
-int8_t ata_read(struct ata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer);
-int8_t ata_write(struct ata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer);
 int8_t atapi_read(struct ata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer);
 struct ata_device *get_ata_device(char *dev_name);
 #endif
@@ -1,11 +1,27 @@
+#include <fs/block_dev.h>
+#include <fs/buffer.h>
 #include <fs/char_dev.h>
 #include <include/errno.h>
+#include <locking/lock_stat.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <proc/wait.h>
 #include <utils/debug.h>
 #include <utils/math.h>
+#include <utils/string.h>
+#include <utils/vsprintf.h>
 
 #define MEMORY_MAJOR 1
 #define NULL_DEVICE 3
 #define RANDOM_DEVICE 8
+#define LOCKSTAT_DEVICE 12
+#define LOCKSTAT_BUFFER_SIZE 0x2000
+#define MEMINFO_DEVICE 13
+#define MEMINFO_BUFFER_SIZE 0x100
+#define SCHEDSTAT_DEVICE 14
+#define SCHEDSTAT_BUFFER_SIZE 0x4000
+#define DISKSTATS_DEVICE 15
+#define DISKSTATS_BUFFER_SIZE 0x400
 
 extern struct vfs_file_operations def_chr_fops;
 
@@ -76,6 +92,171 @@ static struct vfs_file_operations random_fops = {
 	.release = random_release,
 };
 
+#ifdef LOCK_STAT
+static int lockstat_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static int lockstat_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+// snapshot is taken at each read, reader has to use a buffer which is big enough or read from offset 0 again
+static ssize_t lockstat_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	char *text = kcalloc(LOCKSTAT_BUFFER_SIZE, sizeof(char));
+	int len = lock_stat_print(text, LOCKSTAT_BUFFER_SIZE);
+	len += scnprintf(text + len, LOCKSTAT_BUFFER_SIZE - len, "wait-queue: wakeups=%u spurious=%u\n",
+					 wq_stat.nr_wakeups, wq_stat.nr_spurious);
+
+	ssize_t nr = 0;
+	if (ppos < len)
+	{
+		nr = min(count, (size_t)(len - ppos));
+		memcpy(buf, text + ppos, nr);
+		file->f_pos = ppos + nr;
+	}
+
+	kfree(text);
+	return nr;
+}
+
+static struct vfs_file_operations lockstat_fops = {
+	.read = lockstat_read,
+	.open = lockstat_open,
+	.release = lockstat_release,
+};
+
+static struct char_device cdev_lockstat = (struct char_device)DECLARE_CHRDEV("lockstat", MEMORY_MAJOR, LOCKSTAT_DEVICE, 1, &lockstat_fops);
+#endif
+
+static int meminfo_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static int meminfo_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+// frames are never released on unmap, `used` of a process is measured as the difference before/after
+static ssize_t meminfo_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	char text[MEMINFO_BUFFER_SIZE];
+	uint32_t dirty_buffers_size;
+	uint32_t buffers_size = get_buffers_size(&dirty_buffers_size);
+	uint32_t nr_free_kstacks;
+	uint32_t nr_kstacks = get_kernel_stacks(&nr_free_kstacks);
+	int len = scnprintf(text, MEMINFO_BUFFER_SIZE, "MemTotal: %u kB\nMemUsed: %u kB\nCached: %u kB\nBuffers: %u kB\nDirty: %u kB\nKernelStack: %u kB\nKernelStackFree: %u kB\n",
+						get_total_frames() * (PMM_FRAME_SIZE / 1024),
+						get_used_frames() * (PMM_FRAME_SIZE / 1024),
+						get_cached_pages() * (PMM_FRAME_SIZE / 1024),
+						buffers_size / 1024,
+						dirty_buffers_size / 1024,
+						nr_kstacks * (STACK_SIZE / 1024),
+						nr_free_kstacks * (STACK_SIZE / 1024));
+
+	ssize_t nr = 0;
+	if (ppos < len)
+	{
+		nr = min(count, (size_t)(len - ppos));
+		memcpy(buf, text + ppos, nr);
+		file->f_pos = ppos + nr;
+	}
+	return nr;
+}
+
+static struct vfs_file_operations meminfo_fops = {
+	.read = meminfo_read,
+	.open = meminfo_open,
+	.release = meminfo_release,
+};
+
+static struct char_device cdev_meminfo = (struct char_device)DECLARE_CHRDEV("meminfo", MEMORY_MAJOR, MEMINFO_DEVICE, 1, &meminfo_fops);
+
+static int schedstat_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static int schedstat_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+// same as lockstat, snapshot is taken at each read
+static ssize_t schedstat_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	char *text = kcalloc(SCHEDSTAT_BUFFER_SIZE, sizeof(char));
+	int len = sched_stat_print(text, SCHEDSTAT_BUFFER_SIZE);
+
+	ssize_t nr = 0;
+	if (ppos < len)
+	{
+		nr = min(count, (size_t)(len - ppos));
+		memcpy(buf, text + ppos, nr);
+		file->f_pos = ppos + nr;
+	}
+
+	kfree(text);
+	return nr;
+}
+
+static struct vfs_file_operations schedstat_fops = {
+	.read = schedstat_read,
+	.open = schedstat_open,
+	.release = schedstat_release,
+};
+
+static struct char_device cdev_schedstat = (struct char_device)DECLARE_CHRDEV("schedstat", MEMORY_MAJOR, SCHEDSTAT_DEVICE, 1, &schedstat_fops);
+
+static int diskstats_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static int diskstats_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+// io reaching each disk followed by how well buffer, inode and dentry caches absorb it
+static ssize_t diskstats_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	char text[DISKSTATS_BUFFER_SIZE];
+	int len = blkdev_stat_print(text, DISKSTATS_BUFFER_SIZE);
+	len += scnprintf(text + len, DISKSTATS_BUFFER_SIZE - len, "buffers %u dirty %u hits %u misses %u evictions %u writebacks %u readaheads %u\n",
+					 buffer_stat.nr_buffers, buffer_stat.nr_dirty, buffer_stat.nr_hits,
+					 buffer_stat.nr_misses, buffer_stat.nr_evictions, buffer_stat.nr_writebacks,
+					 buffer_stat.nr_readaheads);
+	len += scnprintf(text + len, DISKSTATS_BUFFER_SIZE - len, "inodes %u unused %u hits %u misses %u evictions %u writebacks %u\n",
+					 inode_stat.nr_inodes, inode_stat.nr_unused, inode_stat.nr_hits,
+					 inode_stat.nr_misses, inode_stat.nr_evictions, inode_stat.nr_writebacks);
+	len += scnprintf(text + len, DISKSTATS_BUFFER_SIZE - len, "dentries %u unused %u negative %u hits %u misses %u evictions %u\n",
+					 dentry_stat.nr_dentries, dentry_stat.nr_unused, dentry_stat.nr_negative,
+					 dentry_stat.nr_hits, dentry_stat.nr_misses, dentry_stat.nr_evictions);
+
+	ssize_t nr = 0;
+	if (ppos < len)
+	{
+		nr = min(count, (size_t)(len - ppos));
+		memcpy(buf, text + ppos, nr);
+		file->f_pos = ppos + nr;
+	}
+	return nr;
+}
+
+static struct vfs_file_operations diskstats_fops = {
+	.read = diskstats_read,
+	.open = diskstats_open,
+	.release = diskstats_release,
+};
+
+static struct char_device cdev_diskstats = (struct char_device)DECLARE_CHRDEV("diskstats", MEMORY_MAJOR, DISKSTATS_DEVICE, 1, &diskstats_fops);
+
 static struct char_device cdev_null = (struct char_device)DECLARE_CHRDEV("null", MEMORY_MAJOR, NULL_DEVICE, 1, &null_fops);
 
 static struct char_device cdev_random = (struct char_device)DECLARE_CHRDEV("random", MEMORY_MAJOR, RANDOM_DEVICE, 1, &random_fops);
@@ -89,4 +270,22 @@ void chrdev_memory_init()
 	log("Devfs: Mount random");
 	register_chrdev(&cdev_random);
 	vfs_mknod("/dev/random", S_IFCHR, cdev_random.dev);
+
+	log("Devfs: Mount meminfo");
+	register_chrdev(&cdev_meminfo);
+	vfs_mknod("/dev/meminfo", S_IFCHR, cdev_meminfo.dev);
+
+	log("Devfs: Mount schedstat");
+	register_chrdev(&cdev_schedstat);
+	vfs_mknod("/dev/schedstat", S_IFCHR, cdev_schedstat.dev);
+
+	log("Devfs: Mount diskstats");
+	register_chrdev(&cdev_diskstats);
+	vfs_mknod("/dev/diskstats", S_IFCHR, cdev_diskstats.dev);
+
+#ifdef LOCK_STAT
+	log("Devfs: Mount lockstat");
+	register_chrdev(&cdev_lockstat);
+	vfs_mknod("/dev/lockstat", S_IFCHR, cdev_lockstat.dev);
+#endif
 }
@@ -208,7 +208,7 @@ ssize_t ntty_read(struct tty_struct *tty, struct vfs_file *file, char *buf, size
 		tty->read_head = N_TTY_BUF_ALIGN(tty->read_head + count);
 		tty->read_count -= count;
 	}
-	wake_up(&tty->write_wait);
+	wake_up_poll(&tty->write_wait, POLLOUT);
 
 	return count;
 }
@@ -295,7 +295,7 @@ void ntty_receive_buf(struct tty_struct *tty, const char *cp, int count)
 				if (EOF_CHAR(tty) == ch)
 				{
 					put_tty_queue(tty, __DISABLED_CHAR);
-					wake_up(&tty->read_wait);
+					wake_up_poll(&tty->read_wait, POLLIN);
 					continue;
 				}
 				if (EOL_CHAR(tty) == ch || (ch == EOL2_CHAR(tty) && L_IEXTEN(tty)) || ch == '\n')
@@ -303,7 +303,7 @@ void ntty_receive_buf(struct tty_struct *tty, const char *cp, int count)
 					put_tty_queue(tty, ch);
 					if (L_ECHONL(tty) && ch == '\n')
 						opost_block(tty, &(const char){ch}, 1);
-					wake_up(&tty->read_wait);
+					wake_up_poll(&tty->read_wait, POLLIN);
 					continue;
 				}
 			}
@@ -320,7 +320,7 @@ void ntty_receive_buf(struct tty_struct *tty, const char *cp, int count)
 		if (L_ECHO(tty))
 			opost_block(tty, cp, count);
 		if (tty->read_count >= MIN_CHAR(tty))
-			wake_up(&tty->read_wait);
+			wake_up_poll(&tty->read_wait, POLLIN);
 	}
 }
 
@@ -8,6 +8,8 @@
 #include <include/errno.h>
 #include <include/types.h>
 #include <proc/task.h>
+#include <system/softirq.h>
+#include <system/workqueue.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
@@ -232,105 +234,137 @@ void kybrd_enc_send_cmd(uint8_t cmd)
 	outportb(KYBRD_ENC_CMD_REG, cmd);
 }
 
-int32_t i86_kybrd_irq(struct interrupt_registers *regs)
+static void kybrd_set_leds_work(struct work_struct *work)
+{
+	kkybrd_set_leds(_numlock, _capslock, _scrolllock);
+}
+
+// controller is polled until it takes each byte -> leds are set from worker thread
+static DECLARE_WORK(kybrd_leds_work, kybrd_set_leds_work);
+
+static void kybrd_handle_scancode(int code)
+{
+	//! is this an extended code? If so, set it and return
+	if (code == 0xE0 || code == 0xE1)
+		return;
+
+	current_kybrd_event.state = (_ctrl && CONTROL_MASK) || (_shift && SHIFT_MASK) || (_alt && ALT_MASK) || (_capslock && LOCK_MASK);
+	//! test if this is a break code (Original XT Scan Code Set specific)
+	if (code & 0x80)
+	{  //test bit 7
+
+		//! covert the break code into its make code equivelant
+		code -= 0x80;
+
+		//! grab the key
+		int key = _kkybrd_scancode_std[code];
+
+		//! test if a special key has been released & set it
+		switch (key)
+		{
+		case KEY_LEFTCTRL:
+		case KEY_RIGHTCTRL:
+			_ctrl = false;
+			break;
+
+		case KEY_LEFTSHIFT:
+		case KEY_RIGHTSHIFT:
+			_shift = false;
+			break;
+
+		case KEY_LEFTALT:
+		case KEY_RIGHTALT:
+			_alt = false;
+			break;
+		}
+
+		current_kybrd_event.type = KEY_RELEASE;
+		current_kybrd_event.key = key;
+		kybrd_notify_readers(&current_kybrd_event);
+	}
+	else
+	{
+		//! this is a make code - set the scan code
+		_scancode = code;
+
+		//! grab the key
+		int key = _kkybrd_scancode_std[code];
+
+		//! test if user is holding down any special keys & set it
+		switch (key)
+		{
+		case KEY_LEFTCTRL:
+		case KEY_RIGHTCTRL:
+			_ctrl = true;
+			break;
+
+		case KEY_LEFTSHIFT:
+		case KEY_RIGHTSHIFT:
+			_shift = true;
+			break;
+
+		case KEY_LEFTALT:
+		case KEY_RIGHTALT:
+			_alt = true;
+			break;
+
+		case KEY_CAPSLOCK:
+			_capslock = (_capslock) ? false : true;
+			schedule_work(&kybrd_leds_work);
+			break;
+
+		case KEY_NUMLOCK:
+			_numlock = (_numlock) ? false : true;
+			schedule_work(&kybrd_leds_work);
+			break;
+
+		case KEY_SCROLLLOCK:
+			_scrolllock = (_scrolllock) ? false : true;
+			schedule_work(&kybrd_leds_work);
+			break;
+		}
+
+		current_kybrd_event.type = KEY_PRRESS;
+		current_kybrd_event.key = key;
+		kybrd_notify_readers(&current_kybrd_event);
+	}
+}
+
+// irq only takes scan code out of controller, it is decoded and dispatched to readers from tasklet
+// irq is the only producer and tasklet the only consumer -> ring needs no lock, a full ring drops new codes
+#define KYBRD_SCANCODE_QUEUE_LEN 32
+
+static uint8_t scancode_queue[KYBRD_SCANCODE_QUEUE_LEN];
+static volatile uint32_t scancode_head, scancode_tail;
+
+static void kybrd_scancode_tasklet(unsigned long data)
 {
-	int code = 0;
+	while (scancode_head != scancode_tail)
+	{
+		int code = scancode_queue[scancode_head % KYBRD_SCANCODE_QUEUE_LEN];
+		scancode_head++;
+		kybrd_handle_scancode(code);
+	}
+}
+
+static DECLARE_TASKLET(kybrd_tasklet, kybrd_scancode_tasklet, 0);
 
+int32_t i86_kybrd_irq(struct interrupt_registers *regs)
+{
 	//! read scan code only if the kkybrd controller output buffer is full (scan code is in it)
 	if (kybrd_ctrl_read_status() & KYBRD_CTRL_STATS_MASK_OUT_BUF)
 	{
 		//! read the scan code
-		code = kybrd_enc_read_buf();
-
-		irq_ack(regs->int_no);
-
-		//! is this an extended code? If so, set it and return
-		if (code == 0xE0 || code == 0xE1)
-			return IRQ_HANDLER_CONTINUE;
-
-		current_kybrd_event.state = (_ctrl && CONTROL_MASK) || (_shift && SHIFT_MASK) || (_alt && ALT_MASK) || (_capslock && LOCK_MASK);
-		//! test if this is a break code (Original XT Scan Code Set specific)
-		if (code & 0x80)
-		{  //test bit 7
-
-			//! covert the break code into its make code equivelant
-			code -= 0x80;
-
-			//! grab the key
-			int key = _kkybrd_scancode_std[code];
-
-			//! test if a special key has been released & set it
-			switch (key)
-			{
-			case KEY_LEFTCTRL:
-			case KEY_RIGHTCTRL:
-				_ctrl = false;
-				break;
-
-			case KEY_LEFTSHIFT:
-			case KEY_RIGHTSHIFT:
-				_shift = false;
-				break;
-
-			case KEY_LEFTALT:
-			case KEY_RIGHTALT:
-				_alt = false;
-				break;
-			}
-
-			current_kybrd_event.type = KEY_RELEASE;
-			current_kybrd_event.key = key;
-			kybrd_notify_readers(&current_kybrd_event);
-		}
-		else
+		uint8_t code = kybrd_enc_read_buf();
+
+		if (scancode_tail - scancode_head < KYBRD_SCANCODE_QUEUE_LEN)
 		{
-			//! this is a make code - set the scan code
-			_scancode = code;
-
-			//! grab the key
-			int key = _kkybrd_scancode_std[code];
-
-			//! test if user is holding down any special keys & set it
-			switch (key)
-			{
-			case KEY_LEFTCTRL:
-			case KEY_RIGHTCTRL:
-				_ctrl = true;
-				break;
-
-			case KEY_LEFTSHIFT:
-			case KEY_RIGHTSHIFT:
-				_shift = true;
-				break;
-
-			case KEY_LEFTALT:
-			case KEY_RIGHTALT:
-				_alt = true;
-				break;
-
-			case KEY_CAPSLOCK:
-				_capslock = (_capslock) ? false : true;
-				kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-				break;
-
-			case KEY_NUMLOCK:
-				_numlock = (_numlock) ? false : true;
-				kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-				break;
-
-			case KEY_SCROLLLOCK:
-				_scrolllock = (_scrolllock) ? false : true;
-				kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-				break;
-			}
-
-			current_kybrd_event.type = KEY_PRRESS;
-			current_kybrd_event.key = key;
-			kybrd_notify_readers(&current_kybrd_event);
+			scancode_queue[scancode_tail % KYBRD_SCANCODE_QUEUE_LEN] = code;
+			scancode_tail++;
 		}
+		tasklet_hi_schedule(&kybrd_tasklet);
 	}
-	else
-		irq_ack(regs->int_no);
+	irq_ack(regs->int_no);
 
 	return IRQ_HANDLER_CONTINUE;
 }
@@ -369,7 +403,7 @@ static void kybrd_notify_readers(struct key_event *event)
 		iter->packets[iter->tail] = *event;
 		iter->ready = true;
 	}
-	wake_up(&hwait);
+	wake_up_poll(&hwait, POLLIN);
 }
 
 static int kybrd_open(struct vfs_inode *inode, struct vfs_file *file)
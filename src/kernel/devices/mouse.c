@@ -9,6 +9,7 @@
 #include <include/errno.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
+#include <system/softirq.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
@@ -43,7 +44,7 @@ void mouse_notify_readers(struct mouse_event *mm)
 		iter->packets[iter->tail] = *mm;
 		iter->ready = true;
 	}
-	wake_up(&hwait);
+	wake_up_poll(&hwait, POLLIN);
 }
 
 static int mouse_open(struct vfs_inode *inode, struct vfs_file *file)
@@ -141,6 +142,33 @@ static void mouse_calculate_position()
 	}
 }
 
+// irq assembles packets, they are handed to readers from tasklet (same single producer/consumer ring as keyboard)
+#define MOUSE_EVENT_QUEUE_LEN 16
+
+static struct mouse_event event_queue[MOUSE_EVENT_QUEUE_LEN];
+static volatile uint32_t event_head, event_tail;
+
+static void mouse_event_tasklet(unsigned long data)
+{
+	while (event_head != event_tail)
+	{
+		mouse_notify_readers(&event_queue[event_head % MOUSE_EVENT_QUEUE_LEN]);
+		event_head++;
+	}
+}
+
+static DECLARE_TASKLET(mouse_tasklet, mouse_event_tasklet, 0);
+
+static void mouse_queue_event(struct mouse_event *event)
+{
+	if (event_tail - event_head < MOUSE_EVENT_QUEUE_LEN)
+	{
+		event_queue[event_tail % MOUSE_EVENT_QUEUE_LEN] = *event;
+		event_tail++;
+	}
+	tasklet_hi_schedule(&mouse_tasklet);
+}
+
 static int32_t irq_mouse_handler(struct interrupt_registers *regs)
 {
 	uint8_t status = inportb(MOUSE_STATUS);
@@ -166,7 +194,7 @@ static int32_t irq_mouse_handler(struct interrupt_registers *regs)
 			mouse_calculate_position();
 			if (current_mouse_motion.x != 0 || current_mouse_motion.y != 0 ||
 				current_mouse_motion.buttons != 0 || prev_buttons != current_mouse_motion.buttons)
-				mouse_notify_readers(&current_mouse_motion);
+				mouse_queue_event(&current_mouse_motion);
 			break;
 		}
 	}
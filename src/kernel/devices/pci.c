@@ -67,7 +67,7 @@ static uint16_t pci_get_subclass_code(uint32_t address)
 	return (reg >> 16) & 0xFF;
 }
 
-static uint16_t pci_get_prog_if(uint32_t address)
+uint16_t pci_get_prog_if(uint32_t address)
 {
 	uint32_t reg = pci_read_field(address, 0x8);
 	return (reg >> 8) & 0xFF;
@@ -184,6 +184,17 @@ struct pci_device *get_pci_device(int32_t vendorID, int32_t deviceID)
 	return NULL;
 }
 
+struct pci_device *get_pci_class_device(uint8_t class_code, uint8_t subclass_code)
+{
+	struct pci_device *iter_dev;
+	list_for_each_entry(iter_dev, &ldevs, sibling)
+	{
+		if (pci_get_class_code(iter_dev->address) == class_code && pci_get_subclass_code(iter_dev->address) == subclass_code)
+			return iter_dev;
+	}
+	return NULL;
+}
+
 void pci_init()
 {
 	log("PCI: Initializing");
@@ -46,6 +46,8 @@
 
 #define PCI_COMMAND_REG_BUS_MASTER (1 << 2)
 
+#define PCI_PROG_IF_IDE_BUS_MASTER 0x80
+
 struct pci_device
 {
 	int32_t address;
@@ -58,6 +60,8 @@ void pci_init();
 void pci_scan_bus(uint8_t bus);
 void pci_scan_buses();
 struct pci_device *get_pci_device(int32_t vendorID, int32_t deviceID);
+struct pci_device *get_pci_class_device(uint8_t class_code, uint8_t subclass_code);
+uint16_t pci_get_prog_if(uint32_t address);
 uint16_t pci_get_command(uint32_t address);
 uint32_t pci_read_field(uint32_t address, uint8_t offset);
 void pci_write_field(uint32_t address, uint8_t offset, uint32_t value);
@@ -0,0 +1,313 @@
+#include "block_dev.h"
+
+#include <fs/buffer.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <system/time.h>
+#include <utils/debug.h>
+#include <utils/math.h>
+#include <utils/string.h>
+#include <utils/vsprintf.h>
+
+static LIST_HEAD(blkdevs);
+// dispatcher sleeps here until an unplugged queue has requests
+static struct wait_queue_head kblockd_wait;
+
+// runs from timer softirq which cannot take queue's mutex -> kblockd unplugs it with queue locked
+static void blk_plug_timeout(struct timer_list *timer)
+{
+	struct request_queue *q = from_timer(q, timer, unplug_timer);
+
+	del_timer(timer);
+	q->unplug_expired = true;
+	wake_up(&kblockd_wait);
+}
+
+void register_blkdev(struct block_device *bdev)
+{
+	struct request_queue *q = &bdev->queue;
+	mutex_init(&q->lock);
+	INIT_LIST_HEAD(&q->sort_list);
+	INIT_LIST_HEAD(&q->fifo_list[READ]);
+	INIT_LIST_HEAD(&q->fifo_list[WRITE]);
+	q->unplug_timer = (struct timer_list)TIMER_INITIALIZER(blk_plug_timeout, 0);
+
+	list_add_tail(&bdev->sibling, &blkdevs);
+}
+
+// looked up once when a filesystem is mounted, buffers keep the device itself
+struct block_device *get_blkdev(const char *name)
+{
+	struct block_device *iter;
+	list_for_each_entry(iter, &blkdevs, sibling)
+	{
+		if (strcmp(iter->name, name) == 0)
+			return iter;
+	}
+	return NULL;
+}
+
+// called with queue locked
+static void __blk_plug(struct request_queue *q)
+{
+	if (q->plugged)
+		return;
+
+	q->plugged = true;
+	q->unplug_expired = false;
+	mod_timer(&q->unplug_timer, get_milliseconds(NULL) + BLK_UNPLUG_DELAY_MS);
+}
+
+// called with queue locked
+static void __blk_unplug(struct request_queue *q)
+{
+	if (q->plugged)
+	{
+		q->plugged = false;
+		q->unplug_expired = false;
+		del_timer(&q->unplug_timer);
+	}
+	if (q->nr_requests)
+		wake_up(&kblockd_wait);
+}
+
+void blk_unplug(struct block_device *bdev)
+{
+	struct request_queue *q = &bdev->queue;
+
+	mutex_lock(&q->lock);
+	__blk_unplug(q);
+	mutex_unlock(&q->lock);
+}
+
+void blk_unplug_all()
+{
+	struct block_device *iter;
+	list_for_each_entry(iter, &blkdevs, sibling)
+	{
+		blk_unplug(iter);
+	}
+}
+
+// `next` follows `rq` in sector order, they become one request if they are contiguous
+static void attempt_merge(struct block_device *bdev, struct request *rq, struct request *next)
+{
+	if (rq->rw != next->rw || rq->sector + rq->nr_sectors != next->sector ||
+		rq->nr_sectors + next->nr_sectors > BLK_MAX_SECTORS)
+		return;
+
+	list_splice_tail_init(&next->bhs, &rq->bhs);
+	rq->nr_sectors += next->nr_sectors;
+	rq->deadline = min(rq->deadline, next->deadline);
+
+	list_del(&next->sort_sibling);
+	list_del(&next->fifo_sibling);
+	bdev->queue.nr_requests--;
+	bdev->stat.nr_merges++;
+	kfree(next);
+}
+
+// buffer continues (back merge) or precedes (front merge) a queued request in the same direction
+static bool blk_try_merge(struct block_device *bdev, int rw, struct buffer_head *bh)
+{
+	struct request_queue *q = &bdev->queue;
+	uint32_t nr_sectors = buffer_sectors(bh);
+
+	struct request *rq;
+	list_for_each_entry(rq, &q->sort_list, sort_sibling)
+	{
+		if (rq->rw != rw || rq->nr_sectors + nr_sectors > BLK_MAX_SECTORS)
+			continue;
+
+		if (rq->sector + rq->nr_sectors == bh->b_sector)
+		{
+			list_add_tail(&bh->b_reqlist, &rq->bhs);
+			rq->nr_sectors += nr_sectors;
+			bdev->stat.nr_merges++;
+
+			if (!list_is_last(&rq->sort_sibling, &q->sort_list))
+				attempt_merge(bdev, rq, list_next_entry(rq, sort_sibling));
+			return true;
+		}
+		if (bh->b_sector + nr_sectors == rq->sector)
+		{
+			list_add(&bh->b_reqlist, &rq->bhs);
+			rq->sector = bh->b_sector;
+			rq->nr_sectors += nr_sectors;
+			bdev->stat.nr_merges++;
+
+			if (rq->sort_sibling.prev != &q->sort_list)
+				attempt_merge(bdev, list_prev_entry(rq, sort_sibling), rq);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void elv_add_request(struct request_queue *q, struct request *rq)
+{
+	struct request *iter;
+	list_for_each_entry(iter, &q->sort_list, sort_sibling)
+	{
+		if (iter->sector > rq->sector)
+			break;
+	}
+	// before the first one with higher sector (or at tail)
+	list_add_tail(&rq->sort_sibling, &iter->sort_sibling);
+	list_add_tail(&rq->fifo_sibling, &q->fifo_list[rq->rw]);
+	q->nr_requests++;
+}
+
+// expired request first (reads are checked first), otherwise the next one in sector order after the head (c-scan)
+static struct request *elv_next_request(struct request_queue *q)
+{
+	uint64_t now = get_milliseconds(NULL);
+	struct request *rq = NULL;
+
+	for (int rw = READ; rw <= WRITE && !rq; ++rw)
+	{
+		struct request *first = list_first_entry_or_null(&q->fifo_list[rw], struct request, fifo_sibling);
+		if (first && first->deadline <= now)
+			rq = first;
+	}
+
+	if (!rq)
+	{
+		struct request *iter;
+		list_for_each_entry(iter, &q->sort_list, sort_sibling)
+		{
+			if (iter->sector >= q->head_pos)
+			{
+				rq = iter;
+				break;
+			}
+		}
+	}
+	if (!rq)
+		rq = list_first_entry_or_null(&q->sort_list, struct request, sort_sibling);
+
+	if (rq)
+	{
+		list_del(&rq->sort_sibling);
+		list_del(&rq->fifo_sibling);
+		q->nr_requests--;
+		q->head_pos = rq->sector + rq->nr_sectors;
+	}
+	return rq;
+}
+
+// buffer has to be locked by caller, its `b_end_io` is called when io is done
+void submit_bh(int rw, struct buffer_head *bh)
+{
+	struct block_device *bdev = bh->b_bdev;
+	struct request_queue *q = &bdev->queue;
+
+	mutex_lock(&q->lock);
+	if (!blk_try_merge(bdev, rw, bh))
+	{
+		struct request *rq = kcalloc(1, sizeof(struct request));
+		rq->bdev = bdev;
+		rq->rw = rw;
+		rq->sector = bh->b_sector;
+		rq->nr_sectors = buffer_sectors(bh);
+		rq->deadline = get_milliseconds(NULL) + (rw == READ ? BLK_READ_EXPIRE_MS : BLK_WRITE_EXPIRE_MS);
+		INIT_LIST_HEAD(&rq->bhs);
+		list_add_tail(&bh->b_reqlist, &rq->bhs);
+
+		elv_add_request(q, rq);
+		// the first request waits a moment for more to come
+		if (q->nr_requests == 1)
+			__blk_plug(q);
+	}
+
+	if (q->nr_requests >= BLK_UNPLUG_THRESH)
+		__blk_unplug(q);
+	mutex_unlock(&q->lock);
+}
+
+static void blk_end_request(struct request *rq, int ret)
+{
+	struct buffer_head *iter, *next;
+	list_for_each_entry_safe(iter, next, &rq->bhs, b_reqlist)
+	{
+		list_del_init(&iter->b_reqlist);
+		iter->b_end_io(iter, ret >= 0);
+	}
+	kfree(rq);
+}
+
+static struct block_device *blk_next_device()
+{
+	struct block_device *iter;
+	list_for_each_entry(iter, &blkdevs, sibling)
+	{
+		if (iter->queue.nr_requests && (!iter->queue.plugged || iter->queue.unplug_expired))
+			return iter;
+	}
+	return NULL;
+}
+
+// Requests of all devices are transferred from one thread, driver sleeps until its transfer is done (dma irq)
+// and completion callbacks run here as well (they can take mutexes)
+static void kblockd()
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	DEFINE_WAIT(wait);
+	while (true)
+	{
+		struct block_device *bdev;
+		while (true)
+		{
+			prepare_to_wait(&kblockd_wait, &wait);
+			if ((bdev = blk_next_device()))
+				break;
+			schedule();
+		}
+		finish_wait(&kblockd_wait, &wait);
+
+		mutex_lock(&bdev->queue.lock);
+		if (bdev->queue.unplug_expired)
+			__blk_unplug(&bdev->queue);
+		struct request *rq = elv_next_request(&bdev->queue);
+		mutex_unlock(&bdev->queue.lock);
+		if (!rq)
+			continue;
+
+		if (rq->rw == READ)
+		{
+			bdev->stat.nr_reads++;
+			bdev->stat.nr_sectors_read += rq->nr_sectors;
+		}
+		else
+		{
+			bdev->stat.nr_writes++;
+			bdev->stat.nr_sectors_written += rq->nr_sectors;
+		}
+		blk_end_request(rq, bdev->request_fn(bdev, rq));
+	}
+}
+
+int blkdev_stat_print(char *buf, size_t size)
+{
+	int len = scnprintf(buf, size, "%-10s %4s %10s %10s %10s %10s %10s\n", "device", "mode", "reads", "sectors", "writes", "sectors", "merges");
+
+	struct block_device *iter;
+	list_for_each_entry(iter, &blkdevs, sibling)
+	{
+		struct block_stat *stat = &iter->stat;
+		len += scnprintf(buf + len, size - len, "%-10s %4s %10u %10u %10u %10u %10u\n", iter->name, iter->mode,
+						 stat->nr_reads, stat->nr_sectors_read, stat->nr_writes, stat->nr_sectors_written, stat->nr_merges);
+	}
+	return len;
+}
+
+void blkdev_init()
+{
+	INIT_LIST_HEAD(&kblockd_wait.list);
+
+	log("Block: Setup dispatcher");
+	struct process *proc = create_system_process("kblockd", kblockd, 0);
+	update_thread(proc->thread, THREAD_READY);
+}
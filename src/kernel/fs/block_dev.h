@@ -0,0 +1,86 @@
+#ifndef FS_BLOCK_DEV_H
+#define FS_BLOCK_DEV_H
+
+#include <include/list.h>
+#include <include/types.h>
+#include <locking/mutex.h>
+#include <proc/wait.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <system/timer.h>
+
+#define READ 0
+#define WRITE 1
+
+// a command moves at most 256 sectors (sector count 0 in lba28 mode)
+#define BLK_MAX_SECTORS 256
+// plugged queue is kicked after this many requests or this delay, whichever comes first
+#define BLK_UNPLUG_THRESH 16
+#define BLK_UNPLUG_DELAY_MS 3
+// deadline ordering, a request which has waited this long goes before the sorted ones
+#define BLK_READ_EXPIRE_MS 500
+#define BLK_WRITE_EXPIRE_MS 5000
+
+struct block_device;
+struct buffer_head;
+
+// contiguous sectors, made of one or more buffers (merged) in sector order
+struct request
+{
+	struct block_device *bdev;
+	int rw;
+	sector_t sector;
+	uint32_t nr_sectors;
+	uint64_t deadline;			   // ms
+	struct list_head bhs;		   // buffer_head->b_reqlist
+	struct list_head sort_sibling;  // in queue->sort_list
+	struct list_head fifo_sibling;  // in queue->fifo_list[rw]
+};
+
+// Buffers are submitted to device's queue and completed later through their `b_end_io` (io is asynchronous)
+// a buffer which continues a queued request is merged into it, queue is sorted by sector and served in one direction
+// (c-scan), unless a request in fifo is past its deadline. A queue which becomes busy is plugged for a moment
+// so a batch of submissions (readahead, write back) can be merged before the first one goes to the disk
+struct request_queue
+{
+	struct mutex lock;
+	struct list_head sort_list;
+	struct list_head fifo_list[2];
+	uint32_t nr_requests;
+	sector_t head_pos;	// where the last dispatched request ends
+	bool plugged;
+	bool unplug_expired;  // set by unplug timer, kblockd unplugs queue
+	struct timer_list unplug_timer;
+};
+
+struct block_stat
+{
+	uint32_t nr_reads;	// commands
+	uint32_t nr_sectors_read;
+	uint32_t nr_writes;
+	uint32_t nr_sectors_written;
+	uint32_t nr_merges;
+};
+
+struct block_device
+{
+	const char *name;
+	sector_t nr_sectors;
+	const char *mode;  // current transfer mode of driver
+	void *private;
+	// transfer request as a whole (sleeping is fine), return -errno if it fails
+	int (*request_fn)(struct block_device *bdev, struct request *rq);
+	struct request_queue queue;
+	struct block_stat stat;
+	struct list_head sibling;
+};
+
+void register_blkdev(struct block_device *bdev);
+struct block_device *get_blkdev(const char *name);
+void submit_bh(int rw, struct buffer_head *bh);
+void blk_unplug(struct block_device *bdev);
+void blk_unplug_all();
+int blkdev_stat_print(char *buf, size_t size);
+void blkdev_init();
+
+#endif
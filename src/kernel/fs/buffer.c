@@ -1,19 +1,359 @@
 #include "buffer.h"
 
-#include <devices/ata.h>
+#include <fs/block_dev.h>
+#include <fs/vfs.h>
+#include <include/errno.h>
 #include <memory/vmm.h>
+#include <proc/task.h>
+#include <system/time.h>
+#include <utils/debug.h>
 #include <utils/math.h>
 
-char *bread(char *dev_name, sector_t sector, uint32_t size)
+#define BUFFER_HASH_SIZE 256
+// clean unused buffers are reused above this size, dirty and referenced ones can take it further
+#define BUFFER_CACHE_MAX_SIZE 0x200000
+#define BUFFER_FLUSH_INTERVAL_MS 1000
+#define BUFFER_DIRTY_EXPIRE_MS 3000
+
+static struct list_head buffer_hash[BUFFER_HASH_SIZE];
+// least recently used is at the head
+static LIST_HEAD(unused_buffers);
+// oldest is at the head
+static LIST_HEAD(dirty_buffers);
+// protects hash, lists, b_count and b_state, it is never held while doing io
+static struct mutex buffer_lock;
+static uint32_t cached_size, dirty_size;
+struct buffer_stat buffer_stat;
+
+static uint32_t buffer_hashfn(struct block_device *bdev, sector_t sector)
+{
+	return (((uint32_t)bdev >> 4) ^ sector) % BUFFER_HASH_SIZE;
+}
+
+static struct buffer_head *find_buffer(struct block_device *bdev, sector_t sector, uint32_t size)
+{
+	struct buffer_head *iter;
+	list_for_each_entry(iter, &buffer_hash[buffer_hashfn(bdev, sector)], b_hash)
+	{
+		if (iter->b_bdev == bdev && iter->b_sector == sector && iter->b_size == size)
+			return iter;
+	}
+	return NULL;
+}
+
+// free the least recently used clean buffers until `size` fits, called with buffer_lock held
+static void shrink_buffers(uint32_t size)
+{
+	struct buffer_head *iter, *next;
+	list_for_each_entry_safe(iter, next, &unused_buffers, b_lru)
+	{
+		if (cached_size + size <= BUFFER_CACHE_MAX_SIZE)
+			break;
+		// flusher cleans it, it can be freed after that
+		if (atomic_read(&iter->b_state) & (BH_Dirty | BH_Lock))
+			continue;
+
+		list_del(&iter->b_lru);
+		list_del(&iter->b_hash);
+		cached_size -= iter->b_size;
+		buffer_stat.nr_buffers--;
+		buffer_stat.nr_evictions++;
+		kfree(iter->b_data);
+		kfree(iter);
+	}
+}
+
+// take a reference of cached buffer or a new one without reading it (caller is going to overwrite whole buffer)
+struct buffer_head *getblk(struct block_device *bdev, sector_t sector, uint32_t size)
+{
+	mutex_lock(&buffer_lock);
+
+	struct buffer_head *bh = find_buffer(bdev, sector, size);
+	if (bh)
+	{
+		if (!bh->b_count++)
+			list_del_init(&bh->b_lru);
+	}
+	else
+	{
+		shrink_buffers(size);
+
+		bh = kcalloc(1, sizeof(struct buffer_head));
+		bh->b_bdev = bdev;
+		bh->b_sector = sector;
+		bh->b_size = size;
+		bh->b_data = kcalloc(buffer_sectors(bh) * BYTES_PER_SECTOR, sizeof(char));
+		bh->b_count = 1;
+		INIT_LIST_HEAD(&bh->b_wait.list);
+		INIT_LIST_HEAD(&bh->b_lru);
+		INIT_LIST_HEAD(&bh->b_dirty);
+		INIT_LIST_HEAD(&bh->b_reqlist);
+		list_add(&bh->b_hash, &buffer_hash[buffer_hashfn(bdev, sector)]);
+
+		cached_size += size;
+		buffer_stat.nr_buffers++;
+	}
+
+	mutex_unlock(&buffer_lock);
+	return bh;
+}
+
+static bool trylock_buffer(struct buffer_head *bh)
+{
+	return !(atomic_fetch_or(BH_Lock, &bh->b_state) & BH_Lock);
+}
+
+// sleep until buffer is not in flight and take it, the one who locks buffer is the one who submits io for it
+void lock_buffer(struct buffer_head *bh)
+{
+	if (trylock_buffer(bh))
+		return;
+
+	blk_unplug(bh->b_bdev);
+	DEFINE_WAIT(wait);
+	while (true)
+	{
+		prepare_to_wait(&bh->b_wait, &wait);
+		if (trylock_buffer(bh))
+			break;
+		schedule();
+	}
+	finish_wait(&bh->b_wait, &wait);
+}
+
+void unlock_buffer(struct buffer_head *bh)
+{
+	atomic_andnot(BH_Lock, &bh->b_state);
+	wake_up_all(&bh->b_wait);
+}
+
+// submitted io might still sit in a plugged queue, it is kicked before sleeping
+void wait_on_buffer(struct buffer_head *bh)
+{
+	if (!buffer_locked(bh))
+		return;
+
+	blk_unplug(bh->b_bdev);
+	DEFINE_WAIT(wait);
+	while (true)
+	{
+		prepare_to_wait(&bh->b_wait, &wait);
+		if (!buffer_locked(bh))
+			break;
+		schedule();
+	}
+	finish_wait(&bh->b_wait, &wait);
+}
+
+static void end_buffer_read_sync(struct buffer_head *bh, bool uptodate)
+{
+	if (uptodate)
+		atomic_or(BH_Uptodate, &bh->b_state);
+	unlock_buffer(bh);
+}
+
+static void end_buffer_write_sync(struct buffer_head *bh, bool uptodate)
+{
+	// it is written again at the next flush
+	if (!uptodate)
+		mark_buffer_dirty(bh);
+	unlock_buffer(bh);
+}
+
+// submitter's reference is dropped here, nobody waits for async write
+static void end_buffer_write_async(struct buffer_head *bh, bool uptodate)
+{
+	end_buffer_write_sync(bh, uptodate);
+	brelse(bh);
+}
+
+// nobody waits for readahead, its submitter's reference is dropped here
+static void end_buffer_read_async(struct buffer_head *bh, bool uptodate)
 {
-	struct ata_device *device = get_ata_device(dev_name);
-	char *buf = kcalloc(div_ceil(size, BYTES_PER_SECTOR) * BYTES_PER_SECTOR, sizeof(char));
-	ata_read(device, sector, div_ceil(size, BYTES_PER_SECTOR), (uint16_t *)buf);
-	return buf;
+	end_buffer_read_sync(bh, uptodate);
+	brelse(bh);
 }
 
-void bwrite(char *dev_name, sector_t sector, char *buf, uint32_t size)
+// start reading a buffer which is going to be needed soon without waiting for it
+// (queue stays plugged so consecutive ones are merged, a later `bread` kicks it if needed)
+void breadahead(struct block_device *bdev, sector_t sector, uint32_t size)
 {
-	struct ata_device *device = get_ata_device(dev_name);
-	ata_write(device, sector, div_ceil(size, BYTES_PER_SECTOR), (uint16_t *)buf);
+	struct buffer_head *bh = getblk(bdev, sector, size);
+	// cached or already in flight
+	if (buffer_uptodate(bh) || !trylock_buffer(bh))
+	{
+		brelse(bh);
+		return;
+	}
+	if (buffer_uptodate(bh))
+	{
+		unlock_buffer(bh);
+		brelse(bh);
+		return;
+	}
+
+	buffer_stat.nr_readaheads++;
+	bh->b_end_io = end_buffer_read_async;
+	submit_bh(READ, bh);
+}
+
+// return referenced buffer with disk content, NULL if it cannot be read
+struct buffer_head *bread(struct block_device *bdev, sector_t sector, uint32_t size)
+{
+	struct buffer_head *bh = getblk(bdev, sector, size);
+	if (buffer_uptodate(bh))
+	{
+		buffer_stat.nr_hits++;
+		return bh;
+	}
+
+	// another thread might be reading the same buffer, it is only read once
+	lock_buffer(bh);
+	if (buffer_uptodate(bh))
+	{
+		unlock_buffer(bh);
+		buffer_stat.nr_hits++;
+		return bh;
+	}
+
+	buffer_stat.nr_misses++;
+	bh->b_end_io = end_buffer_read_sync;
+	submit_bh(READ, bh);
+	wait_on_buffer(bh);
+
+	if (!buffer_uptodate(bh))
+	{
+		brelse(bh);
+		return NULL;
+	}
+	return bh;
+}
+
+void brelse(struct buffer_head *bh)
+{
+	if (!bh)
+		return;
+
+	mutex_lock(&buffer_lock);
+	assert(bh->b_count > 0);
+	if (!--bh->b_count)
+		list_add_tail(&bh->b_lru, &unused_buffers);
+	mutex_unlock(&buffer_lock);
+}
+
+// buffer content has been changed by caller, it goes to disk later
+void mark_buffer_dirty(struct buffer_head *bh)
+{
+	mutex_lock(&buffer_lock);
+
+	if (!(atomic_fetch_or(BH_Uptodate | BH_Dirty, &bh->b_state) & BH_Dirty))
+	{
+		bh->b_dirtied_at = get_milliseconds(NULL);
+		list_add_tail(&bh->b_dirty, &dirty_buffers);
+		dirty_size += bh->b_size;
+		buffer_stat.nr_dirty++;
+	}
+
+	mutex_unlock(&buffer_lock);
+}
+
+// called with buffer locked, dirty bit is cleared before writing and a change made meanwhile marks buffer dirty again
+static bool test_clear_buffer_dirty(struct buffer_head *bh)
+{
+	mutex_lock(&buffer_lock);
+	bool dirty = atomic_fetch_andnot(BH_Dirty, &bh->b_state) & BH_Dirty;
+	if (dirty)
+	{
+		list_del_init(&bh->b_dirty);
+		dirty_size -= bh->b_size;
+		buffer_stat.nr_dirty--;
+		buffer_stat.nr_writebacks++;
+	}
+	mutex_unlock(&buffer_lock);
+	return dirty;
+}
+
+int sync_dirty_buffer(struct buffer_head *bh)
+{
+	lock_buffer(bh);
+	if (!test_clear_buffer_dirty(bh))
+	{
+		unlock_buffer(bh);
+		return 0;
+	}
+
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(WRITE, bh);
+	wait_on_buffer(bh);
+	return buffer_dirty(bh) ? -EIO : 0;
+}
+
+// write back at most `nr` buffers which have become dirty before `dirtied_before`, without waiting for them
+static void flush_buffers(uint64_t dirtied_before, uint32_t nr)
+{
+	for (; nr; --nr)
+	{
+		mutex_lock(&buffer_lock);
+		struct buffer_head *bh = list_first_entry_or_null(&dirty_buffers, struct buffer_head, b_dirty);
+		if (!bh || bh->b_dirtied_at > dirtied_before)
+		{
+			mutex_unlock(&buffer_lock);
+			break;
+		}
+		if (!bh->b_count++)
+			list_del_init(&bh->b_lru);
+		mutex_unlock(&buffer_lock);
+
+		lock_buffer(bh);
+		if (test_clear_buffer_dirty(bh))
+		{
+			bh->b_end_io = end_buffer_write_async;
+			submit_bh(WRITE, bh);
+		}
+		else
+		{
+			unlock_buffer(bh);
+			brelse(bh);
+		}
+	}
+	// writes are merged in plugged queues, start them now
+	blk_unplug_all();
+}
+
+void sync_buffers()
+{
+	sync_inodes();
+	flush_buffers(UINT64_MAX, buffer_stat.nr_dirty);
+}
+
+uint32_t get_buffers_size(uint32_t *dirty)
+{
+	if (dirty)
+		*dirty = dirty_size;
+	return cached_size;
+}
+
+static void buffer_flush_loop()
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	while (true)
+	{
+		thread_sleep(BUFFER_FLUSH_INTERVAL_MS);
+		// dirty inodes are copied into their (inode table) buffers first
+		sync_inodes();
+		flush_buffers(get_milliseconds(NULL) - BUFFER_DIRTY_EXPIRE_MS, buffer_stat.nr_dirty);
+	}
+}
+
+void buffer_init()
+{
+	for (int i = 0; i < BUFFER_HASH_SIZE; ++i)
+		INIT_LIST_HEAD(&buffer_hash[i]);
+	mutex_init(&buffer_lock);
+
+	log("Buffer: Setup flusher");
+	struct process *proc = create_system_process("bdflush", buffer_flush_loop, 0);
+	update_thread(proc->thread, THREAD_READY);
 }
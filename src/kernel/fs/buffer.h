@@ -1,13 +1,87 @@
 #ifndef FS_BUFFER_H
 #define FS_BUFFER_H
 
+#include <include/atomic.h>
+#include <include/list.h>
 #include <include/types.h>
+#include <proc/wait.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 // FIXME: MQ 2019-07-16 Is it safe to assume 512 b/s, it's fairly safe for hard disk but CD ROM might use 2048 b/s
 #define BYTES_PER_SECTOR 512
 
-char *bread(char *dev_name, sector_t block, uint32_t size);
-void bwrite(char *dev_name, sector_t block, char *buf, uint32_t size);
+#define BH_Uptodate 0x01  // b_data has disk content (or newer)
+#define BH_Dirty 0x02	  // b_data is newer than disk
+#define BH_Lock 0x04	  // io is in flight
+
+struct block_device;
+
+// Block buffer cache, a buffer is found by (device, sector, size) and stays cached after the last `brelse`
+// unused buffers are kept in lru order and the oldest clean one is reused when cache is full
+// writes only mark buffer dirty, flusher thread writes them back after `BUFFER_DIRTY_EXPIRE_MS`
+// state bits are changed atomically, io completes in block device's dispatcher thread
+struct buffer_head
+{
+	struct block_device *b_bdev;
+	sector_t b_sector;
+	uint32_t b_size;
+	char *b_data;
+	atomic_t b_state;
+	int32_t b_count;		// references, buffer is only reused when it drops to zero
+	uint64_t b_dirtied_at;	// ms, when it has become dirty
+	void (*b_end_io)(struct buffer_head *bh, bool uptodate);
+	struct wait_queue_head b_wait;	// waiters for BH_Lock to be cleared
+	struct list_head b_hash;
+	struct list_head b_lru;		 // in unused list if b_count is zero
+	struct list_head b_dirty;	 // in dirty list if BH_Dirty
+	struct list_head b_reqlist;	 // in request->bhs while io is in flight
+};
+
+struct buffer_stat
+{
+	uint32_t nr_buffers;
+	uint32_t nr_dirty;
+	uint32_t nr_hits;
+	uint32_t nr_misses;
+	uint32_t nr_evictions;
+	uint32_t nr_writebacks;
+	uint32_t nr_readaheads;
+};
+
+static inline bool buffer_uptodate(struct buffer_head *bh)
+{
+	return atomic_read(&bh->b_state) & BH_Uptodate;
+}
+
+static inline bool buffer_dirty(struct buffer_head *bh)
+{
+	return atomic_read(&bh->b_state) & BH_Dirty;
+}
+
+static inline bool buffer_locked(struct buffer_head *bh)
+{
+	return atomic_read(&bh->b_state) & BH_Lock;
+}
+
+static inline uint32_t buffer_sectors(struct buffer_head *bh)
+{
+	return (bh->b_size + BYTES_PER_SECTOR - 1) / BYTES_PER_SECTOR;
+}
+
+extern struct buffer_stat buffer_stat;
+
+struct buffer_head *getblk(struct block_device *bdev, sector_t sector, uint32_t size);
+struct buffer_head *bread(struct block_device *bdev, sector_t sector, uint32_t size);
+void breadahead(struct block_device *bdev, sector_t sector, uint32_t size);
+void brelse(struct buffer_head *bh);
+void lock_buffer(struct buffer_head *bh);
+void unlock_buffer(struct buffer_head *bh);
+void wait_on_buffer(struct buffer_head *bh);
+void mark_buffer_dirty(struct buffer_head *bh);
+int sync_dirty_buffer(struct buffer_head *bh);
+void sync_buffers();
+uint32_t get_buffers_size(uint32_t *dirty);
+void buffer_init();
 
 #endif
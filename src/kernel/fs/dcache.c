@@ -0,0 +1,236 @@
+#include <memory/vmm.h>
+#include <utils/debug.h>
+#include <utils/string.h>
+
+#include "vfs.h"
+
+#define DCACHE_HASH_SIZE 1024
+// unused dentries are dropped above this number, referenced and pinned ones are not counted
+#define DCACHE_UNUSED_MAX 4096
+
+static struct list_head dentry_hashtable[DCACHE_HASH_SIZE];
+// least recently used is at the head
+static LIST_HEAD(unused_dentries);
+// protects hash, unused list and d_count dropping to zero, d_subdirs are protected by dcache_sem
+static struct mutex dcache_lock;
+struct dentry_stat dentry_stat;
+
+static uint32_t d_hash_name(const char *name)
+{
+	uint32_t hash = 0;
+	while (*name)
+		hash = hash * 31 + (unsigned char)*name++;
+	return hash;
+}
+
+static struct list_head *d_hash(struct vfs_dentry *parent, uint32_t name_hash)
+{
+	return &dentry_hashtable[(((uint32_t)parent >> 4) ^ name_hash) % DCACHE_HASH_SIZE];
+}
+
+// it can be read back (a name which doesn't exist can always be looked up again)
+static bool d_evictable(struct vfs_dentry *dentry)
+{
+	if (dentry->d_flags & DCACHE_MOUNTED)
+		return false;
+	return !dentry->d_inode || (dentry->d_sb && dentry->d_sb->s_op->read_inode);
+}
+
+// called with dcache_lock held
+static void __dget(struct vfs_dentry *dentry)
+{
+	if (!atomic_read(&dentry->d_count) && !list_empty(&dentry->d_lru))
+	{
+		list_del_init(&dentry->d_lru);
+		dentry_stat.nr_unused--;
+	}
+	atomic_inc(&dentry->d_count);
+}
+
+// called with dcache_lock held
+static void __d_unhash(struct vfs_dentry *dentry)
+{
+	list_del_init(&dentry->d_hash);
+	dentry_stat.nr_dentries--;
+	if (!dentry->d_inode)
+		dentry_stat.nr_negative--;
+}
+
+// dentry is neither cached nor used, its inode and parent are released
+static void d_free(struct vfs_dentry *dentry)
+{
+	if (!list_empty(&dentry->d_sibling))
+	{
+		down_write(&dcache_sem);
+		list_del_init(&dentry->d_sibling);
+		up_write(&dcache_sem);
+	}
+
+	iput(dentry->d_inode);
+	dput(dentry->d_parent);
+	kfree(dentry->d_name);
+	kfree(dentry);
+}
+
+// the creator holds the only reference, child holds a reference of its parent
+struct vfs_dentry *alloc_dentry(struct vfs_dentry *parent, char *name)
+{
+	struct vfs_dentry *d = kcalloc(1, sizeof(struct vfs_dentry));
+	d->d_name = strdup(name);
+	d->d_name_hash = d_hash_name(name);
+	d->d_parent = parent;
+	atomic_set(&d->d_count, 1);
+	INIT_LIST_HEAD(&d->d_subdirs);
+	INIT_LIST_HEAD(&d->d_sibling);
+	INIT_LIST_HEAD(&d->d_hash);
+	INIT_LIST_HEAD(&d->d_lru);
+
+	if (parent)
+	{
+		d->d_sb = parent->d_sb;
+		dget(parent);
+	}
+
+	return d;
+}
+
+// take a reference of cached child (positive or negative), NULL if name has not been looked up yet
+struct vfs_dentry *d_lookup(struct vfs_dentry *parent, const char *name)
+{
+	uint32_t name_hash = d_hash_name(name);
+	struct vfs_dentry *iter, *dentry = NULL;
+
+	mutex_lock(&dcache_lock);
+	list_for_each_entry(iter, d_hash(parent, name_hash), d_hash)
+	{
+		if (iter->d_parent == parent && iter->d_name_hash == name_hash && !strcmp(iter->d_name, name))
+		{
+			__dget(iter);
+			dentry = iter;
+			break;
+		}
+	}
+	if (dentry)
+		dentry_stat.nr_hits++;
+	else
+		dentry_stat.nr_misses++;
+	mutex_unlock(&dcache_lock);
+
+	return dentry;
+}
+
+// cache `dentry` with `inode` (NULL -> negative) under its parent, a cached dentry of the same name
+// (negative one, the one which is renamed over or mounted over) is dropped
+void d_add(struct vfs_dentry *dentry, struct vfs_inode *inode)
+{
+	struct vfs_dentry *old = d_lookup(dentry->d_parent, dentry->d_name);
+	if (old)
+	{
+		d_drop(old);
+		dput(old);
+	}
+
+	dentry->d_inode = inode;
+	mutex_lock(&dcache_lock);
+	list_add(&dentry->d_hash, d_hash(dentry->d_parent, dentry->d_name_hash));
+	dentry_stat.nr_dentries++;
+	if (!inode)
+		dentry_stat.nr_negative++;
+	mutex_unlock(&dcache_lock);
+
+	if (inode)
+	{
+		down_write(&dcache_sem);
+		list_add_tail(&dentry->d_sibling, &dentry->d_parent->d_subdirs);
+		up_write(&dcache_sem);
+	}
+}
+
+// name of negative dentry has been created
+void d_instantiate(struct vfs_dentry *dentry, struct vfs_inode *inode)
+{
+	mutex_lock(&dcache_lock);
+	dentry->d_inode = inode;
+	if (!list_empty(&dentry->d_hash))
+		dentry_stat.nr_negative--;
+	mutex_unlock(&dcache_lock);
+
+	down_write(&dcache_sem);
+	if (list_empty(&dentry->d_sibling))
+		list_add_tail(&dentry->d_sibling, &dentry->d_parent->d_subdirs);
+	up_write(&dcache_sem);
+}
+
+// name is gone (unlinked, renamed or mounted over), dentry is freed when its last user puts it
+void d_drop(struct vfs_dentry *dentry)
+{
+	mutex_lock(&dcache_lock);
+	if (!list_empty(&dentry->d_hash))
+		__d_unhash(dentry);
+	mutex_unlock(&dcache_lock);
+
+	down_write(&dcache_sem);
+	list_del_init(&dentry->d_sibling);
+	up_write(&dcache_sem);
+}
+
+struct vfs_dentry *dget(struct vfs_dentry *dentry)
+{
+	mutex_lock(&dcache_lock);
+	__dget(dentry);
+	mutex_unlock(&dcache_lock);
+	return dentry;
+}
+
+// the last reference of a cached dentry puts it into unused list (if it can be read back), the least recently
+// used one is dropped when list is full. Dentry which is not cached anymore is freed
+void dput(struct vfs_dentry *dentry)
+{
+	if (!dentry)
+		return;
+
+	mutex_lock(&dcache_lock);
+	assert(atomic_read(&dentry->d_count) > 0);
+	atomic_dec(&dentry->d_count);
+	if (atomic_read(&dentry->d_count))
+	{
+		mutex_unlock(&dcache_lock);
+		return;
+	}
+
+	if (list_empty(&dentry->d_hash))
+	{
+		mutex_unlock(&dcache_lock);
+		d_free(dentry);
+		return;
+	}
+
+	if (!d_evictable(dentry))
+	{
+		mutex_unlock(&dcache_lock);
+		return;
+	}
+
+	list_add_tail(&dentry->d_lru, &unused_dentries);
+	dentry_stat.nr_unused++;
+	struct vfs_dentry *victim = NULL;
+	if (dentry_stat.nr_unused > DCACHE_UNUSED_MAX)
+	{
+		victim = list_first_entry(&unused_dentries, struct vfs_dentry, d_lru);
+		list_del_init(&victim->d_lru);
+		dentry_stat.nr_unused--;
+		__d_unhash(victim);
+		dentry_stat.nr_evictions++;
+	}
+	mutex_unlock(&dcache_lock);
+
+	if (victim)
+		d_free(victim);
+}
+
+void dcache_init()
+{
+	for (int i = 0; i < DCACHE_HASH_SIZE; ++i)
+		INIT_LIST_HEAD(&dentry_hashtable[i]);
+	mutex_init(&dcache_lock);
+}
@@ -12,6 +12,7 @@
 struct vfs_inode *devfs_get_inode(struct vfs_superblock *sb, uint32_t mode)
 {
 	struct vfs_inode *i = sb->s_op->alloc_inode(sb);
+	i->i_ino = get_next_ino();
 	i->i_blksize = PMM_FRAME_SIZE;
 	i->i_mode = mode;
 	i->i_atime.tv_sec = get_seconds(NULL);
@@ -33,6 +34,7 @@ struct vfs_inode *devfs_get_inode(struct vfs_superblock *sb, uint32_t mode)
 		i->i_op = &devfs_special_inode_operations;
 		init_special_inode(i, i->i_mode, i->i_rdev);
 	}
+	insert_inode_hash(i);
 
 	return i;
 }
@@ -41,7 +43,6 @@ static struct vfs_inode *devfs_alloc_inode(struct vfs_superblock *sb)
 {
 	struct vfs_inode *inode = init_inode();
 	inode->i_sb = sb;
-	atomic_set(&inode->i_count, 0);
 
 	return inode;
 }
@@ -0,0 +1,392 @@
+#include "eventpoll.h"
+
+#include <include/errno.h>
+#include <include/fcntl.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <system/time.h>
+#include <system/timer.h>
+#include <utils/debug.h>
+
+/*
+ * Interest list is kept across calls, each item hooks a callback into wait queues of its file once (at EPOLL_CTL_ADD)
+ * When file wakes up its queue, the callback moves item into ready list -> epoll_wait only looks at ready items
+ * - level-triggered: item which still has events after being reported is put back into ready list
+ * - edge-triggered: item is only reported again after the next wake-up of file
+ * - oneshot: item is disabled after being reported until EPOLL_CTL_MOD
+ */
+
+struct ep_pqueue
+{
+	struct poll_table pt;
+	struct epitem *epi;
+};
+
+struct ep_timeout
+{
+	struct timer_list timer;
+	struct thread *thread;
+};
+
+static struct vfs_file_operations eventpoll_fops;
+
+static uint32_t ep_item_poll(struct epitem *epi, struct poll_table *pt)
+{
+	int32_t revents = epi->file->f_op->poll(epi->file, pt);
+	if (revents < 0)
+		return EPOLLERR;
+	return revents & (epi->event.events | EPOLL_ALWAYS_EVENTS);
+}
+
+// called with scheduler locked, from whoever wakes up the file (including irq handlers)
+static int ep_poll_callback(struct wait_queue_entry *wait, uint32_t key)
+{
+	struct eppoll_entry *pwq = container_of(wait, struct eppoll_entry, wait);
+	struct epitem *epi = pwq->base;
+	struct eventpoll *ep = epi->ep;
+
+	// disabled by EPOLLONESHOT
+	if (!(epi->event.events & ~EPOLL_PRIVATE_BITS))
+		return 0;
+	if (key && !(key & (epi->event.events | EPOLL_ALWAYS_EVENTS)))
+		return 0;
+
+	if (list_empty(&epi->rdllink))
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+	wake_up(&ep->wq);
+	return 1;
+}
+
+static void ep_ptable_queue_proc(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt)
+{
+	struct epitem *epi = container_of(pt, struct ep_pqueue, pt)->epi;
+	struct eppoll_entry *pwq = kcalloc(1, sizeof(struct eppoll_entry));
+
+	pwq->base = epi;
+	pwq->whead = wh;
+	pwq->wait.func = ep_poll_callback;
+	list_add_tail(&pwq->sibling, &epi->pwqlist);
+
+	lock_scheduler();
+	add_wait_queue(wh, &pwq->wait);
+	unlock_scheduler();
+}
+
+static void ep_add_ready(struct eventpoll *ep, struct epitem *epi)
+{
+	lock_scheduler();
+	if (list_empty(&epi->rdllink))
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+	wake_up(&ep->wq);
+	unlock_scheduler();
+}
+
+static void ep_unregister_pollwait(struct epitem *epi)
+{
+	struct eppoll_entry *iter, *next;
+	list_for_each_entry_safe(iter, next, &epi->pwqlist, sibling)
+	{
+		lock_scheduler();
+		remove_wait_queue(iter->whead, &iter->wait);
+		unlock_scheduler();
+
+		list_del(&iter->sibling);
+		kfree(iter);
+	}
+}
+
+// called with ep->mtx locked
+static void ep_remove(struct eventpoll *ep, struct epitem *epi)
+{
+	ep_unregister_pollwait(epi);
+
+	lock_scheduler();
+	if (!list_empty(&epi->rdllink))
+		list_del(&epi->rdllink);
+	unlock_scheduler();
+
+	list_del(&epi->fllink);
+	list_del(&epi->sibling);
+	hashmap_remove(&ep->items, &epi->fd);
+	kfree(epi);
+}
+
+static int ep_insert(struct eventpoll *ep, struct epoll_event *event, struct vfs_file *file, int32_t fd)
+{
+	struct epitem *epi = kcalloc(1, sizeof(struct epitem));
+	epi->ep = ep;
+	epi->file = file;
+	epi->fd = fd;
+	epi->event = *event;
+	INIT_LIST_HEAD(&epi->rdllink);
+	INIT_LIST_HEAD(&epi->pwqlist);
+
+	hashmap_put(&ep->items, &epi->fd, epi);
+	list_add_tail(&epi->sibling, &ep->itemlist);
+	list_add_tail(&epi->fllink, &file->f_ep_links);
+
+	struct ep_pqueue epq = {
+		.pt = {.key = event->events | EPOLL_ALWAYS_EVENTS, .qproc = ep_ptable_queue_proc},
+		.epi = epi,
+	};
+	if (ep_item_poll(epi, &epq.pt))
+		ep_add_ready(ep, epi);
+
+	return 0;
+}
+
+static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_event *event)
+{
+	epi->event.events = event->events;
+	epi->event.data = event->data;
+
+	if (ep_item_poll(epi, NULL))
+		ep_add_ready(ep, epi);
+
+	return 0;
+}
+
+static int ep_send_events(struct eventpoll *ep, struct epoll_event *events, int32_t maxevents)
+{
+	LIST_HEAD(txlist);
+	int32_t nr = 0;
+
+	mutex_lock(&ep->mtx);
+
+	lock_scheduler();
+	list_splice_init(&ep->rdllist, &txlist);
+	unlock_scheduler();
+
+	struct epitem *epi, *next;
+	list_for_each_entry_safe(epi, next, &txlist, rdllink)
+	{
+		if (nr >= maxevents)
+			break;
+
+		// callback can queue item again while we are polling it
+		lock_scheduler();
+		list_del_init(&epi->rdllink);
+		unlock_scheduler();
+
+		uint32_t revents = ep_item_poll(epi, NULL);
+		if (!revents)
+			continue;
+
+		events[nr].events = revents;
+		events[nr].data = epi->event.data;
+		nr++;
+
+		if (epi->event.events & EPOLLONESHOT)
+			epi->event.events &= EPOLL_PRIVATE_BITS;
+		else if (!(epi->event.events & EPOLLET))
+		{
+			lock_scheduler();
+			if (list_empty(&epi->rdllink))
+				list_add_tail(&epi->rdllink, &ep->rdllist);
+			unlock_scheduler();
+		}
+	}
+
+	// items we don't have room for stay in front of ready list
+	lock_scheduler();
+	list_splice(&txlist, &ep->rdllist);
+	unlock_scheduler();
+
+	mutex_unlock(&ep->mtx);
+	return nr;
+}
+
+static void ep_timeout(struct timer_list *timer)
+{
+	struct ep_timeout *et = from_timer(et, timer, timer);
+	list_del(&timer->sibling);
+	update_thread(et->thread, THREAD_READY);
+}
+
+// timeout in milliseconds, negative -> wait forever, 0 -> don't wait
+static int ep_poll(struct eventpoll *ep, struct epoll_event *events, int32_t maxevents, int32_t timeout)
+{
+	struct ep_timeout et = {
+		.timer = TIMER_INITIALIZER(ep_timeout, UINT32_MAX),
+		.thread = current_thread,
+	};
+	if (timeout > 0)
+	{
+		et.timer.expires = get_milliseconds(NULL) + timeout;
+		add_timer(&et.timer);
+	}
+
+	DEFINE_WAIT_FUNC(wait, autoremove_wake_function);
+	int32_t ret;
+	for (bool woken = false;; woken = true)
+	{
+		ret = ep_send_events(ep, events, maxevents);
+		if (ret || !timeout)
+			break;
+		if (woken)
+			wq_stat.nr_spurious++;
+		if (timeout > 0 && !is_actived_timer(&et.timer))
+			break;
+		if (current_thread->pending & ~current_thread->blocked)
+		{
+			ret = -EINTR;
+			break;
+		}
+
+		// epoll waiters are exclusive, one event wakes one of them
+		prepare_to_wait_exclusive(&ep->wq, &wait);
+		if (list_empty(&ep->rdllist) && (timeout < 0 || is_actived_timer(&et.timer)))
+			schedule();
+		finish_wait(&ep->wq, &wait);
+	}
+
+	if (timeout > 0 && is_actived_timer(&et.timer))
+		del_timer(&et.timer);
+
+	return ret;
+}
+
+static struct eventpoll *ep_alloc()
+{
+	struct eventpoll *ep = kcalloc(1, sizeof(struct eventpoll));
+
+	mutex_init(&ep->mtx);
+	INIT_LIST_HEAD(&ep->wq.list);
+	INIT_LIST_HEAD(&ep->rdllist);
+	INIT_LIST_HEAD(&ep->itemlist);
+	hashmap_init(&ep->items, hashmap_hash_uint32, hashmap_compare_uint32, 0);
+
+	return ep;
+}
+
+static int ep_release(struct vfs_inode *inode, struct vfs_file *file)
+{
+	struct eventpoll *ep = file->private_data;
+
+	mutex_lock(&ep->mtx);
+	struct epitem *iter, *next;
+	list_for_each_entry_safe(iter, next, &ep->itemlist, sibling)
+	{
+		ep_remove(ep, iter);
+	}
+	mutex_unlock(&ep->mtx);
+
+	hashmap_destroy(&ep->items);
+	kfree(ep);
+	kfree(file->f_dentry);
+	kfree(inode);
+	return 0;
+}
+
+static struct vfs_file_operations eventpoll_fops = {
+	.release = ep_release,
+};
+
+static struct eventpoll *ep_from_fd(int32_t epfd)
+{
+	if (epfd < 0 || epfd >= MAX_FD)
+		return NULL;
+
+	struct vfs_file *file = current_process->files->fd[epfd];
+	if (!file || file->f_op != &eventpoll_fops)
+		return NULL;
+
+	return file->private_data;
+}
+
+int32_t do_epoll_create(int32_t flags)
+{
+	if (flags & ~EPOLL_CLOEXEC)
+		return -EINVAL;
+
+	struct vfs_inode *inode = init_inode();
+	inode->i_fop = &eventpoll_fops;
+
+	struct vfs_dentry *dentry = kcalloc(1, sizeof(struct vfs_dentry));
+	dentry->d_inode = inode;
+
+	struct vfs_file *file = get_empty_filp();
+	file->f_flags = O_RDONLY;
+	file->f_op = &eventpoll_fops;
+	file->f_dentry = dentry;
+	file->private_data = ep_alloc();
+
+	int32_t fd = install_fd(file, 0);
+	if (fd < 0)
+		vfs_fput(file);
+	return fd;
+}
+
+int32_t do_epoll_ctl(int32_t epfd, int32_t op, int32_t fd, struct epoll_event *event)
+{
+	struct eventpoll *ep = ep_from_fd(epfd);
+	if (!ep)
+		return -EBADF;
+	if (fd < 0 || fd >= MAX_FD || !current_process->files->fd[fd])
+		return -EBADF;
+	if (fd == epfd)
+		return -EINVAL;
+	if (op != EPOLL_CTL_DEL && !event)
+		return -EFAULT;
+
+	struct vfs_file *file = current_process->files->fd[fd];
+	if (!file->f_op || !file->f_op->poll)
+		return -EPERM;
+
+	mutex_lock(&ep->mtx);
+
+	int ret = 0;
+	struct epitem *epi = hashmap_get(&ep->items, &fd);
+	if (epi && epi->file != file)
+	{
+		// fd is reused for another file but the old one is still alive (e.g. dup2), treat as stale
+		ep_remove(ep, epi);
+		epi = NULL;
+	}
+
+	switch (op)
+	{
+	case EPOLL_CTL_ADD:
+		ret = epi ? -EEXIST : ep_insert(ep, event, file, fd);
+		break;
+	case EPOLL_CTL_DEL:
+		if (epi)
+			ep_remove(ep, epi);
+		else
+			ret = -ENOENT;
+		break;
+	case EPOLL_CTL_MOD:
+		ret = epi ? ep_modify(ep, epi, event) : -ENOENT;
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+	mutex_unlock(&ep->mtx);
+	return ret;
+}
+
+int32_t do_epoll_wait(int32_t epfd, struct epoll_event *events, int32_t maxevents, int32_t timeout)
+{
+	struct eventpoll *ep = ep_from_fd(epfd);
+	if (!ep)
+		return -EBADF;
+	if (maxevents <= 0 || maxevents > EPOLL_MAX_EVENTS || !events)
+		return -EINVAL;
+
+	return ep_poll(ep, events, maxevents, timeout);
+}
+
+// file is going away, drop it from every epoll set which watches it
+void eventpoll_release(struct vfs_file *file)
+{
+	struct epitem *iter, *next;
+	list_for_each_entry_safe(iter, next, &file->f_ep_links, fllink)
+	{
+		struct eventpoll *ep = iter->ep;
+
+		mutex_lock(&ep->mtx);
+		ep_remove(ep, iter);
+		mutex_unlock(&ep->mtx);
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef FS_EVENTPOLL_H
+#define FS_EVENTPOLL_H
+
+#include <fs/poll.h>
+#include <fs/vfs.h>
+#include <include/list.h>
+#include <locking/mutex.h>
+#include <proc/wait.h>
+#include <stdint.h>
+#include <utils/hashmap.h>
+
+#define EPOLL_CLOEXEC 02000000
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLLIN POLLIN
+#define EPOLLPRI POLLPRI
+#define EPOLLOUT POLLOUT
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+#define EPOLLRDNORM POLLRDNORM
+#define EPOLLWRNORM POLLWRNORM
+#define EPOLLONESHOT (1u << 30)
+#define EPOLLET (1u << 31)
+
+// events which are always reported (no need to ask for)
+#define EPOLL_ALWAYS_EVENTS (EPOLLERR | EPOLLHUP)
+#define EPOLL_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EPOLL_MAX_EVENTS 1024
+
+typedef union epoll_data
+{
+	void *ptr;
+	int fd;
+	uint32_t u32;
+	uint64_t u64;
+} epoll_data_t;
+
+// same layout as linux i386
+struct epoll_event
+{
+	uint32_t events;
+	epoll_data_t data;
+} __attribute__((packed));
+
+struct eventpoll
+{
+	struct mutex mtx;		   // serializes epoll_ctl and event delivery
+	struct wait_queue_head wq; // threads sleeping in epoll_wait
+	struct list_head rdllist;  // ready items, guarded by lock_scheduler (callbacks come from irq)
+	struct hashmap items;	   // fd -> epitem
+	struct list_head itemlist;
+};
+
+struct epitem
+{
+	struct eventpoll *ep;
+	struct vfs_file *file;
+	int32_t fd;
+	struct epoll_event event;
+	struct list_head rdllink;  // in ep->rdllist, empty if not ready
+	struct list_head fllink;   // in file->f_ep_links
+	struct list_head sibling;  // in ep->itemlist
+	struct list_head pwqlist;  // wait queues of file this item is hooked into
+};
+
+// hooks an epitem to a wait queue head of the watched file
+struct eppoll_entry
+{
+	struct epitem *base;
+	struct wait_queue_head *whead;
+	struct wait_queue_entry wait;
+	struct list_head sibling;
+};
+
+int32_t do_epoll_create(int32_t flags);
+int32_t do_epoll_ctl(int32_t epfd, int32_t op, int32_t fd, struct epoll_event *event);
+int32_t do_epoll_wait(int32_t epfd, struct epoll_event *events, int32_t maxevents, int32_t timeout);
+void eventpoll_release(struct vfs_file *file);
+
+#endif
@@ -0,0 +1,176 @@
+#include <fs/buffer.h>
+#include <fs/vfs.h>
+#include <locking/mutex.h>
+#include <memory/vmm.h>
+#include <utils/debug.h>
+#include <utils/math.h>
+
+#include "ext2.h"
+
+// bitmaps, group descriptors and free counts of superblock
+static struct mutex balloc_lock;
+
+static bool ext2_test_bit(unsigned char *bitmap, uint32_t nr)
+{
+	return bitmap[nr / 8] & (1 << (nr % 8));
+}
+
+// called with balloc_lock held
+struct buffer_head *ext2_block_bitmap(struct vfs_superblock *sb, uint32_t group)
+{
+	struct ext2_sb_info *sbi = EXT2_SB_I(sb);
+	if (!sbi->s_block_bitmap[group])
+		sbi->s_block_bitmap[group] = ext2_bread_block(sb, ext2_get_group_desc(sb, group)->bg_block_bitmap);
+	return sbi->s_block_bitmap[group];
+}
+
+// goal itself, a free one shortly after it, the beginning of a free byte (at least 8 free blocks in a row)
+// and lastly any free one, -1 if there is none
+static int ext2_find_free_block(unsigned char *bitmap, uint32_t goal, uint32_t nr_blocks)
+{
+	if (!ext2_test_bit(bitmap, goal))
+		return goal;
+
+	for (uint32_t i = goal + 1, end = min((uint32_t)ALIGN_UP(goal + 1, 64), nr_blocks); i < end; ++i)
+		if (!ext2_test_bit(bitmap, i))
+			return i;
+
+	for (uint32_t i = div_ceil(goal, 8), end = nr_blocks / 8; i < end; ++i)
+		if (!bitmap[i])
+			return i * 8;
+
+	for (uint32_t i = 0; i < nr_blocks; ++i)
+		if (!ext2_test_bit(bitmap, (goal + i) % nr_blocks))
+			return (goal + i) % nr_blocks;
+	return -1;
+}
+
+// take up to `*count` contiguous free blocks of group, at `goal` (relative) or the closest good place after it
+// bitmap and counts are updated once for the whole run. Return first block, 0 if group is full
+static uint32_t ext2_alloc_in_group(struct vfs_superblock *sb, uint32_t group, uint32_t goal, uint32_t *count)
+{
+	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
+	struct ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
+	if (!gdp->bg_free_blocks_count)
+		return 0;
+
+	// last group can be shorter
+	uint32_t nr_blocks = min(ext2_sb->s_blocks_per_group,
+							 ext2_sb->s_blocks_count - ext2_sb->s_first_data_block - group * ext2_sb->s_blocks_per_group);
+	struct buffer_head *bh = ext2_block_bitmap(sb, group);
+	unsigned char *bitmap = (unsigned char *)bh->b_data;
+
+	int start = ext2_find_free_block(bitmap, goal, nr_blocks);
+	if (start < 0)
+		return 0;
+
+	uint32_t nr = 0;
+	while (nr < *count && start + nr < nr_blocks && !ext2_test_bit(bitmap, start + nr))
+	{
+		bitmap[(start + nr) / 8] |= 1 << ((start + nr) % 8);
+		nr++;
+	}
+
+	mark_buffer_dirty(bh);
+	gdp->bg_free_blocks_count -= nr;
+	ext2_write_group_desc(sb, group);
+	ext2_sb->s_free_blocks_count -= nr;
+
+	*count = nr;
+	return group * ext2_sb->s_blocks_per_group + start + ext2_sb->s_first_data_block;
+}
+
+// allocate at most `*count` contiguous blocks as close to `goal` as possible (its group first, then the next ones)
+// `*count` is set to how many are actually allocated, return first block, 0 if there is no space
+uint32_t ext2_new_blocks(struct vfs_superblock *sb, uint32_t goal, uint32_t *count)
+{
+	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
+
+	mutex_lock(&balloc_lock);
+	if (goal < ext2_sb->s_first_data_block || goal >= ext2_sb->s_blocks_count)
+		goal = ext2_sb->s_first_data_block;
+
+	uint32_t nr_groups = EXT2_SB_I(sb)->s_groups_count;
+	uint32_t goal_group = get_group_from_block(ext2_sb, goal);
+	uint32_t block = 0;
+	for (uint32_t i = 0; i < nr_groups && !block; ++i)
+	{
+		uint32_t nr = *count;
+		uint32_t group = (goal_group + i) % nr_groups;
+		block = ext2_alloc_in_group(sb, group, i ? 0 : get_relative_block_in_group(ext2_sb, goal), &nr);
+		if (block)
+			*count = nr;
+	}
+
+	if (block)
+		sb->s_op->write_super(sb);
+	mutex_unlock(&balloc_lock);
+	return block;
+}
+
+// `count` contiguous blocks of one group (one allocated run or a part of it)
+void ext2_free_blocks(struct vfs_superblock *sb, uint32_t block, uint32_t count)
+{
+	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
+	if (!count)
+		return;
+
+	mutex_lock(&balloc_lock);
+	uint32_t group = get_group_from_block(ext2_sb, block);
+	struct buffer_head *bh = ext2_block_bitmap(sb, group);
+	uint32_t relative_block = get_relative_block_in_group(ext2_sb, block);
+	for (uint32_t i = relative_block; i < relative_block + count; ++i)
+	{
+		assert(ext2_test_bit((unsigned char *)bh->b_data, i));
+		bh->b_data[i / 8] &= ~(1 << (i % 8));
+	}
+	mark_buffer_dirty(bh);
+
+	ext2_get_group_desc(sb, group)->bg_free_blocks_count += count;
+	ext2_write_group_desc(sb, group);
+	ext2_sb->s_free_blocks_count += count;
+	sb->s_op->write_super(sb);
+	mutex_unlock(&balloc_lock);
+}
+
+// A growing file takes a run of `EXT2_PREALLOC_BLOCKS` blocks at once, the ones it doesn't need yet stay reserved
+// (marked in bitmap) for its next blocks, so files written at the same time are not interleaved block by block
+// the rest is given back when file is closed or truncated. Called with bmap_lock held
+uint32_t ext2_alloc_block(struct vfs_inode *inode, uint32_t goal)
+{
+	struct ext2_inode_info *info = EXT2_I(inode);
+
+	if (info->prealloc_count && info->prealloc_block == goal)
+	{
+		info->prealloc_block++;
+		info->prealloc_count--;
+		return goal;
+	}
+
+	ext2_free_blocks(inode->i_sb, info->prealloc_block, info->prealloc_count);
+	info->prealloc_count = 0;
+
+	uint32_t count = S_ISREG(inode->i_mode) ? EXT2_PREALLOC_BLOCKS : 1;
+	uint32_t block = ext2_new_blocks(inode->i_sb, goal, &count);
+	if (block && count > 1)
+	{
+		info->prealloc_block = block + 1;
+		info->prealloc_count = count - 1;
+	}
+	return block;
+}
+
+void ext2_discard_prealloc(struct vfs_inode *inode)
+{
+	struct ext2_inode_info *info = EXT2_I(inode);
+
+	mutex_lock(&info->bmap_lock);
+	ext2_free_blocks(inode->i_sb, info->prealloc_block, info->prealloc_count);
+	info->prealloc_count = 0;
+	mutex_unlock(&info->bmap_lock);
+}
+
+void ext2_balloc_init()
+{
+	mutex_init(&balloc_lock);
+}
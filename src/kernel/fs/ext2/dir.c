@@ -0,0 +1,674 @@
+#include <fs/buffer.h>
+#include <fs/vfs.h>
+#include <include/errno.h>
+#include <memory/vmm.h>
+#include <utils/debug.h>
+#include <utils/math.h>
+#include <utils/string.h>
+
+#include "ext2.h"
+
+// root and one level of index nodes, up to (block size / 8)^2 leaves
+#define EXT2_DX_MAX_LEVELS 2
+
+struct dx_frame
+{
+	struct buffer_head *bh;
+	struct ext2_dx_entry *entries;
+	struct ext2_dx_entry *at;  // entry which lookup has gone through
+};
+
+struct dx_hash_info
+{
+	uint32_t hash;
+	int version;  // unsigned one if superblock says so
+};
+
+// live entry of a leaf which is being split
+struct dx_map_entry
+{
+	uint32_t hash;
+	uint16_t offs;
+	uint16_t size;
+};
+
+static struct ext2_dx_countlimit *dx_countlimit(struct ext2_dx_entry *entries)
+{
+	return (struct ext2_dx_countlimit *)entries;
+}
+
+static uint32_t dx_root_limit(struct vfs_superblock *sb)
+{
+	return (sb->s_blocksize - sizeof(struct ext2_dx_root)) / sizeof(struct ext2_dx_entry);
+}
+
+static uint32_t dx_node_limit(struct vfs_superblock *sb)
+{
+	return (sb->s_blocksize - sizeof(struct ext2_dx_node)) / sizeof(struct ext2_dx_entry);
+}
+
+static uint8_t ext2_file_type(mode_t mode)
+{
+	if (S_ISREG(mode))
+		return EXT2_FT_REG_FILE;
+	if (S_ISDIR(mode))
+		return EXT2_FT_DIR;
+	return EXT2_FT_UNKNOWN;
+}
+
+static uint32_t ext2_dir_blocks(struct vfs_inode *dir)
+{
+	return dir->i_size / dir->i_sb->s_blocksize;
+}
+
+static struct buffer_head *ext2_dir_bread(struct vfs_inode *dir, uint32_t iblock)
+{
+	uint32_t block = iblock < ext2_dir_blocks(dir) ? ext2_bmap(dir, iblock) : 0;
+	return block ? ext2_bread_block(dir->i_sb, block) : NULL;
+}
+
+// new block at the end of directory with one empty entry covering it, its logical block is in `*iblock`
+static struct buffer_head *ext2_dir_append(struct vfs_inode *dir, uint32_t *iblock)
+{
+	struct vfs_superblock *sb = dir->i_sb;
+	struct ext2_inode_info *info = EXT2_I(dir);
+	bool new;
+
+	*iblock = ext2_dir_blocks(dir);
+	mutex_lock(&info->bmap_lock);
+	uint32_t block = ext2_get_block(dir, *iblock, &new);
+	mutex_unlock(&info->bmap_lock);
+	if (!block)
+		return NULL;
+
+	struct buffer_head *bh = ext2_getblk(sb, block);
+	memset(bh->b_data, 0, sb->s_blocksize);
+	((struct ext2_dir_entry *)bh->b_data)->rec_len = sb->s_blocksize;
+	mark_buffer_dirty(bh);
+
+	dir->i_size += sb->s_blocksize;
+	mark_inode_dirty(dir);
+	ext2_bmap_invalidate(dir);
+	return bh;
+}
+
+// entry of `name` in directory block, `*prev` is the one before it (NULL if it is the first one)
+static struct ext2_dir_entry *ext2_find_in_block(struct vfs_superblock *sb, struct buffer_head *bh,
+												 const char *name, int len, struct ext2_dir_entry **prev)
+{
+	struct ext2_dir_entry *last = NULL;
+	for (char *p = bh->b_data, *end = bh->b_data + sb->s_blocksize; p + EXT2_DIR_REC_LEN(0) <= end;)
+	{
+		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)p;
+		if (entry->rec_len < EXT2_DIR_REC_LEN(0))
+			break;
+		if (entry->ino && entry->name_len == len && !memcmp(entry->name, name, len))
+		{
+			*prev = last;
+			return entry;
+		}
+		last = entry;
+		p += entry->rec_len;
+	}
+	return NULL;
+}
+
+// put `name` into free space of directory block, -ENOSPC if there is no room
+static int ext2_add_to_block(struct vfs_superblock *sb, struct buffer_head *bh,
+							 const char *name, int len, struct vfs_inode *inode)
+{
+	uint16_t rec_len = EXT2_DIR_REC_LEN(len);
+	for (char *p = bh->b_data, *end = bh->b_data + sb->s_blocksize; p + rec_len <= end;)
+	{
+		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)p;
+		// NOTE: MQ 2020-12-01 some ext2 tools mark entry with zero indicate an unused entry
+		if (!entry->rec_len && p == bh->b_data)
+			entry->rec_len = sb->s_blocksize;
+		if (entry->rec_len < EXT2_DIR_REC_LEN(0))
+			break;
+
+		uint16_t used = entry->ino ? EXT2_DIR_REC_LEN(entry->name_len) : 0;
+		if (entry->rec_len - used >= rec_len)
+		{
+			if (used)
+			{
+				struct ext2_dir_entry *next = (struct ext2_dir_entry *)(p + used);
+				next->rec_len = entry->rec_len - used;
+				entry->rec_len = used;
+				entry = next;
+			}
+			entry->ino = inode->i_ino;
+			entry->name_len = len;
+			entry->file_type = ext2_file_type(inode->i_mode);
+			memcpy(entry->name, name, len);
+			mark_buffer_dirty(bh);
+			return 0;
+		}
+		p += entry->rec_len;
+	}
+	return -ENOSPC;
+}
+
+static bool ext2_dx_enabled(struct vfs_superblock *sb)
+{
+	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
+	return (ext2_sb->s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) && ext2_sb->s_def_hash_version <= DX_HASH_TEA;
+}
+
+static uint32_t dx_hash(struct vfs_superblock *sb, int version, const char *name, int len)
+{
+	return ext2_dirhash(name, len, version, EXT2_SB(sb)->s_hash_seed);
+}
+
+static void dx_release(struct dx_frame *frames, int nr_frames)
+{
+	for (int i = 0; i < nr_frames; ++i)
+		brelse(frames[i].bh);
+}
+
+// walk index from root down to the entry which covers hash of `name`, a frame per level
+// -EINVAL if index is not the one we understand. Nothing is held on failure
+static int dx_probe(struct vfs_inode *dir, const char *name, int len, struct dx_hash_info *hinfo,
+					struct dx_frame *frames, int *nr_frames)
+{
+	struct vfs_superblock *sb = dir->i_sb;
+	*nr_frames = 0;
+
+	struct buffer_head *bh = ext2_dir_bread(dir, 0);
+	if (!bh)
+		return -EIO;
+
+	struct ext2_dx_root *root = (struct ext2_dx_root *)bh->b_data;
+	struct ext2_dx_root_info *info = &root->info;
+	if (info->reserved_zero || info->info_length != sizeof(struct ext2_dx_root_info) || info->unused_flags ||
+		info->hash_version > DX_HASH_TEA || info->indirect_levels >= EXT2_DX_MAX_LEVELS)
+	{
+		brelse(bh);
+		return -EINVAL;
+	}
+
+	int levels = info->indirect_levels;
+	hinfo->version = info->hash_version;
+	if (EXT2_SB(sb)->s_flags & EXT2_FLAGS_UNSIGNED_HASH)
+		hinfo->version += DX_HASH_LEGACY_UNSIGNED;
+	hinfo->hash = dx_hash(sb, hinfo->version, name, len);
+
+	struct ext2_dx_entry *entries = root->entries;
+	uint32_t limit = dx_root_limit(sb);
+	for (int level = 0;; ++level)
+	{
+		struct ext2_dx_countlimit *cl = dx_countlimit(entries);
+		if (!cl->count || cl->count > cl->limit || cl->limit != limit)
+		{
+			brelse(bh);
+			dx_release(frames, level);
+			*nr_frames = 0;
+			return -EINVAL;
+		}
+
+		// the last entry whose hash is not above, entries[0] covers hashes from 0
+		struct ext2_dx_entry *p = entries + 1, *q = entries + cl->count - 1;
+		while (p <= q)
+		{
+			struct ext2_dx_entry *m = p + (q - p) / 2;
+			if (m->hash > hinfo->hash)
+				q = m - 1;
+			else
+				p = m + 1;
+		}
+
+		frames[level].bh = bh;
+		frames[level].entries = entries;
+		frames[level].at = p - 1;
+		*nr_frames = level + 1;
+		if (level == levels)
+			return 0;
+
+		bh = ext2_dir_bread(dir, frames[level].at->block);
+		if (!bh)
+		{
+			dx_release(frames, *nr_frames);
+			*nr_frames = 0;
+			return -EIO;
+		}
+		entries = ((struct ext2_dx_node *)bh->b_data)->entries;
+		limit = dx_node_limit(sb);
+	}
+}
+
+// move frames to the next leaf if names of `hash` continue there, return 1 if they have been moved
+static int dx_next_block(struct vfs_inode *dir, uint32_t hash, struct dx_frame *frames, int nr_frames)
+{
+	int level = nr_frames - 1;
+	while (frames[level].at + 1 == frames[level].entries + dx_countlimit(frames[level].entries)->count)
+	{
+		if (!level)
+			return 0;
+		level--;
+	}
+
+	struct ext2_dx_entry *next = frames[level].at + 1;
+	if ((next->hash & ~1) != hash)
+		return 0;
+
+	frames[level].at = next;
+	for (++level; level < nr_frames; ++level)
+	{
+		struct buffer_head *bh = ext2_dir_bread(dir, frames[level - 1].at->block);
+		if (!bh)
+			return -EIO;
+
+		brelse(frames[level].bh);
+		frames[level].bh = bh;
+		frames[level].entries = ((struct ext2_dx_node *)bh->b_data)->entries;
+		frames[level].at = frames[level].entries;
+	}
+	return 1;
+}
+
+// only the leaf (or the run of leaves if hash collides) of name's hash is searched
+static int ext2_dx_find(struct vfs_inode *dir, const char *name, int len, struct buffer_head **res_bh,
+						struct ext2_dir_entry **res, struct ext2_dir_entry **prev)
+{
+	struct dx_frame frames[EXT2_DX_MAX_LEVELS];
+	struct dx_hash_info hinfo;
+	int nr_frames;
+	int ret = dx_probe(dir, name, len, &hinfo, frames, &nr_frames);
+	if (ret < 0)
+		return ret;
+
+	while (true)
+	{
+		struct buffer_head *bh = ext2_dir_bread(dir, frames[nr_frames - 1].at->block);
+		if (!bh)
+		{
+			ret = -EIO;
+			break;
+		}
+		if ((*res = ext2_find_in_block(dir->i_sb, bh, name, len, prev)))
+		{
+			*res_bh = bh;
+			ret = 0;
+			break;
+		}
+		brelse(bh);
+
+		ret = dx_next_block(dir, hinfo.hash, frames, nr_frames);
+		if (ret <= 0)
+		{
+			ret = ret ? ret : -ENOENT;
+			break;
+		}
+	}
+
+	dx_release(frames, nr_frames);
+	return ret;
+}
+
+// new entry right after the one lookup has gone through, there is a room for it
+static void dx_insert_entry(struct dx_frame *frame, uint32_t hash, uint32_t block)
+{
+	struct ext2_dx_countlimit *cl = dx_countlimit(frame->entries);
+	struct ext2_dx_entry *new = frame->at + 1;
+	for (struct ext2_dx_entry *iter = frame->entries + cl->count; iter > new; --iter)
+		*iter = *(iter - 1);
+	new->hash = hash;
+	new->block = block;
+	cl->count++;
+	mark_buffer_dirty(frame->bh);
+}
+
+// Index which points to leaves gets a free entry, a full root which points to leaves moves its entries into
+// the first index node (tree grows a level), a full index node is split in half and the new one is added to root
+// frames follow the entry which lookup has gone through. -ENOSPC if root is full as well
+static int dx_make_room(struct vfs_inode *dir, struct dx_frame *frames, int *nr_frames)
+{
+	struct vfs_superblock *sb = dir->i_sb;
+	struct dx_frame *frame = &frames[*nr_frames - 1];
+	struct ext2_dx_countlimit *cl = dx_countlimit(frame->entries);
+	if (cl->count < cl->limit)
+		return 0;
+
+	struct dx_frame *parent = *nr_frames > 1 ? &frames[*nr_frames - 2] : NULL;
+	if (parent && dx_countlimit(parent->entries)->count >= dx_countlimit(parent->entries)->limit)
+		return -ENOSPC;
+
+	uint32_t iblock;
+	struct buffer_head *bh = ext2_dir_append(dir, &iblock);
+	if (!bh)
+		return -ENOSPC;
+	struct ext2_dx_node *node = (struct ext2_dx_node *)bh->b_data;
+
+	if (!parent)
+	{
+		memcpy(node->entries, frame->entries, cl->count * sizeof(struct ext2_dx_entry));
+		dx_countlimit(node->entries)->limit = dx_node_limit(sb);
+
+		frames[1].bh = bh;
+		frames[1].entries = node->entries;
+		frames[1].at = node->entries + (frame->at - frame->entries);
+		*nr_frames = 2;
+
+		cl->count = 1;
+		frame->entries[0].block = iblock;
+		frame->at = frame->entries;
+		((struct ext2_dx_root *)frame->bh->b_data)->info.indirect_levels = 1;
+		mark_buffer_dirty(frame->bh);
+		return 0;
+	}
+
+	uint32_t half = cl->count / 2;
+	uint32_t hash = frame->entries[half].hash;
+	memcpy(node->entries, frame->entries + half, (cl->count - half) * sizeof(struct ext2_dx_entry));
+	dx_countlimit(node->entries)->limit = dx_node_limit(sb);
+	dx_countlimit(node->entries)->count = cl->count - half;
+	cl->count = half;
+	mark_buffer_dirty(frame->bh);
+	dx_insert_entry(parent, hash, iblock);
+
+	if (frame->at >= frame->entries + half)
+	{
+		frame->at = node->entries + (frame->at - frame->entries - half);
+		frame->entries = node->entries;
+		brelse(frame->bh);
+		frame->bh = bh;
+		parent->at++;
+	}
+	else
+		brelse(bh);
+	return 0;
+}
+
+// entries of `map` are written one after another into directory block `to`, the last one covers the rest of it
+static void dx_pack_entries(struct vfs_superblock *sb, char *to, const char *from, struct dx_map_entry *map, int count)
+{
+	struct ext2_dir_entry *entry = NULL;
+	char *p = to;
+
+	memset(to, 0, sb->s_blocksize);
+	for (int i = 0; i < count; ++i)
+	{
+		memcpy(p, from + map[i].offs, map[i].size);
+		entry = (struct ext2_dir_entry *)p;
+		entry->rec_len = map[i].size;
+		p += map[i].size;
+	}
+	if (entry)
+		entry->rec_len += to + sb->s_blocksize - p;
+	else
+		((struct ext2_dir_entry *)to)->rec_len = sb->s_blocksize;
+}
+
+// Entries of a full leaf are ordered by hash and the upper half (by size) moves to a new leaf, names of the same hash
+// can end up in both of them, index entry of the new leaf is marked as continued then. `*bh` becomes the leaf
+// whose hash range covers `hash`. Index has a room for the new leaf
+static int dx_split_leaf(struct vfs_inode *dir, struct dx_frame *frame, struct buffer_head **bh, struct dx_hash_info *hinfo)
+{
+	struct vfs_superblock *sb = dir->i_sb;
+	uint32_t iblock;
+	struct buffer_head *bh2 = ext2_dir_append(dir, &iblock);
+	if (!bh2)
+		return -ENOSPC;
+
+	char *data = kmalloc(sb->s_blocksize);
+	memcpy(data, (*bh)->b_data, sb->s_blocksize);
+	struct dx_map_entry *map = kcalloc(sb->s_blocksize / EXT2_DIR_REC_LEN(1), sizeof(struct dx_map_entry));
+
+	int count = 0;
+	uint32_t total = 0;
+	for (char *p = data; p + EXT2_DIR_REC_LEN(0) <= data + sb->s_blocksize;)
+	{
+		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)p;
+		if (entry->rec_len < EXT2_DIR_REC_LEN(0))
+			break;
+		if (entry->ino)
+		{
+			map[count].hash = dx_hash(sb, hinfo->version, entry->name, entry->name_len);
+			map[count].offs = p - data;
+			map[count].size = EXT2_DIR_REC_LEN(entry->name_len);
+			total += map[count++].size;
+		}
+		p += entry->rec_len;
+	}
+
+	for (int i = 1; i < count; ++i)
+	{
+		struct dx_map_entry tmp = map[i];
+		int j = i;
+		for (; j > 0 && map[j - 1].hash > tmp.hash; --j)
+			map[j] = map[j - 1];
+		map[j] = tmp;
+	}
+
+	int split = count;
+	for (uint32_t moved = 0; split > 1 && moved + map[split - 1].size <= total / 2;)
+		moved += map[--split].size;
+	if (split == count && count > 1)
+		split--;
+	// a single (long) name stays only if the new one goes after it
+	if (count == 1 && map[0].hash > hinfo->hash)
+		split = 0;
+
+	uint32_t split_hash = split < count ? map[split].hash : hinfo->hash;
+	uint32_t continued = split && map[split - 1].hash == split_hash;
+
+	dx_pack_entries(sb, (*bh)->b_data, data, map, split);
+	dx_pack_entries(sb, bh2->b_data, data, map + split, count - split);
+	mark_buffer_dirty(*bh);
+	mark_buffer_dirty(bh2);
+	kfree(map);
+	kfree(data);
+
+	dx_insert_entry(frame, split_hash | continued, iblock);
+	if (hinfo->hash >= split_hash)
+	{
+		brelse(*bh);
+		*bh = bh2;
+	}
+	else
+		brelse(bh2);
+	return 0;
+}
+
+static int ext2_dx_add_entry(struct vfs_inode *dir, const char *name, int len, struct vfs_inode *inode)
+{
+	struct vfs_superblock *sb = dir->i_sb;
+	struct dx_frame frames[EXT2_DX_MAX_LEVELS];
+	struct dx_hash_info hinfo;
+	int nr_frames;
+	int ret = dx_probe(dir, name, len, &hinfo, frames, &nr_frames);
+	if (ret < 0)
+		return ret;
+
+	struct buffer_head *bh = ext2_dir_bread(dir, frames[nr_frames - 1].at->block);
+	if (!bh)
+	{
+		ret = -EIO;
+		goto out;
+	}
+	ret = ext2_add_to_block(sb, bh, name, len, inode);
+	if (ret != -ENOSPC)
+		goto out;
+
+	ret = dx_make_room(dir, frames, &nr_frames);
+	if (ret < 0)
+		goto out;
+	ret = dx_split_leaf(dir, &frames[nr_frames - 1], &bh, &hinfo);
+	if (ret < 0)
+		goto out;
+	ret = ext2_add_to_block(sb, bh, name, len, inode);
+
+out:
+	brelse(bh);
+	dx_release(frames, nr_frames);
+	return ret;
+}
+
+// The only block of directory is full, its entries move to a new block which becomes the first leaf
+// and block 0 becomes index root (`..` covers the rest of it). Return -EINVAL if block 0 doesn't start
+// with `.` and `..` as it should
+static int ext2_make_indexed(struct vfs_inode *dir, const char *name, int len, struct vfs_inode *inode)
+{
+	struct vfs_superblock *sb = dir->i_sb;
+	struct buffer_head *root_bh = ext2_dir_bread(dir, 0);
+	if (!root_bh)
+		return -EIO;
+
+	struct ext2_dx_root *root = (struct ext2_dx_root *)root_bh->b_data;
+	struct ext2_dir_entry *dotdot = (struct ext2_dir_entry *)&root->dotdot;
+	if (root->dot.rec_len != EXT2_DIR_REC_LEN(1) || root->dot.name_len != 1 || root->dotdot.name_len != 2 ||
+		memcmp(dotdot->name, "..", 2) || root->dotdot.rec_len < EXT2_DIR_REC_LEN(2))
+	{
+		brelse(root_bh);
+		return -EINVAL;
+	}
+
+	uint32_t iblock;
+	struct buffer_head *bh = ext2_dir_append(dir, &iblock);
+	if (!bh)
+	{
+		brelse(root_bh);
+		return -ENOSPC;
+	}
+
+	// entries following `..` fit into a whole block
+	struct dx_map_entry *map = kcalloc(sb->s_blocksize / EXT2_DIR_REC_LEN(1), sizeof(struct dx_map_entry));
+	int count = 0;
+	char *end = root_bh->b_data + sb->s_blocksize;
+	for (char *p = (char *)dotdot + dotdot->rec_len; p + EXT2_DIR_REC_LEN(0) <= end;)
+	{
+		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)p;
+		if (entry->rec_len < EXT2_DIR_REC_LEN(0))
+			break;
+		if (entry->ino)
+		{
+			map[count].offs = p - root_bh->b_data;
+			map[count++].size = EXT2_DIR_REC_LEN(entry->name_len);
+		}
+		p += entry->rec_len;
+	}
+	dx_pack_entries(sb, bh->b_data, root_bh->b_data, map, count);
+	mark_buffer_dirty(bh);
+	brelse(bh);
+	kfree(map);
+
+	root->dotdot.rec_len = sb->s_blocksize - root->dot.rec_len;
+	memset(&root->info, 0, sb->s_blocksize - offsetof(struct ext2_dx_root, info));
+	root->info.hash_version = EXT2_SB(sb)->s_def_hash_version;
+	root->info.info_length = sizeof(struct ext2_dx_root_info);
+	dx_countlimit(root->entries)->limit = dx_root_limit(sb);
+	dx_countlimit(root->entries)->count = 1;
+	root->entries[0].block = iblock;
+	mark_buffer_dirty(root_bh);
+	brelse(root_bh);
+
+	dir->i_flags |= EXT2_INDEX_FL;
+	mark_inode_dirty(dir);
+	return ext2_dx_add_entry(dir, name, len, inode);
+}
+
+// block which holds the entry of `name` (`*res`, `*prev` is the one before it in block), NULL if there is none
+static struct buffer_head *ext2_find_entry_block(struct vfs_inode *dir, const char *name,
+												 struct ext2_dir_entry **res, struct ext2_dir_entry **prev)
+{
+	int len = strlen(name);
+	struct buffer_head *bh = NULL;
+
+	if (dir->i_flags & EXT2_INDEX_FL)
+	{
+		int ret = ext2_dx_find(dir, name, len, &bh, res, prev);
+		// index which we don't understand is searched like an ordinary directory
+		if (ret != -EINVAL)
+			return ret < 0 ? NULL : bh;
+	}
+
+	for (uint32_t iblock = 0, nr_blocks = ext2_dir_blocks(dir); iblock < nr_blocks; ++iblock)
+	{
+		bh = ext2_dir_bread(dir, iblock);
+		if (!bh)
+			continue;
+		if ((*res = ext2_find_in_block(dir->i_sb, bh, name, len, prev)))
+			return bh;
+		brelse(bh);
+	}
+	return NULL;
+}
+
+// inode number of `name` in directory, -ENOENT if there is none
+int ext2_find_entry(struct vfs_inode *dir, const char *name)
+{
+	struct ext2_dir_entry *entry, *prev;
+	struct buffer_head *bh = ext2_find_entry_block(dir, name, &entry, &prev);
+	if (!bh)
+		return -ENOENT;
+
+	int ino = entry->ino;
+	brelse(bh);
+	return ino;
+}
+
+// Hash-indexed directory only looks into the leaf of name's hash (a few blocks whatever its size is), an ordinary
+// one takes the first block which has a room or grows by a block. When the only block of directory is full and
+// filesystem has `dir_index` feature, directory becomes indexed
+int ext2_add_entry(struct vfs_inode *dir, const char *name, struct vfs_inode *inode)
+{
+	int len = strlen(name);
+	if (len > EXT2_NAME_LEN)
+		return -ENAMETOOLONG;
+
+	if (dir->i_flags & EXT2_INDEX_FL)
+	{
+		int ret = ext2_dx_add_entry(dir, name, len, inode);
+		if (ret != -EINVAL)
+			return ret;
+
+		// index is stale after a linear insert, it is an ordinary directory from now on (like linux ext2 does)
+		dir->i_flags &= ~EXT2_INDEX_FL;
+		mark_inode_dirty(dir);
+	}
+
+	uint32_t nr_blocks = ext2_dir_blocks(dir);
+	for (uint32_t iblock = 0; iblock < nr_blocks; ++iblock)
+	{
+		struct buffer_head *bh = ext2_dir_bread(dir, iblock);
+		if (!bh)
+			continue;
+		int ret = ext2_add_to_block(dir->i_sb, bh, name, len, inode);
+		brelse(bh);
+		if (ret != -ENOSPC)
+			return ret;
+	}
+
+	if (nr_blocks == 1 && ext2_dx_enabled(dir->i_sb))
+	{
+		int ret = ext2_make_indexed(dir, name, len, inode);
+		if (ret != -EINVAL)
+			return ret;
+	}
+
+	uint32_t iblock;
+	struct buffer_head *bh = ext2_dir_append(dir, &iblock);
+	if (!bh)
+		return -ENOSPC;
+	int ret = ext2_add_to_block(dir->i_sb, bh, name, len, inode);
+	brelse(bh);
+	return ret;
+}
+
+// remove entry of `name`, return its inode number or -ENOENT. Index (if there is) doesn't change
+int ext2_delete_entry(struct vfs_inode *dir, const char *name)
+{
+	struct ext2_dir_entry *entry, *prev;
+	struct buffer_head *bh = ext2_find_entry_block(dir, name, &entry, &prev);
+	if (!bh)
+		return -ENOENT;
+
+	int ino = entry->ino;
+	if (prev)
+		prev->rec_len += entry->rec_len;
+	else
+		entry->ino = 0;
+	mark_buffer_dirty(bh);
+	brelse(bh);
+	return ino;
+}
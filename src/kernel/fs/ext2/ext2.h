@@ -4,11 +4,18 @@
 #include <fs/vfs.h>
 #include <stdint.h>
 
+struct buffer_head;
+
 #define EXT2_INO_UPPER_LEVEL0 12
 #define EXT2_INO_UPPER_LEVEL1 268
 #define EXT2_INO_UPPER_LEVEL2 65804
 #define EXT2_INO_UPPER_LEVEL3 16843020
 
+// i_block index of indirect blocks
+#define EXT2_IND_BLOCK 12
+#define EXT2_DIND_BLOCK 13
+#define EXT2_TIND_BLOCK 14
+
 /*
  * Special struct vfs_inode numbers
  */
@@ -78,9 +85,27 @@ struct ext2_superblock
 	uint16_t s_reserved_word_pad;
 	uint32_t s_default_mount_opts;
 	uint32_t s_first_meta_bg; /* First metablock block group */
-	uint32_t s_reserved[190]; /* Padding to the end of the block */
+	uint32_t s_mkfs_time; /* When the filesystem was created */
+	uint32_t s_jnl_blocks[17]; /* Backup of the journal inode */
+	uint32_t s_blocks_count_hi; /* Blocks count (64bit) */
+	uint32_t s_r_blocks_count_hi; /* Reserved blocks count (64bit) */
+	uint32_t s_free_blocks_hi; /* Free blocks count (64bit) */
+	uint16_t s_min_extra_isize; /* All inodes have at least # bytes */
+	uint16_t s_want_extra_isize; /* New inodes should reserve # bytes */
+	uint32_t s_flags; /* Miscellaneous flags */
+	uint32_t s_reserved[167]; /* Padding to the end of the block */
 };
 
+// s_feature_compat
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+
+// s_flags, how `char` of names is hashed
+#define EXT2_FLAGS_SIGNED_HASH 0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002
+
+// i_flags
+#define EXT2_INDEX_FL 0x00001000 /* hash-indexed directory */
+
 struct ext2_group_desc
 {
 	uint32_t bg_block_bitmap;
@@ -156,6 +181,34 @@ struct ext2_inode
 	} osd2; /* OS dependent 2 */
 };
 
+// logical blocks [lblock, lblock + len) of a file are physical blocks [pblock, pblock + len)
+struct ext2_extent
+{
+	uint32_t lblock;
+	uint32_t pblock;
+	uint32_t len;
+};
+
+#define EXT2_BMAP_CACHE_SIZE 8
+// blocks reserved at once for a growing file
+#define EXT2_PREALLOC_BLOCKS 16
+
+// In-memory inode, raw inode goes first so it is written back as it is
+// recent block map lookups are cached as extents, so indirect blocks are only walked once per contiguous run
+struct ext2_inode_info
+{
+	struct ext2_inode raw;
+	struct mutex bmap_lock;
+	struct ext2_extent bmap_cache[EXT2_BMAP_CACHE_SIZE];  // len 0 is unused
+	uint32_t bmap_next;	 // slot which is replaced at next miss (round robin)
+	// reserved blocks [prealloc_block, prealloc_block + prealloc_count), protected by bmap_lock as well
+	uint32_t prealloc_block;
+	uint32_t prealloc_count;
+	// last allocated data block, the next one is placed after it
+	uint32_t last_alloc_lblock;
+	uint32_t last_alloc_pblock;
+};
+
 #define EXT2_NAME_LEN 255
 
 struct ext2_dir_entry
@@ -167,6 +220,64 @@ struct ext2_dir_entry
 	char name[];
 };
 
+// Hash-indexed directory (htree), block 0 is the root: `.` and `..` entries (`..` covers the rest of block,
+// so the directory is still readable linearly) followed by root info and index entries. Index entry `i` points
+// to the block which holds names whose hash is in [entries[i].hash, entries[i + 1].hash), entries[0] has no hash
+// (count and limit are in its place). With one indirect level, root points to index nodes (a block with one empty
+// entry covering it) and they point to leaves, which are ordinary directory blocks
+struct ext2_dx_fake_entry
+{
+	uint32_t ino;
+	uint16_t rec_len;
+	uint8_t name_len;
+	uint8_t file_type;
+};
+
+struct ext2_dx_root_info
+{
+	uint32_t reserved_zero;
+	uint8_t hash_version;
+	uint8_t info_length; /* 8 */
+	uint8_t indirect_levels;
+	uint8_t unused_flags;
+};
+
+struct ext2_dx_entry
+{
+	uint32_t hash;	// lowest bit is set if names of this hash continue from the previous block
+	uint32_t block; // logical block in directory
+};
+
+struct ext2_dx_countlimit
+{
+	uint16_t limit;
+	uint16_t count;
+};
+
+struct ext2_dx_root
+{
+	struct ext2_dx_fake_entry dot;
+	char dot_name[4];
+	struct ext2_dx_fake_entry dotdot;
+	char dotdot_name[4];
+	struct ext2_dx_root_info info;
+	struct ext2_dx_entry entries[];
+};
+
+struct ext2_dx_node
+{
+	struct ext2_dx_fake_entry fake;
+	struct ext2_dx_entry entries[];
+};
+
+#define DX_HASH_LEGACY 0
+#define DX_HASH_HALF_MD4 1
+#define DX_HASH_TEA 2
+// only in memory, on disk they are the signed ones and EXT2_FLAGS_UNSIGNED_HASH tells them apart
+#define DX_HASH_LEGACY_UNSIGNED 3
+#define DX_HASH_HALF_MD4_UNSIGNED 4
+#define DX_HASH_TEA_UNSIGNED 5
+
 enum
 {
 	EXT2_FT_UNKNOWN,
@@ -175,16 +286,40 @@ enum
 	EXT2_FT_MAX
 };
 
-static inline struct ext2_superblock *EXT2_SB(struct vfs_superblock *sb)
+// In-memory superblock, raw superblock goes first so it is written back as it is
+// group descriptor blocks are read at mount and bitmaps at first use, they stay pinned in buffer cache
+// (a reference is never dropped) and changes to them are written back by flusher like any dirty buffer
+struct ext2_sb_info
+{
+	struct ext2_superblock raw;
+	uint32_t s_groups_count;
+	struct buffer_head **s_group_desc;	  // descriptor blocks
+	struct buffer_head **s_block_bitmap;  // per group, NULL until it is needed
+	struct buffer_head **s_inode_bitmap;
+	uint32_t s_dirs_count;		 // directories of all groups
+	uint32_t s_next_dir_group;	 // where searching for a group of a top level directory starts
+};
+
+static inline struct ext2_sb_info *EXT2_SB_I(struct vfs_superblock *sb)
 {
 	return sb->s_fs_info;
 }
 
-static inline struct ext2_inode *EXT2_INODE(struct vfs_inode *inode)
+static inline struct ext2_superblock *EXT2_SB(struct vfs_superblock *sb)
+{
+	return &EXT2_SB_I(sb)->raw;
+}
+
+static inline struct ext2_inode_info *EXT2_I(struct vfs_inode *inode)
 {
 	return inode->i_fs_info;
 }
 
+static inline struct ext2_inode *EXT2_INODE(struct vfs_inode *inode)
+{
+	return &EXT2_I(inode)->raw;
+}
+
 #define EXT2_MIN_BLOCK_SIZE 1024
 #define EXT2_MAX_BLOCK_SIZE 4096
 
@@ -201,24 +336,47 @@ static inline struct ext2_inode *EXT2_INODE(struct vfs_inode *inode)
 extern struct vfs_super_operations ext2_super_operations;
 void init_ext2_fs();
 void exit_ext2_fs();
-char *ext2_bread_block(struct vfs_superblock *sb, uint32_t iblock);
-char *ext2_bread(struct vfs_superblock *sb, uint32_t iblock, uint32_t size);
-void ext2_bwrite_block(struct vfs_superblock *sb, uint32_t iblock, char *buf);
-void ext2_bwrite(struct vfs_superblock *sb, uint32_t iblock, char *buf, uint32_t size);
+struct buffer_head *ext2_bread_block(struct vfs_superblock *sb, uint32_t iblock);
+struct buffer_head *ext2_bread(struct vfs_superblock *sb, uint32_t iblock, uint32_t size);
+struct buffer_head *ext2_getblk(struct vfs_superblock *sb, uint32_t iblock);
 struct vfs_inode *ext2_alloc_inode(struct vfs_superblock *sb);
+struct ext2_inode_info *ext2_alloc_inode_info();
 void ext2_read_inode(struct vfs_inode *);
 void ext2_write_inode(struct vfs_inode *);
 struct ext2_group_desc *ext2_get_group_desc(struct vfs_superblock *sb, uint32_t block_group);
-void ext2_write_group_desc(struct vfs_superblock *sb, struct ext2_group_desc *gdp);
+void ext2_write_group_desc(struct vfs_superblock *sb, uint32_t group);
 
 // vfs_inode.c
 extern struct vfs_inode_operations ext2_dir_inode_operations;
 extern struct vfs_inode_operations ext2_file_inode_operations;
 extern struct vfs_inode_operations ext2_special_inode_operations;
-uint32_t ext2_create_block(struct vfs_superblock *sb);
+uint32_t ext2_create_block(struct vfs_inode *inode);
+
+// dir.c
+int ext2_find_entry(struct vfs_inode *dir, const char *name);
+int ext2_add_entry(struct vfs_inode *dir, const char *name, struct vfs_inode *inode);
+int ext2_delete_entry(struct vfs_inode *dir, const char *name);
+
+// hash.c
+uint32_t ext2_dirhash(const char *name, int len, int hash_version, const uint32_t seed[4]);
+
+// balloc.c
+uint32_t ext2_new_blocks(struct vfs_superblock *sb, uint32_t goal, uint32_t *count);
+void ext2_free_blocks(struct vfs_superblock *sb, uint32_t block, uint32_t count);
+uint32_t ext2_alloc_block(struct vfs_inode *inode, uint32_t goal);
+void ext2_discard_prealloc(struct vfs_inode *inode);
+struct buffer_head *ext2_block_bitmap(struct vfs_superblock *sb, uint32_t group);
+void ext2_balloc_init();
+
+// ialloc.c
+int ext2_new_inode(struct vfs_inode *dir, mode_t mode);
+void ext2_ialloc_init();
 
 // file.c
 extern struct vfs_file_operations ext2_file_operations;
+uint32_t ext2_bmap(struct vfs_inode *inode, uint32_t iblock);
+uint32_t ext2_get_block(struct vfs_inode *inode, uint32_t iblock, bool *new);
+void ext2_bmap_invalidate(struct vfs_inode *inode);
 extern struct vfs_file_operations ext2_dir_operations;
 extern struct vfs_file_operations def_chr_fops;
 
@@ -1,3 +1,4 @@
+#include <fs/block_dev.h>
 #include <fs/buffer.h>
 #include <fs/vfs.h>
 #include <include/errno.h>
@@ -10,52 +11,284 @@
 
 #include "ext2.h"
 
-static void ext2_read_nth_block(struct vfs_superblock *sb, uint32_t block, char **iter_buf, loff_t ppos, uint32_t *p, size_t count, int level)
+// readahead window grows from min to max (bytes), max is what one disk command can transfer
+#define EXT2_RA_MIN_SIZE 0x4000
+#define EXT2_RA_MAX_SIZE (BLK_MAX_SECTORS * BYTES_PER_SECTOR)
+
+// offsets of each level to reach logical block `iblock`, return depth (1 is direct block)
+static int ext2_block_to_path(struct vfs_superblock *sb, uint32_t iblock, uint32_t offsets[4])
+{
+	uint32_t ptrs = sb->s_blocksize / 4;
+
+	if (iblock < EXT2_INO_UPPER_LEVEL0)
+	{
+		offsets[0] = iblock;
+		return 1;
+	}
+	iblock -= EXT2_INO_UPPER_LEVEL0;
+	if (iblock < ptrs)
+	{
+		offsets[0] = EXT2_IND_BLOCK;
+		offsets[1] = iblock;
+		return 2;
+	}
+	iblock -= ptrs;
+	if (iblock < ptrs * ptrs)
+	{
+		offsets[0] = EXT2_DIND_BLOCK;
+		offsets[1] = iblock / ptrs;
+		offsets[2] = iblock % ptrs;
+		return 3;
+	}
+	iblock -= ptrs * ptrs;
+	offsets[0] = EXT2_TIND_BLOCK;
+	offsets[1] = iblock / (ptrs * ptrs);
+	offsets[2] = iblock / ptrs % ptrs;
+	offsets[3] = iblock % ptrs;
+	return 4;
+}
+
+static bool ext2_bmap_lookup(struct ext2_inode_info *info, uint32_t iblock, uint32_t *block)
+{
+	for (int i = 0; i < EXT2_BMAP_CACHE_SIZE; ++i)
+	{
+		struct ext2_extent *extent = &info->bmap_cache[i];
+		if (iblock - extent->lblock < extent->len)
+		{
+			*block = extent->pblock + (iblock - extent->lblock);
+			return true;
+		}
+	}
+	return false;
+}
+
+// `map` is direct blocks of inode or an indirect block (`nr` entries), entry at `index` is mapped
+// and the contiguous run around it becomes one extent
+static void ext2_bmap_insert(struct ext2_inode_info *info, uint32_t iblock, uint32_t *map, uint32_t index, uint32_t nr)
+{
+	uint32_t block = map[index];
+	uint32_t first = index, last = index;
+	while (first > 0 && map[first - 1] == block - (index - first + 1))
+		first--;
+	while (last + 1 < nr && map[last + 1] == block + (last + 1 - index))
+		last++;
+
+	struct ext2_extent *extent = &info->bmap_cache[info->bmap_next++ % EXT2_BMAP_CACHE_SIZE];
+	extent->lblock = iblock - (index - first);
+	extent->pblock = map[first];
+	extent->len = last - first + 1;
+}
+
+// called with bmap_lock held
+static uint32_t __ext2_bmap(struct vfs_inode *inode, uint32_t iblock)
+{
+	struct vfs_superblock *sb = inode->i_sb;
+	struct ext2_inode_info *info = EXT2_I(inode);
+	uint32_t block = 0;
+
+	if (ext2_bmap_lookup(info, iblock, &block))
+		return block;
+
+	uint32_t offsets[4];
+	int depth = ext2_block_to_path(sb, iblock, offsets);
+	uint32_t *map = info->raw.i_block;
+	uint32_t nr = EXT2_INO_UPPER_LEVEL0;
+	struct buffer_head *bh = NULL;
+	for (int i = 1; i < depth; ++i)
+	{
+		uint32_t next = map[offsets[i - 1]];
+		brelse(bh);
+		bh = next ? ext2_bread_block(sb, next) : NULL;
+		if (!bh)
+			return 0;
+		map = (uint32_t *)bh->b_data;
+		nr = sb->s_blocksize / 4;
+	}
+
+	block = map[offsets[depth - 1]];
+	if (block)
+		ext2_bmap_insert(info, iblock, map, offsets[depth - 1], nr);
+	brelse(bh);
+	return block;
+}
+
+// physical block of logical block `iblock` in file, 0 if it is a hole
+uint32_t ext2_bmap(struct vfs_inode *inode, uint32_t iblock)
+{
+	struct ext2_inode_info *info = EXT2_I(inode);
+
+	mutex_lock(&info->bmap_lock);
+	uint32_t block = __ext2_bmap(inode, iblock);
+	mutex_unlock(&info->bmap_lock);
+	return block;
+}
+
+// right after the block which precedes `iblock` in file, otherwise at the beginning of inode's group
+static uint32_t ext2_find_goal(struct vfs_inode *inode, uint32_t iblock)
+{
+	struct ext2_superblock *ext2_sb = EXT2_SB(inode->i_sb);
+	struct ext2_inode_info *info = EXT2_I(inode);
+
+	if (info->last_alloc_pblock && iblock == info->last_alloc_lblock + 1)
+		return info->last_alloc_pblock + 1;
+
+	uint32_t prev = iblock ? __ext2_bmap(inode, iblock - 1) : 0;
+	if (prev)
+		return prev + 1;
+
+	return get_group_from_inode(ext2_sb, inode->i_ino) * ext2_sb->s_blocks_per_group + ext2_sb->s_first_data_block;
+}
+
+// Like `__ext2_bmap` but missing indirect blocks and data block are allocated on the way (indirect ones are zeroed)
+// `*new` tells caller that data block has just been allocated and its disk content is garbage
+// raw inode is changed in memory, caller writes it back. Called with bmap_lock held, return 0 if disk is full
+uint32_t ext2_get_block(struct vfs_inode *inode, uint32_t iblock, bool *new)
+{
+	struct vfs_superblock *sb = inode->i_sb;
+	struct ext2_inode_info *info = EXT2_I(inode);
+
+	*new = false;
+	uint32_t block = __ext2_bmap(inode, iblock);
+	if (block)
+		return block;
+
+	uint32_t offsets[4];
+	int depth = ext2_block_to_path(sb, iblock, offsets);
+	uint32_t goal = ext2_find_goal(inode, iblock);
+	uint32_t *map = info->raw.i_block;
+	struct buffer_head *bh = NULL;
+	for (int i = 0; i < depth; ++i)
+	{
+		bool allocated = false;
+		block = map[offsets[i]];
+		if (!block)
+		{
+			block = ext2_alloc_block(inode, goal);
+			if (!block)
+				break;
+
+			map[offsets[i]] = block;
+			if (bh)
+				mark_buffer_dirty(bh);
+			inode->i_blocks += sb->s_blocksize / BYTES_PER_SECTOR;
+			goal = block + 1;
+			allocated = true;
+		}
+		if (i == depth - 1)
+		{
+			*new = allocated;
+			break;
+		}
+
+		brelse(bh);
+		if (allocated)
+		{
+			bh = ext2_getblk(sb, block);
+			memset(bh->b_data, 0, sb->s_blocksize);
+			mark_buffer_dirty(bh);
+		}
+		else
+			bh = ext2_bread_block(sb, block);
+		if (!bh)
+		{
+			block = 0;
+			break;
+		}
+		map = (uint32_t *)bh->b_data;
+	}
+	brelse(bh);
+
+	if (*new)
+	{
+		info->last_alloc_lblock = iblock;
+		info->last_alloc_pblock = block;
+	}
+	return block;
+}
+
+// mapping of file has changed (blocks are allocated or freed)
+void ext2_bmap_invalidate(struct vfs_inode *inode)
 {
-	assert(level <= 3);
+	struct ext2_inode_info *info = EXT2_I(inode);
 
-	if (level > 0)
+	mutex_lock(&info->bmap_lock);
+	memset(info->bmap_cache, 0, sizeof(info->bmap_cache));
+	mutex_unlock(&info->bmap_lock);
+}
+
+// Reading blocks [first, last] of file, if it continues the previous read and has reached the second half
+// of current window, the next window (twice as large) is submitted without waiting, so it is in flight
+// while the caller consumes current one. A random read collapses the window -> no readahead for it
+static void ext2_file_readahead(struct vfs_file *file, struct vfs_inode *inode, uint32_t first, uint32_t last)
+{
+	struct file_ra_state *ra = &file->f_ra;
+	struct vfs_superblock *sb = inode->i_sb;
+	// a small read can continue inside the block where the previous one has stopped
+	bool sequential = first == ra->next || (ra->next && first == ra->next - 1);
+	ra->next = last + 1;
+
+	if (!sequential)
 	{
-		uint32_t *block_buf = (uint32_t *)ext2_bread_block(sb, block);
-		for (uint32_t i = 0, times = sb->s_blocksize / 4; *p < ppos + count && i < times; ++i)
-			ext2_read_nth_block(sb, block_buf[i], iter_buf, ppos, p, count, level - 1);
+		ra->start = ra->size = 0;
+		return;
 	}
-	else
+	if (ra->size && last < ra->start + ra->size / 2)
+		return;
+
+	uint32_t nr_blocks = div_ceil(inode->i_size, sb->s_blocksize);
+	uint32_t start = max(ra->start + ra->size, last + 1);
+	if (start >= nr_blocks)
+		return;
+
+	uint32_t size = ra->size ? min_t(uint32_t, ra->size * 2, EXT2_RA_MAX_SIZE / sb->s_blocksize)
+							 : EXT2_RA_MIN_SIZE / sb->s_blocksize;
+	ra->start = start;
+	ra->size = min(size, nr_blocks - start);
+
+	for (uint32_t iblock = ra->start; iblock < ra->start + ra->size; ++iblock)
 	{
-		char *block_buf = ext2_bread_block(sb, block);
-		int32_t pstart = (ppos > *p) ? ppos - *p : 0;
-		uint32_t pend = ((ppos + count) < (*p + sb->s_blocksize)) ? (*p + sb->s_blocksize - ppos - count) : 0;
-		memcpy(*iter_buf, block_buf + pstart, sb->s_blocksize - pstart - pend);
-		ext2_bwrite_block(sb, block, block_buf);
-		*p += sb->s_blocksize;
-		*iter_buf += sb->s_blocksize - pstart - pend;
+		uint32_t block = ext2_bmap(inode, iblock);
+		if (block)
+			breadahead(sb->s_bdev, block * (sb->s_blocksize / BYTES_PER_SECTOR), sb->s_blocksize);
 	}
 }
 
 static ssize_t ext2_read_file(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
 {
 	struct vfs_inode *inode = file->f_dentry->d_inode;
-	struct ext2_inode *ei = EXT2_INODE(inode);
 	struct vfs_superblock *sb = inode->i_sb;
 
-	count = min_t(size_t, ppos + count, ei->i_size) - ppos;
-	uint32_t p = (ppos / sb->s_blocksize) * sb->s_blocksize;
+	if (ppos >= inode->i_size)
+		return 0;
+	count = min_t(size_t, ppos + count, inode->i_size) - ppos;
+	if (!count)
+		return 0;
+
+	uint32_t first = ppos / sb->s_blocksize;
+	uint32_t last = (ppos + count - 1) / sb->s_blocksize;
+	ext2_file_readahead(file, inode, first, last);
+
 	char *iter_buf = buf;
-	while (p < ppos + count)
+	for (uint32_t iblock = first; iblock <= last; ++iblock)
 	{
-		uint32_t relative_block = p / sb->s_blocksize;
-		if (relative_block < EXT2_INO_UPPER_LEVEL0)
-			ext2_read_nth_block(sb, ei->i_block[relative_block], &iter_buf, ppos, &p, count, 0);
-		else if (relative_block < EXT2_INO_UPPER_LEVEL1)
-			ext2_read_nth_block(sb, ei->i_block[12], &iter_buf, ppos, &p, count, 1);
-		else if (relative_block < EXT2_INO_UPPER_LEVEL2)
-			ext2_read_nth_block(sb, ei->i_block[13], &iter_buf, ppos, &p, count, 2);
-		else if (relative_block < EXT2_INO_UPPER_LEVEL3)
-			ext2_read_nth_block(sb, ei->i_block[14], &iter_buf, ppos, &p, count, 3);
+		uint32_t pstart = iblock == first ? ppos % sb->s_blocksize : 0;
+		uint32_t len = min_t(uint32_t, sb->s_blocksize - pstart, buf + count - iter_buf);
+		uint32_t block = ext2_bmap(inode, iblock);
+
+		struct buffer_head *bh = block ? ext2_bread_block(sb, block) : NULL;
+		if (block && !bh)
+			break;
+		if (bh)
+			memcpy(iter_buf, bh->b_data + pstart, len);
 		else
-			assert_not_reached();
+			memset(iter_buf, 0, len);
+		brelse(bh);
+		iter_buf += len;
 	}
 
+	count = iter_buf - buf;
+	if (!count)
+		return -EIO;
 	file->f_pos = ppos + count;
 	return count;
 }
@@ -63,69 +296,118 @@ static ssize_t ext2_read_file(struct vfs_file *file, char *buf, size_t count, lo
 static ssize_t ext2_write_file(struct vfs_file *file, const char *buf, size_t count, loff_t ppos)
 {
 	struct vfs_inode *inode = file->f_dentry->d_inode;
-	struct ext2_inode *ei = EXT2_INODE(inode);
+	struct ext2_inode_info *info = EXT2_I(inode);
 	struct vfs_superblock *sb = inode->i_sb;
 
-	if (ppos + count > inode->i_size)
-	{
-		inode->i_size = ppos + count;
-		inode->i_blocks = div_ceil(ppos + count, BYTES_PER_SECTOR);
-		sb->s_op->write_inode(inode);
-	}
+	if (!count)
+		return 0;
 
-	uint32_t p = (ppos / sb->s_blocksize) * sb->s_blocksize;
-	char *iter_buf = buf;
-	while (p < ppos + count)
+	uint32_t first = ppos / sb->s_blocksize;
+	uint32_t last = (ppos + count - 1) / sb->s_blocksize;
+	bool allocated = false;
+	const char *iter_buf = buf;
+	for (uint32_t iblock = first; iblock <= last; ++iblock)
 	{
-		uint32_t relative_block = p / sb->s_blocksize;
-		uint32_t block = 0;
-		// FIXME: MQ 2019-07-18 Only support direct blocks
-		if (relative_block < EXT2_INO_UPPER_LEVEL0)
-		{
-			block = ei->i_block[relative_block];
-			if (!block)
-			{
-				block = ext2_create_block(sb);
-				ei->i_block[relative_block] = block;
-				inode->i_mtime.tv_sec = get_seconds(NULL);
-				sb->s_op->write_inode(inode);
-			}
-		}
-		else
-			assert_not_reached("Only support direct blocks, fail writing at %d-nth block", relative_block);
-		char *block_buf = ext2_bread_block(sb, block);
-		uint32_t pstart = (ppos > p) ? ppos - p : 0;
-		uint32_t pend = ((ppos + count) < (p + sb->s_blocksize)) ? (p + sb->s_blocksize - ppos - count) : 0;
-		memcpy(block_buf + pstart, iter_buf, sb->s_blocksize - pstart - pend);
-		ext2_bwrite_block(sb, block, block_buf);
-		p += sb->s_blocksize;
-		iter_buf += sb->s_blocksize - pstart - pend;
+		uint32_t pstart = iblock == first ? ppos % sb->s_blocksize : 0;
+		uint32_t len = min_t(uint32_t, sb->s_blocksize - pstart, buf + count - iter_buf);
+
+		bool new;
+		mutex_lock(&info->bmap_lock);
+		uint32_t block = ext2_get_block(inode, iblock, &new);
+		mutex_unlock(&info->bmap_lock);
+		if (!block)
+			break;
+		allocated |= new;
+
+		// a block which is new or overwritten as a whole doesn't have to be read first
+		struct buffer_head *bh = (new || len == sb->s_blocksize) ? ext2_getblk(sb, block) : ext2_bread_block(sb, block);
+		if (!bh)
+			break;
+		if (new && len < sb->s_blocksize)
+			memset(bh->b_data, 0, sb->s_blocksize);
+		memcpy(bh->b_data + pstart, iter_buf, len);
+		mark_buffer_dirty(bh);
+		brelse(bh);
+		iter_buf += len;
 	}
 
+	count = iter_buf - buf;
+	if (!count)
+		return -ENOSPC;
+
+	// inode (size, blocks and block map) is written back by flusher
+	if (ppos + count > inode->i_size)
+		inode->i_size = ppos + count;
+	inode->i_mtime.tv_sec = get_seconds(NULL);
+	mark_inode_dirty(inode);
+	if (allocated)
+		ext2_bmap_invalidate(inode);
+	invalidate_inode_pages(inode);
+
 	file->f_pos = ppos + count;
 	return count;
 }
 
+// blocks reserved for file's growth go back to free ones
+static int ext2_release_file(struct vfs_inode *inode, struct vfs_file *file)
+{
+	ext2_discard_prealloc(inode);
+	return 0;
+}
+
+// Entries from f_pos as long as they fit in `count`, f_pos stops at the first one which doesn't fit
+// empty entries are skipped, index blocks of hash-indexed directory look like a block with one empty entry
 static int ext2_readdir(struct vfs_file *file, struct dirent *dirent, unsigned int count)
 {
-	char *buf = kcalloc(count, sizeof(char));
-	count = ext2_read_file(file, buf, count, file->f_pos);
+	struct vfs_inode *inode = file->f_dentry->d_inode;
+	struct vfs_superblock *sb = inode->i_sb;
 
 	int entries_size = 0;
 	struct dirent *idirent = dirent;
-	for (char *ibuf = buf; ibuf - buf < count;)
+	bool full = false;
+	while (!full && file->f_pos < inode->i_size)
 	{
-		struct ext2_dir_entry *entry = (struct ext2_dir_entry *)ibuf;
-		idirent->d_ino = entry->ino;
-		idirent->d_off = 0;
-		idirent->d_reclen = sizeof(struct dirent) + entry->name_len + 1;
-		idirent->d_type = entry->file_type;
-		memcpy(idirent->d_name, entry->name, entry->name_len);
-		idirent->d_name[entry->name_len] = 0;
-
-		entries_size += idirent->d_reclen;
-		ibuf += entry->rec_len;
-		idirent = (struct dirent *)((char *)idirent + idirent->d_reclen);
+		uint32_t iblock = file->f_pos / sb->s_blocksize;
+		uint32_t offset = file->f_pos % sb->s_blocksize;
+		if (!offset)
+			ext2_file_readahead(file, inode, iblock, iblock);
+
+		uint32_t block = ext2_bmap(inode, iblock);
+		struct buffer_head *bh = block ? ext2_bread_block(sb, block) : NULL;
+		if (block && !bh)
+			break;
+
+		while (bh && offset + EXT2_DIR_REC_LEN(0) <= sb->s_blocksize)
+		{
+			struct ext2_dir_entry *entry = (struct ext2_dir_entry *)(bh->b_data + offset);
+			if (entry->rec_len < EXT2_DIR_REC_LEN(0))
+				break;
+
+			if (entry->ino)
+			{
+				unsigned int reclen = sizeof(struct dirent) + entry->name_len + 1;
+				if (entries_size + reclen > count)
+				{
+					full = true;
+					break;
+				}
+
+				idirent->d_ino = entry->ino;
+				idirent->d_off = 0;
+				idirent->d_reclen = reclen;
+				idirent->d_type = entry->file_type;
+				memcpy(idirent->d_name, entry->name, entry->name_len);
+				idirent->d_name[entry->name_len] = 0;
+
+				entries_size += reclen;
+				idirent = (struct dirent *)((char *)idirent + reclen);
+			}
+			offset += entry->rec_len;
+		}
+		brelse(bh);
+
+		// a hole or a broken entry skips the rest of block
+		file->f_pos = full ? iblock * sb->s_blocksize + offset : (iblock + 1) * sb->s_blocksize;
 	}
 	return entries_size;
 }
@@ -154,6 +436,7 @@ struct vfs_file_operations ext2_file_operations = {
 	.read = ext2_read_file,
 	.write = ext2_write_file,
 	.mmap = ext2_mmap_file,
+	.release = ext2_release_file,
 };
 
 struct vfs_file_operations ext2_dir_operations = {
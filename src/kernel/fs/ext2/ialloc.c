@@ -0,0 +1,153 @@
+#include <fs/buffer.h>
+#include <fs/vfs.h>
+#include <include/errno.h>
+#include <locking/mutex.h>
+#include <utils/debug.h>
+#include <utils/math.h>
+
+#include "ext2.h"
+
+// inode bitmaps, inode and directory counts of group descriptors and superblock
+static struct mutex ialloc_lock;
+
+static struct buffer_head *ext2_inode_bitmap(struct vfs_superblock *sb, uint32_t group)
+{
+	struct ext2_sb_info *sbi = EXT2_SB_I(sb);
+	if (!sbi->s_inode_bitmap[group])
+		sbi->s_inode_bitmap[group] = ext2_bread_block(sb, ext2_get_group_desc(sb, group)->bg_inode_bitmap);
+	return sbi->s_inode_bitmap[group];
+}
+
+// Orlov allocator, a directory under root starts a new subtree -> it goes to a group which has more free inodes
+// and blocks than average and the fewest directories (search starts where the previous one has stopped, so they are spread)
+// a deeper directory stays in its parent's group unless that group has too many directories or is running out of space
+static int find_group_dir(struct vfs_superblock *sb, struct vfs_inode *parent)
+{
+	struct ext2_sb_info *sbi = EXT2_SB_I(sb);
+	struct ext2_superblock *ext2_sb = &sbi->raw;
+	uint32_t nr_groups = sbi->s_groups_count;
+	uint32_t avg_free_inodes = ext2_sb->s_free_inodes_count / nr_groups;
+	uint32_t avg_free_blocks = ext2_sb->s_free_blocks_count / nr_groups;
+	uint32_t parent_group = get_group_from_inode(ext2_sb, parent->i_ino);
+
+	if (parent->i_ino == EXT2_ROOT_INO)
+	{
+		int best = -1;
+		uint32_t best_dirs = UINT32_MAX;
+		for (uint32_t i = 0; i < nr_groups; ++i)
+		{
+			uint32_t group = (sbi->s_next_dir_group + i) % nr_groups;
+			struct ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
+			if (gdp->bg_free_inodes_count < avg_free_inodes || gdp->bg_free_blocks_count < avg_free_blocks)
+				continue;
+			if (gdp->bg_used_dirs_count < best_dirs)
+			{
+				best = group;
+				best_dirs = gdp->bg_used_dirs_count;
+			}
+		}
+		if (best >= 0)
+		{
+			sbi->s_next_dir_group = best + 1;
+			return best;
+		}
+	}
+	else
+	{
+		uint32_t max_dirs = sbi->s_dirs_count / nr_groups + ext2_sb->s_inodes_per_group / 16;
+		uint32_t min_inodes = max_t(int32_t, avg_free_inodes - ext2_sb->s_inodes_per_group / 4, 1);
+		uint32_t min_blocks = max_t(int32_t, avg_free_blocks - ext2_sb->s_blocks_per_group / 4, 1);
+		for (uint32_t i = 0; i < nr_groups; ++i)
+		{
+			uint32_t group = (parent_group + i) % nr_groups;
+			struct ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
+			if (gdp->bg_used_dirs_count < max_dirs && gdp->bg_free_inodes_count >= min_inodes &&
+				gdp->bg_free_blocks_count >= min_blocks)
+				return group;
+		}
+	}
+
+	for (uint32_t i = 0; i < nr_groups; ++i)
+	{
+		uint32_t group = (parent_group + i) % nr_groups;
+		if (ext2_get_group_desc(sb, group)->bg_free_inodes_count)
+			return group;
+	}
+	return -ENOSPC;
+}
+
+// a file goes next to its directory, otherwise to a group with free inodes and blocks (quadratic hash from parent's group)
+// and lastly to any group with a free inode
+static int find_group_other(struct vfs_superblock *sb, struct vfs_inode *parent)
+{
+	struct ext2_sb_info *sbi = EXT2_SB_I(sb);
+	struct ext2_superblock *ext2_sb = &sbi->raw;
+	uint32_t nr_groups = sbi->s_groups_count;
+	uint32_t group = get_group_from_inode(ext2_sb, parent->i_ino);
+
+	struct ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
+	if (gdp->bg_free_inodes_count && gdp->bg_free_blocks_count)
+		return group;
+
+	for (uint32_t i = 1; i < nr_groups; i <<= 1)
+	{
+		group = (group + i) % nr_groups;
+		gdp = ext2_get_group_desc(sb, group);
+		if (gdp->bg_free_inodes_count && gdp->bg_free_blocks_count)
+			return group;
+	}
+
+	group = get_group_from_inode(ext2_sb, parent->i_ino);
+	for (uint32_t i = 0; i < nr_groups; ++i)
+	{
+		if (ext2_get_group_desc(sb, (group + i) % nr_groups)->bg_free_inodes_count)
+			return (group + i) % nr_groups;
+	}
+	return -ENOSPC;
+}
+
+// allocate inode number for a new child of `dir`, bitmap and counts are updated, return -ENOSPC if there is none
+int ext2_new_inode(struct vfs_inode *dir, mode_t mode)
+{
+	struct vfs_superblock *sb = dir->i_sb;
+	struct ext2_sb_info *sbi = EXT2_SB_I(sb);
+	struct ext2_superblock *ext2_sb = &sbi->raw;
+
+	mutex_lock(&ialloc_lock);
+	int group = S_ISDIR(mode) ? find_group_dir(sb, dir) : find_group_other(sb, dir);
+	if (group < 0)
+	{
+		mutex_unlock(&ialloc_lock);
+		return group;
+	}
+
+	struct buffer_head *bh = ext2_inode_bitmap(sb, group);
+	unsigned char *bitmap = (unsigned char *)bh->b_data;
+	uint32_t relative_inode = 0;
+	while (relative_inode < ext2_sb->s_inodes_per_group && (bitmap[relative_inode / 8] & (1 << (relative_inode % 8))))
+		relative_inode++;
+	// free count and bitmap disagree
+	assert(relative_inode < ext2_sb->s_inodes_per_group);
+
+	bitmap[relative_inode / 8] |= 1 << (relative_inode % 8);
+	mark_buffer_dirty(bh);
+
+	struct ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
+	gdp->bg_free_inodes_count -= 1;
+	if (S_ISDIR(mode))
+	{
+		gdp->bg_used_dirs_count += 1;
+		sbi->s_dirs_count += 1;
+	}
+	ext2_write_group_desc(sb, group);
+	ext2_sb->s_free_inodes_count -= 1;
+	sb->s_op->write_super(sb);
+	mutex_unlock(&ialloc_lock);
+
+	return group * ext2_sb->s_inodes_per_group + relative_inode + EXT2_STARTING_INO;
+}
+
+void ext2_ialloc_init()
+{
+	mutex_init(&ialloc_lock);
+}
@@ -1,4 +1,4 @@
-#include <devices/ata.h>
+#include <fs/block_dev.h>
 #include <fs/buffer.h>
 #include <fs/vfs.h>
 #include <include/errno.h>
@@ -10,52 +10,69 @@
 
 #include "ext2.h"
 
+// descriptors stay in memory (their blocks are pinned in buffer cache since mount)
 struct ext2_group_desc *ext2_get_group_desc(struct vfs_superblock *sb, uint32_t group)
 {
-	struct ext2_group_desc *gdp = kcalloc(1, sizeof(struct ext2_group_desc));
-	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
-	uint32_t block = ext2_sb->s_first_data_block + 1 + group / EXT2_GROUPS_PER_BLOCK(ext2_sb);
-	char *group_block_buf = ext2_bread_block(sb, block);
-	uint32_t offset = group % EXT2_GROUPS_PER_BLOCK(ext2_sb) * sizeof(struct ext2_group_desc);
-	memcpy(gdp, group_block_buf + offset, sizeof(struct ext2_group_desc));
-	return gdp;
+	struct ext2_sb_info *sbi = EXT2_SB_I(sb);
+	struct ext2_superblock *ext2_sb = &sbi->raw;
+	assert(group < sbi->s_groups_count);
+
+	struct buffer_head *bh = sbi->s_group_desc[group / EXT2_GROUPS_PER_BLOCK(ext2_sb)];
+	return (struct ext2_group_desc *)bh->b_data + group % EXT2_GROUPS_PER_BLOCK(ext2_sb);
 }
 
-void ext2_write_group_desc(struct vfs_superblock *sb, struct ext2_group_desc *gdp)
+// descriptor has been changed in place, it is written back with its block by flusher
+void ext2_write_group_desc(struct vfs_superblock *sb, uint32_t group)
 {
-	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
-	uint32_t group = get_group_from_block(ext2_sb, gdp->bg_block_bitmap);
-	uint32_t block = ext2_sb->s_first_data_block + 1 + group / EXT2_GROUPS_PER_BLOCK(ext2_sb);
-	uint32_t offset = group % EXT2_GROUPS_PER_BLOCK(ext2_sb) * sizeof(struct ext2_group_desc);
-	char *group_block_buf = ext2_bread_block(sb, block);
-	memcpy(group_block_buf + offset, gdp, sizeof(struct ext2_group_desc));
-	ext2_bwrite_block(sb, block, group_block_buf);
+	struct ext2_sb_info *sbi = EXT2_SB_I(sb);
+	struct ext2_superblock *ext2_sb = &sbi->raw;
+	mark_buffer_dirty(sbi->s_group_desc[group / EXT2_GROUPS_PER_BLOCK(ext2_sb)]);
+}
+
+struct ext2_inode_info *ext2_alloc_inode_info()
+{
+	struct ext2_inode_info *info = kcalloc(1, sizeof(struct ext2_inode_info));
+	mutex_init(&info->bmap_lock);
+	return info;
 }
 
-static struct ext2_inode *ext2_get_inode(struct vfs_superblock *sb, ino_t ino)
+// inode table block can be evicted from buffer cache -> vfs inode keeps its own copy of raw inode
+static struct ext2_inode_info *ext2_get_inode(struct vfs_superblock *sb, ino_t ino)
 {
 	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
 	uint32_t group = get_group_from_inode(ext2_sb, ino);
 	struct ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
 	uint32_t block = gdp->bg_inode_table + get_relative_inode_in_group(ext2_sb, ino) / EXT2_INODES_PER_BLOCK(ext2_sb);
 	uint32_t offset = (get_relative_inode_in_group(ext2_sb, ino) % EXT2_INODES_PER_BLOCK(ext2_sb)) * sizeof(struct ext2_inode);
-	char *table_buf = ext2_bread_block(sb, block);
 
-	return (struct ext2_inode *)(table_buf + offset);
+	struct ext2_inode_info *info = ext2_alloc_inode_info();
+	struct buffer_head *bh = ext2_bread_block(sb, block);
+	memcpy(&info->raw, bh->b_data + offset, sizeof(struct ext2_inode));
+	brelse(bh);
+
+	return info;
 }
 
 struct vfs_inode *ext2_alloc_inode(struct vfs_superblock *sb)
 {
 	struct vfs_inode *i = init_inode();
 	i->i_sb = sb;
-	atomic_set(&i->i_count, 0);
 
 	return i;
 }
 
+// inode is not cached anymore (evicted or the last reference of unlinked one is gone)
+static void ext2_destroy_inode(struct vfs_inode *i)
+{
+	ext2_discard_prealloc(i);
+	kfree(i->i_fs_info);
+	kfree(i);
+}
+
 void ext2_read_inode(struct vfs_inode *i)
 {
-	struct ext2_inode *raw_node = ext2_get_inode(i->i_sb, i->i_ino);
+	struct ext2_inode_info *info = ext2_get_inode(i->i_sb, i->i_ino);
+	struct ext2_inode *raw_node = &info->raw;
 
 	i->i_mode = raw_node->i_mode;
 	i->i_gid = raw_node->i_gid;
@@ -71,7 +88,7 @@ void ext2_read_inode(struct vfs_inode *i)
 	i->i_blksize = PMM_FRAME_SIZE; /* This is the optimal IO size (for stat), not the fs block size */
 	i->i_blocks = raw_node->i_blocks;
 	i->i_flags = raw_node->i_flags;
-	i->i_fs_info = raw_node;
+	i->i_fs_info = info;
 
 	if (S_ISREG(i->i_mode))
 	{
@@ -115,39 +132,68 @@ void ext2_write_inode(struct vfs_inode *i)
 	struct ext2_group_desc *gdp = ext2_get_group_desc(i->i_sb, group);
 	uint32_t block = gdp->bg_inode_table + get_relative_inode_in_group(ext2_sb, i->i_ino) / EXT2_INODES_PER_BLOCK(ext2_sb);
 	uint32_t offset = (get_relative_inode_in_group(ext2_sb, i->i_ino) % EXT2_INODES_PER_BLOCK(ext2_sb)) * sizeof(struct ext2_inode);
-	char *buf = ext2_bread_block(i->i_sb, block);
 
-	memcpy(buf + offset, ei, sizeof(struct ext2_inode));
-	ext2_bwrite_block(i->i_sb, block, buf);
+	struct buffer_head *bh = ext2_bread_block(i->i_sb, block);
+	memcpy(bh->b_data + offset, ei, sizeof(struct ext2_inode));
+	mark_buffer_dirty(bh);
+	brelse(bh);
+}
+
+// superblock is always at byte 1024 whatever block size is
+static struct buffer_head *ext2_bread_super(struct vfs_superblock *sb)
+{
+	return bread(sb->s_bdev, EXT2_MIN_BLOCK_SIZE / BYTES_PER_SECTOR, EXT2_MIN_BLOCK_SIZE);
 }
 
 static void ext2_write_super(struct vfs_superblock *sb)
 {
-	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
-	ext2_bwrite_block(sb, ext2_sb->s_first_data_block, (char *)ext2_sb);
+	struct buffer_head *bh = ext2_bread_super(sb);
+	memcpy(bh->b_data, EXT2_SB(sb), sizeof(struct ext2_superblock));
+	mark_buffer_dirty(bh);
+	brelse(bh);
 }
 
 struct vfs_super_operations ext2_super_operations = {
 	.alloc_inode = ext2_alloc_inode,
 	.read_inode = ext2_read_inode,
 	.write_inode = ext2_write_inode,
+	.destroy_inode = ext2_destroy_inode,
 	.write_super = ext2_write_super,
 };
 
 static int ext2_fill_super(struct vfs_superblock *sb)
 {
-	struct ext2_superblock *ext2_sb = (struct ext2_superblock *)kcalloc(1, sizeof(struct ext2_superblock));
-	char *buf = ext2_bread_block(sb, 1);
-	memcpy(ext2_sb, (struct ext2_superblock *)buf, sb->s_blocksize);
+	struct ext2_sb_info *sbi = kcalloc(1, sizeof(struct ext2_sb_info));
+	struct ext2_superblock *ext2_sb = &sbi->raw;
+	struct buffer_head *bh = ext2_bread_super(sb);
+	memcpy(ext2_sb, bh->b_data, sizeof(struct ext2_superblock));
+	brelse(bh);
 
 	if (ext2_sb->s_magic != EXT2_SUPER_MAGIC)
+	{
+		kfree(sbi);
 		return -EINVAL;
+	}
 
-	sb->s_fs_info = ext2_sb;
+	sb->s_fs_info = sbi;
 	sb->s_op = &ext2_super_operations;
 	sb->s_blocksize = EXT2_BLOCK_SIZE(ext2_sb);
 	sb->s_blocksize_bits = ext2_sb->s_log_block_size;
 	sb->s_magic = EXT2_SUPER_MAGIC;
+
+	// descriptor table follows superblock's block
+	sbi->s_groups_count = div_ceil(ext2_sb->s_blocks_count - ext2_sb->s_first_data_block, ext2_sb->s_blocks_per_group);
+	uint32_t nr_desc_blocks = div_ceil(sbi->s_groups_count, EXT2_GROUPS_PER_BLOCK(ext2_sb));
+	sbi->s_group_desc = kcalloc(nr_desc_blocks, sizeof(struct buffer_head *));
+	for (uint32_t i = 0; i < nr_desc_blocks; ++i)
+	{
+		sbi->s_group_desc[i] = ext2_bread_block(sb, ext2_sb->s_first_data_block + 1 + i);
+		assert(sbi->s_group_desc[i]);
+	}
+	sbi->s_block_bitmap = kcalloc(sbi->s_groups_count, sizeof(struct buffer_head *));
+	sbi->s_inode_bitmap = kcalloc(sbi->s_groups_count, sizeof(struct buffer_head *));
+	for (uint32_t group = 0; group < sbi->s_groups_count; ++group)
+		sbi->s_dirs_count += ext2_get_group_desc(sb, group)->bg_used_dirs_count;
 	return 0;
 }
 
@@ -157,12 +203,12 @@ static struct vfs_mount *ext2_mount(struct vfs_file_system_type *fs_type,
 	struct vfs_superblock *sb = (struct vfs_superblock *)kcalloc(1, sizeof(struct vfs_superblock));
 	sb->s_blocksize = EXT2_MIN_BLOCK_SIZE;
 	sb->mnt_devname = strdup(dev_name);
+	sb->s_bdev = get_blkdev(dev_name);
+	assert(sb->s_bdev);
 	sb->s_type = fs_type;
 	ext2_fill_super(sb);
 
-	struct vfs_inode *i_root = ext2_alloc_inode(sb);
-	i_root->i_ino = EXT2_ROOT_INO;
-	ext2_read_inode(i_root);
+	struct vfs_inode *i_root = iget(sb, EXT2_ROOT_INO);
 
 	struct vfs_dentry *d_root = alloc_dentry(NULL, dir_name);
 	d_root->d_inode = i_root;
@@ -185,6 +231,8 @@ struct vfs_file_system_type ext2_fs_type = {
 
 void init_ext2_fs()
 {
+	ext2_balloc_init();
+	ext2_ialloc_init();
 	register_filesystem(&ext2_fs_type);
 }
 
@@ -193,22 +241,21 @@ void exit_ext2_fs()
 	unregister_filesystem(&ext2_fs_type);
 }
 
-char *ext2_bread_block(struct vfs_superblock *sb, uint32_t block)
+struct buffer_head *ext2_bread_block(struct vfs_superblock *sb, uint32_t block)
 {
 	return ext2_bread(sb, block, sb->s_blocksize);
 }
 
-char *ext2_bread(struct vfs_superblock *sb, uint32_t block, uint32_t size)
-{
-	return bread(sb->mnt_devname, block * (sb->s_blocksize / BYTES_PER_SECTOR), size);
-}
-
-void ext2_bwrite_block(struct vfs_superblock *sb, uint32_t block, char *buf)
+struct buffer_head *ext2_bread(struct vfs_superblock *sb, uint32_t block, uint32_t size)
 {
-	return ext2_bwrite(sb, block, buf, sb->s_blocksize);
+	return bread(sb->s_bdev, block * (sb->s_blocksize / BYTES_PER_SECTOR), size);
 }
 
-void ext2_bwrite(struct vfs_superblock *sb, uint32_t block, char *buf, uint32_t size)
+// block is going to be overwritten as a whole, its disk content is not read
+// (a read in flight would overwrite new content when it completes -> it is waited for)
+struct buffer_head *ext2_getblk(struct vfs_superblock *sb, uint32_t block)
 {
-	return bwrite(sb->mnt_devname, block * (sb->s_blocksize / BYTES_PER_SECTOR), buf, size);
+	struct buffer_head *bh = getblk(sb->s_bdev, block * (sb->s_blocksize / BYTES_PER_SECTOR), sb->s_blocksize);
+	wait_on_buffer(bh);
+	return bh;
 }
@@ -13,9 +13,8 @@ int do_fcntl(int fd, int cmd, unsigned long arg)
 	switch (cmd)
 	{
 	case F_DUPFD:
-		if ((ret = find_unused_fd_slot(arg)) < 0)
-			return -EMFILE;
-		current_process->files->fd[ret] = filp;
+		if ((ret = install_fd(filp, arg)) < 0)
+			return ret;
 		break;
 	case F_GETFD:
 		ret = filp->f_flags;
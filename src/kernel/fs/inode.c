@@ -0,0 +1,252 @@
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <proc/wait.h>
+#include <utils/debug.h>
+
+#include "vfs.h"
+
+#define INODE_HASH_SIZE 256
+// unused inodes are destroyed above this number, referenced ones are not counted
+#define INODE_UNUSED_MAX 1024
+
+static struct list_head inode_hash[INODE_HASH_SIZE];
+// least recently used is at the head
+static LIST_HEAD(unused_inodes);
+// oldest is at the head
+static LIST_HEAD(dirty_inodes);
+// protects hash, lists, i_state and i_count dropping to zero, it is never held while doing io
+static struct mutex inode_lock;
+// waiters for I_NEW or I_FREEING to be cleared
+static struct wait_queue_head inode_wait;
+static atomic_t last_ino;
+struct inode_stat inode_stat;
+
+static uint32_t inode_hashfn(struct vfs_superblock *sb, unsigned long ino)
+{
+	return (((uint32_t)sb >> 4) ^ ino) % INODE_HASH_SIZE;
+}
+
+static struct vfs_inode *find_inode(struct vfs_superblock *sb, unsigned long ino)
+{
+	struct vfs_inode *iter;
+	list_for_each_entry(iter, &inode_hash[inode_hashfn(sb, ino)], i_hash)
+	{
+		if (iter->i_sb == sb && iter->i_ino == ino)
+			return iter;
+	}
+	return NULL;
+}
+
+static void wait_on_inode(struct vfs_inode *inode)
+{
+	DEFINE_WAIT(wait);
+	while (true)
+	{
+		prepare_to_wait(&inode_wait, &wait);
+		if (!(inode->i_state & I_NEW))
+			break;
+		schedule();
+	}
+	finish_wait(&inode_wait, &wait);
+}
+
+static void destroy_inode(struct vfs_inode *inode)
+{
+	invalidate_inode_pages(inode);
+	if (inode->i_sb->s_op->destroy_inode)
+		inode->i_sb->s_op->destroy_inode(inode);
+	else
+		kfree(inode);
+}
+
+// take a reference of cached inode or read it from disk, concurrent `iget`s of the same inode read it once
+struct vfs_inode *iget(struct vfs_superblock *sb, unsigned long ino)
+{
+	struct vfs_inode *inode;
+
+	while (true)
+	{
+		mutex_lock(&inode_lock);
+		inode = find_inode(sb, ino);
+		if (!inode || !(inode->i_state & I_FREEING))
+			break;
+
+		// it is unhashed (and the waker takes inode_lock) before waking up -> wakeup is not missed
+		DEFINE_WAIT(wait);
+		prepare_to_wait(&inode_wait, &wait);
+		mutex_unlock(&inode_lock);
+		schedule();
+		finish_wait(&inode_wait, &wait);
+	}
+
+	if (inode)
+	{
+		if (!atomic_read(&inode->i_count))
+		{
+			list_del_init(&inode->i_lru);
+			inode_stat.nr_unused--;
+		}
+		atomic_inc(&inode->i_count);
+		inode_stat.nr_hits++;
+		mutex_unlock(&inode_lock);
+
+		wait_on_inode(inode);
+		return inode;
+	}
+
+	inode = sb->s_op->alloc_inode(sb);
+	inode->i_ino = ino;
+	inode->i_state = I_NEW;
+	list_add(&inode->i_hash, &inode_hash[inode_hashfn(sb, ino)]);
+	inode_stat.nr_inodes++;
+	inode_stat.nr_misses++;
+	mutex_unlock(&inode_lock);
+
+	sb->s_op->read_inode(inode);
+
+	mutex_lock(&inode_lock);
+	inode->i_state &= ~I_NEW;
+	wake_up_all(&inode_wait);
+	mutex_unlock(&inode_lock);
+	return inode;
+}
+
+// caller already has a reference (e.g. from dentry)
+void ihold(struct vfs_inode *inode)
+{
+	atomic_inc(&inode->i_count);
+}
+
+// the last reference of a cached inode puts it into unused list, if it has no links or list is full
+// the inode (or the least recently used one) is written back and destroyed. Inodes which are not in cache
+// (pipes, sockets) belong to their creator
+void iput(struct vfs_inode *inode)
+{
+	if (!inode)
+		return;
+
+	mutex_lock(&inode_lock);
+	assert(atomic_read(&inode->i_count) > 0);
+	atomic_dec(&inode->i_count);
+	if (atomic_read(&inode->i_count) || list_empty(&inode->i_hash))
+	{
+		mutex_unlock(&inode_lock);
+		return;
+	}
+
+	if (inode->i_nlink)
+	{
+		list_add_tail(&inode->i_lru, &unused_inodes);
+		inode_stat.nr_unused++;
+		if (inode_stat.nr_unused <= INODE_UNUSED_MAX)
+		{
+			mutex_unlock(&inode_lock);
+			return;
+		}
+
+		inode = list_first_entry(&unused_inodes, struct vfs_inode, i_lru);
+		list_del_init(&inode->i_lru);
+		inode_stat.nr_unused--;
+	}
+
+	bool dirty = inode->i_state & I_DIRTY;
+	if (dirty)
+		list_del_init(&inode->i_dirty);
+	inode->i_state = I_FREEING;
+	mutex_unlock(&inode_lock);
+
+	if (dirty)
+	{
+		inode->i_sb->s_op->write_inode(inode);
+		inode_stat.nr_writebacks++;
+	}
+
+	mutex_lock(&inode_lock);
+	list_del_init(&inode->i_hash);
+	inode_stat.nr_inodes--;
+	inode_stat.nr_evictions++;
+	wake_up_all(&inode_wait);
+	mutex_unlock(&inode_lock);
+
+	destroy_inode(inode);
+}
+
+// new inode (just created by filesystem) which has been set up
+void insert_inode_hash(struct vfs_inode *inode)
+{
+	mutex_lock(&inode_lock);
+	list_add(&inode->i_hash, &inode_hash[inode_hashfn(inode->i_sb, inode->i_ino)]);
+	inode_stat.nr_inodes++;
+	mutex_unlock(&inode_lock);
+}
+
+// inode is written back by flusher (or when it is evicted), the one which is not cached is written right away
+void mark_inode_dirty(struct vfs_inode *inode)
+{
+	if (!inode->i_sb || !inode->i_sb->s_op->write_inode)
+		return;
+
+	mutex_lock(&inode_lock);
+	if (list_empty(&inode->i_hash))
+	{
+		mutex_unlock(&inode_lock);
+		inode->i_sb->s_op->write_inode(inode);
+		return;
+	}
+
+	if (!(inode->i_state & I_DIRTY))
+	{
+		inode->i_state |= I_DIRTY;
+		list_add_tail(&inode->i_dirty, &dirty_inodes);
+	}
+	mutex_unlock(&inode_lock);
+}
+
+// inode numbers of filesystems without backing store
+unsigned long get_next_ino()
+{
+	int ino;
+	do
+	{
+		ino = atomic_read(&last_ino);
+	} while (atomic_cmpxchg(&last_ino, ino, ino + 1) != ino);
+	return ino + 1;
+}
+
+// write every dirty inode into its buffer, buffers are written back by flusher
+void sync_inodes()
+{
+	while (true)
+	{
+		mutex_lock(&inode_lock);
+		struct vfs_inode *inode = list_first_entry_or_null(&dirty_inodes, struct vfs_inode, i_dirty);
+		if (!inode)
+		{
+			mutex_unlock(&inode_lock);
+			break;
+		}
+
+		list_del_init(&inode->i_dirty);
+		inode->i_state &= ~I_DIRTY;
+		// reference keeps it from being evicted while it is written
+		if (!atomic_read(&inode->i_count))
+		{
+			list_del_init(&inode->i_lru);
+			inode_stat.nr_unused--;
+		}
+		atomic_inc(&inode->i_count);
+		mutex_unlock(&inode_lock);
+
+		inode->i_sb->s_op->write_inode(inode);
+		inode_stat.nr_writebacks++;
+		iput(inode);
+	}
+}
+
+void inode_init()
+{
+	for (int i = 0; i < INODE_HASH_SIZE; ++i)
+		INIT_LIST_HEAD(&inode_hash[i]);
+	mutex_init(&inode_lock);
+	INIT_LIST_HEAD(&inode_wait.list);
+}
@@ -12,8 +12,7 @@ static int mqueue_file_open(struct vfs_inode *inode, struct vfs_file *file)
 	if (!mq)
 	{
 		mq = kcalloc(1, sizeof(struct message_queue));
-		INIT_LIST_HEAD(&mq->senders);
-		INIT_LIST_HEAD(&mq->receivers);
+		mutex_init(&mq->lock);
 		INIT_LIST_HEAD(&mq->messages);
 		INIT_LIST_HEAD(&mq->wait.list);
 
@@ -29,7 +28,8 @@ static unsigned int mqueue_file_poll(struct vfs_file *file, struct poll_table *p
 {
 	struct message_queue *mq = (struct message_queue *)file->private_data;
 	poll_wait(file, &mq->wait, pt);
-	return (!list_empty(&mq->messages) ? POLLIN : 0) | POLLOUT;
+	bool full = mq->attr && mq->attr->mq_curmsgs >= mq->attr->mq_maxmsg;
+	return (!list_empty(&mq->messages) ? POLLIN : 0) | (!full ? POLLOUT : 0);
 }
 
 struct vfs_file_operations mqueuefs_file_operations = {
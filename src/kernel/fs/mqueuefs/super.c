@@ -53,7 +53,6 @@ static struct vfs_inode *mqueuefs_alloc_inode(struct vfs_superblock *sb)
 {
 	struct vfs_inode *inode = init_inode();
 	inode->i_sb = sb;
-	atomic_set(&inode->i_count, 0);
 
 	return inode;
 }
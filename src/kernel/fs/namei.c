@@ -51,7 +51,8 @@ int vfs_unlink(const char *path, int flag)
 	int ret = vfs_open(abs_path, O_RDONLY);
 	if (ret >= 0)
 	{
-		struct vfs_file *file = current_process->files->fd[ret];
+		int fd = ret;
+		struct vfs_file *file = current_process->files->fd[fd];
 		if (!file)
 			ret = -EBADF;
 		else if (flag & AT_REMOVEDIR && file->f_dentry->d_inode->i_mode & S_IFREG)
@@ -61,9 +62,10 @@ int vfs_unlink(const char *path, int flag)
 			struct vfs_inode *dir = file->f_dentry->d_parent->d_inode;
 			if (dir->i_op && dir->i_op->unlink)
 				ret = dir->i_op->unlink(dir, file->f_dentry);
-			list_del(&file->f_dentry->d_sibling);
+			// dentry (and its inode reference) is freed when our fd is closed
+			d_drop(file->f_dentry);
 		}
-		vfs_close(ret);
+		vfs_close(fd);
 	}
 
 	if (abs_path != path)
@@ -87,6 +89,7 @@ int vfs_rename(const char *oldpath, const char *newpath)
 	struct vfs_dentry *old_dentry = oldfilp->f_dentry;
 	struct vfs_inode *old_dir = old_dentry->d_parent->d_inode;
 
+	int ret = 0;
 	mode_t old_mode = old_dentry->d_inode->i_mode;
 	newfd = vfs_open(abs_newpath, O_RDONLY);
 	if (newfd >= 0)
@@ -99,16 +102,24 @@ int vfs_rename(const char *oldpath, const char *newpath)
 		struct vfs_dentry *new_dentry = newfilp->f_dentry;
 		mode_t new_mode = newfilp->f_dentry->d_inode->i_mode;
 
+		bool same = (S_ISREG(old_mode) == S_ISREG(new_mode) && old_stat.st_ino == new_stat.st_ino) ||
+					(S_ISCHR(old_mode) == S_ISCHR(new_mode) && old_stat.st_rdev == new_stat.st_rdev) ||
+					(S_ISSOCK(old_mode) == S_ISSOCK(new_mode) && SOCKET_I(old_dentry->d_inode) == SOCKET_I(new_dentry->d_inode));
+		vfs_close(newfd);
+
 		if (!S_ISDIR(old_mode) && S_ISDIR(new_mode))
-			return -EISDIR;
+			ret = -EISDIR;
 		else if (S_ISDIR(old_mode) && !S_ISDIR(new_mode))
-			return -ENOTDIR;
-		else if ((S_ISREG(old_mode) == S_ISREG(new_mode) && old_stat.st_ino == new_stat.st_ino) ||
-				 (S_ISCHR(old_mode) == S_ISCHR(new_mode) && old_stat.st_rdev == new_stat.st_rdev) ||
-				 (S_ISSOCK(old_mode) == S_ISSOCK(new_mode) && SOCKET_I(old_dentry->d_inode) == SOCKET_I(new_dentry->d_inode)))
-			return 0;
+			ret = -ENOTDIR;
+		else if (same)
+			ret = 1;
 		else if (S_ISDIR(old_mode) && S_ISDIR(new_mode) && new_stat.st_size > 0)
-			return -ENOTEMPTY;
+			ret = -ENOTEMPTY;
+		if (ret)
+		{
+			vfs_close(oldfd);
+			return ret < 0 ? ret : 0;
+		}
 
 		vfs_unlink(abs_newpath, 0);
 	}
@@ -119,12 +130,13 @@ int vfs_rename(const char *oldpath, const char *newpath)
 	if (!new_dirpath)
 		new_dirpath = "/";
 
-	int ret = 0;
 	struct nameidata nd;
+	struct vfs_dentry *new_dentry = NULL;
 	if ((ret = path_walk(&nd, new_dirpath, O_RDONLY, S_IFDIR)) >= 0)
 	{
 		struct vfs_inode *new_dir = nd.dentry->d_inode;
-		struct vfs_dentry *new_dentry = alloc_dentry(nd.dentry, new_filename);
+		new_dentry = alloc_dentry(nd.dentry, new_filename);
+		dput(nd.dentry);
 
 		if (oldfilp->f_vfsmnt != nd.mnt)
 			ret = -EXDEV;
@@ -136,9 +148,13 @@ int vfs_rename(const char *oldpath, const char *newpath)
 
 	if (ret >= 0)
 	{
+		// new dentry shares the inode, old one is dropped by unlink
+		ihold(old_dentry->d_inode);
+		d_add(new_dentry, old_dentry->d_inode);
 		vfs_unlink(abs_oldpath, 0);
-		list_del(&old_dentry->d_sibling);
 	}
+	dput(new_dentry);
+	vfs_close(oldfd);
 
 	kfree(new_dirpath);
 	kfree(new_filename);
@@ -150,7 +166,5 @@ int generic_memory_rename(struct vfs_inode *old_dir, struct vfs_dentry *old_dent
 						  struct vfs_inode *new_dir, struct vfs_dentry *new_dentry)
 {
 	new_dentry->d_inode = old_dentry->d_inode;
-	list_add_tail(&new_dentry->d_sibling, &new_dentry->d_parent->d_subdirs);
-
 	return 0;
 }
@@ -1,4 +1,5 @@
 #include <fs/buffer.h>
+#include <fs/eventpoll.h>
 #include <include/errno.h>
 #include <include/limits.h>
 #include <memory/vmm.h>
@@ -8,31 +9,67 @@
 
 #include "vfs.h"
 
-struct vfs_dentry *alloc_dentry(struct vfs_dentry *parent, char *name)
+/*
+ * Looking up a name which is not in dentry cache goes to filesystem and might sleep on disk io
+ * -> parent's i_mutex serializes it (other walkers keep using cache), a name which is not found is cached as negative dentry
+ * `nd->dentry` is replaced by a referenced child, caller puts the parent
+ */
+static int d_lookup_slow(struct nameidata *nd, char *name, bool is_last, int32_t flags, mode_t mode)
 {
-	struct vfs_dentry *d = kcalloc(1, sizeof(struct vfs_dentry));
-	d->d_name = strdup(name);
-	d->d_parent = parent;
-	INIT_LIST_HEAD(&d->d_subdirs);
+	struct vfs_inode *dir = nd->dentry->d_inode;
+	int ret = 0;
+
+	mutex_lock(&dir->i_mutex);
+
+	// someone else might have added it while we were waiting
+	struct vfs_dentry *d_child = d_lookup(nd->dentry, name);
+	if (!d_child)
+	{
+		d_child = alloc_dentry(nd->dentry, name);
+		struct vfs_inode *inode = NULL;
+		if (dir->i_op->lookup)
+			inode = dir->i_op->lookup(dir, d_child);
+		d_add(d_child, inode);
+	}
+	else if (d_child->d_inode && is_last && flags & O_CREAT && flags & O_EXCL)
+		ret = -EEXIST;
+
+	if (!d_child->d_inode)
+	{
+		if (is_last && flags & O_CREAT)
+		{
+			struct vfs_inode *inode = dir->i_op->create ? dir->i_op->create(dir, d_child, mode) : NULL;
+			if (inode)
+				d_instantiate(d_child, inode);
+			else
+				ret = -ENOSPC;
+		}
+		else
+			ret = -ENOENT;
+	}
 
-	if (parent)
-		d->d_sb = parent->d_sb;
+	if (ret < 0)
+		dput(d_child);
+	else
+		nd->dentry = d_child;
 
-	return d;
+	mutex_unlock(&dir->i_mutex);
+	return ret;
 }
 
+// `nd->dentry` is referenced on success, caller puts it
 int path_walk(struct nameidata *nd, const char *path, int32_t flags, mode_t mode)
 {
 	nd->mnt = current_process->fs->mnt_root;
 	int i = 0;
 	if (path[i] == '/')
 	{
-		nd->dentry = current_process->fs->mnt_root->mnt_root;
+		nd->dentry = dget(current_process->fs->mnt_root->mnt_root);
 		for (; path[i] == '/'; ++i)
 			;
 	}
 	else
-		nd->dentry = current_process->fs->d_root;
+		nd->dentry = dget(current_process->fs->d_root);
 
 	char part_name[256] = {0};
 	for (int length = strlen(path); i < length;)
@@ -43,48 +80,38 @@ int path_walk(struct nameidata *nd, const char *path, int32_t flags, mode_t mode
 		for (; path[i] == '/' && i < length; ++i)
 			;
 
-		struct vfs_dentry *iter = NULL;
-		struct vfs_dentry *d_child = NULL;
-		list_for_each_entry(iter, &nd->dentry->d_subdirs, d_sibling)
+		int ret = 0;
+		bool is_last = i == length;
+		struct vfs_dentry *parent = nd->dentry;
+		struct vfs_dentry *d_child = d_lookup(parent, part_name);
+		if (d_child && d_child->d_inode)
 		{
-			if (!strcmp(part_name, iter->d_name))
-			{
-				d_child = iter;
-				break;
-			}
+			nd->dentry = d_child;
+			if (is_last && flags & O_CREAT && flags & O_EXCL)
+				ret = -EEXIST;
 		}
-
-		if (d_child)
+		// negative dentry, name is known to not exist
+		else if (d_child && !(is_last && flags & O_CREAT))
 		{
-			nd->dentry = d_child;
-			if (i == length && flags & O_CREAT && flags & O_EXCL)
-				return -EEXIST;
+			dput(d_child);
+			ret = -ENOENT;
 		}
 		else
 		{
-			d_child = alloc_dentry(nd->dentry, part_name);
-
-			struct vfs_inode *inode = NULL;
-			if (nd->dentry->d_inode->i_op->lookup)
-				inode = nd->dentry->d_inode->i_op->lookup(nd->dentry->d_inode, d_child);
-
-			if (inode == NULL)
-			{
-				if (i == length && flags & O_CREAT)
-					inode = nd->dentry->d_inode->i_op->create(nd->dentry->d_inode, d_child, i == length ? mode : S_IFDIR);
-				else
-				{
-					log("%s is not exist", path);
-					return -ENOENT;
-				}
-			}
-			else if (i == length && flags & O_CREAT && flags & O_EXCL)
-				return -EEXIST;
-
-			d_child->d_inode = inode;
-			list_add_tail(&d_child->d_sibling, &nd->dentry->d_subdirs);
-			nd->dentry = d_child;
+			dput(d_child);
+			ret = d_lookup_slow(nd, part_name, is_last, flags, is_last ? mode : S_IFDIR);
+			if (ret == -ENOENT)
+				log("%s is not exist", path);
+		}
+
+		if (ret < 0)
+		{
+			if (nd->dentry != parent)
+				dput(nd->dentry);
+			dput(parent);
+			return ret;
 		}
+		dput(parent);
 
 		struct vfs_mount *mnt = lookup_mnt(nd->dentry);
 		if (mnt)
@@ -99,13 +126,13 @@ struct vfs_file *get_empty_filp()
 	struct vfs_file *file = kcalloc(1, sizeof(struct vfs_file));
 	file->f_maxcount = INT_MAX;
 	atomic_set(&file->f_count, 1);
+	INIT_LIST_HEAD(&file->f_ep_links);
 
 	return file;
 }
 
 int32_t vfs_open(const char *path, int32_t flags, ...)
 {
-	int fd = find_unused_fd_slot(0);
 	mode_t mode = 0;
 	if (flags & O_CREAT)
 	{
@@ -137,38 +164,49 @@ int32_t vfs_open(const char *path, int32_t flags, ...)
 		ret = file->f_op->open(nd.dentry->d_inode, file);
 		if (ret < 0)
 		{
+			dput(nd.dentry);
 			kfree(file);
 			return ret;
 		}
 	}
 
-	atomic_inc(&file->f_dentry->d_inode->i_count);
-	current_process->files->fd[fd] = file;
+	ihold(file->f_dentry->d_inode);
+	int fd = install_fd(file, 0);
+	if (fd < 0)
+		vfs_fput(file);
 	return fd;
 }
 
-int32_t vfs_close(int32_t fd)
+// drops a reference which is not tied to fd table (e.g. file-backed vma)
+int32_t vfs_fput(struct vfs_file *file)
 {
-	struct files_struct *files = current_process->files;
-	acquire_semaphore(&files->lock);
-
 	int ret = 0;
-	struct vfs_file *file = files->fd[fd];
-	if (file)
+	if (atomic_dec_and_test(&file->f_count))
 	{
-		atomic_dec(&file->f_count);
-		if (!atomic_read(&file->f_count))
+		eventpoll_release(file);
+		if (file->f_op && file->f_op->release)
+			ret = file->f_op->release(file->f_dentry->d_inode, file);
+		// only files opened by path hold their dentry and inode
+		if (file->f_vfsmnt)
 		{
-			if (file->f_op && file->f_op->release)
-				ret = file->f_op->release(file->f_dentry->d_inode, file);
-			kfree(file);
+			iput(file->f_dentry->d_inode);
+			dput(file->f_dentry);
 		}
+		kfree(file);
 	}
-	else
-		ret = -EBADF;
+	return ret;
+}
+
+int32_t vfs_close(int32_t fd)
+{
+	struct files_struct *files = current_process->files;
+	mutex_lock(&files->lock);
+
+	struct vfs_file *file = files->fd[fd];
+	int ret = file ? vfs_fput(file) : -EBADF;
 
 	files->fd[fd] = NULL;
-	release_semaphore(&files->lock);
+	mutex_unlock(&files->lock);
 	return ret;
 }
 
@@ -214,7 +252,9 @@ int vfs_stat(const char *path, struct kstat *stat)
 	if (ret < 0)
 		return ret;
 
-	return do_getattr(nd.mnt, nd.dentry, stat);
+	ret = do_getattr(nd.mnt, nd.dentry, stat);
+	dput(nd.dentry);
+	return ret;
 }
 
 int vfs_fstat(int32_t fd, struct kstat *stat)
@@ -239,11 +279,11 @@ int vfs_mknod(const char *path, int mode, dev_t dev)
 
 	struct vfs_dentry *d_child = alloc_dentry(nd.dentry, name);
 	ret = nd.dentry->d_inode->i_op->mknod(nd.dentry->d_inode, d_child, mode, dev);
-	if (ret < 0)
-		return ret;
-
-	list_add_tail(&d_child->d_sibling, &nd.dentry->d_subdirs);
+	if (ret >= 0)
+		d_add(d_child, d_child->d_inode);
 
+	dput(d_child);
+	dput(nd.dentry);
 	return ret;
 }
 
@@ -257,9 +297,14 @@ int vfs_setattr(struct vfs_dentry *dentry, struct iattr *attrs)
 	else
 	{
 		if (attrs->ia_valid & ATTR_SIZE)
+		{
 			inode->i_size = attrs->ia_size;
+			if (inode->i_op->truncate)
+				inode->i_op->truncate(inode);
+		}
 		if (attrs->ia_valid & ATTR_MODE)
 			inode->i_mode = attrs->ia_mode;
+		mark_inode_dirty(inode);
 	}
 	return ret;
 }
@@ -282,7 +327,9 @@ int vfs_truncate(const char *path, int32_t length)
 	if (ret < 0)
 		return ret;
 
-	return do_truncate(nd.dentry, length);
+	ret = do_truncate(nd.dentry, length);
+	dput(nd.dentry);
+	return ret;
 }
 
 int vfs_ftruncate(int32_t fd, int32_t length)
@@ -299,6 +346,7 @@ int generic_memory_readdir(struct vfs_file *file, struct dirent *dirent, unsigne
 
 	struct dirent *idrent = dirent;
 	struct vfs_dentry *iter;
+	down_read(&dcache_sem);
 	list_for_each_entry(iter, &dentry->d_subdirs, d_sibling)
 	{
 		int len = strlen(iter->d_name);
@@ -314,5 +362,6 @@ int generic_memory_readdir(struct vfs_file *file, struct dirent *dirent, unsigne
 		entries_size += idrent->d_reclen;
 		idrent = (struct dirent *)((char *)idrent + idrent->d_reclen);
 	}
+	up_read(&dcache_sem);
 	return entries_size;
 }
@@ -1,9 +1,10 @@
 #include "pipe.h"
 
+#include <fs/poll.h>
 #include <fs/vfs.h>
 #include <include/errno.h>
 #include <include/fcntl.h>
-#include <locking/semaphore.h>
+#include <locking/mutex.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
 #include <system/time.h>
@@ -16,10 +17,12 @@ static ssize_t pipe_read(struct vfs_file *file, char *buf, size_t count, loff_t
 		return -EINVAL;
 
 	struct pipe *p = file->f_dentry->d_inode->i_pipe;
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	for (uint32_t i = 0; i < count; ++i)
 		circular_buf_get(p->buf, buf + i);
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
+
+	wake_up_poll(&p->wait, POLLOUT | POLLWRNORM);
 	return 0;
 }
 
@@ -29,18 +32,43 @@ static ssize_t pipe_write(struct vfs_file *file, const char *buf, size_t count,
 		return -EINVAL;
 
 	struct pipe *p = file->f_dentry->d_inode->i_pipe;
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	for (uint32_t i = 0; i < count; ++i)
 		circular_buf_put(p->buf, buf[i]);
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
+
+	wake_up_poll(&p->wait, POLLIN | POLLRDNORM);
 	return 0;
 }
 
+static unsigned int pipe_poll(struct vfs_file *file, struct poll_table *pt)
+{
+	struct pipe *p = file->f_dentry->d_inode->i_pipe;
+	unsigned int mask = 0;
+
+	poll_wait(file, &p->wait, pt);
+	if (file->f_flags & O_WRONLY)
+	{
+		if (!circular_buf_full(p->buf))
+			mask |= POLLOUT | POLLWRNORM;
+		if (!p->readers)
+			mask |= POLLERR;
+	}
+	else
+	{
+		if (!circular_buf_empty(p->buf))
+			mask |= POLLIN | POLLRDNORM;
+		if (!p->writers)
+			mask |= POLLHUP;
+	}
+	return mask;
+}
+
 static int pipe_open(struct vfs_inode *inode, struct vfs_file *file)
 {
 	struct pipe *p = inode->i_pipe;
 
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	switch (file->f_flags)
 	{
 	case O_RDONLY:
@@ -55,7 +83,7 @@ static int pipe_open(struct vfs_inode *inode, struct vfs_file *file)
 		assert_not_implemented();
 		break;
 	}
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
 	return 0;
 }
 
@@ -63,7 +91,7 @@ static int pipe_release(struct vfs_inode *inode, struct vfs_file *file)
 {
 	struct pipe *p = inode->i_pipe;
 
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	p->files--;
 	switch (file->f_flags)
 	{
@@ -79,7 +107,10 @@ static int pipe_release(struct vfs_inode *inode, struct vfs_file *file)
 		assert_not_implemented();
 		break;
 	}
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
+
+	// the other end sees hang-up/error
+	wake_up_all(&p->wait);
 
 	if (!p->files && !p->writers && !p->readers)
 	{
@@ -93,6 +124,7 @@ static int pipe_release(struct vfs_inode *inode, struct vfs_file *file)
 struct vfs_file_operations pipe_fops = {
 	.read = pipe_read,
 	.write = pipe_write,
+	.poll = pipe_poll,
 	.open = pipe_open,
 	.release = pipe_release,
 };
@@ -104,7 +136,8 @@ static struct pipe *alloc_pipe()
 	p->readers = 0;
 	p->writers = 0;
 
-	sema_init(&p->mutex, 1);
+	mutex_init(&p->mutex);
+	INIT_LIST_HEAD(&p->wait.list);
 
 	char *buf = kcalloc(PIPE_SIZE, sizeof(char));
 	p->buf = circular_buf_init(buf, PIPE_SIZE);
@@ -125,7 +158,7 @@ static struct vfs_inode *get_pipe_inode()
 	inode->i_ctime.tv_sec = get_seconds(NULL);
 	inode->i_mtime.tv_sec = get_seconds(NULL);
 	inode->i_pipe = p;
-	sema_init(&inode->i_sem, 1);
+	mutex_init(&inode->i_mutex);
 	inode->i_fop = &pipe_fops;
 
 	return inode;
@@ -148,13 +181,19 @@ int32_t do_pipe(int32_t *fd)
 	f2->f_op = &pipe_fops;
 	f2->f_dentry = dentry;
 
-	int32_t ufd1 = find_unused_fd_slot(0);
-	current_process->files->fd[ufd1] = f1;
-	fd[0] = ufd1;
+	int32_t ufd1 = install_fd(f1, 0);
+	int32_t ufd2 = ufd1 >= 0 ? install_fd(f2, 0) : -EMFILE;
+	if (ufd2 < 0)
+	{
+		if (ufd1 >= 0)
+			vfs_close(ufd1);
+		else
+			vfs_fput(f1);
+		vfs_fput(f2);
+		return -EMFILE;
+	}
 
-	int32_t ufd2 = find_unused_fd_slot(0);
-	current_process->files->fd[ufd2] = f2;
+	fd[0] = ufd1;
 	fd[1] = ufd2;
-
 	return 0;
 }
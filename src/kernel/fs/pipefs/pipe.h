@@ -2,7 +2,7 @@
 #define FS_PIPE_H
 
 #include <fs/vfs.h>
-#include <locking/semaphore.h>
+#include <locking/mutex.h>
 #include <utils/circular_buffer.h>
 
 #define PIPE_SIZE 0x10000
@@ -10,7 +10,8 @@
 struct pipe
 {
 	struct circular_buf_t *buf;
-	struct semaphore mutex;
+	struct mutex mutex;
+	struct wait_queue_head wait;  // pollers (readers for data, writers for space)
 	uint32_t files;
 	uint32_t readers;
 	uint32_t writers;
@@ -1,72 +1,243 @@
 #include "poll.h"
 
+#include <include/errno.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
+#include <system/time.h>
+#include <utils/string.h>
 
-static void poll_table_free(struct poll_table *pt)
+#define DEFAULT_POLLMASK (POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM)
+#define POLLIN_SET (POLLIN | POLLRDNORM | POLLHUP | POLLERR)
+#define POLLOUT_SET (POLLOUT | POLLWRNORM | POLLERR)
+#define POLLEX_SET (POLLPRI)
+
+static struct poll_table_entry *poll_get_entry(struct poll_wqueues *pwq)
 {
-	struct poll_table_entry *iter, *next;
+	if (pwq->inline_index < N_INLINE_POLL_ENTRIES)
+		return &pwq->inline_entries[pwq->inline_index++];
 
-	list_for_each_entry_safe(iter, next, &pt->list, sibling)
+	struct poll_table_page *table = pwq->table;
+	if (!table || table->nr == POLL_TABLE_PAGE_ENTRIES)
 	{
-		list_del(&iter->wait.sibling);
-		list_del(&iter->sibling);
-		kfree(iter);
+		struct poll_table_page *new_table = kcalloc(1, PMM_FRAME_SIZE);
+		new_table->next = table;
+		pwq->table = new_table;
+		table = new_table;
 	}
-	kfree(pt);
+	return &table->entries[table->nr++];
 }
 
-void poll_wakeup(struct thread *t)
+static void __pollwait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt)
 {
-	update_thread(t, THREAD_READY);
+	struct poll_wqueues *pwq = container_of(pt, struct poll_wqueues, pt);
+	struct poll_table_entry *pe = poll_get_entry(pwq);
+
+	pe->file = file;
+	pe->whead = wh;
+	pe->wait = (struct wait_queue_entry){
+		.thread = pwq->thread,
+		.func = default_wake_function,
+		.key = pt->key,
+	};
+
+	lock_scheduler();
+	add_wait_queue(wh, &pe->wait);
+	unlock_scheduler();
 }
 
+// `pt` is NULL when caller only wants to know the current events of file (e.g. poll/epoll re-checks a ready file)
 void poll_wait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt)
 {
-	struct poll_table_entry *pe = kcalloc(sizeof(struct poll_table_entry), 1);
-	pe->file = file;
-	pe->wait.func = poll_wakeup;
-	pe->wait.thread = current_thread;
-	list_add_tail(&pe->wait.sibling, &wh->list);
-	list_add_tail(&pe->sibling, &pt->list);
+	if (pt && pt->qproc)
+		pt->qproc(file, wh, pt);
+}
+
+static void poll_timeout(struct timer_list *timer)
+{
+	struct poll_wqueues *pwq = from_timer(pwq, timer, timer);
+
+	list_del(&timer->sibling);
+	pwq->timed_out = true;
+	update_thread(pwq->thread, THREAD_READY);
+}
+
+static void poll_initwait(struct poll_wqueues *pwq, int32_t timeout)
+{
+	pwq->pt.key = 0;
+	pwq->pt.qproc = __pollwait;
+	pwq->thread = current_thread;
+	pwq->timer = (struct timer_list)TIMER_INITIALIZER(poll_timeout, UINT32_MAX);
+	pwq->timed_out = timeout == 0;
+	pwq->inline_index = 0;
+	pwq->table = NULL;
+
+	if (timeout > 0)
+	{
+		pwq->timer.expires = get_milliseconds(NULL) + timeout;
+		add_timer(&pwq->timer);
+	}
+}
+
+static void poll_freewait(struct poll_wqueues *pwq, int32_t timeout)
+{
+	lock_scheduler();
+	if (timeout > 0 && !pwq->timed_out)
+		del_timer(&pwq->timer);
+
+	for (uint32_t i = 0; i < pwq->inline_index; ++i)
+		remove_wait_queue(pwq->inline_entries[i].whead, &pwq->inline_entries[i].wait);
+	for (struct poll_table_page *table = pwq->table; table; table = table->next)
+		for (uint32_t i = 0; i < table->nr; ++i)
+			remove_wait_queue(table->entries[i].whead, &table->entries[i].wait);
+	unlock_scheduler();
+
+	struct poll_table_page *table = pwq->table;
+	while (table)
+	{
+		struct poll_table_page *next = table->next;
+		kfree(table);
+		table = next;
+	}
+}
+
+/*
+ * Called before each pass over descriptors, the thread is marked waiting first so a wake-up which comes
+ * while we are polling makes it ready again and the following `schedule` returns immediately
+ * Return false if caller should stop (timed out or there is an unblocked pending signal)
+ */
+static bool poll_prepare_pass(struct poll_wqueues *pwq)
+{
+	if (pwq->timed_out || (current_thread->pending & ~current_thread->blocked))
+		return false;
+
+	update_thread(current_thread, THREAD_WAITING);
+	return true;
+}
+
+static uint32_t do_pollfd(struct vfs_file *file, uint32_t events, struct poll_table *pt)
+{
+	if (!file)
+		return POLLNVAL;
+	if (!file->f_op || !file->f_op->poll)
+		return DEFAULT_POLLMASK & events;
+
+	if (pt)
+		pt->key = events | POLLERR | POLLHUP;
+	int32_t mask = file->f_op->poll(file, pt);
+	if (mask < 0)
+		return POLLERR;
+	// POLLERR/POLLHUP are always reported
+	return mask & (events | POLLERR | POLLHUP);
 }
 
-int do_poll(struct pollfd *fds, uint32_t nfds)
+static struct vfs_file *poll_get_file(int32_t fd)
 {
-	int32_t nr;
+	if (fd < 0 || fd >= MAX_FD)
+		return NULL;
+
+	return current_process->files->fd[fd];
+}
+
+int do_poll(struct pollfd *fds, uint32_t nfds, int32_t timeout)
+{
+	if (nfds > MAX_FD)
+		return -EINVAL;
+
+	struct poll_wqueues table;
+	poll_initwait(&table, timeout);
 
-	while (true)
+	// only the first pass hooks into wait queues, entries stay there until we return
+	struct poll_table *pt = &table.pt;
+	int32_t nr = 0;
+	for (bool woken = false;; woken = true)
 	{
-		struct poll_table *pt = kcalloc(sizeof(struct poll_table), 1);
-		INIT_LIST_HEAD(&pt->list);
+		bool can_wait = poll_prepare_pass(&table);
 
-		nr = 0;
 		for (uint32_t i = 0; i < nfds; ++i)
 		{
 			struct pollfd *pfd = &fds[i];
 
-			if (pfd->fd >= 0)
-			{
-				struct vfs_file *f = current_thread->parent->files->fd[pfd->fd];
+			pfd->revents = pfd->fd >= 0 ? do_pollfd(poll_get_file(pfd->fd), pfd->events, pt) : 0;
+			if (pfd->revents)
+				nr++;
+		}
+		pt = NULL;
+
+		if (nr || !can_wait)
+			break;
+		if (woken)
+			wq_stat.nr_spurious++;
+
+		schedule();
+	}
+	update_thread(current_thread, THREAD_RUNNING);
+
+	poll_freewait(&table, timeout);
+	if (!nr && !table.timed_out)
+		return -EINTR;
+	return nr;
+}
+
+int do_select(int32_t nfds, uint32_t *readfds, uint32_t *writefds, uint32_t *exceptfds, int32_t timeout)
+{
+	if (nfds < 0 || nfds > MAX_FD)
+		return -EINVAL;
+
+	uint32_t nwords = (nfds + 31) / 32;
+	uint32_t *in[3] = {readfds, writefds, exceptfds};
+	uint32_t res[3][MAX_FD / 32];
+	static const uint32_t sets[3] = {POLLIN_SET, POLLOUT_SET, POLLEX_SET};
+
+	for (int32_t fd = 0; fd < nfds; ++fd)
+		for (int k = 0; k < 3; ++k)
+			if (in[k] && (in[k][fd / 32] & (1u << (fd % 32))) && !poll_get_file(fd))
+				return -EBADF;
+
+	struct poll_wqueues table;
+	poll_initwait(&table, timeout);
 
-				pfd->revents = f->f_op->poll(f, pt);
-				if (pfd->events & pfd->revents)
+	struct poll_table *pt = &table.pt;
+	int32_t nr = 0;
+	for (bool woken = false;; woken = true)
+	{
+		bool can_wait = poll_prepare_pass(&table);
+		memset(res, 0, sizeof(res));
+
+		for (int32_t fd = 0; fd < nfds; ++fd)
+		{
+			uint32_t bit = 1u << (fd % 32);
+			uint32_t events = 0;
+			for (int k = 0; k < 3; ++k)
+				if (in[k] && (in[k][fd / 32] & bit))
+					events |= sets[k];
+			if (!events)
+				continue;
+
+			uint32_t mask = do_pollfd(poll_get_file(fd), events, pt);
+			for (int k = 0; k < 3; ++k)
+				if (in[k] && (in[k][fd / 32] & bit) && (mask & sets[k]))
+				{
+					res[k][fd / 32] |= bit;
 					nr++;
-			}
-			else
-				pfd->revents = 0;
+				}
 		}
+		pt = NULL;
 
-		if (nr > 0)
-		{
-			poll_table_free(pt);
+		if (nr || !can_wait)
 			break;
-		}
+		if (woken)
+			wq_stat.nr_spurious++;
 
-		update_thread(current_thread, THREAD_WAITING);
 		schedule();
-		poll_table_free(pt);
 	}
+	update_thread(current_thread, THREAD_RUNNING);
+
+	poll_freewait(&table, timeout);
+	if (!nr && !table.timed_out)
+		return -EINTR;
 
+	for (int k = 0; k < 3; ++k)
+		if (in[k])
+			memcpy(in[k], res[k], nwords * sizeof(uint32_t));
 	return nr;
 }
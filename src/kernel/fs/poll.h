@@ -2,8 +2,11 @@
 #define FS_POLL_H
 
 #include <include/list.h>
+#include <memory/pmm.h>
 #include <proc/wait.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <system/timer.h>
 
 #define POLLIN 0x0001
 #define POLLPRI 0x0002
@@ -18,16 +21,45 @@
 #define POLLMSG 0x0400
 #define POLLREMOVE 0x1000
 
+struct vfs_file;
+struct poll_table;
+
+typedef void (*poll_queue_proc)(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt);
+
 struct poll_table
 {
-	struct list_head list;
+	uint32_t key;			// events of fd being polled, waiter is only woken up if they match
+	poll_queue_proc qproc;	// how to hook into wait queue of file
 };
 
 struct poll_table_entry
 {
 	struct vfs_file *file;
+	struct wait_queue_head *whead;
 	struct wait_queue_entry wait;
-	struct list_head sibling;
+};
+
+// poll/select of a few descriptors (the common case) keeps entries inline on kernel stack,
+// only when they are used up, entries are taken from kcalloc-ed pages
+#define N_INLINE_POLL_ENTRIES 16
+#define POLL_TABLE_PAGE_ENTRIES ((PMM_FRAME_SIZE - 2 * sizeof(void *)) / sizeof(struct poll_table_entry))
+
+struct poll_table_page
+{
+	struct poll_table_page *next;
+	uint32_t nr;
+	struct poll_table_entry entries[];
+};
+
+struct poll_wqueues
+{
+	struct poll_table pt;
+	struct thread *thread;
+	struct timer_list timer;
+	bool timed_out;
+	uint32_t inline_index;
+	struct poll_table_entry inline_entries[N_INLINE_POLL_ENTRIES];
+	struct poll_table_page *table;
 };
 
 struct pollfd
@@ -37,8 +69,9 @@ struct pollfd
 	int16_t revents; /* returned events */
 };
 
-int do_poll(struct pollfd *fds, uint32_t nfds);
+// timeout in milliseconds, negative -> wait forever, 0 -> don't wait
+int do_poll(struct pollfd *fds, uint32_t nfds, int32_t timeout);
+int do_select(int32_t nfds, uint32_t *readfds, uint32_t *writefds, uint32_t *exceptfds, int32_t timeout);
 void poll_wait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt);
-void poll_wakeup(struct thread *t);
 
 #endif
@@ -12,10 +12,11 @@ char *vfs_read(const char *path)
 	if (fd < 0)
 		return NULL;
 
-	struct kstat *stat = kcalloc(1, sizeof(struct kstat));
-	vfs_fstat(fd, stat);
-	char *buf = kcalloc(stat->st_size, sizeof(char));
-	vfs_fread(fd, buf, stat->st_size);
+	struct kstat stat;
+	vfs_fstat(fd, &stat);
+	char *buf = kcalloc(stat.st_size, sizeof(char));
+	vfs_fread(fd, buf, stat.st_size);
+	vfs_close(fd);
 	return buf;
 }
 
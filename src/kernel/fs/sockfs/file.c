@@ -30,9 +30,29 @@ int sockfs_ioctl(struct vfs_inode *inode, struct vfs_file *file, unsigned int cm
 	return 0;
 }
 
+static unsigned int sockfs_poll(struct vfs_file *file, struct poll_table *pt)
+{
+	struct socket *sock = SOCKET_I(file->f_dentry->d_inode);
+	struct sock *sk = sock->sk;
+	unsigned int mask = 0;
+
+	if (!sk)
+		return POLLNVAL;
+
+	poll_wait(file, &sk->sk_wait, pt);
+	if (!list_empty(&sk->rx_queue))
+		mask |= POLLIN | POLLRDNORM;
+	if (sock->state == SS_DISCONNECTED)
+		mask |= POLLHUP;
+	else if (sock->type != SOCK_STREAM || sock->state == SS_CONNECTED)
+		mask |= POLLOUT | POLLWRNORM;
+	return mask;
+}
+
 struct vfs_file_operations sockfs_file_operations = {
 	.read = sockfs_read_file,
 	.write = sockfs_write_file,
+	.poll = sockfs_poll,
 	.release = sockfs_release_file,
 	.ioctl = sockfs_ioctl,
 };
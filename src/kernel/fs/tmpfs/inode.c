@@ -17,6 +17,7 @@ int tmpfs_setsize(struct vfs_inode *inode, loff_t new_size)
 		{
 			struct page *p = kcalloc(1, sizeof(struct page));
 			p->frame = (uint32_t)pmm_alloc_block();
+			p->index = aligned_size / PMM_FRAME_SIZE + i;
 			list_add_tail(&p->sibling, &inode->i_data.pages);
 		}
 	}
@@ -13,8 +13,13 @@
 #include "sockfs/sockfs.h"
 #include "tmpfs/tmpfs.h"
 
+#define MOUNT_HASH_SIZE 64
+
 static struct vfs_file_system_type *file_systems;
 struct list_head vfsmntlist;
+static struct list_head mount_hashtable[MOUNT_HASH_SIZE];
+struct rw_semaphore mount_sem;  // protects vfsmntlist and mount hash
+struct rw_semaphore dcache_sem;	 // protects dentry tree (d_subdirs)
 
 static struct vfs_file_system_type **find_filesystem(const char *name)
 {
@@ -51,13 +56,28 @@ int unregister_filesystem(struct vfs_file_system_type *fs)
 	return -EINVAL;
 }
 
-int find_unused_fd_slot(int lowerlimit)
+// caller holds files->lock
+static int find_unused_fd_slot(int lowerlimit)
 {
-	for (int i = lowerlimit; i < 256; ++i)
+	for (int i = lowerlimit; i < MAX_FD; ++i)
 		if (!current_process->files->fd[i])
 			return i;
 
-	return -EINVAL;
+	return -EMFILE;
+}
+
+// slot lookup and store happen under files->lock, threads of process can't get the same fd
+int install_fd(struct vfs_file *file, int lowerlimit)
+{
+	struct files_struct *files = current_process->files;
+	mutex_lock(&files->lock);
+
+	int fd = find_unused_fd_slot(lowerlimit);
+	if (fd >= 0)
+		files->fd[fd] = file;
+
+	mutex_unlock(&files->lock);
+	return fd;
 }
 
 struct vfs_inode *init_inode()
@@ -65,7 +85,12 @@ struct vfs_inode *init_inode()
 	struct vfs_inode *i = kcalloc(1, sizeof(struct vfs_inode));
 	i->i_blocks = 0;
 	i->i_size = 0;
-	sema_init(&i->i_sem, 1);
+	atomic_set(&i->i_count, 1);
+	mutex_init(&i->i_mutex);
+	INIT_LIST_HEAD(&i->i_data.pages);
+	INIT_LIST_HEAD(&i->i_hash);
+	INIT_LIST_HEAD(&i->i_lru);
+	INIT_LIST_HEAD(&i->i_dirty);
 
 	return i;
 }
@@ -80,16 +105,39 @@ void init_special_inode(struct vfs_inode *inode, umode_t mode, dev_t dev)
 	}
 }
 
+static struct list_head *mount_hash(struct vfs_dentry *d)
+{
+	return &mount_hashtable[((uint32_t)d >> 4) % MOUNT_HASH_SIZE];
+}
+
+static void attach_mnt(struct vfs_mount *mnt)
+{
+	mnt->mnt_mountpoint->d_flags |= DCACHE_MOUNTED;
+	down_write(&mount_sem);
+	list_add_tail(&mnt->sibling, &vfsmntlist);
+	list_add(&mnt->mnt_hash, mount_hash(mnt->mnt_mountpoint));
+	up_write(&mount_sem);
+}
+
+// every component of every path walk comes here, most dentries are not mountpoints
 struct vfs_mount *lookup_mnt(struct vfs_dentry *d)
 {
-	struct vfs_mount *iter;
-	list_for_each_entry(iter, &vfsmntlist, sibling)
+	struct vfs_mount *iter, *mnt = NULL;
+	if (!(d->d_flags & DCACHE_MOUNTED))
+		return NULL;
+
+	down_read(&mount_sem);
+	list_for_each_entry(iter, mount_hash(d), mnt_hash)
 	{
 		if (iter->mnt_mountpoint == d)
-			return iter;
+		{
+			mnt = iter;
+			break;
+		}
 	}
+	up_read(&mount_sem);
 
-	return NULL;
+	return mnt;
 }
 
 struct vfs_mount *do_mount(const char *fstype, int flags, const char *path)
@@ -106,20 +154,12 @@ struct vfs_mount *do_mount(const char *fstype, int flags, const char *path)
 	struct nameidata nd;
 	path_walk(&nd, dir, O_RDONLY, S_IFDIR);
 
-	struct vfs_dentry *iter, *next;
-	list_for_each_entry_safe(iter, next, &nd.dentry->d_subdirs, d_sibling)
-	{
-		if (!strcmp(iter->d_name, name))
-		{
-			// TODO: MQ 2020-10-24 Make sure path is empty folder
-			list_del(&iter->d_sibling);
-			kfree(iter);
-		}
-	}
-
-	mnt->mnt_mountpoint->d_parent = nd.dentry;
-	list_add_tail(&mnt->mnt_mountpoint->d_sibling, &nd.dentry->d_subdirs);
-	list_add_tail(&mnt->sibling, &vfsmntlist);
+	// mounted root takes the place of existing dentry with the same name, walker's reference is kept as its parent's one
+	// TODO: MQ 2020-10-24 Make sure path is empty folder
+	struct vfs_dentry *root = mnt->mnt_mountpoint;
+	root->d_parent = nd.dentry;
+	d_add(root, root->d_inode);
+	attach_mnt(mnt);
 
 	return mnt;
 }
@@ -129,7 +169,7 @@ static void init_rootfs(struct vfs_file_system_type *fs_type, char *dev_name)
 	init_ext2_fs();
 
 	struct vfs_mount *mnt = fs_type->mount(fs_type, dev_name, "/");
-	list_add_tail(&mnt->sibling, &vfsmntlist);
+	attach_mnt(mnt);
 
 	current_process->fs->d_root = mnt->mnt_root;
 	current_process->fs->mnt_root = mnt;
@@ -142,6 +182,11 @@ void vfs_init(struct vfs_file_system_type *fs, char *dev_name)
 	log("VFS: Initializing");
 
 	INIT_LIST_HEAD(&vfsmntlist);
+	init_rwsem(&mount_sem);
+	init_rwsem(&dcache_sem);
+	for (int i = 0; i < MOUNT_HASH_SIZE; ++i)
+		INIT_LIST_HEAD(&mount_hashtable[i]);
+	dcache_init();
 
 	log("VFS: Mount ext2");
 	init_rootfs(fs, dev_name);
@@ -6,7 +6,8 @@
 #include <include/fcntl.h>
 #include <include/list.h>
 #include <include/types.h>
-#include <locking/semaphore.h>
+#include <locking/mutex.h>
+#include <locking/rwsem.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <system/time.h>
@@ -101,6 +102,7 @@ struct vfs_mount
 	struct vfs_superblock *mnt_sb;
 	char *mnt_devname;
 	struct list_head sibling;
+	struct list_head mnt_hash;	// in mount hash, keyed by mountpoint
 };
 
 struct vfs_superblock
@@ -113,6 +115,7 @@ struct vfs_superblock
 	unsigned long s_magic;
 	struct vfs_dentry *s_root;
 	char *mnt_devname;
+	struct block_device *s_bdev;
 	void *s_fs_info;
 };
 
@@ -121,9 +124,28 @@ struct vfs_super_operations
 	struct vfs_inode *(*alloc_inode)(struct vfs_superblock *sb);
 	void (*read_inode)(struct vfs_inode *);
 	void (*write_inode)(struct vfs_inode *);
+	void (*destroy_inode)(struct vfs_inode *);
 	void (*write_super)(struct vfs_superblock *);
 };
 
+// inode state
+#define I_NEW 0x1	   // being read by `read_inode`, others wait for it in `iget`
+#define I_DIRTY 0x2	   // newer than disk, in dirty list
+#define I_FREEING 0x4  // being written back and destroyed, `iget` waits until it is gone
+
+// Inode cache, an inode is found by (superblock, inode number) and stays cached after its last `iput`
+// every reference (dentry, open file) holds `i_count`, unused inodes are kept in lru order and the oldest ones are
+// written back (if dirty) and destroyed when there are too many of them. An inode without links is destroyed right away
+struct inode_stat
+{
+	uint32_t nr_inodes;
+	uint32_t nr_unused;
+	uint32_t nr_hits;
+	uint32_t nr_misses;
+	uint32_t nr_evictions;
+	uint32_t nr_writebacks;
+};
+
 struct vfs_inode
 {
 	unsigned long i_ino;
@@ -140,13 +162,17 @@ struct vfs_inode
 	unsigned long i_blksize;
 	uint32_t i_flags;
 	uint32_t i_size;
-	struct semaphore i_sem;
+	struct mutex i_mutex;
 	struct pipe *i_pipe;
 	struct address_space i_data;
 	struct vfs_inode_operations *i_op;
 	struct vfs_file_operations *i_fop;
 	struct vfs_superblock *i_sb;
 	void *i_fs_info;
+	uint32_t i_state;
+	struct list_head i_hash;   // empty if inode is not in inode cache
+	struct list_head i_lru;	   // in unused list if i_count is zero
+	struct list_head i_dirty;  // in dirty list if I_DIRTY
 };
 
 struct vfs_inode_operations
@@ -163,14 +189,45 @@ struct vfs_inode_operations
 	int (*getattr)(struct vfs_mount *mnt, struct vfs_dentry *, struct kstat *);
 };
 
+// dentry flags
+#define DCACHE_MOUNTED 0x1	// a filesystem is mounted here, look it up in mount hash
+
+// Dentry cache, a dentry is found by (parent, name) in a global hash, a name which doesn't exist is cached as
+// negative dentry (no inode). `d_count` is held by walkers, open files, cwd and children (on their parent)
+// unused dentries are kept in lru order and the oldest ones are dropped when there are too many of them
+// only negative dentries and the ones whose filesystem can read them back are dropped (tmpfs, devfs are not)
+struct dentry_stat
+{
+	uint32_t nr_dentries;
+	uint32_t nr_unused;
+	uint32_t nr_negative;
+	uint32_t nr_hits;
+	uint32_t nr_misses;
+	uint32_t nr_evictions;
+};
+
 struct vfs_dentry
 {
-	struct vfs_inode *d_inode;
+	struct vfs_inode *d_inode;	// NULL for negative dentry
 	struct vfs_dentry *d_parent;
 	char *d_name;
+	uint32_t d_name_hash;
+	uint32_t d_flags;
+	atomic_t d_count;
 	struct vfs_superblock *d_sb;
 	struct list_head d_subdirs;
-	struct list_head d_sibling;
+	struct list_head d_sibling;	 // in parent's d_subdirs if it is positive and cached
+	struct list_head d_hash;	 // empty if dentry is not in dentry cache
+	struct list_head d_lru;		 // in unused list if d_count is zero
+};
+
+// Per open file readahead window (in filesystem blocks), `start + size` is where the next window begins
+// the window is doubled while reads are sequential and collapses on a random one
+struct file_ra_state
+{
+	uint32_t start;
+	uint32_t size;
+	uint32_t next;	// block expected by a sequential read
 };
 
 struct vfs_file
@@ -184,6 +241,8 @@ struct vfs_file
 	void *private_data;
 	fmode_t f_mode;
 	loff_t f_pos;
+	struct list_head f_ep_links;  // epoll items watching this file
+	struct file_ra_state f_ra;
 };
 
 struct vfs_file_operations
@@ -205,19 +264,44 @@ struct nameidata
 	struct vfs_mount *mnt;
 };
 
+extern struct rw_semaphore mount_sem;
+extern struct rw_semaphore dcache_sem;
+extern struct inode_stat inode_stat;
+extern struct dentry_stat dentry_stat;
+
 int register_filesystem(struct vfs_file_system_type *fs);
 int unregister_filesystem(struct vfs_file_system_type *fs);
-int find_unused_fd_slot(int lowerlimit);
+int install_fd(struct vfs_file *file, int lowerlimit);
 struct vfs_mount *lookup_mnt(struct vfs_dentry *d);
 void vfs_init(struct vfs_file_system_type *fs, char *dev_name);
 struct vfs_inode *init_inode();
 void init_special_inode(struct vfs_inode *inode, umode_t mode, dev_t dev);
 struct vfs_mount *do_mount(const char *fstype, int flags, const char *name);
 
-// open.c
+// inode.c
+struct vfs_inode *iget(struct vfs_superblock *sb, unsigned long ino);
+void ihold(struct vfs_inode *inode);
+void iput(struct vfs_inode *inode);
+void insert_inode_hash(struct vfs_inode *inode);
+void mark_inode_dirty(struct vfs_inode *inode);
+unsigned long get_next_ino();
+void sync_inodes();
+void inode_init();
+
+// dcache.c
 struct vfs_dentry *alloc_dentry(struct vfs_dentry *parent, char *name);
+struct vfs_dentry *d_lookup(struct vfs_dentry *parent, const char *name);
+void d_add(struct vfs_dentry *dentry, struct vfs_inode *inode);
+void d_instantiate(struct vfs_dentry *dentry, struct vfs_inode *inode);
+void d_drop(struct vfs_dentry *dentry);
+struct vfs_dentry *dget(struct vfs_dentry *dentry);
+void dput(struct vfs_dentry *dentry);
+void dcache_init();
+
+// open.c
 int32_t vfs_open(const char *path, int32_t flags, ...);
 int32_t vfs_close(int32_t fd);
+int32_t vfs_fput(struct vfs_file *file);
 int vfs_stat(const char *path, struct kstat *stat);
 int vfs_fstat(int32_t fd, struct kstat *stat);
 int vfs_mknod(const char *path, int mode, dev_t dev);
@@ -1,6 +1,8 @@
 #ifndef INCLUDE_ATOMIC_H
 #define INCLUDE_ATOMIC_H
 
+#include <stdbool.h>
+
 typedef struct
 {
 	volatile int counter;
@@ -47,4 +49,66 @@ static inline void atomic_dec(atomic_t *v)
 		: "m"(v->counter));
 }
 
+// return true if `v` has dropped to zero, decrement and test are one instruction's result
+static inline bool atomic_dec_and_test(atomic_t *v)
+{
+	unsigned char c;
+	__asm__ __volatile__(
+		"decl %0; sete %1"
+		: "+m"(v->counter), "=qm"(c)
+		:
+		: "memory");
+	return c != 0;
+}
+
+// single instruction -> atomic against irqs and preemption (there is one cpu)
+static inline void atomic_or(int mask, atomic_t *v)
+{
+	__asm__ __volatile__(
+		"orl %1,%0"
+		: "+m"(v->counter)
+		: "ir"(mask)
+		: "memory");
+}
+
+static inline void atomic_andnot(int mask, atomic_t *v)
+{
+	__asm__ __volatile__(
+		"andl %1,%0"
+		: "+m"(v->counter)
+		: "ir"(~mask)
+		: "memory");
+}
+
+// return the old value, `v` is set to `new` only if it was `old`
+static inline int atomic_cmpxchg(atomic_t *v, int old, int new)
+{
+	int prev;
+	__asm__ __volatile__(
+		"lock cmpxchgl %2,%1"
+		: "=a"(prev), "+m"(v->counter)
+		: "r"(new), "0"(old)
+		: "memory");
+	return prev;
+}
+
+// return the old value
+static inline int atomic_fetch_or(int mask, atomic_t *v)
+{
+	int old;
+	do
+		old = atomic_read(v);
+	while (atomic_cmpxchg(v, old, old | mask) != old);
+	return old;
+}
+
+static inline int atomic_fetch_andnot(int mask, atomic_t *v)
+{
+	int old;
+	do
+		old = atomic_read(v);
+	while (atomic_cmpxchg(v, old, old & ~mask) != old);
+	return old;
+}
+
 #endif
@@ -0,0 +1,54 @@
+#ifndef INCLUDE_SPAWN_H
+#define INCLUDE_SPAWN_H
+
+#include <include/types.h>
+
+// posix_spawnattr flags
+#define POSIX_SPAWN_RESETIDS 0x01
+#define POSIX_SPAWN_SETPGROUP 0x02
+#define POSIX_SPAWN_SETSIGDEF 0x04
+#define POSIX_SPAWN_SETSIGMASK 0x08
+#define POSIX_SPAWN_SETSID 0x80
+
+// file action types
+#define SPAWN_DO_CLOSE 0
+#define SPAWN_DO_DUP2 1
+#define SPAWN_DO_OPEN 2
+
+// layout is shared with libc spawn.h
+struct spawn_action
+{
+	int type;
+	int fd;
+	int newfd;
+	int oflag;
+	mode_t mode;
+	char *path;
+};
+
+struct spawn_file_actions
+{
+	int allocated;
+	int used;
+	struct spawn_action *actions;
+};
+
+struct spawn_attr
+{
+	short flags;
+	pid_t pgrp;
+	sigset_t sigdefault;
+	sigset_t sigmask;
+};
+
+struct kspawn_args
+{
+	pid_t *pid;
+	const char *path;
+	const struct spawn_file_actions *file_actions;
+	const struct spawn_attr *attrp;
+	char *const *argv;
+	char *const *envp;
+};
+
+#endif
@@ -83,28 +83,16 @@ int32_t mq_unlink(const char *name)
 		struct message_queue *mq = hashmap_get(&mq_map, &mqi->key);
 		assert(mq);
 
+		mutex_lock(&mq->lock);
 		struct mq_message *miter, *mnext;
 		list_for_each_entry_safe(miter, mnext, &mq->messages, sibling)
 		{
 			list_del(&miter->sibling);
 			kfree(miter);
 		}
+		mutex_unlock(&mq->lock);
 
-		struct mq_sender *siter, *snext;
-		list_for_each_entry_safe(siter, snext, &mq->senders, sibling)
-		{
-			list_del(&siter->sibling);
-			kfree(siter);
-			update_thread(siter->sender, THREAD_READY);
-		}
-
-		struct mq_receiver *riter, *rnext;
-		list_for_each_entry_safe(riter, rnext, &mq->receivers, sibling)
-		{
-			list_del(&riter->sibling);
-			kfree(riter);
-			update_thread(riter->receiver, THREAD_READY);
-		}
+		wake_up_all(&mq->wait);
 
 		hashmap_remove(&mq_map, &mqi->key);
 		kfree(mq->attr);
@@ -133,36 +121,6 @@ static void mq_add_message(struct message_queue *mq, struct mq_message *msg)
 	mq->attr->mq_curmsgs += 1;
 }
 
-static void mq_add_sender(struct message_queue *mq, struct mq_sender *mqs)
-{
-	struct mq_sender *iter;
-	list_for_each_entry(iter, &mq->senders, sibling)
-	{
-		if (mqs->priority > iter->priority)
-			break;
-	}
-
-	if (&iter->sibling == &mq->senders)
-		list_add_tail(&mqs->sibling, &mq->senders);
-	else
-		list_add(&mqs->sibling, iter->sibling.prev);
-}
-
-static void mq_add_receiver(struct message_queue *mq, struct mq_receiver *mqr)
-{
-	struct mq_receiver *iter;
-	list_for_each_entry(iter, &mq->receivers, sibling)
-	{
-		if (mqr->priority > iter->priority)
-			break;
-	}
-
-	if (&iter->sibling == &mq->receivers)
-		list_add_tail(&mqr->sibling, &mq->receivers);
-	else
-		list_add(&mqr->sibling, iter->sibling.prev);
-}
-
 int32_t mq_send(int32_t fd, char *user_buf, uint32_t priority, uint32_t msize)
 {
 	struct vfs_file *file = current_thread->parent->files->fd[fd];
@@ -173,25 +131,6 @@ int32_t mq_send(int32_t fd, char *user_buf, uint32_t priority, uint32_t msize)
 	else if (msize > mq->attr->mq_msgsize)
 		return -EMSGSIZE;
 
-	assert(mq->attr->mq_curmsgs <= mq->attr->mq_maxmsg);
-	if (mq->attr->mq_curmsgs == mq->attr->mq_maxmsg)
-	{
-		if ((mq->attr->mq_flags & O_NONBLOCK) == 0)
-		{
-			struct mq_sender *mqs;
-			wait_until_with_setup(list_is_poison(&mqs->sibling) && mq->attr->mq_curmsgs < mq->attr->mq_maxmsg, ({
-									  mqs = kcalloc(1, sizeof(struct mq_sender));
-									  mqs->sender = current_thread;
-									  mqs->priority = priority;
-									  mq_add_sender(mq, mqs);
-								  }),
-								  kfree(mqs));
-		}
-		else
-			return -EAGAIN;
-	}
-	assert(mq->attr->mq_curmsgs < mq->attr->mq_maxmsg);
-
 	char *kernel_buf = kcalloc(msize, sizeof(char));
 	memcpy(kernel_buf, user_buf, msize);
 
@@ -199,17 +138,26 @@ int32_t mq_send(int32_t fd, char *user_buf, uint32_t priority, uint32_t msize)
 	mqm->buf = kernel_buf;
 	mqm->msize = msize;
 	mqm->priority = priority;
-	mq_add_message(mq, mqm);
 
-	struct mq_receiver *mqr = list_first_entry_or_null(&mq->receivers, struct mq_receiver, sibling);
-	if (mqr)
+	// a woken sender can find queue full again (another one has been faster), it checks under lock
+	mutex_lock(&mq->lock);
+	while (mq->attr->mq_curmsgs >= mq->attr->mq_maxmsg)
 	{
-		assert(mq->attr->mq_curmsgs == 1);
-		list_del(&mqr->sibling);
-		update_thread(mqr->receiver, THREAD_READY);
+		mutex_unlock(&mq->lock);
+		if (mq->attr->mq_flags & O_NONBLOCK)
+		{
+			kfree(kernel_buf);
+			kfree(mqm);
+			return -EAGAIN;
+		}
+		wait_event_exclusive_key(&mq->wait, mq->attr->mq_curmsgs < mq->attr->mq_maxmsg, POLLOUT);
+		mutex_lock(&mq->lock);
 	}
+	mq_add_message(mq, mqm);
+	mutex_unlock(&mq->lock);
 
-	wake_up(&mq->wait);
+	// all pollers + one blocked receiver
+	wake_up_poll(&mq->wait, POLLIN | POLLRDNORM);
 
 	return 0;
 }
@@ -224,41 +172,30 @@ int32_t mq_receive(int32_t fd, char *user_buf, uint32_t priority, uint32_t msize
 	else if (msize < mq->attr->mq_msgsize)
 		return -EMSGSIZE;
 
-	assert(0 <= mq->attr->mq_curmsgs && mq->attr->mq_curmsgs <= mq->attr->mq_maxmsg);
-	assert(msize >= mq->attr->mq_msgsize);
-	if (mq->attr->mq_curmsgs == mq->attr->mq_maxmsg)
-	{
-		struct mq_sender *mqs = list_first_entry_or_null(&mq->senders, struct mq_sender, sibling);
-		if (mqs)
-		{
-			list_del(&mqs->sibling);
-			update_thread(mqs->sender, THREAD_READY);
-		}
-	}
-	else if (mq->attr->mq_curmsgs == 0)
+	// a woken receiver can find queue empty again (another one has taken the message), it checks under lock
+	mutex_lock(&mq->lock);
+	while (!mq->attr->mq_curmsgs)
 	{
-		if ((mq->attr->mq_flags & O_NONBLOCK) == 0)
-		{
-			struct mq_receiver *mqr;
-			wait_until_with_setup(mq->attr->mq_curmsgs > 0 && list_is_poison(&mqr->sibling), ({
-									  mqr = kcalloc(1, sizeof(struct mq_receiver));
-									  mqr->priority = priority;
-									  mqr->receiver = current_thread;
-									  mq_add_receiver(mq, mqr);
-								  }),
-								  kfree(mqr));
-		}
-		else
+		mutex_unlock(&mq->lock);
+		if (mq->attr->mq_flags & O_NONBLOCK)
 			return -EAGAIN;
+		wait_event_exclusive_key(&mq->wait, mq->attr->mq_curmsgs > 0, POLLIN);
+		mutex_lock(&mq->lock);
 	}
 
 	struct mq_message *mqm = list_first_entry_or_null(&mq->messages, struct mq_message, sibling);
 	assert(mqm);
 	list_del(&mqm->sibling);
 	mq->attr->mq_curmsgs--;
-	memcpy(user_buf, mqm->buf, msize);
+	mutex_unlock(&mq->lock);
+
+	memcpy(user_buf, mqm->buf, mqm->msize);
+	kfree(mqm->buf);
 	kfree(mqm);
 
+	// all pollers + one blocked sender
+	wake_up_poll(&mq->wait, POLLOUT | POLLWRNORM);
+
 	return 0;
 }
 
@@ -19,20 +19,6 @@ struct mq_attr
                                        (ignored for mq_open()) */
 };
 
-struct mq_sender
-{
-	struct thread *sender;
-	struct list_head sibling;
-	uint32_t priority;
-};
-
-struct mq_receiver
-{
-	struct thread *receiver;
-	uint32_t priority;
-	struct list_head sibling;
-};
-
 struct mq_message
 {
 	char *buf;
@@ -41,12 +27,12 @@ struct mq_message
 	struct list_head sibling;
 };
 
+// blocked senders/receivers are exclusive waiters in `wait` (woken one per message), pollers are non-exclusive
 struct message_queue
 {
+	struct mutex lock;	// messages and mq_curmsgs, it is dropped while waiting
 	struct wait_queue_head wait;
 	struct list_head messages;
-	struct list_head senders;
-	struct list_head receivers;
 	struct mq_attr *attr;
 };
 
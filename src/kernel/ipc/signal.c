@@ -174,9 +174,11 @@ int do_kill(pid_t pid, int32_t signum)
 
 void signal_handler(struct interrupt_registers *regs)
 {
-	if (!current_thread || !current_thread->pending || current_thread->signaling ||
+	if (!current_thread || !current_thread->pending ||
 		((uint32_t)regs + sizeof(struct interrupt_registers) != current_thread->kernel_stack))
 		return;
+	if (current_thread->signaling && !(current_thread->flags & TIF_GROUP_EXIT))
+		return;
 
 	handle_signal(regs, current_thread->blocked);
 }
@@ -189,6 +191,13 @@ void handle_signal(struct interrupt_registers *regs, sigset_t restored_sig)
 	if (!current_thread->pending)
 		return;
 
+	// sibling has called exit/execve, this is a return point where no kernel lock is held
+	if (current_thread->flags & TIF_GROUP_EXIT)
+	{
+		sigemptyset(&current_thread->pending);
+		do_exit_thread(current_process->exit_code);
+	}
+
 	int signum = next_signal(current_thread->pending, current_thread->blocked);
 	if (!signum)
 		return;
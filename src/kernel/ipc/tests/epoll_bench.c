@@ -0,0 +1,173 @@
+#include <mqueue.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+#include "../../tests/bench.h"
+
+// 1000 message queues are watched but only one of them gets messages
+// poll has to scan every descriptor on each call, epoll only looks at the ready one
+// also checks level-triggered, edge-triggered and oneshot semantics on a pipe
+// build: i386-mos-gcc epoll_bench.c -o epoll_bench
+
+#define NR_WATCHED 1000
+#define ROUNDS 1000
+#define MSG_SIZE 16
+
+static int fds[NR_WATCHED];
+static struct pollfd pfds[NR_WATCHED];
+
+static bool open_queues()
+{
+	char name[32];
+	struct mq_attr attr = {.mq_maxmsg = 1, .mq_msgsize = MSG_SIZE};
+
+	for (int i = 0; i < NR_WATCHED; ++i)
+	{
+		snprintf(name, sizeof(name), "epoll_bench_%d", i);
+		fds[i] = mq_open(name, O_RDWR | O_CREAT | O_NONBLOCK, &attr);
+		if (fds[i] < 0)
+		{
+			printf("epoll: cannot open queue %d\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void close_queues()
+{
+	char name[32];
+
+	for (int i = 0; i < NR_WATCHED; ++i)
+	{
+		snprintf(name, sizeof(name), "epoll_bench_%d", i);
+		mq_close(fds[i]);
+		mq_unlink(name);
+	}
+}
+
+// return elapsed time, wake-ups which don't report the active queue are added to misses
+static int bench_poll(int active, int *misses)
+{
+	char msg[MSG_SIZE] = {0};
+
+	for (int i = 0; i < NR_WATCHED; ++i)
+		pfds[i] = (struct pollfd){.fd = fds[i], .events = POLLIN};
+
+	uint64_t start = now_ms();
+	for (int r = 0; r < ROUNDS; ++r)
+	{
+		mq_send(fds[active], msg, 0, MSG_SIZE);
+		if (poll(pfds, NR_WATCHED, -1) != 1 || !(pfds[active].revents & POLLIN))
+			(*misses)++;
+		mq_receive(fds[active], msg, 0, MSG_SIZE);
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	printf("poll: %d fds, %d rounds in %dms, %dus per wake-up\n", NR_WATCHED, ROUNDS, (int)elapsed, (int)(elapsed * 1000 / ROUNDS));
+	return elapsed;
+}
+
+static int bench_epoll(int active, int *misses)
+{
+	char msg[MSG_SIZE] = {0};
+	struct epoll_event ev;
+
+	int epfd = epoll_create1(0);
+	for (int i = 0; i < NR_WATCHED; ++i)
+		epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &(struct epoll_event){.events = EPOLLIN, .data.u32 = i});
+
+	uint64_t start = now_ms();
+	for (int r = 0; r < ROUNDS; ++r)
+	{
+		mq_send(fds[active], msg, 0, MSG_SIZE);
+		if (epoll_wait(epfd, &ev, 1, -1) != 1 || ev.data.u32 != (uint32_t)active)
+			(*misses)++;
+		mq_receive(fds[active], msg, 0, MSG_SIZE);
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	printf("epoll: %d fds, %d rounds in %dms, %dus per wake-up\n", NR_WATCHED, ROUNDS, (int)elapsed, (int)(elapsed * 1000 / ROUNDS));
+	close(epfd);
+	return elapsed;
+}
+
+static int expect(int epfd, int nr, const char *what)
+{
+	struct epoll_event ev;
+	int ret = epoll_wait(epfd, &ev, 1, 0);
+	if (ret == nr)
+		return 0;
+
+	printf("epoll: %s reported %d events, expected %d\n", what, ret, nr);
+	return 1;
+}
+
+static int check_triggers()
+{
+	int failures = 0;
+	int p[2];
+	char c = 'x';
+
+	pipe(p);
+	int lt = epoll_create1(0), et = epoll_create1(0), os = epoll_create1(0);
+	epoll_ctl(lt, EPOLL_CTL_ADD, p[0], &(struct epoll_event){.events = EPOLLIN});
+	epoll_ctl(et, EPOLL_CTL_ADD, p[0], &(struct epoll_event){.events = EPOLLIN | EPOLLET});
+	epoll_ctl(os, EPOLL_CTL_ADD, p[0], &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT});
+
+	failures += expect(lt, 0, "empty pipe");
+	write(p[1], &c, 1);
+
+	failures += expect(lt, 1, "level-triggered");
+	failures += expect(lt, 1, "level-triggered (again)");
+	failures += expect(et, 1, "edge-triggered");
+	failures += expect(et, 0, "edge-triggered (no new edge)");
+	failures += expect(os, 1, "oneshot");
+
+	write(p[1], &c, 1);
+	failures += expect(et, 1, "edge-triggered (new edge)");
+	failures += expect(os, 0, "oneshot (disarmed)");
+	epoll_ctl(os, EPOLL_CTL_MOD, p[0], &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT});
+	failures += expect(os, 1, "oneshot (rearmed)");
+
+	read(p[0], &c, 1);
+	read(p[0], &c, 1);
+	failures += expect(lt, 0, "level-triggered (drained)");
+
+	// closing a watched fd drops it from the set
+	close(p[0]);
+	if (epoll_ctl(lt, EPOLL_CTL_DEL, p[0], NULL) == 0)
+	{
+		printf("epoll: closed fd is still in the set\n");
+		failures++;
+	}
+
+	struct epoll_event ev;
+	uint64_t start = now_ms();
+	epoll_wait(lt, &ev, 1, 100);
+	printf("epoll: 100ms timeout took %dms\n", (int)(now_ms() - start));
+
+	close(p[1]);
+	close(lt);
+	close(et);
+	close(os);
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!open_queues())
+		return 1;
+
+	int active = NR_WATCHED / 2;
+	int misses = 0;
+	int elapsed_poll = bench_poll(active, &misses);
+	int elapsed_epoll = bench_epoll(active, &misses);
+	close_queues();
+
+	int failures = check(!misses, "%d wake-ups have not reported the active queue", misses);
+	// epoll does not scan the idle queues on each wait
+	failures += check(elapsed_epoll < elapsed_poll, "epoll is not faster than poll");
+	failures += check_triggers();
+	return test_result("epoll", failures);
+}
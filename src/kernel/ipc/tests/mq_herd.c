@@ -0,0 +1,124 @@
+#include <mqueue.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include "../../tests/bench.h"
+
+// 32 reader threads wait on one message queue while a writer sends messages one by one
+// - blocking mode: readers sleep in mq_receive (exclusive waiters, one is woken per message)
+// - poll mode: readers sleep in poll (non-exclusive, all are woken), then race for the message with O_NONBLOCK
+// wake-up/spurious counters are taken from /dev/lockstat (debug kernel), EAGAIN after poll is counted in userspace
+// build: i386-mos-gcc mq_herd.c -o mq_herd
+
+#define NR_READERS 32
+#define NR_MESSAGES 2000
+#define MSG_SIZE 16
+#define MSG_QUIT 0xffffffff
+// a blocking reader is only woken for a message it gets, apart from races with the writer
+#define SPURIOUS_SLACK (NR_READERS * 2)
+
+struct herd
+{
+	int fd;
+	bool use_poll;
+	volatile int received;
+	volatile int eagain;
+};
+
+static bool read_wq_stat(unsigned int *wakeups, unsigned int *spurious)
+{
+	char line[128];
+	return stat_line("/dev/lockstat", "wait-queue:", line, sizeof(line)) &&
+		   sscanf(line, "wait-queue: wakeups=%u spurious=%u", wakeups, spurious) == 2;
+}
+
+static void *reader(void *arg)
+{
+	struct herd *h = arg;
+	char msg[MSG_SIZE];
+
+	while (true)
+	{
+		if (h->use_poll)
+		{
+			struct pollfd pfd = {.fd = h->fd, .events = POLLIN};
+			poll(&pfd, 1, -1);
+		}
+
+		// errno is shared by threads, the only failure of a valid fd in poll mode is EAGAIN
+		if (mq_receive(h->fd, msg, 0, MSG_SIZE) < 0)
+		{
+			__atomic_add_fetch(&h->eagain, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (*(unsigned int *)msg == MSG_QUIT)
+			break;
+		__atomic_add_fetch(&h->received, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static void send_one(struct herd *h, unsigned int value)
+{
+	char msg[MSG_SIZE] = {0};
+	*(unsigned int *)msg = value;
+
+	while (mq_send(h->fd, msg, 0, MSG_SIZE) < 0)
+	{
+		struct pollfd pfd = {.fd = h->fd, .events = POLLOUT};
+		poll(&pfd, 1, -1);
+	}
+}
+
+// return the number of failed checks
+static int run(const char *name, bool use_poll)
+{
+	struct mq_attr attr = {.mq_maxmsg = 8, .mq_msgsize = MSG_SIZE};
+	struct herd h = {.use_poll = use_poll};
+
+	h.fd = mq_open(name, O_RDWR | O_CREAT | (use_poll ? O_NONBLOCK : 0), &attr);
+	if (h.fd < 0)
+		return check(0, "%s: mq_open failed", name);
+
+	unsigned int wakeups[2] = {0}, spurious[2] = {0};
+	bool has_stat = read_wq_stat(&wakeups[0], &spurious[0]);
+
+	pthread_t threads[NR_READERS];
+	for (int i = 0; i < NR_READERS; ++i)
+		pthread_create(&threads[i], NULL, reader, &h);
+
+	for (unsigned int i = 0; i < NR_MESSAGES; ++i)
+		send_one(&h, i);
+	for (int i = 0; i < NR_READERS; ++i)
+		send_one(&h, MSG_QUIT);
+
+	for (int i = 0; i < NR_READERS; ++i)
+		pthread_join(threads[i], NULL);
+
+	if (has_stat)
+		read_wq_stat(&wakeups[1], &spurious[1]);
+
+	printf("%s: %d messages, %d readers, EAGAIN after wake-up=%d", use_poll ? "poll" : "blocking",
+		   h.received, NR_READERS, h.eagain);
+	if (has_stat)
+		printf(", wakeups=%u spurious=%u", wakeups[1] - wakeups[0], spurious[1] - spurious[0]);
+	printf("\n");
+
+	mq_close(h.fd);
+	mq_unlink(name);
+
+	int failures = check(h.received == NR_MESSAGES, "%s: %d of %d messages are received", name, h.received, NR_MESSAGES);
+	// exclusive waiters, the herd is only woken in poll mode (wait queue stats are only there in debug kernel)
+	if (has_stat && !use_poll)
+		failures += check(spurious[1] - spurious[0] <= SPURIOUS_SLACK, "%s: %u spurious wake-ups", name,
+						  spurious[1] - spurious[0]);
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	int failures = run("mq_herd", false);
+	failures += run("mq_herd_poll", true);
+	return test_result("mq_herd", failures);
+}
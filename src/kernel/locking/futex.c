@@ -0,0 +1,352 @@
+#include "futex.h"
+
+#include <include/errno.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <utils/debug.h>
+
+static struct futex_hash_bucket futex_queues[FUTEX_HASH_SIZE];
+
+static struct futex_hash_bucket *hash_futex(uint32_t key)
+{
+	return &futex_queues[(key * 0x9E370001UL) >> (32 - FUTEX_HASH_BITS)];
+}
+
+// physical address of user word, 0 if it is not mapped
+static uint32_t get_futex_key(uint32_t *uaddr)
+{
+	uint32_t vaddr = (uint32_t)uaddr;
+	if (!vaddr || vaddr >= KERNEL_HIGHER_HALF)
+		return 0;
+
+	return vmm_get_mapped_physical_address(vaddr);
+}
+
+static void futex_timeout(struct timer_list *timer)
+{
+	struct futex_q *q = from_timer(q, timer, timer);
+	list_del(&timer->sibling);
+	update_thread(q->thread, THREAD_READY);
+}
+
+static void futex_wake_one(struct futex_q *q)
+{
+	list_del(&q->sibling);
+	q->woken = true;
+	update_thread(q->thread, THREAD_READY);
+}
+
+/*
+ * Checking the user value and queuing is done with scheduler locked, a waker (which runs after us on this cpu)
+ * either sees our entry in the bucket or we see the changed value and return -EAGAIN -> no lost wake-ups
+ * Return 0 if woken by FUTEX_WAKE, -ETIMEDOUT if timeout elapsed, -EINTR if there is an unblocked pending signal
+ */
+int futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *timeout)
+{
+	if ((uint32_t)uaddr & 0x3)
+		return -EINVAL;
+	if (timeout && (timeout->tv_sec < 0 || timeout->tv_nsec < 0 || timeout->tv_nsec >= 1000000000))
+		return -EINVAL;
+
+	uint32_t key = get_futex_key(uaddr);
+	if (!key)
+		return -EFAULT;
+
+	struct futex_q q = {
+		.key = key,
+		.thread = current_thread,
+		.timer = TIMER_INITIALIZER(futex_timeout, UINT32_MAX),
+		.woken = false,
+	};
+	struct futex_hash_bucket *hb = hash_futex(key);
+	int ret = 0;
+
+	lock_scheduler();
+
+	if (*(volatile uint32_t *)uaddr != val)
+	{
+		unlock_scheduler();
+		return -EAGAIN;
+	}
+
+	list_add_tail(&q.sibling, &hb->chain);
+	if (timeout)
+	{
+		q.timer.expires = get_milliseconds(NULL) + (uint64_t)timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000;
+		add_timer(&q.timer);
+	}
+
+	while (!q.woken)
+	{
+		if (timeout && !is_actived_timer(&q.timer))
+		{
+			ret = -ETIMEDOUT;
+			break;
+		}
+		if (current_thread->pending & ~current_thread->blocked)
+		{
+			ret = -EINTR;
+			break;
+		}
+
+		update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+		lock_scheduler();
+	}
+
+	if (!q.woken)
+		list_del(&q.sibling);
+	if (timeout && is_actived_timer(&q.timer))
+		del_timer(&q.timer);
+
+	unlock_scheduler();
+	return ret;
+}
+
+int futex_wake(uint32_t *uaddr, int nr_wake)
+{
+	uint32_t key = get_futex_key(uaddr);
+	if (!key)
+		return -EFAULT;
+
+	struct futex_hash_bucket *hb = hash_futex(key);
+	struct futex_q *iter, *next;
+	int nr = 0;
+
+	lock_scheduler();
+
+	list_for_each_entry_safe(iter, next, &hb->chain, sibling)
+	{
+		if (nr >= nr_wake)
+			break;
+		if (iter->key != key)
+			continue;
+
+		futex_wake_one(iter);
+		nr++;
+	}
+
+	unlock_scheduler();
+	return nr;
+}
+
+// wake up to `nr_wake` waiters of `uaddr` and move up to `nr_requeue` of the rest to `uaddr2` (avoid thundering herd in condvar broadcast)
+int futex_requeue(uint32_t *uaddr, int nr_wake, int nr_requeue, uint32_t *uaddr2)
+{
+	uint32_t key = get_futex_key(uaddr);
+	uint32_t key2 = get_futex_key(uaddr2);
+	if (!key || !key2)
+		return -EFAULT;
+
+	struct futex_hash_bucket *hb = hash_futex(key);
+	struct futex_hash_bucket *hb2 = hash_futex(key2);
+	struct futex_q *iter, *next;
+	int nr = 0, nr_moved = 0;
+
+	lock_scheduler();
+
+	list_for_each_entry_safe(iter, next, &hb->chain, sibling)
+	{
+		if (iter->key != key)
+			continue;
+
+		if (nr < nr_wake)
+		{
+			futex_wake_one(iter);
+			nr++;
+		}
+		else if (nr_moved < nr_requeue)
+		{
+			iter->key = key2;
+			if (hb != hb2)
+				list_move_tail(&iter->sibling, &hb2->chain);
+			nr_moved++;
+		}
+		else
+			break;
+	}
+
+	unlock_scheduler();
+	return nr + nr_moved;
+}
+
+static struct futex_pi_state *find_pi_state(struct futex_hash_bucket *hb, uint32_t key)
+{
+	struct futex_pi_state *iter;
+	list_for_each_entry(iter, &hb->pi_states, sibling)
+	{
+		if (iter->key == key)
+			return iter;
+	}
+	return NULL;
+}
+
+/*
+ * Userspace takes a free pi futex by cmpxchg 0 -> tid and only comes here when it is owned
+ * the owner (found by tid in futex word) inherits priority of the top waiter until it calls FUTEX_UNLOCK_PI,
+ * which hands futex word directly to that waiter. Scheduler is locked while touching user word -> no other
+ * thread can change it in between on this cpu
+ * Return -EINTR if an unblocked signal or group exit arrives first, -EOWNERDEAD if the owner has exited
+ * while holding it, the lock is ours then and futex word is tagged FUTEX_OWNER_DIED
+ */
+int futex_lock_pi(uint32_t *uaddr)
+{
+	if ((uint32_t)uaddr & 0x3)
+		return -EINVAL;
+
+	uint32_t key = get_futex_key(uaddr);
+	if (!key)
+		return -EFAULT;
+
+	struct futex_hash_bucket *hb = hash_futex(key);
+	volatile uint32_t *word = uaddr;
+
+	lock_scheduler();
+
+	struct futex_pi_state *state = find_pi_state(hb, key);
+	tid_t owner_tid = *word & FUTEX_TID_MASK;
+	if (!owner_tid)
+	{
+		*word = current_thread->tid | (state && pi_has_waiters(&state->pi) ? FUTEX_WAITERS : 0);
+		unlock_scheduler();
+		return 0;
+	}
+	if (owner_tid == current_thread->tid)
+	{
+		unlock_scheduler();
+		return -EDEADLK;
+	}
+
+	if (!state)
+	{
+		struct thread *owner = find_thread_by_tid(owner_tid);
+		if (!owner || owner->state == THREAD_TERMINATED)
+		{
+			*word = current_thread->tid | FUTEX_OWNER_DIED;
+			unlock_scheduler();
+			return -EOWNERDEAD;
+		}
+
+		state = kcalloc(1, sizeof(struct futex_pi_state));
+		state->key = key;
+		pi_lock_init(&state->pi, true);
+		pi_set_owner(&state->pi, owner);
+		list_add_tail(&state->sibling, &hb->pi_states);
+	}
+	*word |= FUTEX_WAITERS;
+
+	struct pi_waiter waiter;
+	int ret = 0;
+	pi_enqueue_waiter(&state->pi, &waiter);
+	while (!waiter.granted)
+	{
+		// owner has exited without unlocking, we take the lock over and let caller know its data might be inconsistent
+		struct thread *owner = state->pi.owner;
+		if (!owner || owner->state == THREAD_TERMINATED)
+		{
+			pi_remove_waiter(&state->pi, &waiter);
+			pi_set_owner(&state->pi, current_thread);
+			*word = current_thread->tid | FUTEX_OWNER_DIED | (pi_has_waiters(&state->pi) ? FUTEX_WAITERS : 0);
+			ret = -EOWNERDEAD;
+			break;
+		}
+		if ((current_thread->pending & ~current_thread->blocked) || (current_thread->flags & TIF_GROUP_EXIT))
+		{
+			pi_remove_waiter(&state->pi, &waiter);
+			if (!pi_has_waiters(&state->pi))
+				*word &= ~FUTEX_WAITERS;
+			ret = -EINTR;
+			break;
+		}
+
+		update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+		lock_scheduler();
+	}
+
+	// granted -> `futex_unlock_pi` has already freed state if we were the last waiter
+	if (ret && !pi_has_waiters(&state->pi))
+	{
+		list_del(&state->sibling);
+		kfree(state);
+	}
+
+	// otherwise `futex_unlock_pi` has written our tid into futex word
+	unlock_scheduler();
+	return ret;
+}
+
+int futex_unlock_pi(uint32_t *uaddr)
+{
+	uint32_t key = get_futex_key(uaddr);
+	if (!key)
+		return -EFAULT;
+
+	struct futex_hash_bucket *hb = hash_futex(key);
+	volatile uint32_t *word = uaddr;
+
+	lock_scheduler();
+
+	if ((*word & FUTEX_TID_MASK) != current_thread->tid)
+	{
+		unlock_scheduler();
+		return -EPERM;
+	}
+
+	struct futex_pi_state *state = find_pi_state(hb, key);
+	struct pi_waiter *waiter = NULL;
+	if (state)
+	{
+		pi_set_owner(&state->pi, current_thread);
+		waiter = pi_wake_top_waiter(&state->pi);
+	}
+
+	if (waiter)
+		*word = waiter->task->tid | (pi_has_waiters(&state->pi) ? FUTEX_WAITERS : 0);
+	else
+		*word = 0;
+
+	if (state && !pi_has_waiters(&state->pi))
+	{
+		list_del(&state->sibling);
+		kfree(state);
+	}
+
+	unlock_scheduler();
+	return 0;
+}
+
+int do_futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout, uint32_t *uaddr2)
+{
+	switch (op & FUTEX_CMD_MASK)
+	{
+	case FUTEX_WAIT:
+		return futex_wait(uaddr, val, timeout);
+	case FUTEX_WAKE:
+		return futex_wake(uaddr, val);
+	case FUTEX_REQUEUE:
+		// linux passes nr_requeue in place of timeout
+		return futex_requeue(uaddr, val, (int)timeout, uaddr2);
+	case FUTEX_LOCK_PI:
+		return futex_lock_pi(uaddr);
+	case FUTEX_UNLOCK_PI:
+		return futex_unlock_pi(uaddr);
+	default:
+		return -ENOSYS;
+	}
+}
+
+void futex_init()
+{
+	log("Futex: Initializing");
+
+	for (int i = 0; i < FUTEX_HASH_SIZE; ++i)
+	{
+		INIT_LIST_HEAD(&futex_queues[i].chain);
+		INIT_LIST_HEAD(&futex_queues[i].pi_states);
+	}
+
+	log("Futex: Done");
+}
@@ -0,0 +1,62 @@
+#ifndef LOCKING_FUTEX_H
+#define LOCKING_FUTEX_H
+
+#include <include/list.h>
+#include <locking/pi.h>
+#include <stdint.h>
+#include <system/time.h>
+#include <system/timer.h>
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+#define FUTEX_LOCK_PI 6
+#define FUTEX_UNLOCK_PI 7
+
+#define FUTEX_PRIVATE_FLAG 128
+#define FUTEX_CMD_MASK (~FUTEX_PRIVATE_FLAG)
+
+// pi futex word: tid of owner, FUTEX_WAITERS is set by kernel when someone sleeps on it -> unlock has to enter kernel
+#define FUTEX_WAITERS 0x80000000
+#define FUTEX_OWNER_DIED 0x40000000
+#define FUTEX_TID_MASK 0x3fffffff
+
+#define FUTEX_HASH_BITS 8
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+struct thread;
+
+// futex is identified by physical address of the user word, two processes which map the same frame
+// (shm_open + mmap) at different virtual addresses still meet in the same queue
+struct futex_q
+{
+	uint32_t key;
+	struct thread *thread;
+	struct list_head sibling;  // in futex_hash_bucket->chain
+	struct timer_list timer;
+	bool woken;
+};
+
+// kernel side of a contended pi futex, it exists while there are waiters
+struct futex_pi_state
+{
+	uint32_t key;
+	struct pi_lock pi;
+	struct list_head sibling;  // in futex_hash_bucket->pi_states
+};
+
+struct futex_hash_bucket
+{
+	struct list_head chain;
+	struct list_head pi_states;
+};
+
+int futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *timeout);
+int futex_wake(uint32_t *uaddr, int nr_wake);
+int futex_requeue(uint32_t *uaddr, int nr_wake, int nr_requeue, uint32_t *uaddr2);
+int futex_lock_pi(uint32_t *uaddr);
+int futex_unlock_pi(uint32_t *uaddr);
+int do_futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout, uint32_t *uaddr2);
+void futex_init();
+
+#endif
@@ -0,0 +1,56 @@
+#include "lock_stat.h"
+
+#include <utils/vsprintf.h>
+
+#ifdef LOCK_STAT
+
+static LIST_HEAD(lock_classes);
+
+// `contended_at` is 0 if lock is taken without waiting
+void lock_stat_acquired(struct lock_class_stat *class, uint64_t contended_at)
+{
+	if (!class)
+		return;
+
+	// classes are registered lazily, most of them are static locals in init functions
+	if (!class->sibling.next)
+		list_add_tail(&class->sibling, &lock_classes);
+
+	class->nr_acquired++;
+	if (contended_at)
+	{
+		uint64_t wait = lock_stat_clock() - contended_at;
+		class->nr_contended++;
+		class->wait_total += wait;
+		if (wait > class->wait_max)
+			class->wait_max = wait;
+	}
+}
+
+void lock_stat_released(struct lock_class_stat *class, uint64_t acquired_at)
+{
+	if (!class || !acquired_at)
+		return;
+
+	uint64_t hold = lock_stat_clock() - acquired_at;
+	class->hold_total += hold;
+	if (hold > class->hold_max)
+		class->hold_max = hold;
+}
+
+int lock_stat_print(char *buf, size_t size)
+{
+	int len = scnprintf(buf, size, "%-24s %10s %10s %14s %14s %14s %14s\n",
+						"class", "acquired", "contended", "wait-total", "wait-max", "hold-total", "hold-max");
+
+	struct lock_class_stat *iter;
+	list_for_each_entry(iter, &lock_classes, sibling)
+	{
+		len += scnprintf(buf + len, size - len, "%-24s %10u %10u %14llu %14llu %14llu %14llu\n",
+						 iter->name, iter->nr_acquired, iter->nr_contended,
+						 iter->wait_total, iter->wait_max, iter->hold_total, iter->hold_max);
+	}
+	return len;
+}
+
+#endif
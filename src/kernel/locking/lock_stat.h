@@ -0,0 +1,46 @@
+#ifndef LOCKING_LOCK_STAT_H
+#define LOCKING_LOCK_STAT_H
+
+#include <cpu/hal.h>
+#include <include/list.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/debug.h>
+
+// Contention statistics are only collected in debug builds. Locks are grouped by their init site (lock class)
+// e.g. all inodes' i_mutex share one entry, classes are listed in /dev/lockstat
+#ifdef KERNEL_DEBUG
+#define LOCK_STAT 1
+#endif
+
+struct lock_class_stat
+{
+	const char *name;
+	uint32_t nr_acquired;
+	uint32_t nr_contended;
+	// in cpu cycles
+	uint64_t wait_total, wait_max;
+	uint64_t hold_total, hold_max;
+	struct list_head sibling;
+};
+
+#define LOCK_CLASS_STAT_INIT(_name) \
+	{                               \
+		.name = (_name),            \
+	}
+
+static inline uint64_t lock_stat_clock()
+{
+	return rdtsc();
+}
+
+#ifdef LOCK_STAT
+void lock_stat_acquired(struct lock_class_stat *class, uint64_t contended_at);
+void lock_stat_released(struct lock_class_stat *class, uint64_t acquired_at);
+int lock_stat_print(char *buf, size_t size);
+#else
+#define lock_stat_acquired(class, contended_at) ((void)0)
+#define lock_stat_released(class, acquired_at) ((void)0)
+#endif
+
+#endif
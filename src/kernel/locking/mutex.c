@@ -0,0 +1,126 @@
+#include "mutex.h"
+
+#include <proc/task.h>
+
+void __mutex_init(struct mutex *lock, struct lock_class_stat *class)
+{
+	atomic_set(&lock->count, 1);
+	lock->owner = NULL;
+	pi_lock_init(&lock->pi, true);
+#ifdef LOCK_STAT
+	lock->class = class;
+	lock->acquired_at = 0;
+#endif
+}
+
+static void mutex_set_owner(struct mutex *lock, uint64_t contended_at)
+{
+	lock->owner = current_thread;
+#ifdef LOCK_STAT
+	lock_stat_acquired(lock->class, contended_at);
+	lock->acquired_at = lock_stat_clock();
+#endif
+}
+
+/*
+ * Spinning only makes sense while owner is running on another cpu and is about to release the lock
+ * on single cpu, owner cannot run while we are spinning so we fall through to sleep right away
+ */
+static bool mutex_optimistic_spin(struct mutex *lock)
+{
+	for (int i = 0; i < MUTEX_SPIN_COUNT; ++i)
+	{
+		struct thread *owner = lock->owner;
+		if (!owner || owner == current_thread || owner->state != THREAD_RUNNING)
+			break;
+
+		cpu_relax();
+		if (atomic_cmpxchg(&lock->count, 1, 0) == 1)
+			return true;
+	}
+	return false;
+}
+
+static void mutex_lock_slowpath(struct mutex *lock)
+{
+	uint64_t contended_at = lock_stat_clock();
+
+	if (mutex_optimistic_spin(lock))
+	{
+		mutex_set_owner(lock, contended_at);
+		return;
+	}
+
+	lock_scheduler();
+
+	// owner might have released it in between
+	if (atomic_cmpxchg(&lock->count, 1, 0) == 1)
+	{
+		mutex_set_owner(lock, contended_at);
+		unlock_scheduler();
+		return;
+	}
+
+	// owner which took it on the fast path is only known by `lock->owner`
+	// (it is NULL for a moment when lock is handed over, then `pi.owner` is already set)
+	if (lock->owner)
+		pi_set_owner(&lock->pi, lock->owner);
+	struct pi_waiter waiter;
+	pi_enqueue_waiter(&lock->pi, &waiter);
+	atomic_set(&lock->count, -1);
+
+	while (!waiter.granted)
+	{
+		update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+		lock_scheduler();
+	}
+
+	// `mutex_unlock` has removed us from wait list and kept lock in locked state
+	mutex_set_owner(lock, contended_at);
+	unlock_scheduler();
+}
+
+void mutex_lock(struct mutex *lock)
+{
+	if (atomic_cmpxchg(&lock->count, 1, 0) == 1)
+		mutex_set_owner(lock, 0);
+	else
+		mutex_lock_slowpath(lock);
+}
+
+bool mutex_trylock(struct mutex *lock)
+{
+	if (atomic_cmpxchg(&lock->count, 1, 0) != 1)
+		return false;
+
+	mutex_set_owner(lock, 0);
+	return true;
+}
+
+static void mutex_unlock_slowpath(struct mutex *lock)
+{
+	lock_scheduler();
+
+	// hand over (lock stays locked for the waiter), we drop priority inherited from waiters
+	pi_set_owner(&lock->pi, current_thread);
+	if (pi_wake_top_waiter(&lock->pi))
+		atomic_set(&lock->count, pi_has_waiters(&lock->pi) ? -1 : 0);
+	else
+		atomic_set(&lock->count, 1);
+
+	unlock_scheduler();
+}
+
+void mutex_unlock(struct mutex *lock)
+{
+#ifdef LOCK_STAT
+	lock_stat_released(lock->class, lock->acquired_at);
+	lock->acquired_at = 0;
+#endif
+	lock->owner = NULL;
+
+	if (atomic_cmpxchg(&lock->count, 0, 1) != 0)
+		mutex_unlock_slowpath(lock);
+}
@@ -0,0 +1,51 @@
+#ifndef LOCKING_MUTEX_H
+#define LOCKING_MUTEX_H
+
+#include <include/atomic.h>
+#include <include/list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lock_stat.h"
+#include "pi.h"
+
+struct thread;
+
+// count: 1 unlocked, 0 locked, -1 locked and there are waiters
+// uncontended lock/unlock is a single cmpxchg, waiters are handed the lock directly in priority (then FIFO) order
+// owner inherits priority of its top waiter (pi.h)
+struct mutex
+{
+	atomic_t count;
+	struct thread *owner;
+	struct pi_lock pi;
+#ifdef LOCK_STAT
+	struct lock_class_stat *class;
+	uint64_t acquired_at;
+#endif
+};
+
+// how many times a contender polls the owner before sleeping
+#define MUTEX_SPIN_COUNT 100
+
+void __mutex_init(struct mutex *lock, struct lock_class_stat *class);
+
+#ifdef LOCK_STAT
+#define mutex_init(lock) ({                                              \
+	static struct lock_class_stat __class = LOCK_CLASS_STAT_INIT(#lock); \
+	__mutex_init((lock), &__class);                                      \
+})
+#else
+#define mutex_init(lock) __mutex_init((lock), NULL)
+#endif
+
+void mutex_lock(struct mutex *lock);
+bool mutex_trylock(struct mutex *lock);
+void mutex_unlock(struct mutex *lock);
+
+static inline bool mutex_is_locked(struct mutex *lock)
+{
+	return atomic_read(&lock->count) != 1;
+}
+
+#endif
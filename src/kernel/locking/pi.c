@@ -0,0 +1,245 @@
+#include "pi.h"
+
+#include <include/limits.h>
+#include <proc/task.h>
+
+// blocking chains longer than this are not followed (and a cycle, which is a deadlock anyway, ends here)
+#define PI_MAX_CHAIN 16
+
+static int pi_key(enum thread_policy policy, int prio)
+{
+	return policy == THREAD_APP_POLICY ? INT_MAX : (int)policy * PI_POLICY_RANGE + prio;
+}
+
+static int thread_pi_key(struct thread *th)
+{
+	return pi_key(th->policy, th->sched_sibling.prio);
+}
+
+static int thread_normal_key(struct thread *th)
+{
+	return th->pi_boosted ? pi_key(th->normal_policy, th->normal_prio) : thread_pi_key(th);
+}
+
+static struct pi_waiter *pi_top_waiter(struct pi_lock *lock)
+{
+	if (plist_head_empty(&lock->waiters))
+		return NULL;
+	return plist_first_entry(&lock->waiters, struct pi_waiter, sibling);
+}
+
+static void pi_add_owner_waiter(struct thread *owner, struct pi_waiter *waiter)
+{
+	plist_node_init(&waiter->pi_sibling, waiter->sibling.prio);
+	plist_add(&waiter->pi_sibling, &owner->pi_waiters);
+}
+
+// effective priority = the best of thread's own and its top pi waiter, return true if it has changed
+static bool pi_adjust_prio(struct thread *th)
+{
+	int normal = thread_normal_key(th);
+	int top = plist_head_empty(&th->pi_waiters) ? INT_MAX : plist_first(&th->pi_waiters)->prio;
+
+	if (top < normal)
+	{
+		if (!th->pi_boosted)
+		{
+			th->normal_policy = th->policy;
+			th->normal_prio = th->sched_sibling.prio;
+			th->pi_boosted = true;
+		}
+		if (top == thread_pi_key(th))
+			return false;
+
+		sched_setprio(th, top / PI_POLICY_RANGE, top % PI_POLICY_RANGE);
+		return true;
+	}
+
+	if (!th->pi_boosted)
+		return false;
+
+	th->pi_boosted = false;
+	sched_setprio(th, th->normal_policy, th->normal_prio);
+	return true;
+}
+
+// walk from `th` along locks it is blocked on, each owner gets the new priority of its top waiter
+static void pi_adjust_chain(struct thread *th)
+{
+	for (int depth = 0; th && depth < PI_MAX_CHAIN; ++depth)
+	{
+		if (!pi_adjust_prio(th) || !th->pi_blocked_on)
+			break;
+
+		struct pi_waiter *waiter = th->pi_blocked_on;
+		struct pi_lock *lock = waiter->lock;
+		struct pi_waiter *prev_top = pi_top_waiter(lock);
+
+		plist_del(&waiter->sibling, &lock->waiters);
+		plist_node_init(&waiter->sibling, thread_pi_key(th));
+		plist_add(&waiter->sibling, &lock->waiters);
+
+		th = lock->owner;
+		if (!th)
+			break;
+
+		plist_del(&prev_top->pi_sibling, &th->pi_waiters);
+		pi_add_owner_waiter(th, pi_top_waiter(lock));
+	}
+}
+
+void pi_lock_init(struct pi_lock *lock, bool owned)
+{
+	*lock = (struct pi_lock)__PI_LOCK_INITIALIZER(*lock, owned);
+}
+
+// current thread is about to sleep on `lock`, called with scheduler locked
+void pi_enqueue_waiter(struct pi_lock *lock, struct pi_waiter *waiter)
+{
+	struct pi_waiter *prev_top = pi_top_waiter(lock);
+
+	waiter->task = current_thread;
+	waiter->lock = lock;
+	waiter->granted = false;
+	plist_node_init(&waiter->sibling, thread_pi_key(current_thread));
+	plist_add(&waiter->sibling, &lock->waiters);
+	current_thread->pi_blocked_on = waiter;
+
+	struct thread *owner = lock->owner;
+	if (!owner || pi_top_waiter(lock) == prev_top)
+		return;
+
+	if (prev_top)
+		plist_del(&prev_top->pi_sibling, &owner->pi_waiters);
+	pi_add_owner_waiter(owner, waiter);
+	pi_adjust_chain(owner);
+}
+
+// waiter gives up (timeout, signal) before being granted
+void pi_remove_waiter(struct pi_lock *lock, struct pi_waiter *waiter)
+{
+	struct pi_waiter *prev_top = pi_top_waiter(lock);
+
+	plist_del(&waiter->sibling, &lock->waiters);
+	waiter->task->pi_blocked_on = NULL;
+
+	struct thread *owner = lock->owner;
+	if (!owner || waiter != prev_top)
+		return;
+
+	plist_del(&waiter->pi_sibling, &owner->pi_waiters);
+	struct pi_waiter *top = pi_top_waiter(lock);
+	if (top)
+		pi_add_owner_waiter(owner, top);
+	pi_adjust_chain(owner);
+}
+
+// ownership moves without handing over to a waiter (acquired uncontended, released without waiters or found via futex word)
+void pi_set_owner(struct pi_lock *lock, struct thread *owner)
+{
+	if (!lock->owned || lock->owner == owner)
+		return;
+
+	struct thread *prev_owner = lock->owner;
+	struct pi_waiter *top = pi_top_waiter(lock);
+
+	lock->owner = owner;
+	if (!top)
+		return;
+
+	if (prev_owner)
+	{
+		plist_del(&top->pi_sibling, &prev_owner->pi_waiters);
+		pi_adjust_chain(prev_owner);
+	}
+	if (owner)
+	{
+		pi_add_owner_waiter(owner, top);
+		pi_adjust_chain(owner);
+	}
+}
+
+/*
+  Hand the lock over to the most important waiter, called with scheduler locked
+  - waiter becomes owner and inherits the next waiter
+  - previous owner drops the priority it has got from this lock
+  return NULL if there is no one to wake up (zapped waiters are skipped), lock is free then
+*/
+struct pi_waiter *pi_wake_top_waiter(struct pi_lock *lock)
+{
+	struct thread *prev_owner = lock->owner;
+	struct pi_waiter *top = pi_top_waiter(lock);
+
+	if (prev_owner && top)
+		plist_del(&top->pi_sibling, &prev_owner->pi_waiters);
+
+	// waiter might be zapped by its sibling thread while sleeping (its stack is never reused)
+	while (top && top->task->state == THREAD_TERMINATED)
+	{
+		plist_del(&top->sibling, &lock->waiters);
+		top->task->pi_blocked_on = NULL;
+		top = pi_top_waiter(lock);
+	}
+
+	lock->owner = NULL;
+	if (top)
+	{
+		plist_del(&top->sibling, &lock->waiters);
+		top->task->pi_blocked_on = NULL;
+		top->granted = true;
+
+		if (lock->owned)
+		{
+			lock->owner = top->task;
+			struct pi_waiter *next = pi_top_waiter(lock);
+			if (next)
+			{
+				pi_add_owner_waiter(top->task, next);
+				pi_adjust_chain(top->task);
+			}
+		}
+	}
+
+	if (prev_owner)
+		pi_adjust_chain(prev_owner);
+	if (top)
+		update_thread(top->task, THREAD_READY);
+	return top;
+}
+
+// change thread's own priority, a boosted thread keeps the inherited one until it is no longer better
+void pi_setscheduler(struct thread *th, int policy, int prio)
+{
+	lock_scheduler();
+
+	if (th->pi_boosted)
+	{
+		th->normal_policy = policy;
+		th->normal_prio = prio;
+	}
+	else
+		sched_setprio(th, policy, prio);
+	pi_adjust_prio(th);
+
+	// a changed priority has to reach owner of the lock thread is waiting on
+	struct pi_waiter *waiter = th->pi_blocked_on;
+	if (waiter)
+	{
+		struct pi_lock *lock = waiter->lock;
+		pi_remove_waiter(lock, waiter);
+		plist_node_init(&waiter->sibling, thread_pi_key(th));
+		struct pi_waiter *prev_top = pi_top_waiter(lock);
+		plist_add(&waiter->sibling, &lock->waiters);
+		th->pi_blocked_on = waiter;
+
+		if (lock->owner && pi_top_waiter(lock) != prev_top)
+		{
+			if (prev_top)
+				plist_del(&prev_top->pi_sibling, &lock->owner->pi_waiters);
+			pi_add_owner_waiter(lock->owner, waiter);
+			pi_adjust_chain(lock->owner);
+		}
+	}
+
+	unlock_scheduler();
+}
@@ -0,0 +1,53 @@
+#ifndef LOCKING_PI_H
+#define LOCKING_PI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <utils/plist.h>
+
+struct thread;
+
+// Priority inheritance, waiters of a lock are sorted by priority and the top one lends its priority to lock's owner
+// owner keeps top waiter of every lock it holds in `thread->pi_waiters`, its effective priority is the best of them
+// and its own. A boosted owner which is blocked on another lock passes priority on along the chain
+struct pi_lock
+{
+	struct thread *owner;
+	bool owned;	 // false -> holder is not tracked (counting semaphore), waiters are only sorted
+	struct plist_head waiters;
+};
+
+// lives on the stack of sleeping thread
+struct pi_waiter
+{
+	struct thread *task;
+	struct pi_lock *lock;
+	struct plist_node sibling;	   // in lock->waiters
+	struct plist_node pi_sibling;  // in lock->owner->pi_waiters if it is the top waiter
+	bool granted;
+};
+
+#define __PI_LOCK_INITIALIZER(name, _owned)          \
+	{                                                \
+		.owner = NULL,                               \
+		.owned = (_owned),                           \
+		.waiters = PLIST_HEAD_INIT((name).waiters), \
+	}
+
+// kernel policy < system policy < app policy, priority only orders kernel/system threads
+// app threads take turns by time slice -> they neither boost nor are boosted by each other
+#define PI_POLICY_RANGE 0x10000
+
+void pi_lock_init(struct pi_lock *lock, bool owned);
+void pi_enqueue_waiter(struct pi_lock *lock, struct pi_waiter *waiter);
+void pi_remove_waiter(struct pi_lock *lock, struct pi_waiter *waiter);
+struct pi_waiter *pi_wake_top_waiter(struct pi_lock *lock);
+void pi_set_owner(struct pi_lock *lock, struct thread *owner);
+void pi_setscheduler(struct thread *th, int policy, int prio);
+
+static inline bool pi_has_waiters(struct pi_lock *lock)
+{
+	return !plist_head_empty(&lock->waiters);
+}
+
+#endif
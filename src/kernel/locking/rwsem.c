@@ -0,0 +1,181 @@
+#include "rwsem.h"
+
+#include <proc/task.h>
+
+void __init_rwsem(struct rw_semaphore *sem, struct lock_class_stat *class)
+{
+	sem->count = 0;
+	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef LOCK_STAT
+	sem->class = class;
+	sem->acquired_at = 0;
+#endif
+}
+
+static void rwsem_acquired(struct rw_semaphore *sem, uint64_t contended_at)
+{
+#ifdef LOCK_STAT
+	lock_stat_acquired(sem->class, contended_at);
+	// hold time is counted from the first reader (or writer) until semaphore is free again
+	if (!sem->acquired_at)
+		sem->acquired_at = lock_stat_clock();
+#endif
+}
+
+static void rwsem_released(struct rw_semaphore *sem)
+{
+#ifdef LOCK_STAT
+	if (sem->count == 0)
+	{
+		lock_stat_released(sem->class, sem->acquired_at);
+		sem->acquired_at = 0;
+	}
+#endif
+}
+
+/*
+ * Grant semaphore to waiters at the head of queue, must be called with scheduler locked
+ * - a writer at the head gets it alone if semaphore is free
+ * - otherwise every reader at the head is granted until the first writer
+ */
+static void rwsem_wake(struct rw_semaphore *sem)
+{
+	struct rwsem_waiter *iter, *next;
+	list_for_each_entry_safe(iter, next, &sem->wait_list, sibling)
+	{
+		// waiter might be zapped by its sibling thread while sleeping (its stack is never reused)
+		if (iter->task->state == THREAD_TERMINATED)
+		{
+			list_del(&iter->sibling);
+			continue;
+		}
+
+		if (iter->type == RWSEM_WAITING_FOR_WRITE)
+		{
+			if (sem->count == 0)
+			{
+				sem->count = -1;
+				list_del(&iter->sibling);
+				iter->granted = true;
+				update_thread(iter->task, THREAD_READY);
+			}
+			break;
+		}
+
+		sem->count++;
+		list_del(&iter->sibling);
+		iter->granted = true;
+		update_thread(iter->task, THREAD_READY);
+	}
+}
+
+static void rwsem_wait(struct rw_semaphore *sem, enum rwsem_waiter_type type)
+{
+	struct rwsem_waiter waiter = {
+		.task = current_thread,
+		.type = type,
+		.granted = false,
+	};
+	list_add_tail(&waiter.sibling, &sem->wait_list);
+
+	while (!waiter.granted)
+	{
+		update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+		lock_scheduler();
+	}
+}
+
+void down_read(struct rw_semaphore *sem)
+{
+	lock_scheduler();
+
+	if (sem->count >= 0 && list_empty(&sem->wait_list))
+	{
+		sem->count++;
+		rwsem_acquired(sem, 0);
+	}
+	else
+	{
+		uint64_t contended_at = lock_stat_clock();
+		rwsem_wait(sem, RWSEM_WAITING_FOR_READ);
+		rwsem_acquired(sem, contended_at);
+	}
+
+	unlock_scheduler();
+}
+
+bool down_read_trylock(struct rw_semaphore *sem)
+{
+	bool ret = false;
+	lock_scheduler();
+
+	if (sem->count >= 0 && list_empty(&sem->wait_list))
+	{
+		sem->count++;
+		rwsem_acquired(sem, 0);
+		ret = true;
+	}
+
+	unlock_scheduler();
+	return ret;
+}
+
+void up_read(struct rw_semaphore *sem)
+{
+	lock_scheduler();
+
+	sem->count--;
+	rwsem_released(sem);
+	if (sem->count == 0)
+		rwsem_wake(sem);
+
+	unlock_scheduler();
+}
+
+void down_write(struct rw_semaphore *sem)
+{
+	lock_scheduler();
+
+	if (sem->count == 0 && list_empty(&sem->wait_list))
+	{
+		sem->count = -1;
+		rwsem_acquired(sem, 0);
+	}
+	else
+	{
+		uint64_t contended_at = lock_stat_clock();
+		rwsem_wait(sem, RWSEM_WAITING_FOR_WRITE);
+		rwsem_acquired(sem, contended_at);
+	}
+
+	unlock_scheduler();
+}
+
+bool down_write_trylock(struct rw_semaphore *sem)
+{
+	bool ret = false;
+	lock_scheduler();
+
+	if (sem->count == 0 && list_empty(&sem->wait_list))
+	{
+		sem->count = -1;
+		rwsem_acquired(sem, 0);
+		ret = true;
+	}
+
+	unlock_scheduler();
+	return ret;
+}
+
+void up_write(struct rw_semaphore *sem)
+{
+	lock_scheduler();
+
+	sem->count = 0;
+	rwsem_released(sem);
+	rwsem_wake(sem);
+
+	unlock_scheduler();
+}
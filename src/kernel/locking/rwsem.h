@@ -0,0 +1,56 @@
+#ifndef LOCKING_RWSEM_H
+#define LOCKING_RWSEM_H
+
+#include <include/list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lock_stat.h"
+
+struct thread;
+
+// count: > 0 number of active readers, 0 free, -1 held by a writer
+// new readers queue up behind a waiting writer so writers don't starve on read-mostly structures
+struct rw_semaphore
+{
+	volatile int32_t count;
+	struct list_head wait_list;
+#ifdef LOCK_STAT
+	struct lock_class_stat *class;
+	uint64_t acquired_at;
+#endif
+};
+
+enum rwsem_waiter_type
+{
+	RWSEM_WAITING_FOR_READ,
+	RWSEM_WAITING_FOR_WRITE,
+};
+
+struct rwsem_waiter
+{
+	struct list_head sibling;
+	struct thread *task;
+	enum rwsem_waiter_type type;
+	bool granted;
+};
+
+void __init_rwsem(struct rw_semaphore *sem, struct lock_class_stat *class);
+
+#ifdef LOCK_STAT
+#define init_rwsem(sem) ({                                              \
+	static struct lock_class_stat __class = LOCK_CLASS_STAT_INIT(#sem); \
+	__init_rwsem((sem), &__class);                                      \
+})
+#else
+#define init_rwsem(sem) __init_rwsem((sem), NULL)
+#endif
+
+void down_read(struct rw_semaphore *sem);
+bool down_read_trylock(struct rw_semaphore *sem);
+void up_read(struct rw_semaphore *sem);
+void down_write(struct rw_semaphore *sem);
+bool down_write_trylock(struct rw_semaphore *sem);
+void up_write(struct rw_semaphore *sem);
+
+#endif
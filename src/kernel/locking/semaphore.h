@@ -4,22 +4,24 @@
 #include <include/list.h>
 #include <stdint.h>
 
+#include "pi.h"
 #include "spinlock.h"
 
+// holder of binary semaphore inherits priority of its top waiter, counting one only sorts waiters
 struct semaphore
 {
 	spinlock_t lock;
 	uint32_t count;
 	uint32_t capacity;
-	struct list_head wait_list;
+	struct pi_lock pi;
 };
 
-#define __SEMAPHORE_INITIALIZER(name, n)               \
-	{                                                  \
-		.lock = 0,                                     \
-		.count = n,                                    \
-		.capacity = n,                                 \
-		.wait_list = LIST_HEAD_INIT((name).wait_list), \
+#define __SEMAPHORE_INITIALIZER(name, n)                       \
+	{                                                          \
+		.lock = 0,                                             \
+		.count = n,                                            \
+		.capacity = n,                                         \
+		.pi = __PI_LOCK_INITIALIZER((name).pi, (n) == 1), \
 	}
 
 #define DEFINE_SEMAPHORE(name) \
@@ -0,0 +1,122 @@
+#include <errno.h>
+#include <sys/futex.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../../tests/bench.h"
+
+// Two processes map the same shm page (at their own virtual addresses) and hand a token back and forth
+// via futex, every round trip is two FUTEX_WAKE + two FUTEX_WAIT -> measures wake-up latency of futex
+// build: i386-mos-gcc futex_pingpong.c -o futex_pingpong
+
+#define SHM_NAME "futex_pingpong"
+#define ROUNDS 10000
+#define PAGE_SIZE 4096
+
+struct shared_page
+{
+	volatile int turn;
+};
+
+static struct shared_page *map_shared_page()
+{
+	int fd = shm_open(SHM_NAME, O_RDWR, 0);
+	if (fd < 0)
+		return NULL;
+
+	void *addr = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return addr == MAP_FAILED ? NULL : addr;
+}
+
+static void wait_for(volatile int *word, int value)
+{
+	int v;
+	while ((v = *word) != value)
+		futex(word, FUTEX_WAIT, v, NULL, NULL);
+}
+
+static void set_and_wake(volatile int *word, int value)
+{
+	*word = value;
+	futex(word, FUTEX_WAKE, 1, NULL, NULL);
+}
+
+static int check_semantics(volatile int *word)
+{
+	int failures = 0;
+	struct timespec timeout = {.tv_sec = 0, .tv_nsec = 100000000};
+
+	*word = 5;
+	if (futex(word, FUTEX_WAIT, 4, NULL, NULL) != -1 || errno != EAGAIN)
+	{
+		printf("futex: WAIT with stale value does not return EAGAIN\n");
+		failures++;
+	}
+
+	uint64_t start = now_ms();
+	if (futex(word, FUTEX_WAIT, 5, &timeout, NULL) != -1 || errno != ETIMEDOUT)
+	{
+		printf("futex: WAIT does not time out\n");
+		failures++;
+	}
+	printf("futex: 100ms timeout took %dms\n", (int)(now_ms() - start));
+
+	if (futex(word, FUTEX_WAKE, 1, NULL, NULL) != 0)
+	{
+		printf("futex: WAKE without waiters does not return 0\n");
+		failures++;
+	}
+
+	*word = 0;
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : ROUNDS;
+
+	// tmpfs mmap only maps pages which exist -> fill the page first
+	int fd = shm_open(SHM_NAME, O_RDWR | O_CREAT, 0666);
+	char zero[PAGE_SIZE];
+	memset(zero, 0, sizeof(zero));
+	write(fd, zero, sizeof(zero));
+	close(fd);
+
+	pid_t pid = fork();
+	struct shared_page *page = map_shared_page();
+	if (!page)
+	{
+		printf("futex: cannot map shared page\n");
+		return 1;
+	}
+
+	if (pid == 0)
+	{
+		for (int i = 0; i < rounds; ++i)
+		{
+			wait_for(&page->turn, 1);
+			set_and_wake(&page->turn, 0);
+		}
+		exit(0);
+	}
+
+	int failures = 0;
+	uint64_t start = now_ms();
+	for (int i = 0; i < rounds; ++i)
+	{
+		set_and_wake(&page->turn, 1);
+		wait_for(&page->turn, 0);
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	int wstatus;
+	waitpid(pid, &wstatus, 0);
+	if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+		failures++;
+
+	printf("futex: %d round trips in %dms, %dus per round trip\n",
+		   rounds, (int)elapsed, rounds ? (int)(elapsed * 1000 / rounds) : 0);
+
+	failures += check_semantics(&page->turn);
+	return test_result("futex", failures);
+}
@@ -0,0 +1,120 @@
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../../tests/bench.h"
+
+// Classic three thread inversion with SCHED_FIFO threads: low holds a lock, high blocks on it, medium spins
+// with priority inheritance low is boosted above medium and high gets the lock after low's critical section,
+// without it high waits until medium is done. Chain case: high -> lock b (held by mid) -> lock a (held by low)
+// build: i386-mos-gcc priority_inversion.c -o priority_inversion
+
+#define PRIO_HIGH 30
+#define PRIO_MEDIUM 20
+#define PRIO_LOW 10
+#define CRITICAL_SECTION_MS 20
+#define MEDIUM_SPIN_MS 300
+// a few pit ticks for switching back and forth
+#define SLACK_MS 10
+
+static pthread_mutex_t lock_a, lock_b;
+static volatile int low_locked, mid_locked;
+
+static void set_fifo(int prio)
+{
+	struct sched_param param = {.sched_priority = prio};
+	sched_setscheduler(0, SCHED_FIFO, &param);
+}
+
+static void busy_ms(int ms)
+{
+	uint64_t end = now_ms() + ms;
+	while (now_ms() < end)
+		;
+}
+
+// threads start with creator's (high) priority, they run as soon as it sleeps and lower themselves
+static void wait_for(volatile int *flag)
+{
+	while (!*flag)
+		poll(NULL, 0, 1);
+}
+
+static void *low(void *arg)
+{
+	set_fifo(PRIO_LOW);
+	pthread_mutex_lock(&lock_a);
+	low_locked = 1;
+	busy_ms(CRITICAL_SECTION_MS);
+	pthread_mutex_unlock(&lock_a);
+	return NULL;
+}
+
+static void *mid(void *arg)
+{
+	set_fifo(PRIO_LOW);
+	pthread_mutex_lock(&lock_b);
+	mid_locked = 1;
+	pthread_mutex_lock(&lock_a);
+	pthread_mutex_unlock(&lock_a);
+	pthread_mutex_unlock(&lock_b);
+	return NULL;
+}
+
+static void *medium(void *arg)
+{
+	set_fifo(PRIO_MEDIUM);
+	busy_ms(MEDIUM_SPIN_MS);
+	return NULL;
+}
+
+// return how long high priority (calling) thread has waited for the lock
+static int run(int protocol, int chain)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, protocol);
+	pthread_mutex_init(&lock_a, &attr);
+	pthread_mutex_init(&lock_b, &attr);
+	low_locked = mid_locked = 0;
+
+	pthread_t tlow, tmid, tmedium;
+	pthread_create(&tlow, NULL, low, NULL);
+	wait_for(&low_locked);
+	if (chain)
+	{
+		pthread_create(&tmid, NULL, mid, NULL);
+		wait_for(&mid_locked);
+	}
+	pthread_create(&tmedium, NULL, medium, NULL);
+
+	pthread_mutex_t *lock = chain ? &lock_b : &lock_a;
+	uint64_t start = now_ms();
+	pthread_mutex_lock(lock);
+	int waited = (int)(now_ms() - start);
+	pthread_mutex_unlock(lock);
+
+	pthread_join(tlow, NULL);
+	if (chain)
+		pthread_join(tmid, NULL);
+	pthread_join(tmedium, NULL);
+	return waited;
+}
+
+int main(int argc, char *argv[])
+{
+	set_fifo(PRIO_HIGH);
+
+	int failures = 0;
+	for (int chain = 0; chain < 2; ++chain)
+	{
+		const char *name = chain ? "chain" : "inversion";
+		int waited_none = run(PTHREAD_PRIO_NONE, chain);
+		int waited_inherit = run(PTHREAD_PRIO_INHERIT, chain);
+
+		printf("%s: high waited %dms without inheritance, %dms with inheritance (critical section %dms, medium spins %dms)\n",
+			   name, waited_none, waited_inherit, CRITICAL_SECTION_MS, MEDIUM_SPIN_MS);
+		failures += check(waited_inherit <= CRITICAL_SECTION_MS + SLACK_MS, "%s latency is not bounded by critical section", name);
+	}
+
+	return test_result("priority_inversion", failures);
+}
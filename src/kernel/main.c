@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include "cpu/exception.h"
+#include "cpu/fpu.h"
 #include "cpu/gdt.h"
 #include "cpu/hal.h"
 #include "cpu/idt.h"
@@ -16,9 +17,12 @@
 #include "devices/kybrd.h"
 #include "devices/mouse.h"
 #include "devices/pci.h"
+#include "fs/block_dev.h"
+#include "fs/buffer.h"
 #include "fs/ext2/ext2.h"
 #include "fs/vfs.h"
 #include "ipc/message_queue.h"
+#include "locking/futex.h"
 #include "memory/pmm.h"
 #include "memory/vmm.h"
 #include "multiboot2.h"
@@ -30,9 +34,11 @@
 #include "net/tcp.h"
 #include "proc/task.h"
 #include "system/framebuffer.h"
+#include "system/softirq.h"
 #include "system/sysapi.h"
 #include "system/time.h"
 #include "system/timer.h"
+#include "system/workqueue.h"
 #include "utils/math.h"
 #include "utils/string.h"
 
@@ -78,14 +84,21 @@ void kernel_init()
 	// -> trigger manually at the beginning of thread path
 	unlock_scheduler();
 
+	softirq_init();
 	timer_init();
+	workqueue_init();
 
 	// setup random's seed
 	srand(get_seconds(NULL));
 
 	// FIXME: MQ 2019-11-19 ata_init is not called in pci_scan_buses without enabling -O2
 	pci_init();
+	blkdev_init();
 	ata_init();
+	// flusher writes back dirty inodes too
+	inode_init();
+	buffer_init();
+	page_cache_init();
 
 	vfs_init(&ext2_fs_type, "/dev/hda");
 	chrdev_memory_init();
@@ -95,8 +108,9 @@ void kernel_init()
 	kkybrd_install();
 	mouse_init();
 
-	// init ipc message queue
+	// init ipc message queue and futex hash queues
 	mq_init();
+	futex_init();
 
 	// register system apis
 	syscall_init();
@@ -159,6 +173,9 @@ int kernel_main(uint32_t addr, uint32_t magic)
 
 	exception_init();
 
+	// x87/sse with lazy context switching, handlers are installed after exceptions to take precedence
+	fpu_init();
+
 	// timer
 	rtc_init();
 	pit_init();
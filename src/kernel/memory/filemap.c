@@ -0,0 +1,278 @@
+#include <fs/vfs.h>
+#include <include/errno.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <utils/debug.h>
+#include <utils/hashmap.h>
+#include <utils/math.h>
+#include <utils/string.h>
+
+// Page cache lives in `inode->i_data.pages`, a page is read from file once and its frame is shared by every mapping
+// (tmpfs keeps file content in the same list, so its pages are always found). A cached page is counted once by
+// cache itself and once by each user pte and reader which holds it, its frame is released when the count drops
+// to zero. Pages which are only held by cache are evicted in lru order when cache outgrows its share of memory
+#define PAGE_CACHE_SHARE 8	// at most 1/8 of frames
+
+static uint32_t nr_cached_pages;
+static uint32_t max_cached_pages;
+static LIST_HEAD(page_lru);	 // least recently used first
+static struct hashmap page_frames;	// frame -> cached page, user ptes only know frame
+
+static struct page *find_page(struct address_space *mapping, uint32_t index)
+{
+	struct page *iter;
+	list_for_each_entry(iter, &mapping->pages, sibling)
+	{
+		if (iter->index == index)
+			return iter;
+	}
+	return NULL;
+}
+
+void put_page(struct page *page)
+{
+	lock_scheduler();
+	if (!--page->count)
+	{
+		hashmap_remove(&page_frames, &page->frame);
+		pmm_free_block((void *)page->frame);
+		kfree(page);
+	}
+	unlock_scheduler();
+}
+
+// cache drops its reference, page stays alive while somebody still maps it
+static void remove_from_page_cache(struct page *page)
+{
+	lock_scheduler();
+	list_del(&page->sibling);
+	list_del(&page->lru);
+	page->mapping = NULL;
+	nr_cached_pages--;
+	put_page(page);
+	unlock_scheduler();
+}
+
+// caller holds i_mutex of `locked`, other inodes are skipped if their i_mutex is taken
+static void shrink_page_cache(struct address_space *locked)
+{
+	lock_scheduler();
+
+	struct page *iter, *next;
+	list_for_each_entry_safe(iter, next, &page_lru, lru)
+	{
+		if (nr_cached_pages <= max_cached_pages)
+			break;
+		if (iter->count > 1)
+			continue;
+
+		struct address_space *mapping = iter->mapping;
+		struct vfs_inode *inode = container_of(mapping, struct vfs_inode, i_data);
+		if (mapping != locked && !mutex_trylock(&inode->i_mutex))
+			continue;
+
+		// nothing runs until scheduler is unlocked, `next` stays in lru
+		remove_from_page_cache(iter);
+		if (mapping != locked)
+			mutex_unlock(&inode->i_mutex);
+	}
+
+	unlock_scheduler();
+}
+
+// returned page is held, caller releases it by `put_page` (or keeps it as a mapping's reference)
+struct page *find_get_page(struct vfs_file *file, uint32_t index)
+{
+	struct vfs_inode *inode = file->f_dentry->d_inode;
+	struct address_space *mapping = &inode->i_data;
+
+	mutex_lock(&inode->i_mutex);
+	struct page *page = find_page(mapping, index);
+	if (page && (page->flags & PG_CACHED))
+	{
+		lock_scheduler();
+		list_move_tail(&page->lru, &page_lru);
+		page->count++;
+		unlock_scheduler();
+	}
+	else if (!page)
+	{
+		uint32_t frame = (uint32_t)pmm_alloc_block();
+		if (!frame)
+		{
+			mutex_unlock(&inode->i_mutex);
+			return NULL;
+		}
+
+		page = kcalloc(1, sizeof(struct page));
+		page->frame = frame;
+		page->index = index;
+		page->flags = PG_CACHED;
+		page->mapping = mapping;
+		// cache and caller
+		page->count = 2;
+
+		loff_t pos = (loff_t)index * PMM_FRAME_SIZE;
+		size_t count = pos < inode->i_size ? min_t(loff_t, PMM_FRAME_SIZE, inode->i_size - pos) : 0;
+		kmap(page);
+		memset((char *)page->virtual, 0, PMM_FRAME_SIZE);
+		if (count)
+			file->f_op->read(file, (char *)page->virtual, count, pos);
+		kunmap(page);
+		page->virtual = 0;
+
+		list_add_tail(&page->sibling, &mapping->pages);
+		lock_scheduler();
+		list_add_tail(&page->lru, &page_lru);
+		hashmap_put(&page_frames, &page->frame, page);
+		nr_cached_pages++;
+		unlock_scheduler();
+
+		if (nr_cached_pages > max_cached_pages)
+			shrink_page_cache(mapping);
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	return page;
+}
+
+// reads through page cache, used by elf loader for headers and unaligned segments
+ssize_t filemap_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	struct vfs_inode *inode = file->f_dentry->d_inode;
+	if (ppos >= inode->i_size)
+		return 0;
+
+	count = min_t(loff_t, count, inode->i_size - ppos);
+	for (size_t copied = 0; copied < count;)
+	{
+		struct page *page = find_get_page(file, (ppos + copied) / PMM_FRAME_SIZE);
+		if (!page)
+			return -ENOMEM;
+
+		uint32_t offset = (ppos + copied) % PMM_FRAME_SIZE;
+		size_t length = min_t(size_t, PMM_FRAME_SIZE - offset, count - copied);
+		// cached page is shared, map it privately so concurrent readers don't clobber `page->virtual`
+		struct page p = {.frame = page->frame};
+		kmap(&p);
+		memcpy(buf + copied, (char *)p.virtual + offset, length);
+		kunmap(&p);
+		if (page->flags & PG_CACHED)
+			put_page(page);
+		copied += length;
+	}
+	return count;
+}
+
+// processes which still map a page keep its old content until they unmap it, then its frame is released
+void invalidate_inode_pages(struct vfs_inode *inode)
+{
+	struct address_space *mapping = &inode->i_data;
+
+	mutex_lock(&inode->i_mutex);
+	struct page *iter, *next;
+	list_for_each_entry_safe(iter, next, &mapping->pages, sibling)
+	{
+		if (iter->flags & PG_CACHED)
+			remove_from_page_cache(iter);
+		else
+		{
+			// tmpfs content, its frames are owned by tmpfs
+			list_del(&iter->sibling);
+			kfree(iter);
+		}
+	}
+	mutex_unlock(&inode->i_mutex);
+}
+
+// user ptes in range (of current address space) are cleared, mapped cache pages lose this mapping's reference
+void filemap_unmap_range(struct pdirectory *va_dir, uint32_t vm_start, uint32_t vm_end)
+{
+	for (uint32_t addr = vm_start; addr < vm_end; addr += PMM_FRAME_SIZE)
+	{
+		uint32_t frame = vmm_get_mapped_physical_address(addr) & PAGE_MASK;
+		if (!frame)
+			continue;
+
+		vmm_unmap_address(va_dir, addr);
+		filemap_put_frame(frame);
+	}
+}
+
+// a pte which mapped `frame` is gone, it drops its reference if frame belongs to page cache
+void filemap_put_frame(uint32_t frame)
+{
+	lock_scheduler();
+	struct page *page = hashmap_get(&page_frames, &frame);
+	if (page)
+		put_page(page);
+	unlock_scheduler();
+}
+
+// forked address space shares read-only frame at the same address
+void filemap_dup_frame(uint32_t frame)
+{
+	lock_scheduler();
+	struct page *page = hashmap_get(&page_frames, &frame);
+	if (page)
+		page->count++;
+	unlock_scheduler();
+}
+
+uint32_t get_cached_pages()
+{
+	return nr_cached_pages;
+}
+
+void page_cache_init()
+{
+	max_cached_pages = get_total_frames() / PAGE_CACHE_SHARE;
+	hashmap_init(&page_frames, hashmap_hash_uint32, hashmap_compare_uint32, 0);
+}
+
+/*
+  vm_start                                        vm_file_end            vm_end
+  |  shared read-only (private copy on write)  | partial | zero-filled     |
+  Pages fully backed by file are mapped from page cache, the page containing vm_file_end
+  gets a private copy with its tail cleared and pages after it are anonymous
+*/
+static int filemap_fault(struct vm_area_struct *vma, uint32_t address, bool write)
+{
+	uint32_t prot = I86_PTE_PRESENT | I86_PTE_USER;
+	if (vma->vm_flags & VM_WRITE)
+		prot |= I86_PTE_WRITABLE;
+
+	uint32_t frame;
+	if (address >= vma->vm_file_end)
+		frame = alloc_private_frame(NULL, 0);
+	else
+	{
+		struct page *page = find_get_page(vma->vm_file, vma->vm_pgoff + (address - vma->vm_start) / PMM_FRAME_SIZE);
+		if (!page)
+			return -ENOMEM;
+
+		// the reference is kept by pte, it is dropped by filemap_unmap_range
+		if (!write && address + PMM_FRAME_SIZE <= vma->vm_file_end)
+		{
+			vmm_map_address(current_process->pdir, address, page->frame, I86_PTE_PRESENT | I86_PTE_USER);
+			return 0;
+		}
+
+		struct page p = {.frame = page->frame};
+		kmap(&p);
+		frame = alloc_private_frame((char *)p.virtual, min_t(uint32_t, PMM_FRAME_SIZE, vma->vm_file_end - address));
+		kunmap(&p);
+		if (page->flags & PG_CACHED)
+			put_page(page);
+	}
+
+	if (!frame)
+		return -ENOMEM;
+
+	vmm_map_address(current_process->pdir, address, frame, prot);
+	return 0;
+}
+
+struct vm_operations_struct generic_file_vm_ops = {
+	.fault = filemap_fault,
+};
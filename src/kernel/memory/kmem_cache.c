@@ -0,0 +1,109 @@
+#include <proc/task.h>
+#include <utils/debug.h>
+#include <utils/math.h>
+
+#include "vmm.h"
+
+// Per-type cache of fixed size objects (thread, process), a freed object goes to cache's free list
+// (linked through its first word) and is handed out again as is -> caller initializes what it needs
+struct kmem_cache *kmem_cache_create(const char *name, size_t size)
+{
+	struct kmem_cache *cache = kcalloc(1, sizeof(struct kmem_cache));
+	cache->name = name;
+	cache->size = max_t(size_t, size, sizeof(void *));
+	return cache;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+	lock_scheduler();
+
+	void *obj = cache->free_list;
+	if (obj)
+	{
+		cache->free_list = *(void **)obj;
+		cache->nr_free--;
+	}
+	else
+		obj = kmalloc(cache->size);
+	cache->nr_active++;
+
+	unlock_scheduler();
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+	lock_scheduler();
+
+	*(void **)obj = cache->free_list;
+	cache->free_list = obj;
+	cache->nr_free++;
+	cache->nr_active--;
+
+	unlock_scheduler();
+}
+
+/*
+  Kernel stacks have their own area instead of heap
+  | guard | stack (STACK_SIZE) | guard | stack | ...
+  0xF0000000                               0xFC000000 (framebuffer)
+  guard page is never mapped, overflowing a stack faults instead of overwriting heap objects below it
+  a freed stack keeps its frames, the next thread gets it without clearing (only its trap frame is written)
+*/
+#define KSTACK_AREA_BASE 0xF0000000
+#define KSTACK_AREA_TOP 0xFC000000
+#define KSTACK_SLOT_SIZE (STACK_SIZE + PMM_FRAME_SIZE)
+
+static uint32_t kstack_area_next = KSTACK_AREA_BASE;
+static uint32_t free_kstacks;  // top of the first free stack, next one is kept at the bottom of stack
+static uint32_t nr_kstacks, nr_free_kstacks;
+
+// returns top of stack or 0
+uint32_t alloc_kernel_stack()
+{
+	lock_scheduler();
+
+	uint32_t top = free_kstacks;
+	if (top)
+	{
+		free_kstacks = *(uint32_t *)(top - STACK_SIZE);
+		nr_free_kstacks--;
+	}
+	else if (kstack_area_next + KSTACK_SLOT_SIZE <= KSTACK_AREA_TOP)
+	{
+		// page tables of kernel space are preallocated and shared -> stack is mapped in every address space
+		uint32_t bottom = kstack_area_next + PMM_FRAME_SIZE;
+		uint32_t frames = (uint32_t)pmm_alloc_blocks(STACK_SIZE / PMM_FRAME_SIZE);
+		if (frames)
+		{
+			for (uint32_t addr = bottom; addr < bottom + STACK_SIZE; addr += PMM_FRAME_SIZE, frames += PMM_FRAME_SIZE)
+				vmm_map_address(vmm_get_directory(), addr, frames, I86_PTE_PRESENT | I86_PTE_WRITABLE);
+
+			kstack_area_next += KSTACK_SLOT_SIZE;
+			top = bottom + STACK_SIZE;
+			nr_kstacks++;
+		}
+	}
+
+	unlock_scheduler();
+	return top;
+}
+
+void free_kernel_stack(uint32_t top)
+{
+	lock_scheduler();
+
+	*(uint32_t *)(top - STACK_SIZE) = free_kstacks;
+	free_kstacks = top;
+	nr_free_kstacks++;
+
+	unlock_scheduler();
+}
+
+uint32_t get_kernel_stacks(uint32_t *nr_free)
+{
+	if (nr_free)
+		*nr_free = nr_free_kstacks;
+	return nr_kstacks;
+}
@@ -1,3 +1,4 @@
+#include <cpu/hal.h>
 #include <include/errno.h>
 #include <stdbool.h>
 #include <utils/debug.h>
@@ -70,12 +71,15 @@ struct block_meta *request_space(struct block_meta *last, size_t size)
 	return block;
 }
 
+// Block list and heap break are shared by preempted syscalls and irq/softirq handlers (e.g. rx tasklet, tcp timer),
+// they are only touched with interrupts off. A section is one list walk, it never sleeps
 void *kmalloc(size_t size)
 {
 	if (size <= 0)
 		return NULL;
 
 	struct block_meta *block;
+	uint32_t eflags = save_interrupts();
 
 	if (kblocklist)
 	{
@@ -96,6 +100,7 @@ void *kmalloc(size_t size)
 	}
 
 	assert_kblock_valid(block);
+	restore_interrupts(eflags);
 
 	if (block)
 		return block + 1;
@@ -122,8 +127,10 @@ void kfree(void *ptr)
 		return;
 
 	struct block_meta *block = get_block_ptr(ptr);
+	uint32_t eflags = save_interrupts();
 	assert_kblock_valid(block);
 	block->free = true;
+	restore_interrupts(eflags);
 }
 
 // NOTE: MQ 2019-11-24
@@ -136,12 +143,18 @@ void kfree(void *ptr)
 // ------------------- m - sizeof(struct block_meta)
 // |                 | empty object (>= 1)
 // ------------------- padding - sizeof(struct block_meta)
+// caller (vmm_fork, vmm_create_address_space) uses heap right after the padding, it keeps scheduler locked
+// (interrupts off) until the padding is freed so nothing else is placed there
 void *kalign_heap(size_t size)
 {
+	uint32_t eflags = save_interrupts();
 	uint32_t heap_addr = (uint32_t)sbrk(0);
 
 	if (heap_addr % size == 0)
+	{
+		restore_interrupts(eflags);
 		return NULL;
+	}
 
 	uint32_t padding_size = div_ceil(heap_addr, size) * size - heap_addr;
 	uint32_t required_size = sizeof(struct block_meta) * 2;
@@ -154,10 +167,12 @@ void *kalign_heap(size_t size)
 			while (!last->next)
 				last = last->next;
 			struct block_meta *block = request_space(last, padding_size - required_size);
+			restore_interrupts(eflags);
 			return block + 1;
 		}
 		padding_size += size;
 	}
+	restore_interrupts(eflags);
 	return NULL;
 }
 
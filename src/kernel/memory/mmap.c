@@ -1,4 +1,6 @@
 #include <fs/vfs.h>
+#include <include/errno.h>
+#include <include/mman.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
 #include <utils/debug.h>
@@ -33,7 +35,7 @@ struct vm_area_struct *get_unmapped_area(uint32_t addr, uint32_t len)
 
 			if (addr + len <= iter->vm_start)
 			{
-				list_add(&iter->vm_sibling, &mm->mmap);
+				list_add_tail(&vma->vm_sibling, &iter->vm_sibling);
 				break;
 			}
 			else if (addr >= iter->vm_end &&
@@ -63,7 +65,7 @@ struct vm_area_struct *get_unmapped_area(uint32_t addr, uint32_t len)
 	return vma;
 }
 
-static struct vm_area_struct *find_vma(struct mm_struct *mm, uint32_t addr)
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint32_t addr)
 {
 	struct vm_area_struct *iter = NULL;
 	list_for_each_entry(iter, &mm->mmap, vm_sibling)
@@ -118,7 +120,7 @@ int do_munmap(struct mm_struct *mm, uint32_t addr, size_t len)
 
 int32_t do_mmap(uint32_t addr,
 				size_t len, uint32_t prot,
-				uint32_t flag, int32_t fd, __unused off_t off)
+				uint32_t flag, int32_t fd, off_t off)
 {
 	struct vfs_file *file = fd >= 0 ? current_process->files->fd[fd] : NULL;
 	uint32_t aligned_addr = ALIGN_DOWN(addr, PMM_FRAME_SIZE);
@@ -129,7 +131,17 @@ int32_t do_mmap(uint32_t addr,
 	else if (vma->vm_end < addr + len)
 		expand_area(vma, addr + len, true);
 
-	if (file)
+	// private file mapping (shared libraries) is demand-paged from page cache like elf segments
+	if (file && (flag & MAP_PRIVATE))
+	{
+		vma->vm_flags = (prot & PROT_READ ? VM_READ : 0) | (prot & PROT_WRITE ? VM_WRITE : 0) | (prot & PROT_EXEC ? VM_EXEC : 0);
+		vma->vm_file = file;
+		vma->vm_pgoff = off / PMM_FRAME_SIZE;
+		vma->vm_file_end = vma->vm_end;
+		vma->vm_ops = &generic_file_vm_ops;
+		atomic_inc(&file->f_count);
+	}
+	else if (file)
 	{
 		file->f_op->mmap(file, vma);
 		vma->vm_file = file;
@@ -181,3 +193,60 @@ uint32_t do_brk(uint32_t addr, size_t len)
 
 	return 0;
 }
+
+// copies `len` bytes of `src` into a new frame, the rest of frame is zeroed
+uint32_t alloc_private_frame(const char *src, size_t len)
+{
+	struct page p = {.frame = (uint32_t)pmm_alloc_block()};
+	if (!p.frame)
+		return 0;
+
+	kmap(&p);
+	if (len)
+		memcpy((char *)p.virtual, src, len);
+	memset((char *)p.virtual + len, 0, PMM_FRAME_SIZE - len);
+	kunmap(&p);
+	return p.frame;
+}
+
+static int do_anonymous_page(struct vm_area_struct *vma, uint32_t address)
+{
+	uint32_t frame = alloc_private_frame(NULL, 0);
+	if (!frame)
+		return -ENOMEM;
+
+	vmm_map_address(current_process->pdir, address, frame, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+	return 0;
+}
+
+// page is mapped read-only (shared with page cache or parent) -> copy it before the first write
+static int do_wp_page(struct vm_area_struct *vma, uint32_t address)
+{
+	uint32_t old_frame = vmm_get_mapped_physical_address(address) & PAGE_MASK;
+	uint32_t frame = alloc_private_frame((const char *)address, PMM_FRAME_SIZE);
+	if (!frame)
+		return -ENOMEM;
+
+	vmm_map_address(current_process->pdir, address, frame, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+	// old pte held a reference of cached page, private copy doesn't
+	filemap_put_frame(old_frame);
+	return 0;
+}
+
+int do_page_fault(struct mm_struct *mm, uint32_t address, uint32_t err_code)
+{
+	struct vm_area_struct *vma = find_vma(mm, address);
+	if (!vma)
+		return -EFAULT;
+
+	bool write = err_code & I86_PF_WRITE;
+	address = ALIGN_DOWN(address, PMM_FRAME_SIZE);
+
+	if (err_code & I86_PF_PRESENT)
+		return write && (vma->vm_flags & VM_WRITE) ? do_wp_page(vma, address) : -EFAULT;
+
+	if (vma->vm_ops && vma->vm_ops->fault)
+		return write && !(vma->vm_flags & VM_WRITE) ? -EFAULT : vma->vm_ops->fault(vma, address, write);
+
+	return do_anonymous_page(vma, address);
+}
@@ -1,5 +1,6 @@
 #include "pmm.h"
 
+#include <cpu/hal.h>
 #include <utils/debug.h>
 #include <utils/math.h>
 #include <utils/string.h>
@@ -134,41 +135,36 @@ void pmm_deinit_region(uint32_t addr, uint32_t length)
 	}
 }
 
+// bitmap is shared with irq/softirq handlers and preempted syscalls, it is only touched with interrupts off
 void *pmm_alloc_block()
 {
-	if (max_frames <= used_frames)
-		return 0;
+	uint32_t eflags = save_interrupts();
 
-	int frame = memory_bitmap_first_free();
-
-	if (frame == -1)
-		return 0;
-
-	memory_bitmap_set(frame);
-	used_frames++;
+	int frame = max_frames > used_frames ? memory_bitmap_first_free() : -1;
+	if (frame != -1)
+	{
+		memory_bitmap_set(frame);
+		used_frames++;
+	}
 
-	uint32_t addr = frame * PMM_FRAME_SIZE;
-	return (void *)addr;
+	restore_interrupts(eflags);
+	return frame != -1 ? (void *)(frame * PMM_FRAME_SIZE) : 0;
 }
 
 void *pmm_alloc_blocks(size_t size)
 {
-	if (max_frames - used_frames < size)
-		return 0;
-
-	int frame = memory_bitmap_first_frees(size);
-
-	if (frame == -1)
-		return 0;
-
-	for (uint32_t i = 0; i < size; ++i)
-	{
-		memory_bitmap_set(frame + i);
-		used_frames++;
-	}
-
-	uint32_t addr = frame * PMM_FRAME_SIZE;
-	return (void *)addr;
+	uint32_t eflags = save_interrupts();
+
+	int frame = max_frames - used_frames >= size ? memory_bitmap_first_frees(size) : -1;
+	if (frame != -1)
+		for (uint32_t i = 0; i < size; ++i)
+		{
+			memory_bitmap_set(frame + i);
+			used_frames++;
+		}
+
+	restore_interrupts(eflags);
+	return frame != -1 ? (void *)(frame * PMM_FRAME_SIZE) : 0;
 }
 
 void pmm_free_block(void *p)
@@ -176,22 +172,31 @@ void pmm_free_block(void *p)
 	uint32_t addr = (uint32_t)p;
 	uint32_t frame = addr / PMM_FRAME_SIZE;
 
+	uint32_t eflags = save_interrupts();
 	memory_bitmap_unset(frame);
-
 	used_frames--;
+	restore_interrupts(eflags);
 }
 
 void pmm_mark_used_addr(uint32_t paddr)
 {
 	uint32_t frame = paddr / PMM_FRAME_SIZE;
+
+	uint32_t eflags = save_interrupts();
 	if (!memory_bitmap_test(frame))
 	{
 		memory_bitmap_set(frame);
 		used_frames++;
 	}
+	restore_interrupts(eflags);
 }
 
 uint32_t get_total_frames()
 {
 	return max_frames;
 }
+
+uint32_t get_used_frames()
+{
+	return used_frames;
+}
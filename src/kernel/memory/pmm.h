@@ -20,5 +20,6 @@ void *pmm_alloc_blocks(size_t num);
 void pmm_free_block(void *block);
 void pmm_mark_used_addr(uint32_t paddr);
 uint32_t get_total_frames();
+uint32_t get_used_frames();
 
 #endif
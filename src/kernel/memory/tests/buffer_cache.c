@@ -0,0 +1,69 @@
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Walks /bin twice like `ls -l` followed by starting each program (stat + reading elf header and first pages)
+// and prints how many read commands have reached the disk in each pass, with buffer cache the second pass is served from memory
+// build: i386-mos-gcc buffer_cache.c -o buffer_cache
+
+#define DIR_PATH "/bin"
+#define HEAD_SIZE 4096
+
+static int walk()
+{
+	DIR *dir = opendir(DIR_PATH);
+	if (!dir)
+		return -1;
+
+	int nr_files = 0;
+	char path[256], head[HEAD_SIZE];
+	struct dirent *entry;
+	while ((entry = readdir(dir)))
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+
+		struct stat st;
+		snprintf(path, sizeof(path), "%s/%s", DIR_PATH, entry->d_name);
+		if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			continue;
+		read(fd, head, sizeof(head));
+		close(fd);
+		nr_files++;
+	}
+	closedir(dir);
+	return nr_files;
+}
+
+int main(int argc, char *argv[])
+{
+	struct disk_stat disk[3];
+	long long hits[3];
+	int nr_files[2];
+
+	disk_stat(&disk[0]);
+	hits[0] = stat_value("/dev/diskstats", "buffers", "hits");
+	for (int i = 0; i < 2; ++i)
+	{
+		uint64_t start = now_ms();
+		nr_files[i] = walk();
+		uint64_t elapsed = now_ms() - start;
+		disk_stat(&disk[i + 1]);
+		hits[i + 1] = stat_value("/dev/diskstats", "buffers", "hits");
+
+		printf("pass %d: %d files in %dms, %d disk reads, %lld buffer hits\n", i + 1, nr_files[i], (int)elapsed,
+			   disk[i + 1].reads - disk[i].reads, hits[i + 1] - hits[i]);
+	}
+
+	int failures = check(nr_files[0] > 0 && nr_files[0] == nr_files[1], "%s is not walked the same way twice", DIR_PATH);
+	failures += check(hits[0] >= 0, "/dev/diskstats has no buffer stats");
+	failures += check(disk[2].reads - disk[1].reads <= READS_SLACK, "second pass has gone to disk %d times",
+					  disk[2].reads - disk[1].reads);
+	// each file reads at least its first data block through buffer cache
+	failures += check(hits[2] - hits[1] >= nr_files[1], "second pass is not served by buffer cache");
+	return test_result("buffer_cache", failures);
+}
@@ -0,0 +1,150 @@
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../../tests/bench.h"
+
+// Elf segments are demand-paged from page cache: text is shared, data is copied on first write
+// checks that writes (from userspace and from kernel in read syscall) never reach the cached pages,
+// then prints exec latency and resident memory of 10 concurrent shells (from /dev/meminfo)
+// build: i386-mos-gcc exec_rss.c -o exec_rss, run with absolute path (argv[0] is exec'd)
+
+#define NR_EXECS 50
+#define NR_SHELLS 10
+#define CHILD_EXIT_CODE 7
+#define SHELL_PATH "/bin/bash"
+
+static char *self;
+static int data_value = 0x1234;
+static char data_buf[16] = "initial";
+
+static int exit_code(pid_t pid)
+{
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		return -1;
+	return (status >> 8) & 0xff;
+}
+
+static int meminfo(const char *field)
+{
+	return stat_value("/dev/meminfo", field, NULL);
+}
+
+static int check_private_data()
+{
+	int failures = 0;
+	data_value = 0;
+
+	pid_t pid = fork();
+	if (!pid)
+	{
+		int ok = data_value == 0;
+		data_value = 1;
+		_exit(ok ? CHILD_EXIT_CODE : 1);
+	}
+	if (exit_code(pid) != CHILD_EXIT_CODE || data_value != 0)
+	{
+		printf("fork: data page is not private\n");
+		failures++;
+	}
+
+	// kernel writes into a data page which is still shared with page cache
+	int p[2];
+	pipe(p);
+	write(p[1], "changed", 8);
+	read(p[0], data_buf, 8);
+	close(p[0]);
+	close(p[1]);
+
+	// a fresh image has to see original values
+	char *argv[] = {self, "child", NULL};
+	if (posix_spawn(&pid, self, NULL, NULL, argv, NULL) || exit_code(pid) != CHILD_EXIT_CODE)
+	{
+		printf("exec: page cache is modified by writes to private data\n");
+		failures++;
+	}
+	return failures;
+}
+
+static int bench_exec(const char *path)
+{
+	char *shell_argv[] = {(char *)path, "-c", "exit", NULL};
+	char *self_argv[] = {self, "child", NULL};
+	char **argv = path == self ? self_argv : shell_argv;
+	int failures = 0;
+
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_EXECS; ++i)
+	{
+		pid_t pid;
+		if (posix_spawn(&pid, path, NULL, NULL, argv, NULL) || exit_code(pid) < 0)
+			failures++;
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	printf("exec %s: %d launches in %dms, %dus per launch\n", path, NR_EXECS, (int)elapsed,
+		   (int)(elapsed * 1000 / NR_EXECS));
+	return failures;
+}
+
+static int bench_rss(const char *path)
+{
+	char *argv[] = {(char *)path, NULL};
+	pid_t pids[NR_SHELLS];
+	int pipes[NR_SHELLS][2];
+	int failures = 0;
+
+	int used_before = meminfo("MemUsed:");
+	int cached_before = meminfo("Cached:");
+	for (int i = 0; i < NR_SHELLS; ++i)
+	{
+		// shell blocks reading commands from stdin until the pipe is closed
+		pipe(pipes[i]);
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, pipes[i][0], 0);
+		posix_spawn_file_actions_addclose(&actions, pipes[i][0]);
+		posix_spawn_file_actions_addclose(&actions, pipes[i][1]);
+		if (posix_spawn(&pids[i], path, &actions, NULL, argv, NULL))
+			pids[i] = -1;
+		posix_spawn_file_actions_destroy(&actions);
+		close(pipes[i][0]);
+	}
+	sleep(1);
+	int used_after = meminfo("MemUsed:");
+	int cached_after = meminfo("Cached:");
+
+	for (int i = 0; i < NR_SHELLS; ++i)
+	{
+		close(pipes[i][1]);
+		if (pids[i] < 0 || exit_code(pids[i]) != 0)
+			failures++;
+	}
+
+	printf("%d x %s: %dkB used, %dkB per process, %dkB page cache\n", NR_SHELLS, path, used_after - used_before,
+		   (used_after - used_before) / NR_SHELLS, cached_after - cached_before);
+
+	// text is shared through page cache, each shell only pays for its data, heap and stack
+	struct stat st;
+	stat(path, &st);
+	failures += check((used_after - used_before) / NR_SHELLS < (int)(st.st_size / 1024),
+					  "each %s takes more than its image (%lldkB)", path, (long long)st.st_size / 1024);
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && !strcmp(argv[1], "child"))
+		return data_value == 0x1234 && !strcmp(data_buf, "initial") ? CHILD_EXIT_CODE : 1;
+
+	self = argv[0];
+	int failures = check_private_data();
+
+	struct stat st;
+	const char *path = stat(SHELL_PATH, &st) ? self : SHELL_PATH;
+	failures += bench_exec(path);
+	if (path != self)
+		failures += bench_rss(path);
+
+	return test_result("exec_rss", failures);
+}
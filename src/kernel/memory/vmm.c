@@ -18,7 +18,6 @@ void pt_entry_set_frame(pt_entry *, uint32_t);
 void pd_entry_add_attrib(pd_entry *, uint32_t);
 void pd_entry_set_frame(pd_entry *, uint32_t);
 void vmm_create_page_table(struct pdirectory *dir, uint32_t virt, uint32_t flags);
-void vmm_paging(struct pdirectory *, uint32_t);
 
 static struct pdirectory *_current_dir;
 
@@ -121,6 +120,7 @@ void vmm_init_and_map(struct pdirectory *va_dir, uint32_t vaddr, uint32_t paddr)
 	*entry = pa_table | I86_PDE_PRESENT | I86_PDE_WRITABLE;
 }
 
+// cr0.WP makes kernel writes to read-only user pages fault too (copy-on-write in syscalls)
 void vmm_paging(struct pdirectory *va_dir, uint32_t pa_dir)
 {
 	_current_dir = va_dir;
@@ -131,7 +131,7 @@ void vmm_paging(struct pdirectory *va_dir, uint32_t pa_dir)
 		"and $~0x00000010, %%ecx \n"
 		"mov %%ecx, %%cr4        \n"
 		"mov %%cr0, %%ecx        \n"
-		"or $0x80000000, %%ecx   \n"
+		"or $0x80010000, %%ecx   \n"
 		"mov %%ecx, %%cr0        \n" ::"r"(pa_dir));
 }
 
@@ -166,6 +166,20 @@ uint32_t vmm_get_physical_address(uint32_t vaddr, bool is_page)
 		return (paddr & ~0xfff) | (vaddr & 0xfff);
 }
 
+// returns 0 if `vaddr` is not mapped in the current address space
+uint32_t vmm_get_mapped_physical_address(uint32_t vaddr)
+{
+	pd_entry *pd = (pd_entry *)PAGE_DIRECTORY_BASE;
+	if (!is_page_enabled(pd[get_page_directory_index(vaddr)]))
+		return 0;
+
+	uint32_t pte = vmm_get_physical_address(vaddr, true);
+	if (!is_page_enabled(pte))
+		return 0;
+
+	return (pte & ~0xfff) | (vaddr & 0xfff);
+}
+
 struct pdirectory *vmm_create_address_space(struct pdirectory *current)
 {
 	char *aligned_object = kalign_heap(PMM_FRAME_SIZE);
@@ -227,7 +241,8 @@ void vmm_create_page_table(struct pdirectory *va_dir, uint32_t virt, uint32_t fl
 
 	uint32_t pa_table = (uint32_t)pmm_alloc_block();
 
-	va_dir->m_entries[get_page_directory_index(virt)] = pa_table | flags;
+	// page table is shared by every page in 4MB range, read-only is only enforced by page table entry
+	va_dir->m_entries[get_page_directory_index(virt)] = pa_table | I86_PDE_PRESENT | I86_PDE_WRITABLE | (flags & I86_PDE_USER);
 	vmm_flush_tlb_entry(virt);
 
 	memset((char *)PAGE_TABLE_BASE + get_page_directory_index(virt) * PMM_FRAME_SIZE, 0, sizeof(struct ptable));
@@ -279,7 +294,13 @@ struct pdirectory *vmm_fork(struct pdirectory *va_dir)
 			struct ptable *pt = (struct ptable *)(PAGE_TABLE_BASE + ipd * PMM_FRAME_SIZE);
 			for (int ipt = 0; ipt < PAGES_PER_TABLE; ++ipt)
 			{
-				if (is_page_enabled(pt->m_entries[ipt]))
+				// read-only pages (elf text, page cache) are never written in place -> share frame
+				if (is_page_enabled(pt->m_entries[ipt]) && !(pt->m_entries[ipt] & I86_PTE_WRITABLE))
+				{
+					forked_pt->m_entries[ipt] = pt->m_entries[ipt];
+					filemap_dup_frame(pt->m_entries[ipt] & PAGE_MASK);
+				}
+				else if (is_page_enabled(pt->m_entries[ipt]))
 				{
 					char *pte = (char *)heap_current;
 					char *forked_pte = pte + PMM_FRAME_SIZE;
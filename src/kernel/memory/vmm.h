@@ -14,6 +14,8 @@
 
 struct vm_area_struct;
 struct mm_struct;
+struct vfs_file;
+struct vfs_inode;
 
 //! i86 architecture defines this format so be careful if you modify it
 enum PAGE_PTE_FLAGS
@@ -53,15 +55,27 @@ enum PAGE_PDE_FLAGS
 
 typedef uint32_t pd_entry;
 
+//! page fault error code
+#define I86_PF_PRESENT 0x1	// protection violation, page is present
+#define I86_PF_WRITE 0x2
+#define I86_PF_USER 0x4
+
 //! i86 architecture defines 1024 entries per table--do not change
 #define PAGES_PER_TABLE 1024
 #define PAGES_PER_DIR 1024
 
+#define PG_CACHED 0x1	// owned by page cache (filemap.c), otherwise by filesystem (tmpfs)
+
 struct page
 {
 	uint32_t frame;
 	struct list_head sibling;
 	uint32_t virtual;
+	uint32_t index;	 // page offset in file (address_space)
+	uint32_t flags;
+	int32_t count;	// cache + user ptes + readers, frame is released at zero
+	struct address_space *mapping;	// NULL once it is dropped from cache
+	struct list_head lru;
 };
 
 struct pages
@@ -82,13 +96,14 @@ struct pdirectory
 };
 
 void vmm_init();
+void vmm_paging(struct pdirectory *va_dir, uint32_t pa_dir);
 struct pdirectory *vmm_get_directory();
 void vmm_map_address(struct pdirectory *dir, uint32_t virt, uint32_t phys, uint32_t flags);
 void vmm_unmap_address(struct pdirectory *va_dir, uint32_t virt);
 void vmm_unmap_range(struct pdirectory *va_dir, uint32_t vm_start, uint32_t vm_end);
-void *create_kernel_stack(int32_t blocks);
 struct pdirectory *vmm_create_address_space(struct pdirectory *dir);
 uint32_t vmm_get_physical_address(uint32_t vaddr, bool is_page);
+uint32_t vmm_get_mapped_physical_address(uint32_t vaddr);
 struct pdirectory *vmm_fork(struct pdirectory *va_dir);
 
 // malloc.c
@@ -99,6 +114,22 @@ void *krealloc(void *ptr, size_t size);
 void kfree(void *ptr);
 void *kalign_heap(size_t size);
 
+// kmem_cache.c
+struct kmem_cache
+{
+	const char *name;
+	size_t size;
+	void *free_list;
+	uint32_t nr_active, nr_free;
+};
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size);
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+uint32_t alloc_kernel_stack();
+void free_kernel_stack(uint32_t top);
+uint32_t get_kernel_stacks(uint32_t *nr_free);
+
 // mmap.c
 struct vm_area_struct *get_unmapped_area(uint32_t addr, uint32_t len);
 int32_t do_mmap(uint32_t addr,
@@ -106,6 +137,21 @@ int32_t do_mmap(uint32_t addr,
 				uint32_t flag, int32_t fd, off_t off);
 int do_munmap(struct mm_struct *mm, uint32_t addr, size_t len);
 uint32_t do_brk(uint32_t addr, size_t len);
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint32_t addr);
+uint32_t alloc_private_frame(const char *src, size_t len);
+int do_page_fault(struct mm_struct *mm, uint32_t address, uint32_t err_code);
+
+// filemap.c
+extern struct vm_operations_struct generic_file_vm_ops;
+struct page *find_get_page(struct vfs_file *file, uint32_t index);
+void put_page(struct page *page);
+ssize_t filemap_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos);
+void invalidate_inode_pages(struct vfs_inode *inode);
+void filemap_unmap_range(struct pdirectory *va_dir, uint32_t vm_start, uint32_t vm_end);
+void filemap_dup_frame(uint32_t frame);
+void filemap_put_frame(uint32_t frame);
+uint32_t get_cached_pages();
+void page_cache_init();
 
 // highmem.c
 void kmap(struct page *p);
@@ -96,6 +96,7 @@ int packet_handler(struct socket *sock, struct sk_buff *skb)
 
 	list_add_tail(&skb->sibling, &sk->rx_queue);
 	update_thread(sk->owner_thread, THREAD_READY);
+	sock_def_readable(sk);
 	return 0;
 }
 
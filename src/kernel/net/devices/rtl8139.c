@@ -7,6 +7,7 @@
 #include <memory/vmm.h>
 #include <net/net.h>
 #include <proc/task.h>
+#include <system/softirq.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
@@ -27,7 +28,8 @@ void rtl8139_send_packet(void *payload, uint32_t size)
 	tx_counter = tx_counter >= 3 ? 0 : tx_counter + 1;
 }
 
-void rtl8139_receive_packet(struct interrupt_registers *regs)
+// ring is drained from tasklet (interrupts on), net thread is woken once per batch
+static void rtl8139_receive_packet(unsigned long data)
 {
 	while ((inportb(rtl_netdev->base_addr + RTL8139_ChipCmd) & RTL8139_RxBufEmpty) == 0)
 	{
@@ -53,10 +55,11 @@ void rtl8139_receive_packet(struct interrupt_registers *regs)
 		outportw(rtl_netdev->base_addr + RTL8139_RxBufPtr, rx_buf_ptr - 0x10);
 	}
 
-	irq_ack(regs->int_no);
 	net_switch();
 }
 
+static DECLARE_TASKLET(rtl8139_rx_tasklet, rtl8139_receive_packet, 0);
+
 int32_t rtl8139_irq_handler(struct interrupt_registers *regs)
 {
 	uint16_t status = inportw(rtl_netdev->base_addr + RTL8139_IntrStatus);
@@ -65,11 +68,10 @@ int32_t rtl8139_irq_handler(struct interrupt_registers *regs)
 		return status;
 
 	outportw(rtl_netdev->base_addr + RTL8139_IntrStatus, status);
+	irq_ack(regs->int_no);
 
-	if (status & TOK)
-		irq_ack(regs->int_no);
 	if (status & ROK)
-		rtl8139_receive_packet(regs);
+		tasklet_schedule(&rtl8139_rx_tasklet);
 
 	return IRQ_HANDLER_CONTINUE;
 }
@@ -5,6 +5,7 @@
 #include <include/errno.h>
 #include <include/if_ether.h>
 #include <include/sockios.h>
+#include <locking/rwsem.h>
 #include <memory/vmm.h>
 #include <net/arp.h>
 #include <net/ethernet.h>
@@ -23,6 +24,7 @@ struct process *net_process;
 struct thread *net_thread;
 struct list_head lrx_skb;
 struct list_head lsocket;
+struct rw_semaphore lsocket_sem;  // protects lsocket
 struct net_device *current_netdev;
 
 // NOTE: MQ 2020-06-04
@@ -44,6 +46,7 @@ void sock_setup(struct socket *sock, int32_t family)
 	sk->dev = get_current_net_device();
 	sk->owner_thread = current_thread;
 	sk->sock = sock;
+	INIT_LIST_HEAD(&sk->sk_wait.list);
 	INIT_LIST_HEAD(&sk->rx_queue);
 	INIT_LIST_HEAD(&sk->tx_queue);
 
@@ -70,14 +73,18 @@ void socket_setup(int32_t family, enum socket_type type, int32_t protocal, struc
 	else if (family == PF_PACKET)
 		sock->ops = &packet_proto_ops;
 
+	down_write(&lsocket_sem);
 	list_add_tail(&sock->sibling, &lsocket);
+	up_write(&lsocket_sem);
 	sock_setup(sock, family);
 }
 
 int socket_shutdown(struct socket *sock)
 {
 	sock->state = SS_DISCONNECTED;
+	down_write(&lsocket_sem);
 	list_del(&sock->sibling);
+	up_write(&lsocket_sem);
 	return 0;
 }
 
@@ -277,6 +284,8 @@ void net_rx_loop()
 
 	while (true)
 	{
+		// socket handlers run with scheduler locked, take socket list before that because it might sleep
+		down_read(&lsocket_sem);
 		lock_scheduler();
 
 		struct sk_buff *skb;
@@ -307,6 +316,7 @@ void net_rx_loop()
 			list_del(&prev_skb->sibling);
 			skb_free(prev_skb);
 		}
+		up_read(&lsocket_sem);
 
 		update_thread(net_thread, THREAD_WAITING);
 		unlock_scheduler();
@@ -319,20 +329,16 @@ void net_switch()
 	if (list_empty(&lrx_skb))
 		return;
 
+	// called from irq, net thread takes over when returning from it (if current thread holds no lock)
+	update_thread(net_thread, THREAD_READY);
 	if (net_thread != current_thread)
-	{
-		update_thread(net_thread, THREAD_READY);
-		if (current_thread->state == THREAD_RUNNING)
-			update_thread(current_thread, THREAD_READY);
-		schedule();
-	}
-	else
-		update_thread(net_thread, THREAD_READY);
+		current_thread->need_resched = true;
 }
 
 void net_init()
 {
 	INIT_LIST_HEAD(&lsocket);
+	init_rwsem(&lsocket_sem);
 	INIT_LIST_HEAD(&lrx_skb);
 
 	log("Net: Setup neighbour");
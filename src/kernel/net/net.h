@@ -1,6 +1,7 @@
 #ifndef NET_H
 #define NET_H
 
+#include <fs/poll.h>
 #include <fs/vfs.h>
 #include <include/if_ether.h>
 #include <include/list.h>
@@ -134,6 +135,7 @@ struct sock
 	struct socket *sock;
 	struct net_device *dev;
 	struct thread *owner_thread;
+	struct wait_queue_head sk_wait;	 // pollers, woken up when rx_queue gets data or state changes
 	struct list_head rx_queue;
 	uint32_t rx_length;
 	struct list_head tx_queue;
@@ -163,6 +165,11 @@ static inline struct inet_sock *inet_sk(struct sock *sk)
 	return (struct inet_sock *)sk;
 }
 
+static inline void sock_def_readable(struct sock *sk)
+{
+	wake_up_poll(&sk->sk_wait, POLLIN | POLLRDNORM);
+}
+
 struct proto_ops
 {
 	int family;
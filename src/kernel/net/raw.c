@@ -109,6 +109,7 @@ int raw_handler(struct socket *sock, struct sk_buff *skb)
 
 		list_add_tail(&skb->sibling, &sock->sk->rx_queue);
 		update_thread(sock->sk->owner_thread, THREAD_READY);
+		sock_def_readable(sock->sk);
 	}
 	return 0;
 }
@@ -438,5 +438,6 @@ void tcp_handler_established(struct socket *sock, struct sk_buff *skb)
 		}
 	}
 
+	sock_def_readable(sock->sk);
 	update_thread(sock->sk->owner_thread, THREAD_READY);
 }
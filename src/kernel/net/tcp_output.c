@@ -86,7 +86,7 @@ void tcp_transmit(struct socket *sock)
 	while (!list_empty(&sock->sk->tx_queue))
 	{
 		// NOTE: MQ 2020-07-20
-		// we lock scheduler (interrupt) until sending all pending packets (on queue not yet sent)
+		// we don't let net thread run until sending all pending packets (on queue not yet sent)
 		// -> tx_queue now only contains outstanding packets
 		// measure sending with 65535 avaliable window takes ~ 2ms (which less than average RTT for each packet)
 		// the reason is prevent interrupting the sending flow which causes unexpected behaviors
@@ -101,9 +101,15 @@ void tcp_transmit(struct socket *sock)
 		// - send all segments but get interrutped when just out of loop and haven't updated/scheduled yet
 		// - receive ack for all segments -> back to interrupted point above
 		// -> schedule again which don't have anything to wait -> thread is waiting forever
-		lock_scheduler();
-		while (tcp_sender_available_window(tsk) > 0 && sock->sk->send_head)
+		// acks are handled in net thread -> disabling preemption is enough, irqs only queue incoming packets
+		// scheduler is locked per segment against retransmit timer (pit irq) which moves `send_head` back
+		preempt_disable();
+		while (true)
 		{
+			lock_scheduler();
+			if (tcp_sender_available_window(tsk) <= 0 || !sock->sk->send_head)
+				break;
+
 			struct sk_buff *skb = list_entry(sock->sk->send_head, struct sk_buff, sibling);
 			tcp_send_skb(sock, skb, false);
 
@@ -120,9 +126,11 @@ void tcp_transmit(struct socket *sock)
 				tsk->rtt_end_seq = cb->end_seq;
 				tsk->rtt_time = cb->when;
 			}
+			unlock_scheduler();
 		}
 		update_thread(current_thread, THREAD_WAITING);
 		unlock_scheduler();
+		preempt_enable();
 		schedule();
 	}
 };
@@ -1,11 +1,13 @@
 #include "elf.h"
 
 #include <include/errno.h>
+#include <include/fcntl.h>
 #include <include/mman.h>
 #include <memory/pmm.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
 #include <utils/debug.h>
+#include <utils/math.h>
 #include <utils/string.h>
 
 #define NO_ERROR 0
@@ -35,7 +37,7 @@ static int elf_verify(struct Elf32_Ehdr *elf_header)
 	if (elf_header->e_machine != EM_386)
 		return -ERR_NOT_SUPPORTED_PLATFORM;
 
-	if (elf_header->e_type != ET_EXEC)
+	if (elf_header->e_type != ET_EXEC && elf_header->e_type != ET_DYN)
 		return -ERR_NOT_SUPPORTED_TYPE;
 
 	return NO_ERROR;
@@ -60,49 +62,172 @@ static int elf_verify(struct Elf32_Ehdr *elf_header)
 * 	+---------------+
 */
 
-struct Elf32_Layout *elf_load(const char *path)
+// PT_LOAD is mapped as file-backed vma, pages are faulted in from page cache on first access
+// -> text is shared by every process running the same binary and data is copied on first write
+// segment which is not congruent to page size (file offset vs vaddr) is copied eagerly
+static bool elf_map_segment(struct vfs_file *file, struct Elf32_Phdr *ph, uint32_t base)
+{
+	uint32_t vaddr = base + ph->p_vaddr;
+	uint32_t start = ALIGN_DOWN(vaddr, PMM_FRAME_SIZE);
+	uint32_t end = PAGE_ALIGN(vaddr + ph->p_memsz);
+	struct mm_struct *mm = current_process->mm;
+
+	if ((ph->p_vaddr - ph->p_offset) % PMM_FRAME_SIZE != 0 || find_vma(mm, start) || find_vma(mm, end - 1))
+		return false;
+
+	struct vm_area_struct *vma = get_unmapped_area(start, end - start);
+	vma->vm_flags = (ph->p_flags & PF_R ? VM_READ : 0) | (ph->p_flags & PF_W ? VM_WRITE : 0) | (ph->p_flags & PF_X ? VM_EXEC : 0);
+	vma->vm_file = file;
+	vma->vm_pgoff = ph->p_offset / PMM_FRAME_SIZE;
+	vma->vm_file_end = vaddr + ph->p_filesz;
+	// bytes after read-only segment in its last page are not part of any segment, map file page as it is
+	if (!(ph->p_flags & PF_W) && ph->p_filesz == ph->p_memsz)
+		vma->vm_file_end = end;
+	vma->vm_ops = &generic_file_vm_ops;
+	atomic_inc(&file->f_count);
+	return true;
+}
+
+// file is detached from fd table, caller drops it with `vfs_fput`
+static struct vfs_file *elf_open(const char *path, struct Elf32_Ehdr *elf_header, struct Elf32_Phdr **phdrs)
 {
-	const char *buf = vfs_read(path);
-	struct Elf32_Ehdr *elf_header = (struct Elf32_Ehdr *)buf;
+	int32_t fd = vfs_open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		log("ELF: %s cannot be opened", path);
+		return NULL;
+	}
+
+	struct vfs_file *file = current_process->files->fd[fd];
+	current_process->files->fd[fd] = NULL;
+
+	*phdrs = NULL;
+	if (filemap_read(file, (char *)elf_header, sizeof(struct Elf32_Ehdr), 0) == sizeof(struct Elf32_Ehdr) &&
+		elf_verify(elf_header) == NO_ERROR && elf_header->e_phoff != 0 &&
+		elf_header->e_phentsize == sizeof(struct Elf32_Phdr))
+	{
+		uint32_t phdrs_size = elf_header->e_phentsize * elf_header->e_phnum;
+		*phdrs = kcalloc(phdrs_size, sizeof(char));
+		if (filemap_read(file, (char *)*phdrs, phdrs_size, elf_header->e_phoff) != phdrs_size)
+		{
+			kfree(*phdrs);
+			*phdrs = NULL;
+		}
+	}
 
-	if (elf_verify(elf_header) != NO_ERROR || elf_header->e_phoff == 0)
+	if (!*phdrs)
 	{
 		log("ELF: %s is not correct format", path);
+		vfs_fput(file);
+		return NULL;
+	}
+	return file;
+}
+
+static void elf_map_image(struct vfs_file *file, struct Elf32_Ehdr *elf_header, struct Elf32_Phdr *phdrs, uint32_t base)
+{
+	for (struct Elf32_Phdr *ph = phdrs; ph < phdrs + elf_header->e_phnum; ++ph)
+	{
+		if (ph->p_type != PT_LOAD || elf_map_segment(file, ph, base))
+			continue;
+
+		do_mmap(base + ph->p_vaddr, ph->p_memsz, 0, 0, -1, 0);
+		// NOTE: MQ 2019-11-26 According to elf's spec, p_memsz may be larger than p_filesz due to bss section
+		memset((char *)base + ph->p_vaddr, 0, ph->p_memsz);
+		filemap_read(file, (char *)base + ph->p_vaddr, ph->p_filesz, ph->p_offset);
+	}
+}
+
+// Dynamically linked executable (PT_INTERP) is mapped as usual, its interpreter (position-independent ld.so)
+// is mapped at ELF_INTERP_BASE and started instead, it finds the executable via auxv and jumps to AT_ENTRY
+static bool elf_load_interp(struct vfs_file *file, struct Elf32_Phdr *interp, struct Elf32_Layout *layout)
+{
+	char *path = kcalloc(interp->p_filesz + 1, sizeof(char));
+	filemap_read(file, path, interp->p_filesz, interp->p_offset);
+
+	struct Elf32_Ehdr elf_header;
+	struct Elf32_Phdr *phdrs;
+	struct vfs_file *interp_file = elf_open(path, &elf_header, &phdrs);
+	kfree(path);
+	if (!interp_file)
+		return false;
+
+	bool ok = elf_header.e_type == ET_DYN;
+	if (ok)
+	{
+		// keep interpreter out of the way of heap and stack which are placed after executable
+		struct mm_struct *mm = current_process->mm;
+		uint32_t free_area_cache = mm->free_area_cache;
+		elf_map_image(interp_file, &elf_header, phdrs, ELF_INTERP_BASE);
+		mm->free_area_cache = free_area_cache;
+
+		layout->base = ELF_INTERP_BASE;
+		layout->entry = ELF_INTERP_BASE + elf_header.e_entry;
+	}
+
+	kfree(phdrs);
+	vfs_fput(interp_file);
+	return ok;
+}
+
+struct Elf32_Layout *elf_load(const char *path)
+{
+	struct Elf32_Ehdr elf_header;
+	struct Elf32_Phdr *phdrs;
+	struct vfs_file *file = elf_open(path, &elf_header, &phdrs);
+	if (!file)
+		return NULL;
+
+	// position-independent executables are not supported, ET_DYN is only for interpreter
+	if (elf_header.e_type != ET_EXEC)
+	{
+		log("ELF: %s is not executable", path);
+		kfree(phdrs);
+		vfs_fput(file);
 		return NULL;
 	}
 
 	log("ELF: Load %s", path);
 	struct mm_struct *mm = current_process->mm;
 	struct Elf32_Layout *layout = kcalloc(1, sizeof(struct Elf32_Layout));
-	layout->entry = elf_header->e_entry;
-	for (struct Elf32_Phdr *ph = (struct Elf32_Phdr *)(buf + elf_header->e_phoff);
-		 ph && (char *)ph < (buf + elf_header->e_phoff + elf_header->e_phentsize * elf_header->e_phnum);
-		 ++ph)
+	layout->entry = layout->program_entry = elf_header.e_entry;
+	layout->phent = elf_header.e_phentsize;
+	layout->phnum = elf_header.e_phnum;
+
+	struct Elf32_Phdr *interp = NULL;
+	for (struct Elf32_Phdr *ph = phdrs; ph < phdrs + elf_header.e_phnum; ++ph)
 	{
+		if (ph->p_type == PT_INTERP)
+			interp = ph;
+		else if (ph->p_type == PT_PHDR)
+			layout->phdr = ph->p_vaddr;
+		else if (ph->p_type == PT_LOAD && ph->p_offset == 0 && !layout->phdr)
+			layout->phdr = ph->p_vaddr + elf_header.e_phoff;
+
 		if (ph->p_type != PT_LOAD)
 			continue;
 
 		// text segment
 		if ((ph->p_flags & PF_X) != 0 && (ph->p_flags & PF_R) != 0)
 		{
-			do_mmap(ph->p_vaddr, ph->p_memsz, 0, 0, -1, 0);
 			mm->start_code = ph->p_vaddr;
 			mm->end_code = ph->p_vaddr + ph->p_memsz;
 		}
 		// data segment
 		else if ((ph->p_flags & PF_W) != 0 && (ph->p_flags & PF_R) != 0)
 		{
-			do_mmap(ph->p_vaddr, ph->p_memsz, 0, 0, -1, 0);
 			mm->start_data = ph->p_vaddr;
-			mm->end_data = ph->p_memsz;
+			mm->end_data = ph->p_vaddr + ph->p_memsz;
 		}
-		// eh frame
-		else
-			do_mmap(ph->p_vaddr, ph->p_memsz, 0, 0, -1, 0);
+	}
+	elf_map_image(file, &elf_header, phdrs, 0);
 
-		// NOTE: MQ 2019-11-26 According to elf's spec, p_memsz may be larger than p_filesz due to bss section
-		memset((char *)ph->p_vaddr, 0, ph->p_memsz);
-		memcpy((char *)ph->p_vaddr, buf + ph->p_offset, ph->p_filesz);
+	if (interp && !elf_load_interp(file, interp, layout))
+	{
+		kfree(layout);
+		kfree(phdrs);
+		vfs_fput(file);
+		return NULL;
 	}
 
 	uint32_t heap_start = do_mmap(0, UHEAP_SIZE, 0, 0, -1, 0);
@@ -113,6 +238,8 @@ struct Elf32_Layout *elf_load(const char *path)
 	uint32_t stack_start = do_mmap(0, STACK_SIZE, 0, 0, -1, 0);
 	layout->stack = stack_start + STACK_SIZE;
 
+	kfree(phdrs);
+	vfs_fput(file);
 	return layout;
 }
 
@@ -125,7 +252,14 @@ void elf_unload()
 	struct vm_area_struct *iter, *next;
 	list_for_each_entry_safe(iter, next, &current_process->mm->mmap, vm_sibling)
 	{
-		if (!iter->vm_file && (iter->vm_flags & MAP_SHARED) == 0)
+		if (iter->vm_ops)
+		{
+			filemap_unmap_range(current_process->pdir, iter->vm_start, iter->vm_end);
+			vfs_fput(iter->vm_file);
+			list_del(&iter->vm_sibling);
+			kfree(iter);
+		}
+		else if (!iter->vm_file && (iter->vm_flags & MAP_SHARED) == 0)
 		{
 			vmm_unmap_range(current_process->pdir, iter->vm_start, iter->vm_end);
 			list_del(&iter->vm_sibling);
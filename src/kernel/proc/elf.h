@@ -160,10 +160,28 @@ struct Elf32_Phdr
 	Elf32_Word p_align;
 };
 
+// auxiliary vector, passed to dynamic linker after envp
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHENT 4
+#define AT_PHNUM 5
+#define AT_PAGESZ 6
+#define AT_BASE 7
+#define AT_ENTRY 9
+
+// dynamic linker (PT_INTERP) is loaded here, shared libraries are placed below it by the linker itself
+#define ELF_INTERP_BASE 0xA0000000
+
 struct Elf32_Layout
 {
 	uint32_t stack;
 	uint32_t entry;
+	// auxv
+	uint32_t phdr;
+	uint32_t phent;
+	uint32_t phnum;
+	uint32_t base;
+	uint32_t program_entry;
 };
 
 struct Elf32_Layout *elf_load(const char *path);
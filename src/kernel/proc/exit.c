@@ -1,17 +1,26 @@
+#include <cpu/fpu.h>
 #include <devices/char/tty.h>
-#include <include/atomic.h>
 #include <include/errno.h>
 #include <ipc/signal.h>
+#include <locking/futex.h>
 #include <utils/debug.h>
 
 #include "task.h"
 
+// threads which exited alone (others are still running in process), released by whoever is scheduled next
+static LIST_HEAD(dead_threads);
+
 static void exit_mm(struct process *proc)
 {
 	struct vm_area_struct *iter, *next;
 	list_for_each_entry_safe(iter, next, &proc->mm->mmap, vm_sibling)
 	{
-		if (!iter->vm_file)
+		if (iter->vm_ops)
+		{
+			filemap_unmap_range(proc->pdir, iter->vm_start, iter->vm_end);
+			vfs_fput(iter->vm_file);
+		}
+		else if (!iter->vm_file)
 			vmm_unmap_range(proc->pdir, iter->vm_start, iter->vm_end);
 
 		list_del(&iter->vm_sibling);
@@ -19,27 +28,96 @@ static void exit_mm(struct process *proc)
 	}
 }
 
+// each fd drops its reference like close, the last one releases file and its dentry/inode
 static void exit_files(struct process *proc)
 {
+	struct files_struct *files = proc->files;
+	mutex_lock(&files->lock);
+
 	for (int i = 0; i < MAX_FD; ++i)
 	{
-		struct vfs_file *file = proc->files->fd[i];
+		if (!files->fd[i])
+			continue;
 
-		if (file && atomic_read(&file->f_count) == 1 && file->f_op->release)
-		{
-			file->f_op->release(file->f_dentry->d_inode, file);
-			kfree(file);
-		}
+		vfs_fput(files->fd[i]);
+		files->fd[i] = NULL;
 	}
+
+	mutex_unlock(&files->lock);
 }
 
-static void exit_thread(struct process *proc)
+static void exit_thread(struct process *proc, struct thread *th)
 {
-	struct thread *th = proc->thread;
-
 	update_thread(th, THREAD_TERMINATED);
 	del_timer(&th->sleep_timer);
-	vmm_unmap_range(proc->pdir, th->user_stack - STACK_SIZE, th->user_stack);
+
+	// pi futex waiters sleep until the owner unlocks, disown what it still holds and wake them up to take it over
+	lock_scheduler();
+	struct pi_waiter *waiter, *next;
+	plist_for_each_entry_safe(waiter, next, &th->pi_waiters, pi_sibling)
+	{
+		plist_del(&waiter->pi_sibling, &th->pi_waiters);
+		waiter->lock->owner = NULL;
+		update_thread(waiter->task, THREAD_READY);
+	}
+	unlock_scheduler();
+	fpu_release(th);
+	list_del(&th->sibling);
+
+	// joiner in userspace waits for this address becoming zero (pthread_join)
+	if (th->clear_child_tid)
+	{
+		*th->clear_child_tid = 0;
+		futex_wake((uint32_t *)th->clear_child_tid, 1);
+		th->clear_child_tid = NULL;
+	}
+}
+
+/*
+ * Siblings are sent a kill instead of being terminated where they are, a sibling can sleep holding a mutex
+ * or semaphore. Each one leaves at its own syscall or irq return point (handle_signal) where it holds no
+ * kernel lock, interruptible waits return -EINTR to get there, and it is reaped as any thread exiting alone
+ */
+void zap_other_threads(struct process *proc)
+{
+	lock_scheduler();
+
+	struct thread *iter;
+	list_for_each_entry(iter, &proc->threads, sibling)
+	{
+		if (iter == current_thread)
+			continue;
+
+		iter->flags |= TIF_GROUP_EXIT;
+		sigaddset(&iter->pending, SIGKILL);
+		update_thread(iter, THREAD_READY);
+	}
+
+	unlock_scheduler();
+}
+
+// execve continues in calling thread, it cannot drop address space which siblings are still in
+static void wait_other_threads(struct process *proc)
+{
+	lock_scheduler();
+
+	proc->group_exit_waiter = current_thread;
+	while (!list_is_singular(&proc->threads))
+	{
+		update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+		lock_scheduler();
+	}
+	proc->group_exit_waiter = NULL;
+
+	unlock_scheduler();
+}
+
+void de_thread(struct process *proc)
+{
+	zap_other_threads(proc);
+	wait_other_threads(proc);
 }
 
 static void exit_notify(struct process *proc)
@@ -63,23 +141,97 @@ static void exit_notify(struct process *proc)
 	wake_up(&proc->parent->wait_chld);
 }
 
+// thread group exit, all threads in process are terminated
 void do_exit(int32_t code)
 {
 	log("Process: Exit %s(p%d)", current_process->name, current_process->pid);
 	lock_scheduler();
 
-	exit_mm(current_process);
+	// the last sibling which leaves tears down process with group's exit code (do_exit_thread)
+	if (!list_is_singular(&current_process->threads))
+	{
+		if (!(current_process->flags & GROUP_EXITING))
+		{
+			current_process->flags |= GROUP_EXITING;
+			current_process->exit_code = code;
+			zap_other_threads(current_process);
+		}
+		current_thread->clear_child_tid = NULL;
+		unlock_scheduler();
+		do_exit_thread(current_process->exit_code);
+		return;
+	}
+
+	if (current_process->flags & GROUP_EXITING)
+		code = current_process->exit_code;
+	// it is the only thread, files are closed with scheduler unlocked as release can sleep (inode mutex, writeback)
+	unlock_scheduler();
 	exit_files(current_process);
-	exit_thread(current_process);
+	lock_scheduler();
+
+	struct thread *th = current_thread;
+	// whole group is going away, nobody is left to join and the address is unmapped below
+	th->clear_child_tid = NULL;
+	// vfork child exits on parent's address space (no execve), it is left untouched
+	if (!current_process->vfork_done)
+	{
+		if (th->user_stack)
+			vmm_unmap_range(current_process->pdir, th->user_stack - STACK_SIZE, th->user_stack);
+		exit_mm(current_process);
+	}
+	exit_thread(current_process, th);
+	del_timer(&current_process->sig_alarm_timer);
 
 	current_process->exit_code = code;
 	exit_notify(current_process);
+	vfork_release(current_process);
+
+	unlock_scheduler();
+
+	schedule();
+}
+
+// only calling thread exits, the last thread tears down process
+void do_exit_thread(int32_t code)
+{
+	lock_scheduler();
+
+	struct process *proc = current_process;
+	if (list_is_singular(&proc->threads))
+	{
+		unlock_scheduler();
+		do_exit(code);
+		return;
+	}
+
+	log("Process: Exit thread %d in %s(p%d)", current_thread->tid, proc->name, proc->pid);
+	exit_thread(proc, current_thread);
+	if (proc->thread == current_thread)
+		proc->thread = list_first_entry(&proc->threads, struct thread, sibling);
+	// still running on its kernel stack, see reap_dead_threads
+	list_add_tail(&current_thread->sibling, &dead_threads);
+	if (proc->group_exit_waiter && list_is_singular(&proc->threads))
+		update_thread(proc->group_exit_waiter, THREAD_READY);
 
 	unlock_scheduler();
 
 	schedule();
 }
 
+void reap_dead_threads()
+{
+	lock_scheduler();
+
+	struct thread *iter, *next;
+	list_for_each_entry_safe(iter, next, &dead_threads, sibling)
+	{
+		list_del(&iter->sibling);
+		free_thread(iter);
+	}
+
+	unlock_scheduler();
+}
+
 /*
  * Return:
  * - 1 if found a child process which status is available
@@ -143,6 +295,9 @@ int32_t do_wait(idtype_t idtype, id_t id, struct infop *infop, int options)
 		// After waiting for terminated child, we remove it from parent
 		// the next waiting time, we don't find the same one again
 		list_del(&pchild->sibling);
+		// every thread has exited (the last one in do_exit) and it is not running, nothing refers to child anymore
+		if (list_empty(&pchild->threads))
+			free_process(pchild);
 		ret = 1;
 	}
 	else
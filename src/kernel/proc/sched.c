@@ -1,13 +1,17 @@
+#include <cpu/fpu.h>
+#include <cpu/gdt.h>
 #include <cpu/hal.h>
 #include <cpu/idt.h>
 #include <cpu/pic.h>
 #include <cpu/tss.h>
 #include <fs/poll.h>
+#include <include/errno.h>
 #include <include/limits.h>
 #include <ipc/signal.h>
 #include <memory/vmm.h>
 #include <system/time.h>
 #include <utils/debug.h>
+#include <utils/vsprintf.h>
 
 #include "task.h"
 
@@ -17,18 +21,27 @@ extern void do_switch(uint32_t *addr_current_kernel_esp, uint32_t next_kernel_es
 struct plist_head terminated_list, waiting_list;
 struct plist_head kernel_ready_list, system_ready_list, app_ready_list;
 uint32_t volatile scheduler_lock_counter = 0;
+struct sched_stat sched_stat;
+static uint64_t boot_ms;
+static uint64_t irqoff_start;
 
 void lock_scheduler()
 {
 	disable_interrupts();
-	scheduler_lock_counter++;
+	if (!scheduler_lock_counter++)
+		irqoff_start = rdtsc();
 }
 
 void unlock_scheduler()
 {
 	scheduler_lock_counter--;
 	if (scheduler_lock_counter == 0)
+	{
+		uint64_t irqoff = rdtsc() - irqoff_start;
+		if (irqoff > sched_stat.irqoff_max)
+			sched_stat.irqoff_max = irqoff;
 		enable_interrupts();
+	}
 }
 
 static struct thread *get_next_thread_from_list(struct plist_head *list)
@@ -106,11 +119,15 @@ void queue_thread(struct thread *th)
 {
 	struct plist_head *h = get_list_from_thread(th->state, th->policy);
 
+	// requeued ready thread (priority change) keeps waiting since it has been queued first
+	if (th->state == THREAD_READY && !th->ready_since)
+		th->ready_since = rdtsc();
+
 	if (h)
 		plist_add(&th->sched_sibling, h);
 }
 
-static void remove_thread(struct thread *th)
+void dequeue_thread(struct thread *th)
 {
 	struct plist_head *h = get_list_from_thread(th->state, th->policy);
 
@@ -118,22 +135,80 @@ static void remove_thread(struct thread *th)
 		plist_del(&th->sched_sibling, h);
 }
 
+// app threads take turns by time slice, priority only orders kernel/system threads
+static bool thread_outranks(struct thread *th, struct thread *other)
+{
+	if (th->policy != other->policy)
+		return th->policy < other->policy;
+	return th->policy != THREAD_APP_POLICY && th->sched_sibling.prio < other->sched_sibling.prio;
+}
+
+// kernel/system thread is only preempted by more important one
+// woken app thread takes over running app thread, which goes behind other ready app threads
+static bool thread_preempts_current(struct thread *th)
+{
+	if (th->policy == THREAD_APP_POLICY && current_thread->policy == THREAD_APP_POLICY)
+		return true;
+	return thread_outranks(th, current_thread);
+}
+
 void update_thread(struct thread *th, uint8_t state)
 {
-	if (th->state == state)
+	// terminated thread can be still in wait queues (zapped by a sibling), it is never revived
+	if (th->state == state || th->state == THREAD_TERMINATED)
 		return;
 
 	lock_scheduler();
 
-	remove_thread(th);
+	bool woken = th->state == THREAD_WAITING && state == THREAD_READY;
+	dequeue_thread(th);
 	th->state = state;
 	queue_thread(th);
 
+	if (woken && current_thread && th != current_thread &&
+		current_thread->state == THREAD_RUNNING && thread_preempts_current(th))
+		current_thread->need_resched = true;
+
 	unlock_scheduler();
 }
 
+// requeue with another policy/priority (priority inheritance, sched_setscheduler)
+void sched_setprio(struct thread *th, enum thread_policy policy, int prio)
+{
+	lock_scheduler();
+
+	dequeue_thread(th);
+	th->policy = policy;
+	th->sched_sibling.prio = prio;
+	queue_thread(th);
+
+	// boosted ready thread or deboosted current thread -> the more important one runs from the next preemption point
+	if (current_thread->state == THREAD_RUNNING)
+	{
+		struct thread *nt = get_next_thread_to_run();
+		if (nt && thread_outranks(nt, current_thread))
+			current_thread->need_resched = true;
+	}
+
+	unlock_scheduler();
+}
+
+// charge time since it has been switched in (or since the last charge) to the thread on cpu
+static void update_curr(uint64_t now)
+{
+	current_thread->sum_exec_runtime += now - current_thread->exec_start;
+	current_thread->exec_start = now;
+}
+
 static void switch_thread(struct thread *nt)
 {
+	uint64_t now = rdtsc();
+	if (nt->ready_since)
+	{
+		nt->run_delay += now - nt->ready_since;
+		nt->ready_since = 0;
+	}
+
 	if (current_thread == nt)
 	{
 		current_thread->time_slice = 0;
@@ -142,6 +217,17 @@ static void switch_thread(struct thread *nt)
 	}
 
 	struct thread *pt = current_thread;
+	pt->need_resched = false;
+
+	update_curr(now);
+	// still runnable -> it has been preempted or has yielded
+	if (pt->state == THREAD_READY)
+		pt->nivcsw++;
+	else
+		pt->nvcsw++;
+	sched_stat.nr_switches++;
+	nt->exec_start = now;
+	nt->last_cpu = 0;
 
 	current_thread = nt;
 	current_thread->time_slice = 0;
@@ -149,6 +235,8 @@ static void switch_thread(struct thread *nt)
 	current_process = current_thread->parent;
 
 	uint32_t paddr_cr3 = vmm_get_physical_address((uint32_t)current_thread->parent->pdir, true);
+	fpu_switch(pt, current_thread);
+	gdt_set_tls(&current_thread->tls);
 	tss_set_stack(0x10, current_thread->kernel_stack);
 	do_switch(&pt->esp, current_thread->esp, paddr_cr3);
 }
@@ -163,6 +251,9 @@ void schedule()
 	struct thread *nt = pop_next_thread_to_run();
 	if (!nt)
 	{
+		// halted time is idle, it isn't charged to the thread which has gone to sleep
+		uint64_t idle_start = rdtsc();
+		update_curr(idle_start);
 		do
 		{
 			unlock_scheduler();
@@ -176,63 +267,148 @@ void schedule()
 			if (!nt && current_thread->state == THREAD_RUNNING)
 				nt = current_thread;
 		} while (!nt);
+
+		uint64_t now = rdtsc();
+		sched_stat.idle_time += now - idle_start;
+		current_thread->exec_start = now;
 	}
 	switch_thread(nt);
+	// threads which exited on their own stack can be released now, we are on another one
+	reap_dead_threads();
 
-	if (current_thread->pending && !(current_thread->flags & TIF_SIGNAL_MANUAL))
+	if (current_thread->pending && !(current_thread->flags & (TIF_SIGNAL_MANUAL | TIF_GROUP_EXIT)))
 	{
+		// a fatal signal exits in the middle of kernel wait, wait entries on this stack can stay queued
 		struct interrupt_registers *regs = (struct interrupt_registers *)(current_thread->kernel_stack - sizeof(struct interrupt_registers));
+		current_thread->flags |= TIF_NOREAP;
 		handle_signal(regs, current_thread->blocked);
+		current_thread->flags &= ~TIF_NOREAP;
 	}
 	unlock_scheduler();
 }
 
-#define SLICE_THRESHOLD 8
-int32_t irq_schedule_handler(struct interrupt_registers *regs)
+// scale ready app threads to zero and put `th` behind them
+static void rotate_app_thread(struct thread *th)
 {
-	if (current_thread->policy != THREAD_APP_POLICY || current_thread->state != THREAD_RUNNING)
-		return IRQ_HANDLER_CONTINUE;
+	struct thread *first_thd = plist_first_entry(&app_ready_list, struct thread, sched_sibling);
+	struct thread *last_thd = plist_last_entry(&app_ready_list, struct thread, sched_sibling);
+	int scale = first_thd->sched_sibling.prio;
 
+	struct thread *iter;
+	plist_for_each_entry(iter, &app_ready_list, sched_sibling)
+	{
+		iter->sched_sibling.prio -= scale;
+	}
+	th->sched_sibling.prio = last_thd->sched_sibling.prio + 1;
+}
+
+void sched_yield()
+{
 	lock_scheduler();
 
-	bool is_schedulable = false;
-	current_thread->time_slice++;
+	if (current_thread->policy == THREAD_APP_POLICY && !plist_head_empty(&app_ready_list))
+		rotate_app_thread(current_thread);
+	update_thread(current_thread, THREAD_READY);
+
+	unlock_scheduler();
 
-	if (current_thread->time_slice >= SLICE_THRESHOLD)
+	schedule();
+}
+
+/*
+  Preemption point, it runs on the way back from the outermost irq, at the end of syscall and when preempt count drops to zero
+  current thread is switched out only if it holds no lock
+  - scheduler is unlocked (interrupts were on, nobody is in the middle of changing thread lists)
+  - preempt count is zero
+  sleeping locks (mutex, semaphore) can be held, the owner is just another ready thread
+*/
+void preempt_schedule()
+{
+	if (!current_thread || !current_thread->need_resched || current_thread->preempt_count ||
+		scheduler_lock_counter || current_thread->state != THREAD_RUNNING)
+		return;
+
+	lock_scheduler();
+
+	current_thread->need_resched = false;
+	struct thread *nt = get_next_thread_to_run();
+	if (nt)
 	{
-		struct thread *nt = get_next_thread_to_run();
+		// scale ready app threads to zero and set current thread to last + 1
+		if (current_thread->policy == THREAD_APP_POLICY && nt->policy == THREAD_APP_POLICY)
+			rotate_app_thread(current_thread);
+		update_thread(current_thread, THREAD_READY);
+	}
+
+	unlock_scheduler();
+
+	if (nt)
+		schedule();
+}
+
+static char thread_state_char(struct thread *th)
+{
+	switch (th->state)
+	{
+	case THREAD_READY:
+	case THREAD_RUNNING:
+		return 'R';
+	case THREAD_WAITING:
+		return 'S';
+	case THREAD_TERMINATED:
+		return 'Z';
+	default:
+		return 'N';
+	}
+}
+
+/*
+  First line is system wide: switches, irqs, idle time, tsc now and tsc ticks per ms (measured against pit since boot),
+  softirqs and worst interrupts-off time (hard irq handler, scheduler locked)
+  then a line per thread, times are tsc ticks. A reader samples twice and divides deltas of runtime by delta of tsc
+*/
+int sched_stat_print(char *buf, size_t size)
+{
+	lock_scheduler();
+
+	uint64_t now = rdtsc();
+	uint64_t elapsed_ms = get_milliseconds(NULL) - boot_ms;
+	// reader is on cpu, its runtime is charged up to now
+	update_curr(now);
 
-		if (nt)
+	int len = scnprintf(buf, size, "switches %u irqs %u idle %llu tsc %llu tsc_khz %llu softirq %u hardirq_max %llu irqoff_max %llu\n",
+						sched_stat.nr_switches, sched_stat.nr_irqs, sched_stat.idle_time, now,
+						elapsed_ms ? (now - sched_stat.boot_tsc) / elapsed_ms : 0,
+						sched_stat.nr_softirqs, sched_stat.hardirq_max, sched_stat.irqoff_max);
+	len += scnprintf(buf + len, size - len, "%5s %5s %s %6s %6s %3s %14s %14s %8s %8s %s\n",
+					 "pid", "tid", "s", "policy", "prio", "cpu", "runtime", "wait", "nvcsw", "nivcsw", "name");
+
+	struct process *proc;
+	for_each_process(proc)
+	{
+		struct thread *th;
+		list_for_each_entry(th, &proc->threads, sibling)
 		{
-			// 1. if next thread to run is not app policy -> step 4
-			// 2. scale them to zero and set current thead to last + 1
-			// 3. update thread
-			if (nt->policy == THREAD_APP_POLICY)
-			{
-				struct thread *first_thd = plist_first_entry(&app_ready_list, struct thread, sched_sibling);
-				struct thread *last_thd = plist_last_entry(&app_ready_list, struct thread, sched_sibling);
-				int scale = first_thd->sched_sibling.prio;
-
-				struct thread *iter;
-				plist_for_each_entry(iter, &app_ready_list, sched_sibling)
-				{
-					iter->sched_sibling.prio -= scale;
-				}
-				current_thread->sched_sibling.prio = last_thd->sched_sibling.prio + 1;
-			}
-			update_thread(current_thread, THREAD_READY);
-			is_schedulable = true;
+			uint64_t run_delay = th->run_delay + (th->ready_since ? now - th->ready_since : 0);
+			len += scnprintf(buf + len, size - len, "%5d %5d %c %6d %6d %3u %14llu %14llu %8u %8u %s\n",
+							 proc->pid, th->tid, thread_state_char(th), th->policy, th->sched_sibling.prio,
+							 th->last_cpu, th->sum_exec_runtime, run_delay, th->nvcsw, th->nivcsw, proc->name);
 		}
 	}
 
 	unlock_scheduler();
+	return len;
+}
 
-	// NOTE: MQ 2019-10-15 If counter is 1, it means that there is not running scheduler
-	if (is_schedulable && !scheduler_lock_counter)
-	{
-		log("Scheduler: Round-robin for %d", current_thread->tid);
-		schedule();
-	}
+#define SLICE_THRESHOLD 8
+int32_t irq_schedule_handler(struct interrupt_registers *regs)
+{
+	if (current_thread->policy != THREAD_APP_POLICY || current_thread->state != THREAD_RUNNING)
+		return IRQ_HANDLER_CONTINUE;
+
+	// thread is switched when returning from irq, other handlers (rtc ack) on this irq still run
+	if (++current_thread->time_slice >= SLICE_THRESHOLD && get_next_thread_to_run())
+		current_thread->need_resched = true;
 
 	return IRQ_HANDLER_CONTINUE;
 }
@@ -245,25 +421,106 @@ int32_t thread_page_fault(struct interrupt_registers *regs)
 
 	if (regs->cs == 0x1B)
 	{
-		log("Page Fault: From userspace at 0x%x", faultAddr);
 		if (faultAddr == PROCESS_TRAPPED_PAGE_FAULT)
 			do_exit(regs->eax);
 		else if (faultAddr == (uint32_t)sigreturn)
 			sigreturn(regs);
+	}
+
+	// demand paging (elf, anonymous) and copy-on-write, kernel can fault on user memory in syscalls
+	// faulting in file pages waits for disk -> interrupts are re-enabled if they were on before the fault
+	if (faultAddr < KERNEL_HIGHER_HALF && current_process && current_process->mm)
+	{
+		if (regs->eflags & 0x200)
+			enable_interrupts();
 
+		int ret = do_page_fault(current_process->mm, faultAddr, regs->err_code);
+		if (ret >= 0)
+			return IRQ_HANDLER_STOP;
+		if (ret == -ENOMEM && regs->cs == 0x1B)
+		{
+			do_kill(current_process->pid, SIGSEGV);
+			return IRQ_HANDLER_STOP;
+		}
+	}
+
+	if (regs->cs == 0x1B)
+	{
+		log("Page Fault: From userspace at 0x%x", faultAddr);
 		return IRQ_HANDLER_STOP;
 	}
 
 	return IRQ_HANDLER_CONTINUE;
 }
 
-void wake_up(struct wait_queue_head *hq)
+struct wait_queue_stat wq_stat;
+
+int default_wake_function(struct wait_queue_entry *wait, uint32_t key)
+{
+	if (key && wait->key && !(key & wait->key))
+		return 0;
+
+	update_thread(wait->thread, THREAD_READY);
+	return 1;
+}
+
+// waiter is dequeued when woken, so the next `__wake_up` moves on to another exclusive waiter
+int autoremove_wake_function(struct wait_queue_entry *wait, uint32_t key)
+{
+	int ret = default_wake_function(wait, key);
+	if (ret)
+		list_del_init(&wait->sibling);
+	return ret;
+}
+
+// nr_exclusive = 0 wakes up all exclusive waiters
+void __wake_up(struct wait_queue_head *hq, int nr_exclusive, uint32_t key)
 {
+	lock_scheduler();
+
 	struct wait_queue_entry *iter, *next;
 	list_for_each_entry_safe(iter, next, &hq->list, sibling)
 	{
-		iter->func(iter->thread);
+		uint32_t flags = iter->flags;
+		// entries without thread are callbacks (e.g. epoll items)
+		if ((iter->thread && iter->thread->state == THREAD_TERMINATED) || !iter->func(iter, key))
+			continue;
+
+		wq_stat.nr_wakeups++;
+		if ((flags & WQ_FLAG_EXCLUSIVE) && !--nr_exclusive)
+			break;
 	}
+
+	unlock_scheduler();
+}
+
+void prepare_to_wait(struct wait_queue_head *hq, struct wait_queue_entry *wait)
+{
+	lock_scheduler();
+	wait->flags &= ~WQ_FLAG_EXCLUSIVE;
+	if (list_empty(&wait->sibling))
+		list_add(&wait->sibling, &hq->list);
+	update_thread(current_thread, THREAD_WAITING);
+	unlock_scheduler();
+}
+
+void prepare_to_wait_exclusive(struct wait_queue_head *hq, struct wait_queue_entry *wait)
+{
+	lock_scheduler();
+	wait->flags |= WQ_FLAG_EXCLUSIVE;
+	if (list_empty(&wait->sibling))
+		list_add_tail(&wait->sibling, &hq->list);
+	update_thread(current_thread, THREAD_WAITING);
+	unlock_scheduler();
+}
+
+void finish_wait(struct wait_queue_head *hq, struct wait_queue_entry *wait)
+{
+	lock_scheduler();
+	update_thread(current_thread, THREAD_RUNNING);
+	if (!list_empty(&wait->sibling))
+		list_del_init(&wait->sibling);
+	unlock_scheduler();
 }
 
 void sched_init()
@@ -273,4 +530,7 @@ void sched_init()
 	plist_head_init(&app_ready_list);
 	plist_head_init(&waiting_list);
 	plist_head_init(&terminated_list);
+
+	sched_stat.boot_tsc = rdtsc();
+	boot_ms = get_milliseconds(NULL);
 }
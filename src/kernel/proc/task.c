@@ -1,11 +1,14 @@
 #include "task.h"
 
+#include <cpu/fpu.h>
 #include <cpu/hal.h>
 #include <cpu/idt.h>
 #include <cpu/pic.h>
 #include <cpu/tss.h>
 #include <fs/vfs.h>
+#include <include/errno.h>
 #include <include/limits.h>
+#include <include/spawn.h>
 #include <ipc/signal.h>
 #include <memory/pmm.h>
 #include <memory/vmm.h>
@@ -24,12 +27,28 @@ static uint32_t next_tid = 0;
 volatile struct thread *current_thread = NULL;
 volatile struct process *current_process = NULL;
 volatile struct hashmap *mprocess = NULL;
+static struct kmem_cache *thread_cache, *process_cache;
 
 struct process *find_process_by_pid(pid_t pid)
 {
 	return hashmap_get(mprocess, &pid);
 }
 
+struct thread *find_thread_by_tid(tid_t tid)
+{
+	struct process *proc;
+	for_each_process(proc)
+	{
+		struct thread *th;
+		list_for_each_entry(th, &proc->threads, sibling)
+		{
+			if (th->tid == tid)
+				return th;
+		}
+	}
+	return NULL;
+}
+
 static struct files_struct *clone_file_descriptor_table(struct process *parent)
 {
 	struct files_struct *files = kcalloc(1, sizeof(struct files_struct));
@@ -43,7 +62,7 @@ static struct files_struct *clone_file_descriptor_table(struct process *parent)
 				atomic_inc(&parent->files->fd[i]->f_count);
 	}
 
-	sema_init(&files->lock, 1);
+	mutex_init(&files->lock);
 	return files;
 }
 
@@ -61,7 +80,12 @@ static struct mm_struct *clone_mm_struct(struct process *parent)
 		clone->vm_end = iter->vm_end;
 		clone->vm_file = iter->vm_file;
 		clone->vm_flags = iter->vm_flags;
+		clone->vm_pgoff = iter->vm_pgoff;
+		clone->vm_file_end = iter->vm_file_end;
+		clone->vm_ops = iter->vm_ops;
 		clone->vm_mm = mm;
+		if (clone->vm_ops)
+			atomic_inc(&clone->vm_file->f_count);
 		list_add_tail(&clone->vm_sibling, &mm->mmap);
 	}
 
@@ -83,8 +107,11 @@ static void thread_sleep_timer(struct timer_list *timer)
 
 void thread_sleep(uint32_t ms)
 {
+	// timer cannot fire before thread is marked as waiting, otherwise it sleeps forever
+	lock_scheduler();
 	mod_timer(&current_thread->sleep_timer, get_milliseconds(NULL) + ms);
 	update_thread(current_thread, THREAD_WAITING);
+	unlock_scheduler();
 	schedule();
 }
 
@@ -95,23 +122,73 @@ static void process_sig_alarm_timer(struct timer_list *timer)
 	do_kill(proc->pid, SIGALRM);
 }
 
-struct thread *create_thread(struct process *parent, uint32_t eip, enum thread_state state, int policy, int priority)
+/*
+ * thread/process come from their caches and kernel stack from kernel stack area (kmem_cache.c), all of them are recycled
+ * when task is reaped. Stack is not cleared, only trap frame on its top is written
+ */
+static struct thread *alloc_thread(struct process *parent, enum thread_state state, enum thread_policy policy, int priority)
 {
-	lock_scheduler();
-
-	struct thread *th = kcalloc(1, sizeof(struct thread));
+	struct thread *th = kmem_cache_alloc(thread_cache);
+	memset(th, 0, sizeof(struct thread));
 	th->tid = next_tid++;
-	th->kernel_stack = (uint32_t)(kcalloc(STACK_SIZE, sizeof(char)) + STACK_SIZE);
 	th->parent = parent;
 	th->state = state;
 	th->policy = policy;
+	th->kernel_stack = alloc_kernel_stack();
+	assert(th->kernel_stack);
 	th->esp = th->kernel_stack - sizeof(struct trap_frame);
 	plist_node_init(&th->sched_sibling, priority);
+	plist_head_init(&th->pi_waiters);
 	th->sleep_timer = (struct timer_list)TIMER_INITIALIZER(thread_sleep_timer, UINT32_MAX);
 
-	struct trap_frame *frame = (struct trap_frame *)th->esp;
-	memset(frame, 0, sizeof(struct trap_frame));
+	memset((char *)th->esp, 0, sizeof(struct trap_frame));
+	return th;
+}
+
+// thread has exited and is neither running nor queued anywhere
+void free_thread(struct thread *th)
+{
+	lock_scheduler();
+
+	dequeue_thread(th);
+	free_kernel_stack(th->kernel_stack);
+	kmem_cache_free(thread_cache, th);
+
+	unlock_scheduler();
+}
+
+// name and sighand are always written by callers, the rest has to start zeroed
+static struct process *alloc_process()
+{
+	struct process *proc = kmem_cache_alloc(process_cache);
+	memset(proc, 0, offsetof(struct process, name));
+	memset(&proc->parent, 0, offsetof(struct process, sighand) - offsetof(struct process, parent));
+	memset(&proc->exit_code, 0, sizeof(struct process) - offsetof(struct process, exit_code));
+	return proc;
+}
+
+// called when parent has collected exit status, only a thread which might still be referenced is kept (TIF_NOREAP)
+void free_process(struct process *proc)
+{
+	lock_scheduler();
+
+	hashmap_remove(mprocess, &proc->pid);
+	if (proc->thread && !(proc->thread->flags & TIF_NOREAP))
+		free_thread(proc->thread);
+	kfree(proc->fs);
+	kfree(proc->files);
+	kmem_cache_free(process_cache, proc);
+
+	unlock_scheduler();
+}
+
+struct thread *create_thread(struct process *parent, uint32_t eip, enum thread_state state, int policy, int priority)
+{
+	lock_scheduler();
 
+	struct thread *th = alloc_thread(parent, state, policy, priority);
+
+	struct trap_frame *frame = (struct trap_frame *)th->esp;
 	frame->parameter2 = eip;
 	frame->parameter1 = (uint32_t)th;
 	frame->return_address = PROCESS_TRAPPED_PAGE_FAULT;
@@ -127,6 +204,7 @@ struct thread *create_thread(struct process *parent, uint32_t eip, enum thread_s
 	frame->edi = 0;
 
 	parent->thread = th;
+	list_add_tail(&th->sibling, &parent->threads);
 
 	unlock_scheduler();
 
@@ -137,7 +215,7 @@ static struct process *create_process(struct process *parent, const char *name,
 {
 	lock_scheduler();
 
-	struct process *proc = kcalloc(1, sizeof(struct process));
+	struct process *proc = alloc_process();
 	proc->pid = next_pid++;
 	if (pdir)
 		proc->pdir = vmm_create_address_space(pdir);
@@ -150,10 +228,11 @@ static struct process *create_process(struct process *parent, const char *name,
 	proc->mm = kcalloc(1, sizeof(struct mm_struct));
 	proc->sig_alarm_timer = (struct timer_list)TIMER_INITIALIZER(process_sig_alarm_timer, UINT32_MAX);
 	INIT_LIST_HEAD(&proc->wait_chld.list);
+	INIT_LIST_HEAD(&proc->threads);
 	INIT_LIST_HEAD(&proc->mm->mmap);
 
 	for (int i = 0; i < NSIG; ++i)
-		proc->sighand[i].sa_handler = sig_kernel_ignore(i + 1) ? SIG_IGN : SIG_DFL;
+		proc->sighand[i] = (struct sigaction){.sa_handler = sig_kernel_ignore(i + 1) ? SIG_IGN : SIG_DFL};
 
 	if (parent)
 	{
@@ -176,6 +255,7 @@ static void setup_swapper_process()
 {
 	current_process = create_process(NULL, "swapper", NULL);
 	current_thread = create_thread(current_process, 0, THREAD_RUNNING, THREAD_KERNEL_POLICY, 0);
+	current_thread->exec_start = rdtsc();
 }
 
 struct process *create_system_process(const char *pname, void *func, int32_t priority)
@@ -192,6 +272,8 @@ void task_init(void *func)
 
 	mprocess = kcalloc(1, sizeof(struct hashmap));
 	hashmap_init(mprocess, hashmap_hash_uint32, hashmap_compare_uint32, 0);
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread));
+	process_cache = kmem_cache_create("process", sizeof(struct process));
 	sched_init();
 
 	log("Task: Setup swapper process");
@@ -241,49 +323,53 @@ static void user_thread_elf_entry(struct thread *th, const char *path, void (*se
 	enter_usermode(elf_layout->stack, elf_layout->entry, PROCESS_TRAPPED_PAGE_FAULT);
 }
 
-struct thread *create_user_thread(struct process *parent, const char *path, enum thread_state state, enum thread_policy policy, int priority, void (*setup)(struct Elf32_Layout *))
+static struct thread *alloc_user_thread(struct process *parent, enum thread_state state, enum thread_policy policy, int priority,
+										void *entry, uint32_t parameter2, uint32_t parameter3)
 {
 	lock_scheduler();
 
-	struct thread *th = kcalloc(1, sizeof(struct thread));
-	th->tid = next_tid++;
-	th->parent = parent;
-	th->state = state;
-	th->policy = policy;
-	th->kernel_stack = (uint32_t)(kcalloc(STACK_SIZE, sizeof(char)) + STACK_SIZE);
-	th->esp = th->kernel_stack - sizeof(struct trap_frame);
-	plist_node_init(&th->sched_sibling, priority);
-	th->sleep_timer = (struct timer_list)TIMER_INITIALIZER(thread_sleep_timer, UINT32_MAX);
-
+	struct thread *th = alloc_thread(parent, state, policy, priority);
 	struct trap_frame *frame = (struct trap_frame *)th->esp;
-	memset(frame, 0, sizeof(struct trap_frame));
-
-	frame->parameter3 = (uint32_t)setup;
-	frame->parameter2 = (uint32_t)strdup(path);
+	frame->parameter3 = parameter3;
+	frame->parameter2 = parameter2;
 	frame->parameter1 = (uint32_t)th;
 	frame->return_address = PROCESS_TRAPPED_PAGE_FAULT;
-	frame->eip = (uint32_t)user_thread_elf_entry;
-
-	frame->eax = 0;
-	frame->ecx = 0;
-	frame->edx = 0;
-	frame->ebx = 0;
-	frame->esp = 0;
-	frame->ebp = 0;
-	frame->esi = 0;
-	frame->edi = 0;
+	frame->eip = (uint32_t)entry;
 
 	parent->thread = th;
+	list_add_tail(&th->sibling, &parent->threads);
 
 	unlock_scheduler();
 
 	return th;
 }
 
+struct thread *create_user_thread(struct process *parent, const char *path, enum thread_state state, enum thread_policy policy, int priority, void (*setup)(struct Elf32_Layout *))
+{
+	return alloc_user_thread(parent, state, policy, priority, user_thread_elf_entry, (uint32_t)strdup(path), (uint32_t)setup);
+}
+
 void setup_user_thread_stack(struct Elf32_Layout *layout, int argc, char *const argv[], char *const envp[])
 {
 	assert((uint32_t)argv < 0xC0000000 && (uint32_t)envp < 0xC0000000);
 
+	// _start(argc, argv, envp, auxv), only dynamic linker reads auxv
+	uint32_t auxv[] = {
+		AT_PHDR, layout->phdr,
+		AT_PHENT, layout->phent,
+		AT_PHNUM, layout->phnum,
+		AT_PAGESZ, PMM_FRAME_SIZE,
+		AT_BASE, layout->base,
+		AT_ENTRY, layout->program_entry,
+		AT_NULL, 0,
+	};
+	layout->stack -= sizeof(auxv);
+	memcpy((char *)layout->stack, auxv, sizeof(auxv));
+	uint32_t user_auxv = layout->stack;
+
+	layout->stack -= 4;
+	*(uint32_t *)layout->stack = user_auxv;
+
 	layout->stack -= 4;
 	*(uint32_t *)layout->stack = (uint32_t)envp;
 
@@ -302,13 +388,13 @@ void process_load(const char *pname, const char *path, enum thread_policy policy
 	queue_thread(th);
 }
 
-struct process *process_fork(struct process *parent)
+static struct process *copy_process(struct process *parent, uint32_t flags)
 {
-	log("Task: Fork from %s(p%d)", parent->name, parent->pid);
+	log("Task: %s from %s(p%d)", flags & CLONE_VFORK ? "Vfork" : "Fork", parent->name, parent->pid);
 	lock_scheduler();
 
 	// fork process
-	struct process *proc = kcalloc(1, sizeof(struct process));
+	struct process *proc = alloc_process();
 	proc->pid = next_pid++;
 	proc->gid = parent->gid;
 	proc->sid = parent->sid;
@@ -316,7 +402,7 @@ struct process *process_fork(struct process *parent)
 	proc->tty = parent->tty;
 	strcpy(proc->name, parent->name);
 	INIT_LIST_HEAD(&proc->wait_chld.list);
-	proc->mm = clone_mm_struct(parent);
+	INIT_LIST_HEAD(&proc->threads);
 	memcpy(&proc->sighand, &parent->sighand, sizeof(parent->sighand));
 	proc->sig_alarm_timer = (struct timer_list)TIMER_INITIALIZER(process_sig_alarm_timer, UINT32_MAX);
 
@@ -328,24 +414,26 @@ struct process *process_fork(struct process *parent)
 	memcpy(proc->fs, parent->fs, sizeof(struct fs_struct));
 
 	proc->files = clone_file_descriptor_table(parent);
-	proc->pdir = vmm_fork(parent->pdir);
+	if (flags & CLONE_VM)
+	{
+		proc->mm = parent->mm;
+		proc->pdir = parent->pdir;
+	}
+	else
+	{
+		proc->mm = clone_mm_struct(parent);
+		proc->pdir = vmm_fork(parent->pdir);
+	}
 
-	// copy active parent's thread
-	struct thread *parent_thread = parent->thread;
-	struct thread *th = kcalloc(1, sizeof(struct thread));
-	th->tid = next_tid++;
-	th->state = THREAD_READY;
-	th->policy = THREAD_APP_POLICY;
-	th->time_slice = 0;
-	th->parent = proc;
-	th->kernel_stack = (uint32_t)(kcalloc(STACK_SIZE, sizeof(char)) + STACK_SIZE);
+	// copy active parent's thread, only the calling thread is duplicated in child
+	struct thread *parent_thread = current_thread->parent == parent ? current_thread : parent->thread;
+	struct thread *th = alloc_thread(proc, THREAD_READY, THREAD_APP_POLICY, parent_thread->sched_sibling.prio);
 	th->user_stack = parent_thread->user_stack;
-	// NOTE: MQ 2019-12-18 Setup trap frame
-	th->esp = th->kernel_stack - sizeof(struct trap_frame);
-	plist_node_init(&th->sched_sibling, parent_thread->sched_sibling.prio);
+	th->tls = parent_thread->tls;
 
 	memcpy(&th->uregs, &parent_thread->uregs, sizeof(struct interrupt_registers));
 	th->uregs.eax = 0;
+	fpu_fork(parent_thread, th);
 
 	struct trap_frame *frame = (struct trap_frame *)th->esp;
 	frame->parameter1 = (uint32_t)th;
@@ -362,6 +450,7 @@ struct process *process_fork(struct process *parent)
 	frame->edi = 0;
 
 	proc->thread = th;
+	list_add_tail(&th->sibling, &proc->threads);
 	hashmap_put(mprocess, &proc->pid, proc);
 
 	unlock_scheduler();
@@ -369,64 +458,357 @@ struct process *process_fork(struct process *parent)
 	return proc;
 }
 
-int32_t process_execve(const char *path, char *const argv[], char *const envp[])
+struct process *process_fork(struct process *parent)
 {
-	log("Task: Exec %s", path);
-	int argv_length = count_array_of_pointers(argv);
-	char **kernel_argv = kcalloc(argv_length, sizeof(char *));
-	for (int i = 0; i < argv_length; ++i)
+	return copy_process(parent, 0);
+}
+
+/*
+ * vfork child borrows parent's page directory and mm instead of copying every user page like vmm_fork
+ * the calling thread sleeps until child calls execve (it gets a fresh address space) or exits
+ * -> child runs on parent's user stack, libc's vfork keeps its return address in register
+ */
+pid_t process_vfork(struct process *parent)
+{
+	struct vfork_done vfork = {.done = false};
+	INIT_LIST_HEAD(&vfork.wait.list);
+
+	struct process *child = copy_process(parent, CLONE_VM | CLONE_VFORK);
+	child->vfork_done = &vfork;
+	pid_t pid = child->pid;
+	queue_thread(child->thread);
+
+	wait_event(&vfork.wait, vfork.done);
+	return pid;
+}
+
+// hand the address space back to vfork parent, called when child calls execve or exits
+void vfork_release(struct process *proc)
+{
+	lock_scheduler();
+
+	struct vfork_done *vfork = proc->vfork_done;
+	if (vfork)
 	{
-		int ilength = strlen(argv[i]);
-		kernel_argv[i] = kcalloc(ilength + 1, sizeof(char));
-		memcpy(kernel_argv[i], argv[i], ilength);
+		proc->vfork_done = NULL;
+		vfork->done = true;
+		wake_up(&vfork->wait);
 	}
 
-	int envp_length = count_array_of_pointers(envp);
-	char **kernel_envp = kcalloc(envp_length, sizeof(char *));
-	for (int i = 0; i < envp_length; ++i)
+	unlock_scheduler();
+}
+
+/*
+ * Create a new thread in `proc` which shares mm, files, fs and sighand (they live in process)
+ * The new thread returns to userspace at the same place as the caller with eax=0 and esp=newsp
+ */
+struct thread *process_clone(struct process *proc, uint32_t flags, uint32_t newsp, struct user_desc *tls, tid_t *ptid, tid_t *ctid)
+{
+	log("Task: Clone thread in %s(p%d) with flags=0x%x", proc->name, proc->pid, flags);
+	lock_scheduler();
+
+	struct thread *parent_thread = current_thread;
+	struct thread *th = alloc_thread(proc, THREAD_READY, parent_thread->policy, parent_thread->sched_sibling.prio);
+	th->blocked = parent_thread->blocked;
+
+	memcpy(&th->uregs, &parent_thread->uregs, sizeof(struct interrupt_registers));
+	th->uregs.eax = 0;
+	if (newsp)
+		th->uregs.useresp = newsp;
+
+	if (flags & CLONE_SETTLS)
 	{
-		int ilength = strlen(envp[i]);
-		kernel_envp[i] = kcalloc(ilength + 1, sizeof(char));
-		memcpy(kernel_envp[i], envp[i], ilength);
+		th->tls = *tls;
+		th->tls.entry_number = GDT_ENTRY_TLS;
+		th->uregs.gs = GDT_TLS_SELECTOR;
 	}
-	strcpy(current_process->name, path);
+	else
+		th->tls = parent_thread->tls;
+
+	if (flags & CLONE_PARENT_SETTID)
+		*ptid = th->tid;
+	if (flags & CLONE_CHILD_SETTID)
+		*ctid = th->tid;
+	if (flags & CLONE_CHILD_CLEARTID)
+		th->clear_child_tid = ctid;
+
+	struct trap_frame *frame = (struct trap_frame *)th->esp;
+	frame->parameter1 = (uint32_t)th;
+	frame->return_address = PROCESS_TRAPPED_PAGE_FAULT;
+	frame->eip = (uint32_t)user_thread_entry;
+
+	list_add_tail(&th->sibling, &proc->threads);
+
+	unlock_scheduler();
+
+	return th;
+}
+
+// argv/envp have to be in kernel before the address space they live in goes away
+static char **copy_strings_to_kernel(char *const strings[], int *count)
+{
+	*count = count_array_of_pointers((void *)strings);
+	char **kstrings = kcalloc(*count + 1, sizeof(char *));
+	for (int i = 0; i < *count; ++i)
+		kstrings[i] = strdup(strings[i]);
+	return kstrings;
+}
+
+// strings are put in the new image's heap
+static char **copy_strings_to_user(char **kstrings, int count)
+{
+	char **ustrings = (char **)sys_sbrk((count + 1) * sizeof(char *));
+	for (int i = 0; i < count; ++i)
+	{
+		int length = strlen(kstrings[i]);
+		ustrings[i] = (char *)sys_sbrk(length + 1);
+		memcpy(ustrings[i], kstrings[i], length + 1);
+	}
+	ustrings[count] = NULL;
+	return ustrings;
+}
 
+static void free_strings(char **kstrings, int count)
+{
+	for (int i = 0; i < count; ++i)
+		kfree(kstrings[i]);
+	kfree(kstrings);
+}
+
+// vfork child stops borrowing parent's address space and wakes parent up
+static void exec_mmap(struct process *proc)
+{
+	lock_scheduler();
+
+	proc->pdir = vmm_create_address_space(proc->pdir);
+	proc->mm = kcalloc(1, sizeof(struct mm_struct));
+	INIT_LIST_HEAD(&proc->mm->mmap);
+	current_thread->user_stack = 0;
+	vmm_paging(proc->pdir, vmm_get_physical_address((uint32_t)proc->pdir, true));
+
+	unlock_scheduler();
+
+	vfork_release(proc);
+}
+
+int32_t process_execve(const char *path, char *const argv[], char *const envp[])
+{
+	log("Task: Exec %s", path);
+	// nothing is torn down yet, caller still gets an error
+	struct kstat stat;
+	if (vfs_stat(path, &stat) < 0)
+		return -ENOENT;
+
+	int argc, envc;
+	char **kernel_argv = copy_strings_to_kernel(argv, &argc);
+	char **kernel_envp = copy_strings_to_kernel(envp, &envc);
 	char *tmp_path = strdup(path);
+	strcpy(current_process->name, tmp_path);
+
+	if (current_process->vfork_done)
+		exec_mmap(current_process);
+
+	// other threads are gone, the calling thread continues as the new image's main thread
+	de_thread(current_process);
+	current_process->thread = current_thread;
 	elf_unload();
+	// new image starts with clean fpu state
+	fpu_release(current_thread);
 	struct Elf32_Layout *elf_layout = elf_load(tmp_path);
 	kfree(tmp_path);
+	if (!elf_layout)
+	{
+		current_thread->user_stack = 0;
+		free_strings(kernel_argv, argc);
+		free_strings(kernel_envp, envc);
+		do_exit(127);
+	}
+
+	// copy argv, envp back to userspace and setup them in userstack
+	char **user_argv = copy_strings_to_user(kernel_argv, argc);
+	char **user_envp = copy_strings_to_user(kernel_envp, envc);
+	free_strings(kernel_argv, argc);
+	free_strings(kernel_envp, envc);
+
+	current_thread->user_stack = elf_layout->stack;
+	setup_user_thread_stack(elf_layout, argc, user_argv, user_envp);
 
-	// copy argv back to userspace
-	char **user_argv = (char **)sys_sbrk(argv_length + 1);
-	memset(user_argv, 0, argv_length + 1);
-	for (int i = 0; i < argv_length; ++i)
+	tss_set_stack(0x10, current_thread->kernel_stack);
+	log("Kernel: Enter with usermode with stack=0x%x and entry=0x%x", elf_layout->stack, elf_layout->entry);
+	enter_usermode(elf_layout->stack, elf_layout->entry, PROCESS_TRAPPED_PAGE_FAULT);
+	return 0;
+}
+
+struct spawn_request
+{
+	char *path;
+	int argc, envc;
+	char **argv, **envp;
+	int nr_actions;
+	struct spawn_action *actions;
+};
+
+static void spawn_request_free(struct spawn_request *req)
+{
+	for (int i = 0; i < req->nr_actions; ++i)
+		kfree(req->actions[i].path);
+	kfree(req->actions);
+	free_strings(req->argv, req->argc);
+	free_strings(req->envp, req->envc);
+	kfree(req->path);
+	kfree(req);
+}
+
+// fd is duplicated into newfd (or moved if `move`), newfd is closed first if it is used
+static int spawn_dup2(int32_t fd, int32_t newfd, bool move)
+{
+	struct files_struct *files = current_process->files;
+	struct vfs_file *file = files->fd[fd];
+
+	if (!file)
+		return -EBADF;
+	if (fd == newfd)
+		return 0;
+	if (files->fd[newfd])
+		vfs_close(newfd);
+
+	files->fd[newfd] = file;
+	if (move)
+		files->fd[fd] = NULL;
+	else
+		atomic_inc(&file->f_count);
+	return 0;
+}
+
+// run in child, descriptors are inherited from parent at this point
+static int spawn_do_file_actions(struct spawn_request *req)
+{
+	for (int i = 0; i < req->nr_actions; ++i)
 	{
-		int ilength = strlen(kernel_argv[i]);
-		user_argv[i] = (char *)sys_sbrk(ilength + 1);
-		memcpy(user_argv[i], kernel_argv[i], ilength);
+		struct spawn_action *action = &req->actions[i];
+		int ret = 0;
+
+		switch (action->type)
+		{
+		case SPAWN_DO_OPEN:
+			ret = vfs_open(action->path, action->oflag, action->mode);
+			if (ret >= 0 && ret != action->fd)
+				ret = spawn_dup2(ret, action->fd, true);
+			break;
+		case SPAWN_DO_CLOSE:
+			ret = vfs_close(action->fd);
+			break;
+		case SPAWN_DO_DUP2:
+			ret = spawn_dup2(action->fd, action->newfd, false);
+			break;
+		}
+
+		if (ret < 0)
+			return ret;
 	}
+	return 0;
+}
 
-	// copy envp back to userspace
-	char **user_envp = (char **)sys_sbrk(envp_length + 1);
-	memset(user_envp, 0, envp_length + 1);
-	for (int i = 0; i < envp_length; ++i)
+static void user_thread_spawn_entry(struct thread *th, struct spawn_request *req)
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	// parent has already returned, like execve after fork failures are reported by exit status 127
+	struct Elf32_Layout *elf_layout = NULL;
+	if (spawn_do_file_actions(req) >= 0)
+		elf_layout = elf_load(req->path);
+	if (!elf_layout)
 	{
-		int ilength = strlen(kernel_envp[i]);
-		user_envp[i] = (char *)sys_sbrk(ilength + 1);
-		memcpy(user_envp[i], kernel_envp[i], ilength);
+		spawn_request_free(req);
+		do_exit(127);
 	}
 
-	// setup argv, envp in userstack
-	current_thread->user_stack = elf_layout->stack;
-	elf_layout->stack -= 4;
-	*(uint32_t *)elf_layout->stack = (uint32_t)user_envp;
-	elf_layout->stack -= 4;
-	*(uint32_t *)elf_layout->stack = (uint32_t)user_argv;
-	elf_layout->stack -= 4;
-	*(uint32_t *)elf_layout->stack = argv_length;
+	char **user_argv = copy_strings_to_user(req->argv, req->argc);
+	char **user_envp = copy_strings_to_user(req->envp, req->envc);
+	th->user_stack = elf_layout->stack;
+	setup_user_thread_stack(elf_layout, req->argc, user_argv, user_envp);
+	spawn_request_free(req);
 
-	tss_set_stack(0x10, current_thread->kernel_stack);
+	tss_set_stack(0x10, th->kernel_stack);
 	log("Kernel: Enter with usermode with stack=0x%x and entry=0x%x", elf_layout->stack, elf_layout->entry);
 	enter_usermode(elf_layout->stack, elf_layout->entry, PROCESS_TRAPPED_PAGE_FAULT);
+}
+
+/*
+ * Child is built directly from the elf in a fresh address space, nothing of parent's image is copied
+ * only descriptors (then file actions are applied in child), cwd, ignored signals and signal mask are inherited
+ */
+int32_t process_spawn(pid_t *pid, const char *path, const struct spawn_file_actions *file_actions,
+					  const struct spawn_attr *attrp, char *const argv[], char *const envp[])
+{
+	struct kstat stat;
+	if (!path || vfs_stat(path, &stat) < 0)
+		return -ENOENT;
+
+	int nr_actions = file_actions ? file_actions->used : 0;
+	for (int i = 0; i < nr_actions; ++i)
+	{
+		struct spawn_action *action = &file_actions->actions[i];
+		if (action->fd < 0 || action->fd >= MAX_FD ||
+			(action->type == SPAWN_DO_DUP2 && (action->newfd < 0 || action->newfd >= MAX_FD)))
+			return -EBADF;
+		if (action->type == SPAWN_DO_OPEN && !action->path)
+			return -EINVAL;
+	}
+
+	log("Process: Spawn %s from %s(p%d)", path, current_process->name, current_process->pid);
+	struct spawn_request *req = kcalloc(1, sizeof(struct spawn_request));
+	req->path = strdup(path);
+	req->argv = copy_strings_to_kernel(argv, &req->argc);
+	req->envp = copy_strings_to_kernel(envp, &req->envc);
+	req->nr_actions = nr_actions;
+	if (nr_actions)
+	{
+		req->actions = kcalloc(nr_actions, sizeof(struct spawn_action));
+		memcpy(req->actions, file_actions->actions, nr_actions * sizeof(struct spawn_action));
+		for (int i = 0; i < nr_actions; ++i)
+			req->actions[i].path = req->actions[i].type == SPAWN_DO_OPEN ? strdup(req->actions[i].path) : NULL;
+	}
+
+	struct process *parent = current_process;
+	struct thread *parent_thread = current_thread;
+	struct process *proc = create_process(parent, path, parent->pdir);
+	proc->tty = parent->tty;
+
+	// caught signals are reset to default in the new image, ignored ones stay ignored
+	for (int i = 0; i < NSIG; ++i)
+		if (parent->sighand[i].sa_handler == SIG_IGN)
+			proc->sighand[i].sa_handler = SIG_IGN;
+
+	sigset_t blocked = parent_thread->blocked;
+	if (attrp)
+	{
+		if (attrp->flags & POSIX_SPAWN_SETSIGDEF)
+			for (int i = 0; i < NSIG; ++i)
+				if (attrp->sigdefault & sigmask(i + 1))
+					proc->sighand[i].sa_handler = SIG_DFL;
+		if (attrp->flags & POSIX_SPAWN_SETSIGMASK)
+			blocked = attrp->sigmask;
+		if (attrp->flags & POSIX_SPAWN_SETSID)
+		{
+			proc->sid = proc->gid = proc->pid;
+			proc->tty = NULL;
+		}
+		else if (attrp->flags & POSIX_SPAWN_SETPGROUP)
+			proc->gid = attrp->pgrp ? attrp->pgrp : proc->pid;
+	}
+
+	// system processes (window server) launch apps right below them
+	int priority = parent_thread->policy == THREAD_APP_POLICY
+					   ? parent_thread->sched_sibling.prio
+					   : get_top_priority_from_list(THREAD_READY, THREAD_SYSTEM_POLICY) - 1;
+	struct thread *th = alloc_user_thread(proc, THREAD_READY, THREAD_APP_POLICY, priority,
+										  user_thread_spawn_entry, (uint32_t)req, 0);
+	th->blocked = blocked;
+
+	if (pid)
+		*pid = proc->pid;
+	queue_thread(th);
 	return 0;
 }
@@ -1,9 +1,11 @@
 #ifndef PROC_TASK_H
 #define PROC_TASK_H
 
+#include <cpu/gdt.h>
 #include <cpu/idt.h>
 #include <include/list.h>
 #include <ipc/signal.h>
+#include <locking/mutex.h>
 #include <locking/semaphore.h>
 #include <memory/vmm.h>
 #include <proc/elf.h>
@@ -15,7 +17,7 @@
 #define SWAPPER_PID 0
 #define INIT_PID 1
 
-#define MAX_FD 256
+#define MAX_FD 1024
 #define PROCESS_TRAPPED_PAGE_FAULT 0xFFFFFFFF
 #define MAX_THREADS 0x10000
 #define STACK_SIZE 0x2000
@@ -27,15 +29,32 @@
 #define VM_EXEC 0x00000004
 #define VM_SHARED 0x00000008
 
+// clone flags
+#define CSIGNAL 0x000000ff
+#define CLONE_VM 0x00000100
+#define CLONE_FS 0x00000200
+#define CLONE_FILES 0x00000400
+#define CLONE_SIGHAND 0x00000800
+#define CLONE_VFORK 0x00004000
+#define CLONE_THREAD 0x00010000
+#define CLONE_SETTLS 0x00080000
+#define CLONE_PARENT_SETTID 0x00100000
+#define CLONE_CHILD_CLEARTID 0x00200000
+#define CLONE_CHILD_SETTID 0x01000000
+#define CLONE_THREAD_FLAGS (CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD)
+
 #define SIGNAL_STOPED 0x01
 #define SIGNAL_CONTINUED 0x02
 #define SIGNAL_TERMINATED 0x04
 #define EXIT_TERMINATED 0x08
+#define GROUP_EXITING 0x10
 
 struct vfs_file;
 struct vfs_dentry;
 struct vfs_mount;
 struct tty_struct;
+struct spawn_file_actions;
+struct spawn_attr;
 
 enum thread_state
 {
@@ -53,12 +72,31 @@ enum thread_policy
 	THREAD_APP_POLICY,
 } thread_policy;
 
+// SCHED_FIFO thread runs with system policy and priority (SCHED_FIFO_PRIO_BASE - sched_priority)
+// -> it is behind kernel's system threads (net, window server have priority 0) and ahead of all app threads
+#define SCHED_OTHER 0
+#define SCHED_FIFO 1
+#define SCHED_FIFO_PRIO_MAX 99
+#define SCHED_FIFO_PRIO_BASE 100
+
+struct sched_param
+{
+	int sched_priority;
+};
+
 struct files_struct
 {
-	struct semaphore lock;
+	struct mutex lock;
 	struct vfs_file *fd[MAX_FD];
 };
 
+// parent's calling thread sleeps on it until vfork child stops borrowing parent's address space
+struct vfork_done
+{
+	bool done;
+	struct wait_queue_head wait;
+};
+
 struct fs_struct
 {
 	struct vfs_dentry *d_root;
@@ -73,6 +111,13 @@ struct trap_frame
 	uint32_t parameter1, parameter2, parameter3;
 };
 
+struct vm_area_struct;
+
+struct vm_operations_struct
+{
+	int (*fault)(struct vm_area_struct *vma, uint32_t address, bool write);
+};
+
 struct vm_area_struct
 {
 	struct mm_struct *vm_mm;
@@ -82,6 +127,11 @@ struct vm_area_struct
 
 	struct list_head vm_sibling;
 	struct vfs_file *vm_file;
+	// demand-paged file mapping, vma with `vm_ops` holds a reference of `vm_file`
+	// vm_pgoff is file page of vm_start, bytes from vm_file_end to vm_end are zero (bss)
+	uint32_t vm_pgoff;
+	uint32_t vm_file_end;
+	struct vm_operations_struct *vm_ops;
 };
 
 struct mm_struct
@@ -96,6 +146,11 @@ struct mm_struct
 };
 
 #define TIF_SIGNAL_MANUAL 0x1
+#define TIF_FPU_USED 0x2
+#define TIF_NOREAP 0x4	// exited while its wait entries (on kernel stack) could still be queued, it is never recycled
+#define TIF_GROUP_EXIT 0x8	// another thread has called exit/execve, it leaves at its next return point
+
+struct fpu_state;
 
 struct thread
 {
@@ -105,6 +160,7 @@ struct thread
 	enum thread_policy policy;
 	int32_t priority;  // input priority, `sched_sibling.prio` is adjusted number based on scheduler
 	struct process *parent;
+	struct list_head sibling;  // in parent->threads
 
 	uint32_t esp;
 	uint32_t kernel_stack;
@@ -116,9 +172,33 @@ struct thread
 	bool signaling;
 
 	uint32_t time_slice;
+	int32_t preempt_count;	// > 0 -> thread holds something which cannot be given up in the middle, it is not preempted
+	volatile bool need_resched;	 // set from irq or wakeup, thread is switched out at the next preemption point
+
+	struct user_desc tls;
+	tid_t *clear_child_tid;	 // CLONE_CHILD_CLEARTID, zeroed when thread exits
+
+	struct fpu_state *fpu;	// allocated on the first fpu/sse instruction (#NM)
+	uint8_t fpu_counter;	// consecutive slices in which thread has used fpu
 
 	struct plist_node sched_sibling;
 	struct timer_list sleep_timer;
+
+	// priority inheritance (locking/pi.c), own policy/priority are kept aside while boosted
+	struct plist_head pi_waiters;
+	struct pi_waiter *pi_blocked_on;
+	bool pi_boosted;
+	enum thread_policy normal_policy;
+	int32_t normal_prio;
+
+	// scheduler statistics in tsc ticks, listed in /dev/schedstat
+	uint64_t exec_start;	   // switched in at
+	uint64_t sum_exec_runtime;  // on cpu in total
+	uint64_t ready_since;	   // queued as ready at
+	uint64_t run_delay;		   // waited in ready list in total
+	uint32_t nvcsw;			   // switched out by itself (sleep, wait)
+	uint32_t nivcsw;		   // switched out while still runnable (preempted, yield)
+	uint32_t last_cpu;
 };
 
 struct process
@@ -129,7 +209,8 @@ struct process
 
 	char name[256];
 	struct process *parent;
-	struct thread *thread;
+	struct thread *thread;	// main thread, it is handed over to a sibling when exiting alone
+	struct list_head threads;
 	struct pdirectory *pdir;
 
 	struct fs_struct *fs;
@@ -141,7 +222,9 @@ struct process
 	int32_t exit_code;
 	int32_t caused_signal;
 	uint32_t flags;
+	struct thread *group_exit_waiter;  // execve waits until it is the only thread
 	struct wait_queue_head wait_chld;
+	struct vfork_done *vfork_done;	// vfork child runs on parent's pdir/mm until execve or exit
 
 	struct list_head sibling;
 	struct list_head children;
@@ -152,6 +235,36 @@ extern volatile struct thread *current_thread;
 extern volatile struct process *current_process;
 extern volatile struct hashmap *mprocess;
 
+void preempt_schedule();
+
+struct sched_stat
+{
+	uint32_t nr_switches;
+	uint32_t nr_irqs;
+	uint32_t nr_softirqs;
+	uint64_t idle_time;	 // tsc ticks halted without a ready thread
+	uint64_t boot_tsc;
+	// worst interrupts-off sections: hard irq handlers and scheduler locked
+	uint64_t hardirq_max;
+	uint64_t irqoff_max;
+};
+
+extern struct sched_stat sched_stat;
+
+static inline void preempt_disable()
+{
+	current_thread->preempt_count++;
+	barrier();
+}
+
+// the preemption which has been held back while disabled happens here
+static inline void preempt_enable()
+{
+	barrier();
+	if (!--current_thread->preempt_count)
+		preempt_schedule();
+}
+
 #define for_each_process(p)         \
 	struct hashmap_iter *__hm_iter; \
 	for (__hm_iter = hashmap_iter(mprocess), p = hashmap_iter_get_data(__hm_iter); __hm_iter; __hm_iter = hashmap_iter_next(mprocess, __hm_iter), p = hashmap_iter_get_data(__hm_iter))
@@ -161,25 +274,40 @@ void task_init();
 struct process *create_system_process(const char *pname, void *func, int32_t priority);
 void process_load(const char *pname, const char *path, enum thread_policy policy, int priority, void (*setup)(struct Elf32_Layout *));
 struct process *process_fork(struct process *parent);
+pid_t process_vfork(struct process *parent);
+void vfork_release(struct process *proc);
+int32_t process_spawn(pid_t *pid, const char *path, const struct spawn_file_actions *file_actions,
+					  const struct spawn_attr *attrp, char *const argv[], char *const envp[]);
+struct thread *process_clone(struct process *proc, uint32_t flags, uint32_t newsp, struct user_desc *tls, tid_t *ptid, tid_t *ctid);
 int32_t process_execve(const char *pathname, char *const argv[], char *const envp[]);
 void thread_sleep(uint32_t ms);
 struct process *find_process_by_pid(pid_t pid);
+struct thread *find_thread_by_tid(tid_t tid);
 void setup_user_thread_stack(struct Elf32_Layout *layout, int argc, char *const argv[], char *const envp[]);
+void free_thread(struct thread *th);
+void free_process(struct process *proc);
 
 // sched.c
 void update_thread(struct thread *thread, uint8_t state);
 void queue_thread(struct thread *t);
+void dequeue_thread(struct thread *th);
 void schedule();
 void sched_init();
 void lock_scheduler();
 void unlock_scheduler();
 int get_top_priority_from_list(enum thread_state state, enum thread_policy policy);
-void wake_up(struct wait_queue_head *hq);
+void sched_setprio(struct thread *th, enum thread_policy policy, int prio);
+void sched_yield();
+int sched_stat_print(char *buf, size_t size);
 int32_t thread_page_fault(struct interrupt_registers *regs);
 int32_t irq_schedule_handler(struct interrupt_registers *regs);
 
 // exit.c
 int32_t do_wait(idtype_t idtype, id_t id, struct infop *infop, int options);
 void do_exit(int32_t code);
+void do_exit_thread(int32_t code);
+void zap_other_threads(struct process *proc);
+void de_thread(struct process *proc);
+void reap_dead_threads();
 
 #endif
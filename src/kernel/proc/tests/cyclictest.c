@@ -0,0 +1,74 @@
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "../../tests/bench.h"
+
+// Cyclictest-like measurement of scheduling latency, a thread sleeps for a fixed interval over and over
+// and records how late it wakes up while other processes keep the kernel busy (pio disk reads, syscalls)
+// woken thread has to take over at the next preemption point instead of waiting for the end of busy thread's slice
+// build: i386-mos-gcc cyclictest.c -o cyclictest
+
+#define INTERVAL_MS 2
+#define NR_LOOPS 500
+// timeout is precise to a pit tick (1ms), the rest is headroom for short sections with scheduler locked
+#define MAX_LATENCY_MS 10
+#define DISK_LOAD_PATH "/bin/window_server"
+
+static void disk_load()
+{
+	char buf[4096];
+	while (1)
+	{
+		int fd = open(DISK_LOAD_PATH, O_RDONLY);
+		if (fd < 0)
+			_exit(1);
+		while (read(fd, buf, sizeof(buf)) > 0)
+			;
+		close(fd);
+	}
+}
+
+static void syscall_load()
+{
+	while (1)
+		getpid();
+}
+
+static pid_t spawn_load(void (*load)())
+{
+	pid_t pid = fork();
+	if (!pid)
+		load();
+	return pid;
+}
+
+int main(int argc, char *argv[])
+{
+	pid_t loads[] = {spawn_load(disk_load), spawn_load(syscall_load)};
+
+	int min = INT32_MAX, max = 0;
+	uint64_t total = 0;
+	for (int i = 0; i < NR_LOOPS; ++i)
+	{
+		uint64_t expected = now_ms() + INTERVAL_MS;
+		poll(NULL, 0, INTERVAL_MS);
+		int latency = (int)(now_ms() - expected);
+
+		if (latency < min)
+			min = latency;
+		if (latency > max)
+			max = latency;
+		total += latency;
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		kill(loads[i], SIGKILL);
+		waitpid(loads[i], NULL, 0);
+	}
+
+	printf("T:0 I:%dms C:%d Min:%dms Avg:%dms Max:%dms\n", INTERVAL_MS, NR_LOOPS, min, (int)(total / NR_LOOPS), max);
+	int failures = check(loads[0] > 0 && loads[1] > 0, "cannot fork load processes");
+	failures += check(max <= MAX_LATENCY_MS, "woken thread has waited %dms", max);
+	return test_result("cyclictest", failures);
+}
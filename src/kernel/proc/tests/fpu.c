@@ -0,0 +1,96 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Two tasks keep different values in x87 and xmm registers while spinning long enough to be preempted
+// If fpu/sse state is not switched per thread, one of them reads the other's values back
+// build: i386-mos-gcc -msse2 -O0 fpu.c -o fpu_test
+
+#define ROUNDS 200
+#define SPIN 2000000
+
+static bool check_x87(double seed)
+{
+	double out[2];
+	__asm__ __volatile__(
+		"fldl %2           \n"
+		"fldl %3           \n"
+		"1: dec %%ecx      \n"
+		"jnz 1b            \n"
+		"fstpl %0          \n"
+		"fstpl %1          \n"
+		: "=m"(out[0]), "=m"(out[1])
+		: "m"(seed), "m"((double){seed * 2}), "c"(SPIN));
+
+	return out[0] == seed * 2 && out[1] == seed;
+}
+
+static bool check_sse(float seed)
+{
+	float in[4] __attribute__((aligned(16))) = {seed, seed + 1, seed + 2, seed + 3};
+	float out[4] __attribute__((aligned(16)));
+
+	__asm__ __volatile__(
+		"movaps %1, %%xmm0    \n"
+		"movaps %%xmm0, %%xmm7\n"
+		"addps %%xmm0, %%xmm7 \n"
+		"1: dec %%ecx         \n"
+		"jnz 1b               \n"
+		"movaps %%xmm7, %0    \n"
+		: "=m"(out)
+		: "m"(in), "c"(SPIN)
+		: "xmm0", "xmm7");
+
+	for (int i = 0; i < 4; ++i)
+		if (out[i] != in[i] * 2)
+			return false;
+	return true;
+}
+
+// series sum keeps intermediate values in x87 stack across preemption
+static double harmonic(int n, double scale)
+{
+	double sum = 0;
+	for (int i = 1; i <= n; ++i)
+		sum += scale / i;
+	return sum;
+}
+
+static int worker(const char *name, double seed)
+{
+	double expected = harmonic(100000, seed);
+	int failures = 0;
+
+	for (int i = 0; i < ROUNDS; ++i)
+	{
+		if (!check_x87(seed + i))
+			failures++;
+		if (!check_sse((float)(seed + i)))
+			failures++;
+		if (harmonic(100000, seed) != expected)
+			failures++;
+	}
+
+	printf("%s: %s (%d failures)\n", name, failures ? "FAIL" : "PASS", failures);
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pid_t pid = fork();
+	if (pid == 0)
+		exit(worker("child", 3.25));
+
+	int ret = worker("parent", -7.5);
+
+	int wstatus;
+	waitpid(pid, &wstatus, 0);
+	if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+		ret = 1;
+
+	printf("fpu: %s\n", ret ? "FAIL" : "PASS");
+	return ret;
+}
@@ -0,0 +1,64 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Workers share address space and bump one counter under a mutex, sleeping in the middle of critical section
+// so other threads are forced to contend. Each worker returns its own tid to check `pthread_join` retval
+// build: i386-mos-gcc pthread.c -o pthread_test
+
+#define NR_WORKERS 8
+#define NR_ROUNDS 200
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int counter = 0;
+static volatile int shared = 0;
+
+static void *worker(void *arg)
+{
+	int id = (int)arg;
+
+	for (int i = 0; i < NR_ROUNDS; ++i)
+	{
+		pthread_mutex_lock(&lock);
+		int value = counter;
+		if (i % 50 == 0)
+			usleep(1000);
+		counter = value + 1;
+		pthread_mutex_unlock(&lock);
+	}
+
+	// memory written by thread is visible to others without any copy
+	__atomic_fetch_add(&shared, id, __ATOMIC_SEQ_CST);
+	return (void *)gettid();
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[NR_WORKERS];
+	int failures = 0;
+
+	for (int i = 0; i < NR_WORKERS; ++i)
+		if (pthread_create(&threads[i], NULL, worker, (void *)(i + 1)))
+		{
+			printf("pthread: create %d failed\n", i);
+			return 1;
+		}
+
+	for (int i = 0; i < NR_WORKERS; ++i)
+	{
+		void *retval;
+		pthread_join(threads[i], &retval);
+		if ((int)retval == getpid() || (int)retval <= 0)
+			failures++;
+	}
+
+	int expected_shared = NR_WORKERS * (NR_WORKERS + 1) / 2;
+	if (counter != NR_WORKERS * NR_ROUNDS || shared != expected_shared)
+		failures++;
+
+	printf("pthread: counter=%d (expected %d) shared=%d (expected %d)\n",
+		   counter, NR_WORKERS * NR_ROUNDS, shared, expected_shared);
+	printf("pthread: %s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "../../tests/bench.h"
+
+// Launches the same small program (itself with "child" argument) with fork+execve, vfork+execve and posix_spawn
+// and prints launches per second. A 4MB heap buffer is touched first so fork has something to copy
+// also checks vfork sharing/suspending semantics and posix_spawn file actions
+// build: i386-mos-gcc spawn_rate.c -o spawn_rate, run with absolute path (argv[0] is exec'd)
+
+#define NR_LAUNCHES 200
+#define BALLAST_SIZE (4 * 1024 * 1024)
+#define CHILD_EXIT_CODE 7
+
+static char *self;
+
+static int exit_code(pid_t pid)
+{
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		return -1;
+	return (status >> 8) & 0xff;
+}
+
+static pid_t launch_fork(char *argv[])
+{
+	pid_t pid = fork();
+	if (!pid)
+	{
+		execve(self, argv, NULL);
+		_exit(127);
+	}
+	return pid;
+}
+
+static pid_t launch_vfork(char *argv[])
+{
+	pid_t pid = vfork();
+	if (!pid)
+	{
+		execve(self, argv, NULL);
+		_exit(127);
+	}
+	return pid;
+}
+
+static pid_t launch_spawn(char *argv[])
+{
+	pid_t pid;
+	return posix_spawn(&pid, self, NULL, NULL, argv, NULL) ? -1 : pid;
+}
+
+// return elapsed time, -1 if a launch has failed
+static int bench(const char *name, pid_t (*launch)(char *argv[]))
+{
+	char *argv[] = {self, "child", NULL};
+	int failures = 0;
+
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_LAUNCHES; ++i)
+	{
+		pid_t pid = launch(argv);
+		if (pid < 0 || exit_code(pid) != CHILD_EXIT_CODE)
+			failures++;
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	printf("%s: %d launches in %dms, %d per second\n", name, NR_LAUNCHES, (int)elapsed,
+		   elapsed ? (int)(NR_LAUNCHES * 1000 / elapsed) : 0);
+	return failures ? -1 : (int)elapsed;
+}
+
+static int check_vfork()
+{
+	volatile int shared = 0;
+	int failures = 0;
+
+	// parent is suspended until child exits and sees what child wrote in the borrowed address space
+	pid_t pid = vfork();
+	if (!pid)
+	{
+		shared = 1;
+		_exit(CHILD_EXIT_CODE);
+	}
+	if (shared != 1 || exit_code(pid) != CHILD_EXIT_CODE)
+	{
+		printf("vfork: child does not share parent's memory\n");
+		failures++;
+	}
+
+	char *argv[] = {"/nonexistent", NULL};
+	pid = vfork();
+	if (!pid)
+	{
+		execve(argv[0], argv, NULL);
+		_exit(127);
+	}
+	if (exit_code(pid) != 127)
+	{
+		printf("vfork: failed execve is not reported\n");
+		failures++;
+	}
+	return failures;
+}
+
+static int check_spawn()
+{
+	int failures = 0;
+	int p[2];
+	pipe(p);
+
+	// child's stdout is the pipe, child writes one byte to it
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, p[1], 1);
+	posix_spawn_file_actions_addclose(&actions, p[0]);
+
+	pid_t pid;
+	char *argv[] = {self, "child", "write", NULL};
+	if (posix_spawn(&pid, self, &actions, NULL, argv, NULL) != 0)
+		failures++;
+	close(p[1]);
+
+	char c = 0;
+	if (read(p[0], &c, 1) != 1 || c != 'x' || exit_code(pid) != CHILD_EXIT_CODE)
+	{
+		printf("posix_spawn: file actions are not applied\n");
+		failures++;
+	}
+	close(p[0]);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (posix_spawn(&pid, "/nonexistent", NULL, NULL, argv, NULL) != ENOENT)
+	{
+		printf("posix_spawn: missing file is not reported\n");
+		failures++;
+	}
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && !strcmp(argv[1], "child"))
+	{
+		if (argc > 2 && !strcmp(argv[2], "write"))
+			write(1, "x", 1);
+		return CHILD_EXIT_CODE;
+	}
+
+	self = argv[0];
+	char *ballast = malloc(BALLAST_SIZE);
+	memset(ballast, 1, BALLAST_SIZE);
+
+	int failures = check_vfork();
+	failures += check_spawn();
+	int elapsed_fork = bench("fork+execve", launch_fork);
+	int elapsed_vfork = bench("vfork+execve", launch_vfork);
+	int elapsed_spawn = bench("posix_spawn", launch_spawn);
+	failures += check(elapsed_fork >= 0 && elapsed_vfork >= 0 && elapsed_spawn >= 0, "launches have failed");
+
+	// neither of them copies the ballast which fork has to
+	failures += check(elapsed_vfork <= elapsed_fork, "vfork+execve is slower than fork+execve");
+	failures += check(elapsed_spawn <= elapsed_fork, "posix_spawn is slower than fork+execve");
+
+	free(ballast);
+	return test_result("spawn_rate", failures);
+}
@@ -0,0 +1,87 @@
+#include <pthread.h>
+#include <sys/wait.h>
+#include "../../tests/bench.h"
+
+// Creates and joins threads (then forks and reaps processes) back to back and prints how many per second
+// every reaped task gives its kernel stack back, so the number of kernel stacks must not grow with iterations
+// build: i386-mos-gcc thread_rate.c -o thread_rate
+
+#define NR_THREADS 1000
+#define NR_BATCH 8
+#define NR_FORKS 200
+#define CHILD_EXIT_CODE 7
+// tasks of the other processes can come and go in the meantime
+#define KSTACK_SLACK_KB 64
+
+static int meminfo(const char *field)
+{
+	return stat_value("/dev/meminfo", field, NULL);
+}
+
+static void *worker(void *arg)
+{
+	return arg;
+}
+
+static int bench_threads()
+{
+	int failures = 0;
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_THREADS; i += NR_BATCH)
+	{
+		pthread_t threads[NR_BATCH];
+		for (int j = 0; j < NR_BATCH; ++j)
+			if (pthread_create(&threads[j], NULL, worker, (void *)(i + j)))
+				failures++;
+
+		for (int j = 0; j < NR_BATCH; ++j)
+		{
+			void *ret = NULL;
+			if (pthread_join(threads[j], &ret) || (int)ret != i + j)
+				failures++;
+		}
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	printf("pthread create+join: %d threads in %dms, %d per second\n", NR_THREADS, (int)elapsed,
+		   elapsed ? (int)(NR_THREADS * 1000 / elapsed) : 0);
+	return failures;
+}
+
+static int bench_forks()
+{
+	int failures = 0;
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_FORKS; ++i)
+	{
+		pid_t pid = fork();
+		if (!pid)
+			_exit(CHILD_EXIT_CODE);
+
+		int status;
+		if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || ((status >> 8) & 0xff) != CHILD_EXIT_CODE)
+			failures++;
+	}
+	uint64_t elapsed = now_ms() - start;
+
+	printf("fork+exit+wait: %d processes in %dms, %d per second\n", NR_FORKS, (int)elapsed,
+		   elapsed ? (int)(NR_FORKS * 1000 / elapsed) : 0);
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	// warm up caches so the first measurement isn't the one allocating stacks
+	int failures = bench_threads();
+	int kstack_before = meminfo("KernelStack:");
+
+	failures += bench_threads();
+	failures += bench_forks();
+
+	int kstack_after = meminfo("KernelStack:");
+	printf("kernel stacks: %dkB before, %dkB after, %dkB free\n", kstack_before, kstack_after,
+		   meminfo("KernelStackFree:"));
+	failures += check(kstack_before >= 0, "/dev/meminfo has no KernelStack");
+	failures += check(kstack_after - kstack_before <= KSTACK_SLACK_KB, "kernel stacks are not recycled");
+	return test_result("thread_rate", failures);
+}
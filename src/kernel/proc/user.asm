@@ -35,10 +35,11 @@ return_usermode:
 	mov ax,0x23
 	mov ds,ax
 	mov es,ax 
-	mov fs,ax 
-	mov gs,ax ;we don't need to worry about SS. it's handled by iret
+	mov fs,ax ;we don't need to worry about SS. it's handled by iret
 
 	mov eax, [esp + 4]
+	mov ebx, [eax] ;restore gs, it might hold thread's tls selector
+	mov gs,bx
 
 	push dword [eax + 18*4] ;user data segment
 	push dword [eax + 17*4] ;push our current stack
@@ -38,8 +38,12 @@ struct infop
 };
 
 struct thread;
+struct wait_queue_entry;
 
-typedef void (*wait_queue_func)(struct thread *);
+// return 1 if thread is woken (it counts toward `nr_exclusive` in `__wake_up`), 0 if event is irrelevant to waiter
+typedef int (*wait_queue_func)(struct wait_queue_entry *wait, uint32_t key);
+
+#define WQ_FLAG_EXCLUSIVE 0x01
 
 struct wait_queue_head
 {
@@ -50,25 +54,72 @@ struct wait_queue_entry
 {
 	struct thread *thread;
 	wait_queue_func func;
+	uint32_t flags;
+	uint32_t key;  // events (poll mask) waiter is interested in, 0 is any
 	struct list_head sibling;
 };
 
+struct wait_queue_stat
+{
+	uint32_t nr_wakeups;
+	uint32_t nr_spurious;  // woken up but condition is still false -> go back to sleep
+};
+
 extern volatile struct thread *current_thread;
+extern struct wait_queue_stat wq_stat;
 extern void schedule();
 
-#define DEFINE_WAIT(name)            \
-	struct wait_queue_entry name = { \
-		.thread = current_thread,    \
-		.func = poll_wakeup,         \
+int default_wake_function(struct wait_queue_entry *wait, uint32_t key);
+int autoremove_wake_function(struct wait_queue_entry *wait, uint32_t key);
+void __wake_up(struct wait_queue_head *hq, int nr_exclusive, uint32_t key);
+void prepare_to_wait(struct wait_queue_head *hq, struct wait_queue_entry *wait);
+void prepare_to_wait_exclusive(struct wait_queue_head *hq, struct wait_queue_entry *wait);
+void finish_wait(struct wait_queue_head *hq, struct wait_queue_entry *wait);
+
+/*
+ * Non-exclusive waiters are all woken by an event, exclusive ones are queued at the tail and only `nr_exclusive` of them are woken
+ * `key` is poll mask of event, waiter whose `key` doesn't intersect it is skipped (neither woken nor counted)
+ */
+#define wake_up(hq) __wake_up(hq, 1, 0)
+#define wake_up_nr(hq, nr) __wake_up(hq, nr, 0)
+#define wake_up_all(hq) __wake_up(hq, 0, 0)
+#define wake_up_poll(hq, mask) __wake_up(hq, 1, mask)
+
+#define DEFINE_WAIT_FUNC(name, function)           \
+	struct wait_queue_entry name = {               \
+		.thread = current_thread,                  \
+		.func = function,                          \
+		.sibling = LIST_HEAD_INIT((name).sibling), \
 	}
 
+#define DEFINE_WAIT(name) DEFINE_WAIT_FUNC(name, default_wake_function)
+
+static inline void add_wait_queue(struct wait_queue_head *hq, struct wait_queue_entry *wait)
+{
+	wait->flags &= ~WQ_FLAG_EXCLUSIVE;
+	list_add(&wait->sibling, &hq->list);
+}
+
+static inline void add_wait_queue_exclusive(struct wait_queue_head *hq, struct wait_queue_entry *wait)
+{
+	wait->flags |= WQ_FLAG_EXCLUSIVE;
+	list_add_tail(&wait->sibling, &hq->list);
+}
+
+static inline void remove_wait_queue(struct wait_queue_head *hq, struct wait_queue_entry *wait)
+{
+	list_del(&wait->sibling);
+}
+
 // NOTE: MQ 2020-08-17 continue if receiving a signal
-#define wait_until(cond) ({                            \
-	for (; !(cond);)                                   \
-	{                                                  \
-		update_thread(current_thread, THREAD_WAITING); \
-		schedule();                                    \
-	}                                                  \
+#define wait_until(cond) ({                             \
+	for (bool __woken = false; !(cond); __woken = true) \
+	{                                                   \
+		if (__woken)                                    \
+			wq_stat.nr_spurious++;                      \
+		update_thread(current_thread, THREAD_WAITING);  \
+		schedule();                                     \
+	}                                                   \
 })
 
 #define wait_until_with_prework(cond, prework) ({      \
@@ -97,4 +148,22 @@ extern void schedule();
 	list_del(&__wait.sibling);                   \
 })
 
+// only one exclusive waiter is woken per event, it is removed from queue when woken so the next event goes to another waiter
+#define wait_event_exclusive_key(wh, cond, mask) ({     \
+	DEFINE_WAIT_FUNC(__wait, autoremove_wake_function); \
+	__wait.key = (mask);                                \
+	for (bool __woken = false;; __woken = true)         \
+	{                                                   \
+		prepare_to_wait_exclusive(wh, &__wait);         \
+		if (cond)                                       \
+			break;                                      \
+		if (__woken)                                    \
+			wq_stat.nr_spurious++;                      \
+		schedule();                                     \
+	}                                                   \
+	finish_wait(wh, &__wait);                           \
+})
+
+#define wait_event_exclusive(wh, cond) wait_event_exclusive_key(wh, cond, 0)
+
 #endif
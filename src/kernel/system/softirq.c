@@ -0,0 +1,131 @@
+#include "softirq.h"
+
+#include <cpu/hal.h>
+#include <proc/task.h>
+
+// softirqs raised while running are picked up again a few times, the rest waits for the next irq (pit is 1ms)
+#define MAX_SOFTIRQ_RESTART 10
+
+static void (*softirq_actions[NR_SOFTIRQS])();
+static volatile uint32_t softirq_pending;
+static volatile bool softirq_running;
+static LIST_HEAD(tasklet_hi_list);
+static LIST_HEAD(tasklet_list);
+
+void open_softirq(enum softirq_type nr, void (*action)())
+{
+	softirq_actions[nr] = action;
+}
+
+void raise_softirq(enum softirq_type nr)
+{
+	uint32_t eflags = save_interrupts();
+	softirq_pending |= 1 << nr;
+	restore_interrupts(eflags);
+}
+
+bool in_softirq()
+{
+	return softirq_running;
+}
+
+// called with interrupts off when leaving the outermost irq, irqs which come in meanwhile don't run it again
+void do_softirq()
+{
+	if (!softirq_pending || softirq_running || !current_thread)
+		return;
+
+	softirq_running = true;
+	// interrupted thread stays on cpu until softirqs are done (preempt_enable would be a preemption point here)
+	current_thread->preempt_count++;
+
+	for (int restart = 0; softirq_pending && restart < MAX_SOFTIRQ_RESTART; ++restart)
+	{
+		uint32_t pending = softirq_pending;
+		softirq_pending = 0;
+		enable_interrupts();
+
+		for (int nr = 0; nr < NR_SOFTIRQS; ++nr)
+		{
+			if (!(pending & (1 << nr)) || !softirq_actions[nr])
+				continue;
+
+			softirq_actions[nr]();
+			sched_stat.nr_softirqs++;
+		}
+
+		disable_interrupts();
+	}
+
+	current_thread->preempt_count--;
+	softirq_running = false;
+}
+
+void tasklet_init(struct tasklet_struct *t, void (*func)(unsigned long), unsigned long data)
+{
+	INIT_LIST_HEAD(&t->sibling);
+	t->state = 0;
+	t->func = func;
+	t->data = data;
+}
+
+static void __tasklet_schedule(struct tasklet_struct *t, struct list_head *list, enum softirq_type nr)
+{
+	uint32_t eflags = save_interrupts();
+
+	if (!(t->state & TASKLET_STATE_SCHED))
+	{
+		t->state |= TASKLET_STATE_SCHED;
+		list_add_tail(&t->sibling, list);
+		softirq_pending |= 1 << nr;
+	}
+
+	restore_interrupts(eflags);
+}
+
+void tasklet_schedule(struct tasklet_struct *t)
+{
+	__tasklet_schedule(t, &tasklet_list, TASKLET_SOFTIRQ);
+}
+
+void tasklet_hi_schedule(struct tasklet_struct *t)
+{
+	__tasklet_schedule(t, &tasklet_hi_list, HI_SOFTIRQ);
+}
+
+// tasklets are taken off the list at once, one which schedules itself again runs in the next round
+static void tasklet_run_list(struct list_head *list)
+{
+	LIST_HEAD(scheduled);
+
+	disable_interrupts();
+	list_splice_init(list, &scheduled);
+	enable_interrupts();
+
+	struct tasklet_struct *iter, *next;
+	list_for_each_entry_safe(iter, next, &scheduled, sibling)
+	{
+		disable_interrupts();
+		list_del_init(&iter->sibling);
+		iter->state &= ~TASKLET_STATE_SCHED;
+		enable_interrupts();
+
+		iter->func(iter->data);
+	}
+}
+
+static void tasklet_hi_action()
+{
+	tasklet_run_list(&tasklet_hi_list);
+}
+
+static void tasklet_action()
+{
+	tasklet_run_list(&tasklet_list);
+}
+
+void softirq_init()
+{
+	open_softirq(HI_SOFTIRQ, tasklet_hi_action);
+	open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+}
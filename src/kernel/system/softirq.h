@@ -0,0 +1,47 @@
+#ifndef SYSTEM_SOFTIRQ_H
+#define SYSTEM_SOFTIRQ_H
+
+#include <include/list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bottom halves, irq handler only acks device and takes data out of it, the rest is deferred
+// - softirq: a pending bit per type, they run on the way back from the outermost irq with interrupts on
+// - tasklet: driver's callback run from softirq, scheduling it again before it runs is a no-op
+// - work (system/workqueue.h): runs on a kernel worker thread, it can sleep
+// none of softirq/tasklet can sleep, they borrow interrupted thread's stack and it isn't switched out meanwhile
+enum softirq_type
+{
+	HI_SOFTIRQ,	 // tasklets which have to run first (input)
+	TIMER_SOFTIRQ,
+	TASKLET_SOFTIRQ,
+	NR_SOFTIRQS,
+};
+
+#define TASKLET_STATE_SCHED 0x01
+
+struct tasklet_struct
+{
+	struct list_head sibling;
+	uint32_t state;
+	void (*func)(unsigned long);
+	unsigned long data;
+};
+
+#define DECLARE_TASKLET(name, _func, _data)                  \
+	struct tasklet_struct name = {                           \
+		.sibling = LIST_HEAD_INIT((name).sibling),           \
+		.func = (_func),                                     \
+		.data = (_data),                                     \
+	}
+
+void open_softirq(enum softirq_type nr, void (*action)());
+void raise_softirq(enum softirq_type nr);
+bool in_softirq();
+void do_softirq();
+void tasklet_init(struct tasklet_struct *t, void (*func)(unsigned long), unsigned long data);
+void tasklet_schedule(struct tasklet_struct *t);
+void tasklet_hi_schedule(struct tasklet_struct *t);
+void softirq_init();
+
+#endif
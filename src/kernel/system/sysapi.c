@@ -2,6 +2,7 @@
 
 #include <cpu/hal.h>
 #include <devices/char/tty.h>
+#include <fs/eventpoll.h>
 #include <fs/pipefs/pipe.h>
 #include <fs/sockfs/sockfs.h>
 #include <fs/vfs.h>
@@ -9,9 +10,11 @@
 #include <include/fcntl.h>
 #include <include/limits.h>
 #include <include/mman.h>
+#include <include/spawn.h>
 #include <include/utsname.h>
 #include <ipc/message_queue.h>
 #include <ipc/signal.h>
+#include <locking/futex.h>
 #include <net/net.h>
 #include <proc/elf.h>
 #include <proc/task.h>
@@ -42,6 +45,11 @@ static int interpret_path_from_fd(int dirfd, const char *path, char **interprete
 }
 
 static void sys_exit(int32_t code)
+{
+	do_exit_thread(code & 0xff);
+}
+
+static void sys_exit_group(int32_t code)
 {
 	do_exit(code & 0xff);
 }
@@ -54,6 +62,88 @@ pid_t sys_fork()
 	return child->pid;
 }
 
+static pid_t sys_vfork()
+{
+	return process_vfork(current_process);
+}
+
+// same argument order as linux i386 clone
+static int32_t sys_clone(uint32_t flags, void *newsp, tid_t *ptid, struct user_desc *tls, tid_t *ctid)
+{
+	// Only thread flavor is supported, use fork to create process
+	if ((flags & CLONE_THREAD_FLAGS) != CLONE_THREAD_FLAGS)
+		return -EINVAL;
+	if ((flags & CLONE_SETTLS && !tls) ||
+		(flags & CLONE_PARENT_SETTID && !ptid) ||
+		(flags & (CLONE_CHILD_SETTID | CLONE_CHILD_CLEARTID) && !ctid))
+		return -EFAULT;
+
+	struct thread *th = process_clone(current_process, flags, (uint32_t)newsp, tls, ptid, ctid);
+	queue_thread(th);
+
+	return th->tid;
+}
+
+static int32_t sys_set_thread_area(struct user_desc *u_info)
+{
+	if (!u_info)
+		return -EFAULT;
+
+	if (u_info->entry_number == (uint32_t)-1)
+		u_info->entry_number = GDT_ENTRY_TLS;
+	if (u_info->entry_number != GDT_ENTRY_TLS)
+		return -EINVAL;
+
+	current_thread->tls = *u_info;
+	gdt_set_tls(&current_thread->tls);
+	return 0;
+}
+
+static int32_t sys_gettid()
+{
+	return current_thread->tid;
+}
+
+static int32_t sys_sched_yield()
+{
+	sched_yield();
+	return 0;
+}
+
+static int32_t sys_sched_setscheduler(tid_t tid, int policy, const struct sched_param *param)
+{
+	if (!param)
+		return -EFAULT;
+
+	struct thread *th = tid ? find_thread_by_tid(tid) : current_thread;
+	if (!th || th->state == THREAD_TERMINATED)
+		return -ESRCH;
+
+	if (policy == SCHED_FIFO && param->sched_priority >= 1 && param->sched_priority <= SCHED_FIFO_PRIO_MAX)
+		pi_setscheduler(th, THREAD_SYSTEM_POLICY, SCHED_FIFO_PRIO_BASE - param->sched_priority);
+	else if (policy == SCHED_OTHER && param->sched_priority == 0)
+		pi_setscheduler(th, THREAD_APP_POLICY, 0);
+	else
+		return -EINVAL;
+	return 0;
+}
+
+static int32_t sys_sched_getscheduler(tid_t tid)
+{
+	struct thread *th = tid ? find_thread_by_tid(tid) : current_thread;
+	if (!th || th->state == THREAD_TERMINATED)
+		return -ESRCH;
+
+	// inherited priority is not reported
+	enum thread_policy policy = th->pi_boosted ? th->normal_policy : th->policy;
+	return policy == THREAD_APP_POLICY ? SCHED_OTHER : SCHED_FIFO;
+}
+
+static int32_t sys_futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout, uint32_t *uaddr2)
+{
+	return do_futex(uaddr, op, val, timeout, uaddr2);
+}
+
 static int32_t sys_waitid(idtype_t idtype, id_t id, struct infop *infop, int options)
 {
 	int ret = do_wait(idtype, id, infop, options);
@@ -113,10 +203,12 @@ static int32_t sys_waitpid(pid_t pid, int *wstatus, int options)
 	else
 		idtype = P_PID;
 
+	// waitpid always reports terminated children
+	options |= WEXITED;
 	if (options & WUNTRACED)
 	{
 		options &= ~WUNTRACED;
-		options |= WEXITED | WSTOPPED;
+		options |= WSTOPPED;
 	}
 
 	struct infop ifp;
@@ -387,7 +479,8 @@ static int32_t sys_fchdir(int fildes)
 	if (!filp)
 		return -EBADF;
 
-	current_process->fs->d_root = filp->f_dentry;
+	// cwd is copied to children without a reference of its own -> it is pinned for good
+	current_process->fs->d_root = dget(filp->f_dentry);
 	return 0;
 }
 
@@ -545,16 +638,9 @@ static int32_t sys_kill(pid_t pid, int sig)
 	return do_kill(pid, sig);
 }
 
-static void posix_spawn_setup_stack(struct Elf32_Layout *layout)
+static int32_t sys_posix_spawn(struct kspawn_args *args)
 {
-	setup_user_thread_stack(layout, 0, NULL, NULL);
-};
-
-static int32_t sys_posix_spawn(char *path)
-{
-	int top = get_top_priority_from_list(THREAD_READY, THREAD_SYSTEM_POLICY);
-	process_load(path, path, THREAD_APP_POLICY, top - 1, posix_spawn_setup_stack);
-	return 0;
+	return process_spawn(args->pid, args->path, args->file_actions, args->attrp, args->argv, args->envp);
 }
 
 int32_t sys_socket(int32_t family, enum socket_type type, int32_t protocal)
@@ -596,9 +682,46 @@ static int32_t sys_nanosleep(const struct timespec *req, struct timespec *rem)
 	return 0;
 }
 
-static int32_t sys_poll(struct pollfd *fds, uint32_t nfds)
+static int32_t sys_poll(struct pollfd *fds, uint32_t nfds, int32_t timeout)
 {
-	return do_poll(fds, nfds);
+	return do_poll(fds, nfds, timeout);
+}
+
+// fd_set is a bitmap of 32-bit words in libc, timeout is rounded up to milliseconds
+static int32_t sys_select(int32_t nfds, uint32_t *readfds, uint32_t *writefds, uint32_t *exceptfds, struct timeval *timeout)
+{
+	int32_t ms = -1;
+	if (timeout)
+	{
+		if (timeout->tv_sec < 0 || timeout->tv_usec < 0)
+			return -EINVAL;
+		ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+	}
+
+	return do_select(nfds, readfds, writefds, exceptfds, ms);
+}
+
+static int32_t sys_epoll_create(int32_t size)
+{
+	if (size <= 0)
+		return -EINVAL;
+
+	return do_epoll_create(0);
+}
+
+static int32_t sys_epoll_create1(int32_t flags)
+{
+	return do_epoll_create(flags);
+}
+
+static int32_t sys_epoll_ctl(int32_t epfd, int32_t op, int32_t fd, struct epoll_event *event)
+{
+	return do_epoll_ctl(epfd, op, fd, event);
+}
+
+static int32_t sys_epoll_wait(int32_t epfd, struct epoll_event *events, int32_t maxevents, int32_t timeout)
+{
+	return do_epoll_wait(epfd, events, maxevents, timeout);
 }
 
 static int32_t sys_ioctl(int fd, unsigned int cmd, unsigned long arg)
@@ -660,14 +783,19 @@ static int32_t sys_getptsname(int32_t fdm, char *buf)
 
 static int32_t sys_clock_gettime(clockid_t clk_id, struct timespec *tp)
 {
-	if (clk_id != CLOCK_PROCESS_CPUTIME_ID)
-		return -EINVAL;
 	if (!tp)
 		return -EFAULT;
 
-	uint64_t msec = get_milliseconds_since_epoch();
+	uint64_t msec;
+	if (clk_id == CLOCK_REALTIME || clk_id == CLOCK_PROCESS_CPUTIME_ID)
+		msec = get_milliseconds_since_epoch();
+	else if (clk_id == CLOCK_MONOTONIC)
+		msec = jiffies;
+	else
+		return -EINVAL;
+
 	tp->tv_sec = msec / 1000;
-	tp->tv_nsec = (msec % 1000) * 1000;
+	tp->tv_nsec = (msec % 1000) * 1000000;
 
 	return 0;
 }
@@ -752,15 +880,28 @@ static int32_t sys_debug_println(enum debug_level level, const char *out)
 #define __NR_listen 105
 #define __NR_stat 106
 #define __NR_fstat 108
+#define __NR_clone 120
 #define __NR_uname 122
 #define __NR_sigprocmask 126
 #define __NR_fchdir 133
 #define __NR_getpgid 132
 #define __NR_getdents 141
+#define __NR_select 142	 // linux _newselect
 #define __NR_getsid 147
+#define __NR_sched_setscheduler 156
+#define __NR_sched_getscheduler 157
+#define __NR_sched_yield 158
 #define __NR_nanosleep 162
 #define __NR_poll 168
 #define __NR_getcwd 183
+#define __NR_vfork 190
+#define __NR_gettid 224
+#define __NR_futex 240
+#define __NR_set_thread_area 243
+#define __NR_exit_group 252
+#define __NR_epoll_create 254
+#define __NR_epoll_ctl 255
+#define __NR_epoll_wait 256
 #define __NR_clock_gettime 265
 #define __NR_mq_open 277
 #define __NR_mq_close (__NR_mq_open + 1)
@@ -772,6 +913,7 @@ static int32_t sys_debug_println(enum debug_level level, const char *out)
 #define __NR_unlinkat 301
 #define __NR_renameat 302
 #define __NR_faccessat 307
+#define __NR_epoll_create1 329
 #define __NR_sendto 369
 // TODO: MQ 2020-09-05 Use ioctl-FIODGNAME to get pts name
 #define __NR_getptsname 370
@@ -782,7 +924,16 @@ static int32_t sys_debug_println(enum debug_level level, const char *out)
 
 static void *syscalls[] = {
 	[__NR_exit] = sys_exit,
+	[__NR_exit_group] = sys_exit_group,
 	[__NR_fork] = sys_fork,
+	[__NR_vfork] = sys_vfork,
+	[__NR_clone] = sys_clone,
+	[__NR_gettid] = sys_gettid,
+	[__NR_set_thread_area] = sys_set_thread_area,
+	[__NR_sched_setscheduler] = sys_sched_setscheduler,
+	[__NR_sched_getscheduler] = sys_sched_getscheduler,
+	[__NR_sched_yield] = sys_sched_yield,
+	[__NR_futex] = sys_futex,
 	[__NR_read] = sys_read,
 	[__NR_write] = sys_write,
 	[__NR_open] = sys_open,
@@ -847,6 +998,11 @@ static void *syscalls[] = {
 	[__NR_recv] = sys_recv,
 	[__NR_nanosleep] = sys_nanosleep,
 	[__NR_poll] = sys_poll,
+	[__NR_select] = sys_select,
+	[__NR_epoll_create] = sys_epoll_create,
+	[__NR_epoll_create1] = sys_epoll_create1,
+	[__NR_epoll_ctl] = sys_epoll_ctl,
+	[__NR_epoll_wait] = sys_epoll_wait,
 	[__NR_mq_open] = sys_mq_open,
 	[__NR_mq_close] = sys_mq_close,
 	[__NR_mq_unlink] = sys_mq_unlink,
@@ -871,6 +1027,11 @@ static int32_t syscall_dispatcher(struct interrupt_registers *regs)
 
 	memcpy(&current_thread->uregs, regs, sizeof(struct interrupt_registers));
 
+	// syscall runs with interrupts on and can be preempted, state it shares with other threads has to be locked
+	// (fd table: files->lock, message queue: mq->lock, inode: i_mutex, wait queues/thread state: scheduler lock)
+	// and state which irq/softirq handlers also touch (kmalloc heap, frame bitmap, timers) is only touched with interrupts off
+	enable_interrupts();
+
 	uint32_t ret = func(regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
 	regs->eax = ret;
 
@@ -0,0 +1,60 @@
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Reads the same amount of a file in sequential and in random order, each 4KiB chunk at a time
+// and prints elapsed time with commands, sectors and merges which have reached the disk (/dev/diskstats)
+// the file should be larger than buffer cache, otherwise the second run is served from memory
+// build: i386-mos-gcc block_bench.c -o block_bench
+
+#define DEFAULT_PATH "/tmp/large.bin"
+#define CHUNK_SIZE 4096
+#define NR_CHUNKS 1024
+
+// return disk read commands the run has caused, -1 if a chunk cannot be read
+static int run(const char *name, int fd, off_t size, int random)
+{
+	char chunk[CHUNK_SIZE];
+	int nr_chunks = size / CHUNK_SIZE;
+	struct disk_stat before, after;
+
+	disk_stat(&before);
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_CHUNKS; ++i)
+	{
+		int index = random ? rand() % nr_chunks : i % nr_chunks;
+		lseek(fd, (off_t)index * CHUNK_SIZE, SEEK_SET);
+		if (read(fd, chunk, CHUNK_SIZE) != CHUNK_SIZE)
+			return -1;
+	}
+	uint64_t elapsed = now_ms() - start;
+	disk_stat(&after);
+
+	printf("%s: %d KiB in %dms, %d disk reads, %d sectors, %d merges\n", name, NR_CHUNKS * CHUNK_SIZE / 1024,
+		   (int)elapsed, after.reads - before.reads, after.sectors_read - before.sectors_read, after.merges - before.merges);
+	return after.reads - before.reads;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : DEFAULT_PATH;
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < NR_CHUNKS * CHUNK_SIZE)
+	{
+		printf("block_bench: %s has to be at least %d KiB\n", path, NR_CHUNKS * CHUNK_SIZE / 1024);
+		return test_result("block_bench", 1);
+	}
+
+	srand(1);
+	int sequential = run("sequential", fd, st.st_size, 0);
+	int random = run("random", fd, st.st_size, 1);
+	close(fd);
+
+	int failures = check(sequential >= 0 && random >= 0, "%s cannot be read", path);
+	failures += check(sequential > 0, "%s is served from cache, pass a file larger than buffer cache", path);
+	// adjacent 4KiB reads are merged into larger commands, blocks of a random chunk are merged into one
+	// (plus a readahead window started by chance)
+	failures += check(sequential < NR_CHUNKS / 2, "sequential reads are not merged (%d commands)", sequential);
+	failures += check(random <= NR_CHUNKS * 2, "random chunks are not merged (%d commands)", random);
+	return test_result("block_bench", failures);
+}
@@ -0,0 +1,43 @@
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Reads a 64MiB file (created by create_image.sh) from start to end and prints disk operations it has caused
+// everything above file size is metadata, mostly indirect blocks, each of them should be read about once
+// build: i386-mos-gcc bmap_cache.c -o bmap_cache
+
+#define DEFAULT_PATH "/tmp/large.bin"
+#define CHUNK_SIZE 0x10000
+// metadata can take at most 1/64 of data sectors (1KiB blocks need one indirect block per 256 data blocks)
+#define MAX_METADATA_RATIO 64
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : DEFAULT_PATH;
+	char *chunk = malloc(CHUNK_SIZE);
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0)
+		return test_result("bmap_cache", check(0, "cannot open %s", path));
+
+	struct disk_stat before, after;
+	disk_stat(&before);
+	uint64_t start = now_ms();
+	uint64_t total = 0;
+	ssize_t nr;
+	while ((nr = read(fd, chunk, CHUNK_SIZE)) > 0)
+		total += nr;
+	uint64_t elapsed = now_ms() - start;
+	disk_stat(&after);
+	close(fd);
+
+	int reads = after.reads - before.reads;
+	int sectors = after.sectors_read - before.sectors_read;
+	int data_sectors = total / 512;
+	int metadata_sectors = sectors > data_sectors ? sectors - data_sectors : 0;
+	printf("%s: %llu MiB in %llums, %d disk reads, %d sectors (%d above file size)\n", path, total >> 20, elapsed,
+		   reads, sectors, metadata_sectors);
+
+	int failures = check(total == (uint64_t)st.st_size, "read %llu bytes of %lld", total, (long long)st.st_size);
+	failures += check(metadata_sectors <= data_sectors / MAX_METADATA_RATIO, "indirect blocks are read more than once");
+	return test_result("bmap_cache", failures);
+}
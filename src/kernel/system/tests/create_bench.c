@@ -0,0 +1,62 @@
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Creates 10,000 small files (1-4KiB) in 100 directories and prints creation rate, then reads them back and prints
+// disk read commands per file, a file which is not contiguous on disk needs more than one
+// (most of them are out of buffer cache by then). `./check_image.sh` on the host prints `non-contiguous files` as well
+// build: i386-mos-gcc create_bench.c -o create_bench
+
+#define ROOT_PATH "/tmp/create_bench"
+#define NR_DIRS 100
+#define NR_FILES_PER_DIR 100
+#define NR_FILES (NR_DIRS * NR_FILES_PER_DIR)
+// a contiguous file is one command, inode table and directory blocks are shared by many files
+#define MAX_READS_PER_FILE 2
+
+static int file_size(int index)
+{
+	return (index % 4 + 1) * 1024;
+}
+
+int main(int argc, char *argv[])
+{
+	char root[64], path[128];
+	char *data = calloc(1, 4096);
+	snprintf(root, sizeof(root), "%s_%d", ROOT_PATH, getpid());
+	if (mkdir(root, 0755) < 0)
+		return test_result("create_bench", check(0, "cannot create %s", root));
+
+	int failures = 0;
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_FILES && !failures; ++i)
+	{
+		if (i % NR_FILES_PER_DIR == 0)
+		{
+			snprintf(path, sizeof(path), "%s/d%d", root, i / NR_FILES_PER_DIR);
+			failures += check(mkdir(path, 0755) == 0, "cannot create %s", path);
+		}
+		snprintf(path, sizeof(path), "%s/d%d/f%d", root, i / NR_FILES_PER_DIR, i);
+		int fd = open(path, O_WRONLY | O_CREAT, 0644);
+		memset(data, i, file_size(i));
+		failures += check(fd >= 0 && write(fd, data, file_size(i)) == file_size(i), "cannot write %s", path);
+		close(fd);
+	}
+	uint64_t elapsed = now_ms() - start;
+	printf("create: %d files in %llums, %llu files/s\n", NR_FILES, elapsed, elapsed ? NR_FILES * 1000ull / elapsed : 0);
+
+	struct disk_stat before, after;
+	disk_stat(&before);
+	for (int i = 0; i < NR_FILES && !failures; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/d%d/f%d", root, i / NR_FILES_PER_DIR, i);
+		int fd = open(path, O_RDONLY);
+		failures += check(fd >= 0 && read(fd, data, 4096) == file_size(i) && data[0] == (char)i, "%s is corrupted", path);
+		close(fd);
+	}
+	disk_stat(&after);
+	int reads = after.reads - before.reads;
+	printf("read back: %d disk reads, %d.%02d per file\n", reads, reads / NR_FILES, reads * 100 / NR_FILES % 100);
+
+	failures += check(reads <= NR_FILES * MAX_READS_PER_FILE, "files are not contiguous on disk");
+	return test_result("create_bench", failures);
+}
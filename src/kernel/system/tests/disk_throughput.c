@@ -0,0 +1,61 @@
+#include "../../tests/bench.h"
+
+// Reads a file sequentially over and over until 256MiB has been read and prints throughput and how busy cpu was
+// a file larger than buffer cache has to come from disk every pass, with dma the cpu idles while a transfer is in flight
+// run it once per transfer mode (ATA_DMA in devices/ata.h) to compare, `mode` column of /dev/diskstats shows the current one
+// build: i386-mos-gcc disk_throughput.c -o disk_throughput
+
+#define DEFAULT_PATH "/tmp/large.bin"
+#define TOTAL_SIZE (256 * 1024 * 1024)
+#define CHUNK_SIZE 0x10000
+// cpu mostly waits for the transfer in dma mode, pio copies every word itself
+#define MAX_DMA_BUSY_PERCENT 50
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : DEFAULT_PATH;
+	char *chunk = malloc(CHUNK_SIZE);
+
+	struct disk_stat disk_before, disk_after;
+	disk_stat(&disk_before);
+	long long idle_before = stat_value("/dev/schedstat", "switches", "idle");
+	long long tsc_before = stat_value("/dev/schedstat", "switches", "tsc");
+	uint64_t start = now_ms();
+
+	uint64_t total = 0;
+	int failures = 0;
+	while (total < TOTAL_SIZE && !failures)
+	{
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			failures = check(0, "cannot open %s", path);
+			break;
+		}
+
+		ssize_t nr;
+		uint64_t pass = 0;
+		while (total + pass < TOTAL_SIZE && (nr = read(fd, chunk, CHUNK_SIZE)) > 0)
+			pass += nr;
+		close(fd);
+
+		total += pass;
+		failures += check(pass, "%s is empty", path);
+	}
+
+	uint64_t elapsed = now_ms() - start;
+	long long idle = stat_value("/dev/schedstat", "switches", "idle") - idle_before;
+	long long elapsed_tsc = stat_value("/dev/schedstat", "switches", "tsc") - tsc_before;
+	disk_stat(&disk_after);
+	int sectors = disk_after.sectors_read - disk_before.sectors_read;
+
+	unsigned int busy = elapsed_tsc > 0 ? 100 - (unsigned int)(idle * 100 / elapsed_tsc) : 100;
+	printf("%s: %llu MiB in %llums, %llu KiB/s, %d MiB from disk in %s mode, cpu %u%% busy\n", path,
+		   total >> 20, elapsed, elapsed ? total / elapsed * 1000 / 1024 : 0, sectors / 2048, disk_after.mode, busy);
+
+	// busy time only says something about the transfer mode when most of data comes from disk
+	failures += check(sectors >= (int)(total / 512 / 2), "%s is served from cache, pass a file larger than buffer cache", path);
+	if (!strcmp(disk_after.mode, "dma"))
+		failures += check(busy <= MAX_DMA_BUSY_PERCENT, "cpu is %u%% busy during dma transfers", busy);
+	return test_result("disk_throughput", failures);
+}
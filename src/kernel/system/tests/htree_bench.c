@@ -0,0 +1,100 @@
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Creates 20,000 files in one directory and prints creation rate, then looks each of them up (in scattered order)
+// and 1,000 names which don't exist, and lists the directory. The directory becomes hash-indexed once it outgrows
+// its first block, a lookup reads a few blocks of it instead of all of them. Shut mOS down and run
+// `./check_image.sh` on the host, e2fsck verifies the index (names are where their hash says)
+// build: i386-mos-gcc htree_bench.c -o htree_bench
+
+#define ROOT_PATH "/tmp/htree_bench"
+#define NR_FILES 20000
+#define NR_MISSING 1000
+// visits every file once as it is coprime with NR_FILES
+#define STRIDE 7919
+// root, index and leaf block (plus a hash collision or an indirect block of the directory)
+// a linear scan reads all of its hundreds of blocks
+#define MAX_BLOCKS_PER_LOOKUP 6
+
+// directory blocks a lookup has read, from buffer cache or from disk
+static long long buffer_accesses()
+{
+	return stat_value("/dev/diskstats", "buffers", "hits") + stat_value("/dev/diskstats", "buffers", "misses");
+}
+
+static int disk_reads()
+{
+	struct disk_stat stat;
+	disk_stat(&stat);
+	return stat.reads;
+}
+
+static void print_rate(const char *name, int nr, uint64_t elapsed, int reads)
+{
+	printf("%s: %d in %llums, %llu/s, %d disk reads\n", name, nr, elapsed, elapsed ? nr * 1000ull / elapsed : 0, reads);
+}
+
+static int count_entries(const char *root)
+{
+	DIR *dir = opendir(root);
+	if (!dir)
+		return -1;
+
+	int nr_files = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)))
+		nr_files += entry->d_name[0] != '.';
+	closedir(dir);
+	return nr_files;
+}
+
+int main(int argc, char *argv[])
+{
+	char root[64], path[128];
+	snprintf(root, sizeof(root), "%s_%d", ROOT_PATH, getpid());
+	if (mkdir(root, 0755) < 0)
+		return test_result("htree_bench", check(0, "cannot create %s", root));
+
+	int failures = 0;
+	int reads = disk_reads();
+	uint64_t start = now_ms();
+	for (int i = 0; i < NR_FILES && !failures; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/file_%05d", root, i);
+		int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		failures += check(fd >= 0, "cannot create %s", path);
+		close(fd);
+	}
+	print_rate("create", NR_FILES, now_ms() - start, disk_reads() - reads);
+
+	struct stat st;
+	reads = disk_reads();
+	start = now_ms();
+	for (int i = 0; i < NR_FILES && !failures; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/file_%05d", root, (int)((uint64_t)i * STRIDE % NR_FILES));
+		failures += check(stat(path, &st) == 0 && S_ISREG(st.st_mode), "%s is not found", path);
+	}
+	print_rate("lookup", NR_FILES, now_ms() - start, disk_reads() - reads);
+
+	// each missing name is looked up once, it is not in dentry cache yet and has to go to the directory
+	reads = disk_reads();
+	long long accesses = buffer_accesses();
+	start = now_ms();
+	for (int i = 0; i < NR_MISSING && !failures; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/missing_%05d", root, i);
+		failures += check(stat(path, &st) < 0, "%s is found", path);
+	}
+	print_rate("missing lookup", NR_MISSING, now_ms() - start, disk_reads() - reads);
+	accesses = buffer_accesses() - accesses;
+	printf("missing lookup: %lld.%02lld blocks per lookup\n", accesses / NR_MISSING, accesses * 100 / NR_MISSING % 100);
+
+	int nr_files = failures ? 0 : count_entries(root);
+	printf("readdir: %d files\n", nr_files);
+
+	failures += check(accesses <= NR_MISSING * MAX_BLOCKS_PER_LOOKUP, "lookups are not served by the hash index");
+	failures += check(nr_files == NR_FILES, "readdir returns %d files", nr_files);
+	return test_result("htree_bench", failures);
+}
@@ -0,0 +1,72 @@
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "../../tests/bench.h"
+
+// Keeps disk, timers and scheduler busy for a while then prints the worst interrupts-off sections from /dev/schedstat
+// irq handlers only take data out of devices and the rest runs from softirq/tasklet/worker with interrupts on
+// -> the longest hard irq has to stay far below a pit tick
+// build: i386-mos-gcc irqsoff.c -o irqsoff
+
+#define LOAD_MS 2000
+#define HARDIRQ_MAX_US 500
+#define DISK_LOAD_PATH "/bin/window_server"
+
+static long long schedstat(const char *name)
+{
+	return stat_value("/dev/schedstat", "switches", name);
+}
+
+static void disk_load()
+{
+	char buf[4096];
+	while (1)
+	{
+		int fd = open(DISK_LOAD_PATH, O_RDONLY);
+		if (fd < 0)
+			_exit(1);
+		while (read(fd, buf, sizeof(buf)) > 0)
+			;
+		close(fd);
+	}
+}
+
+// many short timeouts -> timer softirq fires on most ticks
+static void timer_load()
+{
+	while (1)
+		poll(NULL, 0, 1);
+}
+
+static pid_t spawn_load(void (*load)())
+{
+	pid_t pid = fork();
+	if (!pid)
+		load();
+	return pid;
+}
+
+int main(int argc, char *argv[])
+{
+	pid_t loads[] = {spawn_load(disk_load), spawn_load(timer_load), spawn_load(timer_load)};
+
+	uint64_t end = now_ms() + LOAD_MS;
+	while (now_ms() < end)
+		poll(NULL, 0, 10);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		kill(loads[i], SIGKILL);
+		waitpid(loads[i], NULL, 0);
+	}
+
+	long long tsc_khz = schedstat("tsc_khz");
+	long long hardirq_us = tsc_khz > 0 ? schedstat("hardirq_max") * 1000 / tsc_khz : 0;
+	long long irqoff_us = tsc_khz > 0 ? schedstat("irqoff_max") * 1000 / tsc_khz : 0;
+	printf("irqsoff: worst hard irq %lldus, worst scheduler locked %lldus, %lld softirqs\n",
+		   hardirq_us, irqoff_us, schedstat("softirq"));
+
+	int failures = check(tsc_khz > 0, "/dev/schedstat has no tsc_khz");
+	failures += check(hardirq_us <= HARDIRQ_MAX_US, "hard irq has run %lldus", hardirq_us);
+	return test_result("irqsoff", failures);
+}
@@ -0,0 +1,71 @@
+#include "../../tests/bench.h"
+
+// Writes a 32MiB file (through single and double indirect blocks with 1KiB blocks) 64KiB at a time, prints throughput
+// then overwrites the same blocks in place (no read before write) and reads it back to verify its content
+// after shutting down, `./check_image.sh` on the host should find the filesystem clean
+// build: i386-mos-gcc large_write.c -o large_write
+
+#define DEFAULT_PATH "/tmp/large_write.bin"
+#define TOTAL_SIZE (32 * 1024 * 1024)
+#define CHUNK_SIZE 0x10000
+// overwriting only reads indirect blocks, 1KiB blocks need one of them per 256 data blocks
+#define MAX_METADATA_RATIO 64
+
+// every word tells where it is, a block written at a wrong place shows up
+static void fill_chunk(uint32_t *chunk, uint32_t offset)
+{
+	for (uint32_t i = 0; i < CHUNK_SIZE / sizeof(uint32_t); ++i)
+		chunk[i] = offset + i * sizeof(uint32_t);
+}
+
+// write the whole file, return -1 if it fails
+static int write_file(const char *path, uint32_t *chunk, int flags)
+{
+	int fd = open(path, O_WRONLY | flags, 0644);
+	if (fd < 0)
+		return -1;
+
+	int ret = 0;
+	uint64_t start = now_ms();
+	for (uint32_t offset = 0; offset < TOTAL_SIZE && !ret; offset += CHUNK_SIZE)
+	{
+		fill_chunk(chunk, offset);
+		ret = write(fd, (char *)chunk, CHUNK_SIZE) == CHUNK_SIZE ? 0 : -1;
+	}
+	uint64_t elapsed = now_ms() - start;
+	close(fd);
+	printf("%s: %d MiB in %llums, %llu KiB/s\n", flags & O_CREAT ? "write" : "overwrite", TOTAL_SIZE >> 20, elapsed,
+		   elapsed ? (uint64_t)TOTAL_SIZE / elapsed * 1000 / 1024 : 0);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : DEFAULT_PATH;
+	uint32_t *chunk = malloc(CHUNK_SIZE);
+	uint32_t *expected = malloc(CHUNK_SIZE);
+
+	int failures = check(write_file(path, chunk, O_CREAT) == 0, "cannot write %s", path);
+
+	// full blocks are overwritten in place, only indirect blocks may be read
+	struct disk_stat before, after;
+	disk_stat(&before);
+	failures += check(!failures && write_file(path, chunk, 0) == 0, "cannot overwrite %s", path);
+	disk_stat(&after);
+	int sectors = after.sectors_read - before.sectors_read;
+	failures += check(sectors <= TOTAL_SIZE / 512 / MAX_METADATA_RATIO, "overwrite has read %d sectors", sectors);
+
+	int fd = open(path, O_RDONLY);
+	uint64_t start = now_ms();
+	for (uint32_t offset = 0; offset < TOTAL_SIZE && !failures; offset += CHUNK_SIZE)
+	{
+		fill_chunk(expected, offset);
+		failures += check(read(fd, (char *)chunk, CHUNK_SIZE) == CHUNK_SIZE && !memcmp(chunk, expected, CHUNK_SIZE),
+						  "content at %u is wrong", offset);
+	}
+	uint64_t elapsed = now_ms() - start;
+	close(fd);
+	printf("read back: %d MiB in %llums\n", TOTAL_SIZE >> 20, elapsed);
+
+	return test_result("large_write", failures);
+}
@@ -0,0 +1,86 @@
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Lists a directory of 1,000 files twice like `ls -l` (readdir + stat of each entry) and prints time, disk reads
+// and inode cache hits/misses of each pass. The directory is created by the first run, run it again after reboot
+// to get a cold first pass (inodes are read from disk), the second pass is served from memory
+// build: i386-mos-gcc ls_bench.c -o ls_bench
+
+#define DIR_PATH "/tmp/ls_bench"
+#define NR_FILES 1000
+
+static int populate()
+{
+	struct stat st;
+	if (stat(DIR_PATH, &st) == 0)
+		return 0;
+
+	char path[64];
+	if (mkdir(DIR_PATH, 0755) < 0)
+		return -1;
+	for (int i = 0; i < NR_FILES; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/e%03d", DIR_PATH, i);
+		int fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0)
+			return -1;
+		close(fd);
+	}
+	return 1;
+}
+
+static int list()
+{
+	DIR *dir = opendir(DIR_PATH);
+	if (!dir)
+		return -1;
+
+	int nr_files = 0;
+	char path[64];
+	struct dirent *entry;
+	while ((entry = readdir(dir)))
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+
+		struct stat st;
+		snprintf(path, sizeof(path), "%s/%s", DIR_PATH, entry->d_name);
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+			nr_files++;
+	}
+	closedir(dir);
+	return nr_files;
+}
+
+int main(int argc, char *argv[])
+{
+	int created = populate();
+	if (created < 0)
+		return test_result("ls_bench", check(0, "cannot populate %s", DIR_PATH));
+
+	int nr_files[2], reads[2];
+	long long misses[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		struct disk_stat before, after;
+		disk_stat(&before);
+		long long start_hits = stat_value("/dev/diskstats", "inodes", "hits");
+		long long start_misses = stat_value("/dev/diskstats", "inodes", "misses");
+		uint64_t start = now_ms();
+		nr_files[i] = list();
+		uint64_t elapsed = now_ms() - start;
+		disk_stat(&after);
+		reads[i] = after.reads - before.reads;
+		misses[i] = stat_value("/dev/diskstats", "inodes", "misses") - start_misses;
+
+		printf("%s pass: %d files in %dms, %d disk reads, %lld inode hits, %lld inode misses\n",
+			   i || created ? "warm" : "cold", nr_files[i], (int)elapsed, reads[i],
+			   stat_value("/dev/diskstats", "inodes", "hits") - start_hits, misses[i]);
+	}
+
+	int failures = check(nr_files[0] == NR_FILES && nr_files[1] == NR_FILES, "%s does not list %d files", DIR_PATH, NR_FILES);
+	failures += check(reads[1] <= READS_SLACK, "warm pass has gone to disk %d times", reads[1]);
+	failures += check(misses[1] <= READS_SLACK, "warm pass has missed inode cache %lld times", misses[1]);
+	return test_result("ls_bench", failures);
+}
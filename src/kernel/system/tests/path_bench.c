@@ -0,0 +1,101 @@
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Prints `stat` and `open`+`close` rate of a file 10 directories deep and the time of looking up a command
+// the way bash does (stat of `<dir>/<name>` for each PATH directory until it is found), for a missing command
+// every lookup fails in each directory -> they are served by negative dentries, without any disk read
+// build: i386-mos-gcc path_bench.c -o path_bench
+
+#define ROOT_PATH "/tmp/path_bench"
+#define DEPTH 10
+#define NR_LOOPS 10000
+#define NR_COMMAND_LOOPS 1000
+
+static const char *search_path[] = {"/usr/local/sbin", "/usr/local/bin", "/usr/sbin", "/usr/bin", "/sbin", "/bin"};
+
+static int make_deep_path(char *path, int size)
+{
+	int len = snprintf(path, size, "%s", ROOT_PATH);
+	mkdir(path, 0755);
+	for (int i = 0; i < DEPTH - 1; ++i)
+	{
+		len += snprintf(path + len, size - len, "/d%d", i);
+		mkdir(path, 0755);
+	}
+	snprintf(path + len, size - len, "/file");
+
+	int fd = open(path, O_WRONLY | O_CREAT, 0644);
+	if (fd < 0)
+		return -1;
+	close(fd);
+	return 0;
+}
+
+// like bash's search of PATH, return the index of directory which has it, -1 if none
+static int find_command(const char *name)
+{
+	char path[128];
+	struct stat st;
+	for (int i = 0; i < sizeof(search_path) / sizeof(search_path[0]); ++i)
+	{
+		snprintf(path, sizeof(path), "%s/%s", search_path[i], name);
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+			return i;
+	}
+	return -1;
+}
+
+static void print_rate(const char *name, int nr, uint64_t elapsed)
+{
+	printf("%s: %d in %llums, %llu/s\n", name, nr, elapsed / 1000, elapsed ? nr * 1000000ull / elapsed : 0);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[256];
+	if (make_deep_path(path, sizeof(path)) < 0)
+		return test_result("path_bench", check(0, "cannot create %s", ROOT_PATH));
+
+	int failures = 0;
+	struct stat st;
+	uint64_t start = now_us();
+	for (int i = 0; i < NR_LOOPS && !failures; ++i)
+		failures += check(stat(path, &st) == 0, "cannot stat %s", path);
+	print_rate("stat", NR_LOOPS, now_us() - start);
+
+	start = now_us();
+	for (int i = 0; i < NR_LOOPS && !failures; ++i)
+	{
+		int fd = open(path, O_RDONLY);
+		failures += check(fd >= 0, "cannot open %s", path);
+		close(fd);
+	}
+	print_rate("open+close", NR_LOOPS, now_us() - start);
+
+	// the first lookup of a missing command goes to disk for each directory, the rest are negative dentries
+	char missing[32];
+	snprintf(missing, sizeof(missing), "missing_%d", getpid());
+	failures += check(find_command(missing) < 0, "%s is found", missing);
+
+	struct disk_stat before, after;
+	disk_stat(&before);
+	long long misses = stat_value("/dev/diskstats", "dentries", "misses");
+	start = now_us();
+	for (int i = 0; i < NR_COMMAND_LOOPS && !failures; ++i)
+		failures += check(find_command(missing) < 0, "%s is found", missing);
+	uint64_t elapsed = now_us() - start;
+	disk_stat(&after);
+	misses = stat_value("/dev/diskstats", "dentries", "misses") - misses;
+	int reads = after.reads - before.reads;
+	printf("missing command lookup: %lluus, %d disk reads, %lld dentry misses\n", elapsed / NR_COMMAND_LOOPS, reads, misses);
+
+	start = now_us();
+	for (int i = 0; i < NR_COMMAND_LOOPS && !failures; ++i)
+		failures += check(find_command("ld") >= 0, "ld is not found");
+	printf("existing command lookup: %lluus\n", (now_us() - start) / NR_COMMAND_LOOPS);
+
+	// a negative dentry answers without asking the filesystem
+	failures += check(reads <= READS_SLACK, "missing lookups have gone to disk %d times", reads);
+	failures += check(misses <= READS_SLACK, "missing lookups have missed dentry cache %lld times", misses);
+	return test_result("path_bench", failures);
+}
@@ -0,0 +1,78 @@
+#include <poll.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include "../../tests/bench.h"
+
+// poll/select on an empty pipe with 10ms timeout have to return 0 within one pit tick (1ms) after the deadline
+// build: i386-mos-gcc poll_timeout.c -o poll_timeout
+
+#define TIMEOUT_MS 10
+#define TICK_MS 1
+#define ROUNDS 20
+
+static int check_elapsed(const char *name, int ret, uint64_t elapsed, int *worst)
+{
+	if ((int)elapsed > *worst)
+		*worst = elapsed;
+
+	if (ret != 0 || elapsed < TIMEOUT_MS || elapsed > TIMEOUT_MS + TICK_MS)
+	{
+		printf("%s: returned %d after %dms\n", name, ret, (int)elapsed);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int failures = 0;
+	int p[2];
+	pipe(p);
+
+	int worst_poll = 0, worst_select = 0;
+	for (int i = 0; i < ROUNDS; ++i)
+	{
+		struct pollfd pfd = {.fd = p[0], .events = POLLIN};
+		uint64_t start = now_ms();
+		int ret = poll(&pfd, 1, TIMEOUT_MS);
+		failures += check_elapsed("poll", ret, now_ms() - start, &worst_poll);
+
+		fd_set rfds;
+		FD_ZERO(&rfds);
+		FD_SET(p[0], &rfds);
+		struct timeval tv = {.tv_sec = 0, .tv_usec = TIMEOUT_MS * 1000};
+		start = now_ms();
+		ret = select(p[0] + 1, &rfds, NULL, NULL, &tv);
+		failures += check_elapsed("select", ret, now_ms() - start, &worst_select);
+	}
+	printf("poll: %dms timeout, worst %dms\n", TIMEOUT_MS, worst_poll);
+	printf("select: %dms timeout, worst %dms\n", TIMEOUT_MS, worst_select);
+
+	// zero timeout never sleeps, ready fd returns right away
+	struct pollfd pfd = {.fd = p[0], .events = POLLIN};
+	if (poll(&pfd, 1, 0) != 0)
+		failures++;
+
+	char c = 'x';
+	write(p[1], &c, 1);
+	uint64_t start = now_ms();
+	if (poll(&pfd, 1, 1000) != 1 || !(pfd.revents & POLLIN) || now_ms() - start > TICK_MS)
+	{
+		printf("poll: ready pipe is not reported right away\n");
+		failures++;
+	}
+
+	fd_set rfds;
+	FD_ZERO(&rfds);
+	FD_SET(p[0], &rfds);
+	if (select(p[0] + 1, &rfds, NULL, NULL, NULL) != 1 || !FD_ISSET(p[0], &rfds))
+	{
+		printf("select: ready pipe is not reported\n");
+		failures++;
+	}
+
+	close(p[0]);
+	close(p[1]);
+
+	return test_result("poll_timeout", failures);
+}
@@ -0,0 +1,74 @@
+#include <sys/stat.h>
+#include "../../tests/bench.h"
+
+// Reads a file like `cat bigfile > /dev/null` (4KiB at a time from start to end) then reads as many random 4KiB chunks
+// and prints throughput with commands, sectors and readaheads which have reached the disk (/dev/diskstats)
+// sequential reads should be served by a few large commands, random ones should not read much more than they ask for
+// build: i386-mos-gcc readahead.c -o readahead
+
+#define DEFAULT_PATH "/tmp/large.bin"
+#define CHUNK_SIZE 4096
+// sequential commands are expected to carry at least this many sectors on average
+#define MIN_SECTORS_PER_READ 16
+// random reads may only pull in twice as much as requested (indirect blocks, a window started by chance)
+#define MAX_RANDOM_AMPLIFICATION 2
+
+static long long readaheads()
+{
+	return stat_value("/dev/diskstats", "buffers", "readaheads");
+}
+
+static void report(const char *name, uint64_t size, uint64_t elapsed, struct disk_stat *before, struct disk_stat *after,
+				   long long nr_readaheads)
+{
+	printf("%s: %llu KiB in %llums, %llu KiB/s, %d disk reads, %d sectors, %lld readaheads\n", name, size / 1024, elapsed,
+		   elapsed ? size / elapsed * 1000 / 1024 : 0, after->reads - before->reads,
+		   after->sectors_read - before->sectors_read, nr_readaheads);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : DEFAULT_PATH;
+	char chunk[CHUNK_SIZE];
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < CHUNK_SIZE)
+		return test_result("readahead", check(0, "cannot open %s", path));
+
+	struct disk_stat before, after;
+	disk_stat(&before);
+	long long readaheads_before = readaheads();
+	uint64_t start = now_ms();
+	uint64_t total = 0;
+	ssize_t nr;
+	while ((nr = read(fd, chunk, CHUNK_SIZE)) > 0)
+		total += nr;
+	uint64_t elapsed = now_ms() - start;
+	disk_stat(&after);
+	report("sequential", total, elapsed, &before, &after, readaheads() - readaheads_before);
+
+	int seq_reads = after.reads - before.reads;
+	int failures = check(total == (uint64_t)st.st_size, "read %llu bytes of %lld", total, (long long)st.st_size);
+	failures += check(seq_reads > 0, "%s is served from cache, pass a file larger than buffer cache", path);
+	failures += check(!seq_reads || (after.sectors_read - before.sectors_read) / seq_reads >= MIN_SECTORS_PER_READ,
+					  "sequential reads are not batched by readahead");
+
+	int nr_chunks = st.st_size / CHUNK_SIZE;
+	srand(1);
+	disk_stat(&before);
+	readaheads_before = readaheads();
+	start = now_ms();
+	for (int i = 0; i < nr_chunks && !failures; ++i)
+	{
+		lseek(fd, (off_t)(rand() % nr_chunks) * CHUNK_SIZE, SEEK_SET);
+		failures += check(read(fd, chunk, CHUNK_SIZE) == CHUNK_SIZE, "random chunk %d cannot be read", i);
+	}
+	elapsed = now_ms() - start;
+	disk_stat(&after);
+	close(fd);
+	report("random", (uint64_t)nr_chunks * CHUNK_SIZE, elapsed, &before, &after, readaheads() - readaheads_before);
+
+	failures += check(after.sectors_read - before.sectors_read <= nr_chunks * (CHUNK_SIZE / 512) * MAX_RANDOM_AMPLIFICATION,
+					  "random reads pull in more than %d times what they ask for", MAX_RANDOM_AMPLIFICATION);
+	return test_result("readahead", failures);
+}
@@ -1,6 +1,9 @@
 #include "timer.h"
 
+#include <cpu/hal.h>
 #include <cpu/idt.h>
+#include <proc/task.h>
+#include <system/softirq.h>
 #include <system/time.h>
 
 static struct list_head list_of_timer;
@@ -16,8 +19,11 @@ bool is_actived_timer(struct timer_list *timer)
 	return timer->sibling.prev != LIST_POISON1 && timer->sibling.next != LIST_POISON2;
 }
 
+// timers fire from softirq and syscalls run with interrupts on -> list is only touched with interrupts off
 void add_timer(struct timer_list *timer)
 {
+	uint32_t eflags = save_interrupts();
+
 	struct timer_list *iter, *node = NULL;
 	list_for_each_entry(iter, &list_of_timer, sibling)
 	{
@@ -31,36 +37,71 @@ void add_timer(struct timer_list *timer)
 		list_add(&timer->sibling, &node->sibling);
 	else
 		list_add_tail(&timer->sibling, &list_of_timer);
+
+	restore_interrupts(eflags);
 }
 
 void del_timer(struct timer_list *timer)
 {
+	uint32_t eflags = save_interrupts();
 	list_del(&timer->sibling);
+	restore_interrupts(eflags);
 }
 
 void mod_timer(struct timer_list *timer, uint64_t expires)
 {
+	uint32_t eflags = save_interrupts();
 	del_timer(timer);
 	timer->expires = expires;
 	add_timer(timer);
+	restore_interrupts(eflags);
 }
 
+// pit irq only checks the earliest timer, expired ones run from softirq
 static int32_t timer_schedule_handler(struct interrupt_registers *regs)
 {
-	struct timer_list *iter, *next;
+	struct timer_list *first = list_first_entry_or_null(&list_of_timer, struct timer_list, sibling);
+	if (first && first->expires <= get_milliseconds(NULL))
+		raise_softirq(TIMER_SOFTIRQ);
+
+	return IRQ_HANDLER_CONTINUE;
+}
+
+/*
+ * Timer function runs with scheduler locked (interrupts off) as it did from pit irq, what it touches (wait entries,
+ * thread state, timer list, tcp control block) is guarded the same way by code it interrupts. A function which
+ * needs a mutex hands its work to a thread instead (blk_plug_timeout -> kblockd). Interrupts are on between two
+ * functions, timer function takes its timer off the list (or moves it later)
+ */
+static void run_timers()
+{
 	uint64_t cms = get_milliseconds(NULL);
-	list_for_each_entry_safe(iter, next, &list_of_timer, sibling)
+	while (true)
 	{
-		assert_timer_valid(iter);
-		if (iter->expires <= cms)
-			iter->function(iter);
-	}
+		lock_scheduler();
 
-	return IRQ_HANDLER_CONTINUE;
+		// timers are sorted by expiry, most of ticks stop at the first one
+		struct timer_list *timer = list_first_entry_or_null(&list_of_timer, struct timer_list, sibling);
+		bool expired = timer && timer->expires <= cms;
+		if (expired)
+		{
+			assert_timer_valid(timer);
+			timer->function(timer);
+		}
+		// timer which is left in place fires at the next tick, as it did from pit irq
+		bool left = expired && list_first_entry_or_null(&list_of_timer, struct timer_list, sibling) == timer && timer->expires <= cms;
+
+		unlock_scheduler();
+
+		if (!expired || left)
+			break;
+	}
 }
 
 void timer_init()
 {
 	INIT_LIST_HEAD(&list_of_timer);
-	register_interrupt_handler(IRQ8, timer_schedule_handler);
+	// timers run on pit (1ms) instead of rtc (32Hz) so poll/select/epoll timeouts are precise to a tick
+	register_interrupt_handler(IRQ0, timer_schedule_handler);
+	open_softirq(TIMER_SOFTIRQ, run_timers);
 }
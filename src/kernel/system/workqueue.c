@@ -0,0 +1,92 @@
+#include "workqueue.h"
+
+#include <cpu/hal.h>
+#include <proc/task.h>
+#include <proc/wait.h>
+#include <utils/debug.h>
+
+#define NR_WORKERS 2
+// same as net thread, ahead of all app threads
+#define WORKER_PRIORITY 0
+
+static LIST_HEAD(pending_works);
+static struct wait_queue_head worker_wait = {
+	.list = LIST_HEAD_INIT(worker_wait.list),
+};
+
+// list is touched from irq -> always with interrupts off
+static struct work_struct *take_work()
+{
+	uint32_t eflags = save_interrupts();
+
+	struct work_struct *work = list_first_entry_or_null(&pending_works, struct work_struct, sibling);
+	if (work)
+	{
+		list_del_init(&work->sibling);
+		work->pending = false;
+	}
+
+	restore_interrupts(eflags);
+	return work;
+}
+
+static void worker_loop()
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	while (true)
+	{
+		// idle workers queue up, a work wakes only one of them
+		wait_event_exclusive(&worker_wait, !list_empty(&pending_works));
+
+		struct work_struct *work = take_work();
+		if (work)
+			work->func(work);
+	}
+}
+
+// return false if work is already pending
+bool schedule_work(struct work_struct *work)
+{
+	uint32_t eflags = save_interrupts();
+
+	bool queued = !work->pending;
+	if (queued)
+	{
+		work->pending = true;
+		list_add_tail(&work->sibling, &pending_works);
+	}
+
+	restore_interrupts(eflags);
+
+	if (queued)
+		wake_up(&worker_wait);
+	return queued;
+}
+
+// return true if work was pending and won't run, a running work is not waited for
+bool cancel_work(struct work_struct *work)
+{
+	uint32_t eflags = save_interrupts();
+
+	bool pending = work->pending;
+	if (pending)
+	{
+		list_del_init(&work->sibling);
+		work->pending = false;
+	}
+
+	restore_interrupts(eflags);
+	return pending;
+}
+
+void workqueue_init()
+{
+	log("Workqueue: Setup %d workers", NR_WORKERS);
+	for (int i = 0; i < NR_WORKERS; ++i)
+	{
+		struct process *proc = create_system_process("kworker", worker_loop, WORKER_PRIORITY);
+		update_thread(proc->thread, THREAD_READY);
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef SYSTEM_WORKQUEUE_H
+#define SYSTEM_WORKQUEUE_H
+
+#include <include/list.h>
+#include <stdbool.h>
+
+// Work which can sleep (wait for device, take a mutex) is handed to a pool of kernel worker threads
+// it can be queued from anywhere (irq, softirq, thread), a pending work is queued only once
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct
+{
+	struct list_head sibling;
+	work_func_t func;
+	bool pending;
+};
+
+#define __WORK_INITIALIZER(name, _func)            \
+	{                                              \
+		.sibling = LIST_HEAD_INIT((name).sibling), \
+		.func = (_func),                           \
+		.pending = false,                          \
+	}
+
+#define DECLARE_WORK(name, func) struct work_struct name = __WORK_INITIALIZER(name, func)
+
+static inline void INIT_WORK(struct work_struct *work, work_func_t func)
+{
+	INIT_LIST_HEAD(&work->sibling);
+	work->func = func;
+	work->pending = false;
+}
+
+bool schedule_work(struct work_struct *work);
+bool cancel_work(struct work_struct *work);
+void workqueue_init();
+
+#endif
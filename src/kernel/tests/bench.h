@@ -0,0 +1,127 @@
+#ifndef TESTS_BENCH_H
+#define TESTS_BENCH_H
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Helpers shared by userspace tests in */tests, they are built one file at a time (i386-mos-gcc foo.c -o foo)
+// so everything here is static and each test only pulls in what it uses
+
+#define DISK_NAME "/dev/hda"
+// other processes (flusher, shell) can touch the disk or caches in the meantime
+#define READS_SLACK 4
+
+struct disk_stat
+{
+	char mode[8];
+	int reads, sectors_read, writes, sectors_written, merges;
+};
+
+static inline uint64_t now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline uint64_t now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// copy of the line starting with `prefix` in a stat device (/dev/diskstats, /dev/meminfo, /dev/schedstat ...)
+static inline char *stat_line(const char *path, const char *prefix, char *line, int size)
+{
+	static char text[0x4000];
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	int len = 0, nr;
+	while (len < (int)sizeof(text) - 1 && (nr = read(fd, text + len, sizeof(text) - 1 - len)) > 0)
+		len += nr;
+	close(fd);
+	text[len] = 0;
+
+	int prefix_len = strlen(prefix);
+	for (char *iter = text; iter && *iter; iter = strchr(iter, '\n') ? strchr(iter, '\n') + 1 : NULL)
+	{
+		if (strncmp(iter, prefix, prefix_len) || iter[prefix_len] != ' ')
+			continue;
+
+		char *end = strchr(iter, '\n');
+		int line_len = end ? end - iter : (int)strlen(iter);
+		line_len = line_len < size - 1 ? line_len : size - 1;
+		memcpy(line, iter, line_len);
+		line[line_len] = 0;
+		return line;
+	}
+	return NULL;
+}
+
+// value following `name` on the line starting with `prefix`, `name` NULL -> the first value after prefix
+// e.g. ("/dev/diskstats", "inodes", "hits") or ("/dev/meminfo", "MemUsed:", NULL), -1 if it is missing
+static inline long long stat_value(const char *path, const char *prefix, const char *name)
+{
+	char line[256];
+	if (!stat_line(path, prefix, line, sizeof(line)))
+		return -1;
+
+	char *value = line + strlen(prefix);
+	if (!name)
+		return strtoll(value, NULL, 10);
+
+	int name_len = strlen(name);
+	while ((value = strstr(value, name)))
+	{
+		if (value[-1] == ' ' && value[name_len] == ' ')
+			return strtoll(value + name_len, NULL, 10);
+		value += name_len;
+	}
+	return -1;
+}
+
+// device mode reads sectors writes sectors merges
+static inline int disk_stat(struct disk_stat *stat)
+{
+	char line[256];
+	memset(stat, 0, sizeof(struct disk_stat));
+	if (!stat_line("/dev/diskstats", DISK_NAME, line, sizeof(line)))
+		return -1;
+
+	return sscanf(line + strlen(DISK_NAME), "%7s %d %d %d %d %d", stat->mode, &stat->reads, &stat->sectors_read,
+				  &stat->writes, &stat->sectors_written, &stat->merges) == 6
+			   ? 0
+			   : -1;
+}
+
+// print why check has failed, return value is added to failures
+static inline int check(int ok, const char *fmt, ...)
+{
+	if (ok)
+		return 0;
+
+	va_list args;
+	va_start(args, fmt);
+	printf("FAIL: ");
+	vprintf(fmt, args);
+	printf("\n");
+	va_end(args);
+	return 1;
+}
+
+static inline int test_result(const char *name, int failures)
+{
+	printf("%s: %s\n", name, failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,471 @@
+#include <elf.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ld.so for i386, kernel maps it next to a program which has PT_INTERP and passes control to `_start` (start.S)
+// 1. relocates itself (only R_386_RELATIVE, it is linked with -Bsymbolic and hidden visibility)
+// 2. maps DT_NEEDED libraries (breadth-first) from /lib and /usr/lib
+// 3. relocates libraries then the program, PLT entries are bound lazily unless LD_BIND_NOW/DF_BIND_NOW
+// 4. runs libraries' initializers and jumps to program's entry
+// ld.so cannot use libc (libc is what it loads), everything it needs is in this file
+
+#define DL_PAGE_SIZE 0x1000
+#define DL_PAGE_DOWN(x) ((x) & ~(DL_PAGE_SIZE - 1))
+#define DL_PAGE_UP(x) DL_PAGE_DOWN((x) + DL_PAGE_SIZE - 1)
+#define DL_LIBRARY_BASE 0x80000000
+#define DL_MAX_OBJECTS 16
+#define DL_PATH_MAX 256
+#define DL_EXIT_CODE 127
+
+#define DL_LOOKUP_PLT 0x1
+#define DL_LOOKUP_SKIP_MAIN 0x2
+
+struct dl_object
+{
+	const char *name;
+	uint32_t base;
+	Elf32_Dyn *dynamic;
+	uint32_t info[DT_NUM];
+	const char *strtab;
+	Elf32_Sym *symtab;
+	uint32_t *hash;
+	uint32_t flags;
+};
+
+_syscall1(exit, int);
+_syscall3(read, int, char *, size_t);
+_syscall3(write, int, const char *, size_t);
+_syscall3(open, const char *, int, mode_t);
+_syscall1(close, int);
+_syscall1(mmap, struct mmap_args *);
+
+extern Elf32_Dyn _DYNAMIC[] __attribute__((visibility("hidden")));
+void _dl_runtime_resolve() __attribute__((visibility("hidden")));
+
+static struct dl_object objects[DL_MAX_OBJECTS];
+static int nr_objects;
+static uint32_t next_library_base = DL_LIBRARY_BASE;
+static bool bind_now;
+static char header[DL_PAGE_SIZE];
+
+// gcc emits calls to them for struct copies
+__attribute__((visibility("hidden"))) void *memset(void *s, int c, size_t n)
+{
+	for (char *p = s; n--;)
+		*p++ = c;
+	return s;
+}
+
+__attribute__((visibility("hidden"))) void *memcpy(void *dest, const void *src, size_t n)
+{
+	char *d = dest;
+	for (const char *s = src; n--;)
+		*d++ = *s++;
+	return dest;
+}
+
+static size_t dl_strlen(const char *s)
+{
+	size_t length = 0;
+	while (s[length])
+		length++;
+	return length;
+}
+
+static int dl_strcmp(const char *s1, const char *s2)
+{
+	for (; *s1 && *s1 == *s2; s1++, s2++)
+		;
+	return (unsigned char)*s1 - (unsigned char)*s2;
+}
+
+static bool dl_startswith(const char *s, const char *prefix)
+{
+	for (; *prefix; s++, prefix++)
+		if (*s != *prefix)
+			return false;
+	return true;
+}
+
+static void dl_puts(const char *s)
+{
+	syscall_write(2, s, dl_strlen(s));
+}
+
+static void __attribute__((noreturn)) dl_fatal(const char *message, const char *name)
+{
+	dl_puts("ld.so: ");
+	dl_puts(message);
+	if (name)
+		dl_puts(name);
+	dl_puts("\n");
+	syscall_exit(DL_EXIT_CODE);
+	__builtin_unreachable();
+}
+
+static void *dl_mmap(uint32_t addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+	struct mmap_args args = {
+		.addr = (void *)addr,
+		.len = len,
+		.prot = prot,
+		.flags = flags,
+		.fildes = fd,
+		.off = off,
+	};
+	int32_t ret = syscall_mmap(&args);
+	if (ret < 0 && ret > -DL_PAGE_SIZE)
+		dl_fatal("cannot map segment", NULL);
+	return (void *)ret;
+}
+
+static uint32_t dl_elf_hash(const char *name)
+{
+	uint32_t h = 0;
+	for (; *name; name++)
+	{
+		h = (h << 4) + (unsigned char)*name;
+		uint32_t g = h & 0xf0000000;
+		if (g)
+			h ^= g >> 24;
+		h &= ~g;
+	}
+	return h;
+}
+
+static void dl_parse_dynamic(struct dl_object *obj)
+{
+	for (Elf32_Dyn *dyn = obj->dynamic; dyn->d_tag != DT_NULL; dyn++)
+	{
+		if (dyn->d_tag < DT_NUM)
+			obj->info[dyn->d_tag] = dyn->d_un.d_val;
+	}
+
+	if (!obj->info[DT_HASH])
+		dl_fatal("DT_HASH is required, link with --hash-style=sysv: ", obj->name);
+	obj->flags = obj->info[DT_FLAGS];
+	if (obj->info[DT_TEXTREL] || (obj->flags & DF_TEXTREL))
+		dl_fatal("text relocations are not supported: ", obj->name);
+	if (obj->info[DT_BIND_NOW])
+		obj->flags |= DF_BIND_NOW;
+
+	obj->strtab = (const char *)(obj->base + obj->info[DT_STRTAB]);
+	obj->symtab = (Elf32_Sym *)(obj->base + obj->info[DT_SYMTAB]);
+	obj->hash = (uint32_t *)(obj->base + obj->info[DT_HASH]);
+}
+
+static struct dl_object *dl_load_library(const char *name)
+{
+	for (int i = 0; i < nr_objects; ++i)
+		if (objects[i].name && !dl_strcmp(objects[i].name, name))
+			return &objects[i];
+	if (nr_objects == DL_MAX_OBJECTS)
+		dl_fatal("too many libraries: ", name);
+
+	static const char *search_dirs[] = {"/lib/", "/usr/lib/"};
+	char path[DL_PATH_MAX];
+	int fd = -1;
+	for (uint32_t i = 0; i < sizeof(search_dirs) / sizeof(search_dirs[0]) && fd < 0; ++i)
+	{
+		size_t dir_length = dl_strlen(search_dirs[i]);
+		size_t name_length = dl_strlen(name);
+		if (dir_length + name_length >= DL_PATH_MAX)
+			continue;
+
+		memcpy(path, search_dirs[i], dir_length);
+		memcpy(path + dir_length, name, name_length + 1);
+		fd = syscall_open(path, O_RDONLY, 0);
+	}
+	if (fd < 0)
+		dl_fatal("cannot find library ", name);
+
+	int32_t size = syscall_read(fd, header, sizeof(header));
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)header;
+	if (size < (int32_t)sizeof(Elf32_Ehdr) || !dl_startswith((const char *)ehdr->e_ident, ELFMAG) ||
+		ehdr->e_type != ET_DYN || ehdr->e_machine != EM_386 || ehdr->e_phentsize != sizeof(Elf32_Phdr) ||
+		ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf32_Phdr) > (uint32_t)size)
+		dl_fatal("not an i386 shared library: ", name);
+
+	Elf32_Phdr *phdrs = (Elf32_Phdr *)(header + ehdr->e_phoff);
+	uint32_t start = UINT32_MAX, end = 0;
+	for (int i = 0; i < ehdr->e_phnum; ++i)
+	{
+		Elf32_Phdr *ph = &phdrs[i];
+		if (ph->p_type != PT_LOAD)
+			continue;
+		if (ph->p_vaddr < start)
+			start = DL_PAGE_DOWN(ph->p_vaddr);
+		if (ph->p_vaddr + ph->p_memsz > end)
+			end = DL_PAGE_UP(ph->p_vaddr + ph->p_memsz);
+	}
+	if (start >= end)
+		dl_fatal("library has no loadable segment: ", name);
+
+	struct dl_object *obj = &objects[nr_objects++];
+	obj->base = next_library_base - start;
+	next_library_base += end - start;
+
+	for (int i = 0; i < ehdr->e_phnum; ++i)
+	{
+		Elf32_Phdr *ph = &phdrs[i];
+		if (ph->p_type == PT_DYNAMIC)
+			obj->dynamic = (Elf32_Dyn *)(obj->base + ph->p_vaddr);
+		if (ph->p_type != PT_LOAD)
+			continue;
+
+		int prot = (ph->p_flags & PF_R ? PROT_READ : 0) | (ph->p_flags & PF_W ? PROT_WRITE : 0) |
+				   (ph->p_flags & PF_X ? PROT_EXEC : 0);
+		uint32_t map_start = DL_PAGE_DOWN(obj->base + ph->p_vaddr);
+		uint32_t file_end = obj->base + ph->p_vaddr + ph->p_filesz;
+		uint32_t mem_end = obj->base + ph->p_vaddr + ph->p_memsz;
+		uint32_t map_end = DL_PAGE_UP(file_end);
+
+		// file pages come from page cache, text is shared by every process which uses this library
+		if (ph->p_filesz)
+			dl_mmap(map_start, map_end - map_start, prot, MAP_PRIVATE | MAP_FIXED, fd,
+					DL_PAGE_DOWN(ph->p_offset));
+		else
+			map_end = map_start;
+
+		// the rest of file page (next section's bytes) is .bss
+		if (ph->p_filesz && mem_end > file_end && (prot & PROT_WRITE))
+			memset((char *)file_end, 0, map_end - file_end);
+		if (mem_end > map_end)
+		{
+			dl_mmap(map_end, DL_PAGE_UP(mem_end) - map_end, prot, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+			memset((char *)map_end, 0, DL_PAGE_UP(mem_end) - map_end);
+		}
+	}
+	// mappings keep their own reference to the file
+	syscall_close(fd);
+
+	if (!obj->dynamic)
+		dl_fatal("library has no PT_DYNAMIC: ", name);
+	obj->name = name;
+	dl_parse_dynamic(obj);
+	return obj;
+}
+
+static bool dl_is_definition(struct dl_object *obj, Elf32_Sym *sym, int flags)
+{
+	int bind = ELF32_ST_BIND(sym->st_info);
+	if (bind != STB_GLOBAL && bind != STB_WEAK)
+		return false;
+	if (sym->st_shndx != SHN_UNDEF)
+		return true;
+	// program takes address of a library function -> its PLT entry is the canonical address,
+	// every GOT has to use it so pointers compare equal, but the PLT slot itself has to go to the library
+	return obj == &objects[0] && ELF32_ST_TYPE(sym->st_info) == STT_FUNC && sym->st_value &&
+		   !(flags & DL_LOOKUP_PLT);
+}
+
+// scope is the program first then libraries in load order, so program's definitions interpose
+static Elf32_Sym *dl_lookup(const char *name, int flags, struct dl_object **found)
+{
+	uint32_t hash = dl_elf_hash(name);
+	for (int i = (flags & DL_LOOKUP_SKIP_MAIN) ? 1 : 0; i < nr_objects; ++i)
+	{
+		struct dl_object *obj = &objects[i];
+		uint32_t nbucket = obj->hash[0];
+		uint32_t *bucket = &obj->hash[2];
+		uint32_t *chain = &bucket[nbucket];
+
+		for (uint32_t idx = bucket[hash % nbucket]; idx; idx = chain[idx])
+		{
+			Elf32_Sym *sym = &obj->symtab[idx];
+			if (!dl_strcmp(obj->strtab + sym->st_name, name) && dl_is_definition(obj, sym, flags))
+			{
+				*found = obj;
+				return sym;
+			}
+		}
+	}
+	return NULL;
+}
+
+static uint32_t dl_resolve(struct dl_object *obj, uint32_t sym_idx, int flags)
+{
+	Elf32_Sym *sym = &obj->symtab[sym_idx];
+	if (ELF32_ST_BIND(sym->st_info) == STB_LOCAL)
+		return obj->base + sym->st_value;
+
+	const char *name = obj->strtab + sym->st_name;
+	struct dl_object *def_obj;
+	Elf32_Sym *def = dl_lookup(name, flags, &def_obj);
+	if (def)
+		return def_obj->base + def->st_value;
+	if (ELF32_ST_BIND(sym->st_info) == STB_WEAK)
+		return 0;
+	dl_fatal("undefined symbol: ", name);
+}
+
+static void dl_relocate_range(struct dl_object *obj, uint32_t rel_addr, uint32_t rel_size, bool lazy)
+{
+	Elf32_Rel *rel = (Elf32_Rel *)(obj->base + rel_addr);
+	Elf32_Rel *rel_end = (Elf32_Rel *)((char *)rel + rel_size);
+
+	for (; rel < rel_end; rel++)
+	{
+		uint32_t *where = (uint32_t *)(obj->base + rel->r_offset);
+		uint32_t sym_idx = ELF32_R_SYM(rel->r_info);
+
+		switch (ELF32_R_TYPE(rel->r_info))
+		{
+		case R_386_NONE:
+			break;
+		case R_386_RELATIVE:
+			*where += obj->base;
+			break;
+		case R_386_32:
+			*where += dl_resolve(obj, sym_idx, 0);
+			break;
+		case R_386_PC32:
+			*where += dl_resolve(obj, sym_idx, 0) - (uint32_t)where;
+			break;
+		case R_386_GLOB_DAT:
+			*where = dl_resolve(obj, sym_idx, 0);
+			break;
+		case R_386_JMP_SLOT:
+			// slot points back to its PLT entry (push offset; jmp PLT0) until the first call
+			if (lazy)
+				*where += obj->base;
+			else
+				*where = dl_resolve(obj, sym_idx, DL_LOOKUP_PLT);
+			break;
+		case R_386_COPY:
+		{
+			// program has its own copy of library's variable (errno, environ ...), library's GOT points to it
+			Elf32_Sym *sym = &obj->symtab[sym_idx];
+			const char *src = (const char *)dl_resolve(obj, sym_idx, DL_LOOKUP_SKIP_MAIN);
+			memcpy(where, src, sym->st_size);
+			break;
+		}
+		default:
+			dl_fatal("unsupported relocation type in ", obj->name);
+		}
+	}
+}
+
+static void dl_relocate(struct dl_object *obj)
+{
+	if (obj->info[DT_REL])
+		dl_relocate_range(obj, obj->info[DT_REL], obj->info[DT_RELSZ], false);
+
+	if (obj->info[DT_JMPREL])
+	{
+		if (obj->info[DT_PLTREL] != DT_REL)
+			dl_fatal("unsupported PLT relocation type in ", obj->name);
+
+		bool lazy = !bind_now && !(obj->flags & DF_BIND_NOW);
+		dl_relocate_range(obj, obj->info[DT_JMPREL], obj->info[DT_PLTRELSZ], lazy);
+
+		// got[1] and got[2] are pushed/jumped to by PLT0
+		uint32_t *got = (uint32_t *)(obj->base + obj->info[DT_PLTGOT]);
+		got[1] = (uint32_t)obj;
+		got[2] = (uint32_t)_dl_runtime_resolve;
+	}
+}
+
+// called from _dl_runtime_resolve on the first call through a PLT entry
+__attribute__((visibility("hidden"))) uint32_t _dl_fixup(struct dl_object *obj, uint32_t reloc_offset)
+{
+	Elf32_Rel *rel = (Elf32_Rel *)(obj->base + obj->info[DT_JMPREL] + reloc_offset);
+	uint32_t *where = (uint32_t *)(obj->base + rel->r_offset);
+	uint32_t value = dl_resolve(obj, ELF32_R_SYM(rel->r_info), DL_LOOKUP_PLT);
+
+	*where = value;
+	return value;
+}
+
+static void dl_relocate_self(uint32_t base)
+{
+	uint32_t rel_addr = 0, rel_size = 0;
+	for (Elf32_Dyn *dyn = _DYNAMIC; dyn->d_tag != DT_NULL; dyn++)
+	{
+		if (dyn->d_tag == DT_REL)
+			rel_addr = dyn->d_un.d_ptr;
+		else if (dyn->d_tag == DT_RELSZ)
+			rel_size = dyn->d_un.d_val;
+	}
+
+	Elf32_Rel *rel_end = (Elf32_Rel *)(base + rel_addr + rel_size);
+	for (Elf32_Rel *rel = (Elf32_Rel *)(base + rel_addr); rel_addr && rel < rel_end; rel++)
+	{
+		if (ELF32_R_TYPE(rel->r_info) == R_386_RELATIVE)
+			*(uint32_t *)(base + rel->r_offset) += base;
+	}
+}
+
+static void dl_init(struct dl_object *obj)
+{
+	if (obj->info[DT_INIT])
+		((void (*)())(obj->base + obj->info[DT_INIT]))();
+
+	void (**init_array)() = (void (**)())(obj->base + obj->info[DT_INIT_ARRAY]);
+	for (uint32_t i = 0; obj->info[DT_INIT_ARRAY] && i < obj->info[DT_INIT_ARRAYSZ] / sizeof(void *); ++i)
+		init_array[i]();
+}
+
+__attribute__((visibility("hidden"))) uint32_t _dl_start(uint32_t *sp)
+{
+	char **envp = (char **)sp[3];
+	Elf32_auxv_t *auxv = (Elf32_auxv_t *)sp[4];
+
+	uint32_t aux[AT_ENTRY + 1] = {0};
+	for (; auxv->a_type != AT_NULL; auxv++)
+	{
+		if (auxv->a_type <= AT_ENTRY)
+			aux[auxv->a_type] = auxv->a_val;
+	}
+
+	// nothing which needs a relocation (static pointers, string tables) can be used before this
+	dl_relocate_self(aux[AT_BASE]);
+
+	for (char **env = envp; env && *env; env++)
+	{
+		if (dl_startswith(*env, "LD_BIND_NOW=") && (*env)[12])
+			bind_now = true;
+	}
+
+	struct dl_object *program = &objects[nr_objects++];
+	Elf32_Phdr *phdrs = (Elf32_Phdr *)aux[AT_PHDR];
+	for (uint32_t i = 0; i < aux[AT_PHNUM]; ++i)
+	{
+		if (phdrs[i].p_type == PT_PHDR)
+			program->base = aux[AT_PHDR] - phdrs[i].p_vaddr;
+	}
+	for (uint32_t i = 0; i < aux[AT_PHNUM]; ++i)
+	{
+		if (phdrs[i].p_type == PT_DYNAMIC)
+			program->dynamic = (Elf32_Dyn *)(program->base + phdrs[i].p_vaddr);
+	}
+	if (!program->dynamic)
+		dl_fatal("program has no PT_DYNAMIC", NULL);
+	program->name = "";
+	dl_parse_dynamic(program);
+
+	// objects array is the breadth-first queue, a library's DT_NEEDED are added after it
+	for (int i = 0; i < nr_objects; ++i)
+	{
+		struct dl_object *obj = &objects[i];
+		for (Elf32_Dyn *dyn = obj->dynamic; dyn->d_tag != DT_NULL; dyn++)
+		{
+			if (dyn->d_tag == DT_NEEDED)
+				dl_load_library(obj->strtab + dyn->d_un.d_val);
+		}
+	}
+
+	// program goes last so R_386_COPY reads library data after it is relocated
+	for (int i = nr_objects - 1; i >= 0; --i)
+		dl_relocate(&objects[i]);
+
+	// program's initializers are run by its crt0
+	for (int i = nr_objects - 1; i > 0; --i)
+		dl_init(&objects[i]);
+
+	return aux[AT_ENTRY];
+}
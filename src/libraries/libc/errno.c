@@ -3,3 +3,10 @@
 int errno = 0;
 char *program_invocation_name;
 char *program_invocation_short_name;
+
+// used by assembly stubs, hidden -> called directly (without plt) inside libc.so
+__attribute__((visibility("hidden"))) int __syscall_error(int ret)
+{
+	errno = -ret;
+	return -1;
+}
@@ -14,6 +14,9 @@
 
 #define NAME_MAX 255
 
+// same as kernel MAX_FD
+#define OPEN_MAX 1024
+
 #define PIPE_BUF 4096
 
 #define INT_MAX INT32_MAX
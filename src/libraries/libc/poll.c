@@ -2,8 +2,8 @@
 #include <poll.h>
 #include <unistd.h>
 
-_syscall2(poll, struct pollfd *, uint32_t);
-int poll(struct pollfd *fds, uint32_t nfds)
+_syscall3(poll, struct pollfd *, uint32_t, int);
+int poll(struct pollfd *fds, uint32_t nfds, int timeout)
 {
-	SYSCALL_RETURN_ORIGINAL(syscall_poll(fds, nfds));
+	SYSCALL_RETURN_ORIGINAL(syscall_poll(fds, nfds, timeout));
 }
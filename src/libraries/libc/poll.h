@@ -23,6 +23,7 @@ struct pollfd
 	int16_t revents; /* returned events */
 };
 
-int poll(struct pollfd *fds, uint32_t nfds);
+// timeout is in milliseconds, negative waits forever
+int poll(struct pollfd *fds, uint32_t nfds, int timeout);
 
 #endif
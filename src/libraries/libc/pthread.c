@@ -0,0 +1,377 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/futex.h>
+#include <unistd.h>
+
+#define TLS_SELECTOR 0x33
+
+// each thread's gs points (via tls descriptor) to its `struct pthread`, `self` has to stay the first field
+// so `pthread_self` is a single gs:0 load. Main thread has no tls, its `struct pthread` is a static one
+// which tid is cached at startup and refreshed in child of fork/vfork -> pi mutex fast path never traps
+struct pthread
+{
+	struct pthread *self;
+	pid_t tid;
+	// cleared by kernel when thread exits (CLONE_CHILD_CLEARTID)
+	volatile pid_t ctid;
+	void *(*start_routine)(void *);
+	void *arg;
+	void *retval;
+	void *stack;
+};
+
+static struct pthread main_thread;
+
+static inline int atomic_xchg(volatile int *ptr, int val)
+{
+	__asm__ __volatile__("xchg %0, %1"
+						 : "+r"(val), "+m"(*ptr)
+						 :
+						 : "memory");
+	return val;
+}
+
+static inline int atomic_cmpxchg(volatile int *ptr, int old, int new)
+{
+	int prev;
+	__asm__ __volatile__("lock cmpxchg %2, %1"
+						 : "=a"(prev), "+m"(*ptr)
+						 : "r"(new), "0"(old)
+						 : "memory");
+	return prev;
+}
+
+static inline int atomic_add(volatile int *ptr, int val)
+{
+	__asm__ __volatile__("lock xadd %0, %1"
+						 : "+r"(val), "+m"(*ptr)
+						 :
+						 : "memory");
+	return val;
+}
+
+static inline uint16_t read_gs()
+{
+	uint16_t gs;
+	__asm__ __volatile__("mov %%gs, %0"
+						 : "=r"(gs));
+	return gs;
+}
+
+// called once from _start before main
+void __pthread_init()
+{
+	main_thread.self = &main_thread;
+	main_thread.tid = gettid();
+}
+
+// calling thread has another tid in child of fork/vfork, vfork's parent calls it too as child has shared its memory
+__attribute__((visibility("hidden"))) void __pthread_refresh_tid()
+{
+	pthread_self()->tid = gettid();
+}
+
+pthread_t pthread_self()
+{
+	if (read_gs() != TLS_SELECTOR)
+		return &main_thread;
+
+	pthread_t self;
+	__asm__ __volatile__("movl %%gs:0, %0"
+						 : "=r"(self));
+	return self;
+}
+
+int pthread_equal(pthread_t t1, pthread_t t2)
+{
+	return t1 == t2;
+}
+
+static int pthread_start(void *arg)
+{
+	struct pthread *thread = arg;
+
+	thread->retval = thread->start_routine(thread->arg);
+	return 0;
+}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg)
+{
+	size_t stacksize = attr ? attr->stacksize : PTHREAD_STACK_DEFAULT;
+	struct pthread *th = calloc(1, sizeof(struct pthread));
+	if (!th)
+		return EAGAIN;
+
+	th->stack = malloc(stacksize);
+	if (!th->stack)
+	{
+		free(th);
+		return EAGAIN;
+	}
+	th->self = th;
+	th->start_routine = start_routine;
+	th->arg = arg;
+
+	struct user_desc tls = {
+		.entry_number = -1,
+		.base_addr = (unsigned int)th,
+		.limit = 0xfffff,
+		.seg_32bit = 1,
+		.limit_in_pages = 1,
+	};
+	int flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD |
+				CLONE_SETTLS | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+	// ctid is set before clone, kernel zeroes it once the thread is gone
+	th->ctid = 1;
+
+	int ret = clone(pthread_start, (char *)th->stack + stacksize, flags, th, &th->tid, &tls, (pid_t *)&th->ctid);
+	if (ret < 0)
+	{
+		free(th->stack);
+		free(th);
+		return errno;
+	}
+
+	*thread = th;
+	return 0;
+}
+
+int pthread_join(pthread_t thread, void **retval)
+{
+	if (thread == pthread_self())
+		return EDEADLK;
+
+	int ctid;
+	while ((ctid = thread->ctid))
+		futex(&thread->ctid, FUTEX_WAIT, ctid, NULL, NULL);
+
+	if (retval)
+		*retval = thread->retval;
+	free(thread->stack);
+	free(thread);
+	return 0;
+}
+
+_syscall1(exit, int);
+void pthread_exit(void *retval)
+{
+	struct pthread *self = pthread_self();
+	if (self == &main_thread)
+		exit(0);
+
+	self->retval = retval;
+	syscall_exit(0);
+	__builtin_unreachable();
+}
+
+int pthread_attr_init(pthread_attr_t *attr)
+{
+	attr->stacksize = PTHREAD_STACK_DEFAULT;
+	return 0;
+}
+
+int pthread_attr_destroy(pthread_attr_t *attr)
+{
+	return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize)
+{
+	if (stacksize < PTHREAD_STACK_MIN)
+		return EINVAL;
+
+	attr->stacksize = stacksize;
+	return 0;
+}
+
+int pthread_attr_getstacksize(const pthread_attr_t *attr, size_t *stacksize)
+{
+	*stacksize = attr->stacksize;
+	return 0;
+}
+
+int pthread_mutexattr_init(pthread_mutexattr_t *attr)
+{
+	attr->protocol = PTHREAD_PRIO_NONE;
+	return 0;
+}
+
+int pthread_mutexattr_destroy(pthread_mutexattr_t *attr)
+{
+	return 0;
+}
+
+int pthread_mutexattr_setprotocol(pthread_mutexattr_t *attr, int protocol)
+{
+	if (protocol != PTHREAD_PRIO_NONE && protocol != PTHREAD_PRIO_INHERIT)
+		return EINVAL;
+
+	attr->protocol = protocol;
+	return 0;
+}
+
+int pthread_mutexattr_getprotocol(const pthread_mutexattr_t *attr, int *protocol)
+{
+	*protocol = attr->protocol;
+	return 0;
+}
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
+{
+	mutex->lock = 0;
+	mutex->protocol = attr ? attr->protocol : PTHREAD_PRIO_NONE;
+	return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex)
+{
+	return mutex->lock ? EBUSY : 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+	int val = mutex->protocol == PTHREAD_PRIO_INHERIT ? pthread_self()->tid : 1;
+	return atomic_cmpxchg(&mutex->lock, 0, val) ? EBUSY : 0;
+}
+
+// Uncontended pi mutex is still a single cmpxchg (0 <-> tid), kernel is entered when it is owned
+// FUTEX_LOCK_PI returns when the owner has handed it over to us
+static int pi_mutex_lock(pthread_mutex_t *mutex)
+{
+	if (!atomic_cmpxchg(&mutex->lock, 0, pthread_self()->tid))
+		return 0;
+
+	return futex(&mutex->lock, FUTEX_LOCK_PI, 0, NULL, NULL) < 0 ? errno : 0;
+}
+
+// FUTEX_WAITERS is set -> cmpxchg fails and kernel picks the next owner
+static int pi_mutex_unlock(pthread_mutex_t *mutex)
+{
+	pid_t tid = pthread_self()->tid;
+	if (atomic_cmpxchg(&mutex->lock, tid, 0) == tid)
+		return 0;
+
+	return futex(&mutex->lock, FUTEX_UNLOCK_PI, 0, NULL, NULL) < 0 ? errno : 0;
+}
+
+/*
+ * Uncontended lock/unlock is a single atomic instruction without entering kernel
+ * a contender marks lock as 2 before sleeping so the owner knows it has to issue FUTEX_WAKE on unlock
+ */
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	if (mutex->protocol == PTHREAD_PRIO_INHERIT)
+		return pi_mutex_lock(mutex);
+
+	int c = atomic_cmpxchg(&mutex->lock, 0, 1);
+	if (!c)
+		return 0;
+
+	if (c != 2)
+		c = atomic_xchg(&mutex->lock, 2);
+	while (c)
+	{
+		futex(&mutex->lock, FUTEX_WAIT, 2, NULL, NULL);
+		c = atomic_xchg(&mutex->lock, 2);
+	}
+	return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+	if (mutex->protocol == PTHREAD_PRIO_INHERIT)
+		return pi_mutex_unlock(mutex);
+
+	if (atomic_xchg(&mutex->lock, 0) == 2)
+		futex(&mutex->lock, FUTEX_WAKE, 1, NULL, NULL);
+	return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+	cond->seq = 0;
+	cond->waiters = 0;
+	cond->mutex = NULL;
+	return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+	return cond->waiters ? EBUSY : 0;
+}
+
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *reltime)
+{
+	int seq = cond->seq;
+	int ret = 0;
+
+	cond->mutex = mutex;
+	atomic_add(&cond->waiters, 1);
+	pthread_mutex_unlock(mutex);
+
+	// seq has changed in between -> futex returns EAGAIN, that is a normal wake-up
+	if (futex(&cond->seq, FUTEX_WAIT, seq, reltime, NULL) < 0 && errno == ETIMEDOUT)
+		ret = ETIMEDOUT;
+	atomic_add(&cond->waiters, -1);
+
+	if (mutex->protocol == PTHREAD_PRIO_INHERIT)
+	{
+		pi_mutex_lock(mutex);
+		return ret;
+	}
+
+	// we might be requeued onto mutex by broadcast, lock as contended so the next waiter is woken on unlock
+	while (atomic_xchg(&mutex->lock, 2))
+		futex(&mutex->lock, FUTEX_WAIT, 2, NULL, NULL);
+	return ret;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	return cond_wait(cond, mutex, NULL);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+	struct timespec now, reltime;
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	reltime.tv_sec = abstime->tv_sec - now.tv_sec;
+	reltime.tv_nsec = abstime->tv_nsec - now.tv_nsec;
+	if (reltime.tv_nsec < 0)
+	{
+		reltime.tv_sec--;
+		reltime.tv_nsec += 1000000000;
+	}
+	if (reltime.tv_sec < 0)
+		return ETIMEDOUT;
+
+	return cond_wait(cond, mutex, &reltime);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+	atomic_add(&cond->seq, 1);
+	if (cond->waiters)
+		futex(&cond->seq, FUTEX_WAKE, 1, NULL, NULL);
+	return 0;
+}
+
+// wake one waiter and move the rest onto mutex, they are woken one by one when mutex is unlocked
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+	atomic_add(&cond->seq, 1);
+	if (!cond->waiters)
+		return 0;
+
+	// pi mutex word is owned by kernel's handover, waiters cannot be parked on it with FUTEX_WAIT
+	if (cond->mutex && cond->mutex->protocol != PTHREAD_PRIO_INHERIT)
+		futex(&cond->seq, FUTEX_REQUEUE, 1, (const struct timespec *)INT_MAX, &cond->mutex->lock);
+	else
+		futex(&cond->seq, FUTEX_WAKE, INT_MAX, NULL, NULL);
+	return 0;
+}
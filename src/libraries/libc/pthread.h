@@ -0,0 +1,86 @@
+#ifndef _LIBC_PTHREAD_H
+#define _LIBC_PTHREAD_H 1
+
+#include <limits.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define PTHREAD_STACK_DEFAULT 65536
+
+struct pthread;
+typedef struct pthread *pthread_t;
+
+typedef struct
+{
+	size_t stacksize;
+} pthread_attr_t;
+
+#define PTHREAD_PRIO_NONE 0
+#define PTHREAD_PRIO_INHERIT 1
+
+// lock: 0 unlocked, 1 locked, 2 locked and there might be waiters in kernel
+// PTHREAD_PRIO_INHERIT -> lock is owner's tid (| FUTEX_WAITERS), owner inherits priority of waiters in kernel
+typedef struct
+{
+	volatile int lock;
+	int protocol;
+} pthread_mutex_t;
+
+typedef struct
+{
+	int protocol;
+} pthread_mutexattr_t;
+
+#define PTHREAD_MUTEX_INITIALIZER \
+	{                             \
+		0, PTHREAD_PRIO_NONE      \
+	}
+
+// seq is bumped on every signal/broadcast, waiters sleep on it with the value they saw before unlocking mutex
+typedef struct
+{
+	volatile int seq;
+	volatile int waiters;
+	pthread_mutex_t *mutex;
+} pthread_cond_t;
+
+typedef struct
+{
+	int unused;
+} pthread_condattr_t;
+
+#define PTHREAD_COND_INITIALIZER \
+	{                            \
+		0, 0, NULL               \
+	}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg);
+int pthread_join(pthread_t thread, void **retval);
+void pthread_exit(void *retval);
+pthread_t pthread_self();
+int pthread_equal(pthread_t t1, pthread_t t2);
+
+int pthread_attr_init(pthread_attr_t *attr);
+int pthread_attr_destroy(pthread_attr_t *attr);
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize);
+int pthread_attr_getstacksize(const pthread_attr_t *attr, size_t *stacksize);
+
+int pthread_mutexattr_init(pthread_mutexattr_t *attr);
+int pthread_mutexattr_destroy(pthread_mutexattr_t *attr);
+int pthread_mutexattr_setprotocol(pthread_mutexattr_t *attr, int protocol);
+int pthread_mutexattr_getprotocol(const pthread_mutexattr_t *attr, int *protocol);
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr);
+int pthread_mutex_destroy(pthread_mutex_t *mutex);
+int pthread_mutex_lock(pthread_mutex_t *mutex);
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
+int pthread_mutex_unlock(pthread_mutex_t *mutex);
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+int pthread_cond_destroy(pthread_cond_t *cond);
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime);
+int pthread_cond_signal(pthread_cond_t *cond);
+int pthread_cond_broadcast(pthread_cond_t *cond);
+
+#endif
@@ -0,0 +1,37 @@
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+
+extern int __clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, struct user_desc *tls, pid_t *ctid);
+
+_syscall0(sched_yield);
+int sched_yield()
+{
+	SYSCALL_RETURN(syscall_sched_yield());
+}
+
+_syscall3(sched_setscheduler, pid_t, int, const struct sched_param *);
+int sched_setscheduler(pid_t tid, int policy, const struct sched_param *param)
+{
+	SYSCALL_RETURN(syscall_sched_setscheduler(tid, policy, param));
+}
+
+_syscall1(sched_getscheduler, pid_t);
+int sched_getscheduler(pid_t tid)
+{
+	SYSCALL_RETURN(syscall_sched_getscheduler(tid));
+}
+
+_syscall1(set_thread_area, struct user_desc *);
+int set_thread_area(struct user_desc *u_info)
+{
+	SYSCALL_RETURN(syscall_set_thread_area(u_info));
+}
+
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, struct user_desc *tls, pid_t *ctid)
+{
+	if (!fn || !stack)
+		return errno = EINVAL, -1;
+
+	SYSCALL_RETURN_ORIGINAL(__clone(fn, stack, flags, arg, ptid, tls, ctid));
+}
@@ -0,0 +1,45 @@
+#ifndef _LIBC_SCHED_H
+#define _LIBC_SCHED_H 1
+
+#include <sys/types.h>
+
+#define CSIGNAL 0x000000ff
+#define CLONE_VM 0x00000100
+#define CLONE_FS 0x00000200
+#define CLONE_FILES 0x00000400
+#define CLONE_SIGHAND 0x00000800
+#define CLONE_THREAD 0x00010000
+#define CLONE_SETTLS 0x00080000
+#define CLONE_PARENT_SETTID 0x00100000
+#define CLONE_CHILD_CLEARTID 0x00200000
+#define CLONE_CHILD_SETTID 0x01000000
+
+#define SCHED_OTHER 0
+#define SCHED_FIFO 1
+
+// SCHED_FIFO: 1 (lowest) .. 99, runs ahead of all SCHED_OTHER threads until it blocks
+struct sched_param
+{
+	int sched_priority;
+};
+
+struct user_desc
+{
+	unsigned int entry_number;
+	unsigned int base_addr;
+	unsigned int limit;
+	unsigned int seg_32bit : 1;
+	unsigned int contents : 2;
+	unsigned int read_exec_only : 1;
+	unsigned int limit_in_pages : 1;
+	unsigned int seg_not_present : 1;
+	unsigned int useable : 1;
+};
+
+int sched_yield();
+int sched_setscheduler(pid_t tid, int policy, const struct sched_param *param);
+int sched_getscheduler(pid_t tid);
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, struct user_desc *tls, pid_t *ctid);
+int set_thread_area(struct user_desc *u_info);
+
+#endif
@@ -0,0 +1,206 @@
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// actions are kept in kernel's layout, kernel applies them in child before loading elf
+#define SPAWN_DO_CLOSE 0
+#define SPAWN_DO_DUP2 1
+#define SPAWN_DO_OPEN 2
+
+_syscall1(posix_spawn, struct spawn_args *);
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions,
+				const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+	struct spawn_args args = {
+		.pid = pid,
+		.path = path,
+		.file_actions = file_actions,
+		.attrp = attrp,
+		.argv = argv,
+		.envp = envp,
+	};
+	int ret = syscall_posix_spawn(&args);
+	return ret < 0 ? -ret : 0;
+}
+
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions,
+				 const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+	if (strchr(file, '/'))
+		return posix_spawn(pid, file, file_actions, attrp, argv, envp);
+
+	const char *paths = getenv("PATH");
+	if (!paths)
+		paths = "/bin:/usr/bin";
+
+	char path[PATH_MAX];
+	int ret = ENOENT;
+	for (const char *dir = paths; ret == ENOENT && *dir;)
+	{
+		const char *end = strchr(dir, ':');
+		int dir_length = end ? end - dir : (int)strlen(dir);
+		if (dir_length + 1 + strlen(file) < PATH_MAX)
+		{
+			memcpy(path, dir, dir_length);
+			path[dir_length] = '/';
+			strcpy(path + dir_length + 1, file);
+			ret = posix_spawn(pid, path, file_actions, attrp, argv, envp);
+		}
+		dir = end ? end + 1 : dir + dir_length;
+	}
+	return ret;
+}
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions)
+{
+	memset(file_actions, 0, sizeof(posix_spawn_file_actions_t));
+	return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions)
+{
+	for (int i = 0; i < file_actions->used; ++i)
+		free(file_actions->actions[i].path);
+	free(file_actions->actions);
+	memset(file_actions, 0, sizeof(posix_spawn_file_actions_t));
+	return 0;
+}
+
+static struct __spawn_action *add_action(posix_spawn_file_actions_t *file_actions)
+{
+	if (file_actions->used == file_actions->allocated)
+	{
+		int allocated = file_actions->allocated ? file_actions->allocated * 2 : 8;
+		struct __spawn_action *actions = realloc(file_actions->actions, allocated * sizeof(struct __spawn_action));
+		if (!actions)
+			return NULL;
+
+		file_actions->actions = actions;
+		file_actions->allocated = allocated;
+	}
+
+	struct __spawn_action *action = &file_actions->actions[file_actions->used++];
+	memset(action, 0, sizeof(struct __spawn_action));
+	return action;
+}
+
+static bool is_valid_fd(int fd)
+{
+	return 0 <= fd && fd < OPEN_MAX;
+}
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions, int fd, const char *path, int oflag, mode_t mode)
+{
+	if (!is_valid_fd(fd))
+		return EBADF;
+
+	char *dup_path = strdup(path);
+	struct __spawn_action *action = dup_path ? add_action(file_actions) : NULL;
+	if (!action)
+	{
+		free(dup_path);
+		return ENOMEM;
+	}
+
+	action->type = SPAWN_DO_OPEN;
+	action->fd = fd;
+	action->path = dup_path;
+	action->oflag = oflag;
+	action->mode = mode;
+	return 0;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions, int fd)
+{
+	if (!is_valid_fd(fd))
+		return EBADF;
+
+	struct __spawn_action *action = add_action(file_actions);
+	if (!action)
+		return ENOMEM;
+
+	action->type = SPAWN_DO_CLOSE;
+	action->fd = fd;
+	return 0;
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions, int fd, int newfd)
+{
+	if (!is_valid_fd(fd) || !is_valid_fd(newfd))
+		return EBADF;
+
+	struct __spawn_action *action = add_action(file_actions);
+	if (!action)
+		return ENOMEM;
+
+	action->type = SPAWN_DO_DUP2;
+	action->fd = fd;
+	action->newfd = newfd;
+	return 0;
+}
+
+int posix_spawnattr_init(posix_spawnattr_t *attr)
+{
+	memset(attr, 0, sizeof(posix_spawnattr_t));
+	return 0;
+}
+
+int posix_spawnattr_destroy(posix_spawnattr_t *attr)
+{
+	return 0;
+}
+
+int posix_spawnattr_getflags(const posix_spawnattr_t *attr, short *flags)
+{
+	*flags = attr->flags;
+	return 0;
+}
+
+int posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags)
+{
+	if (flags & ~(POSIX_SPAWN_RESETIDS | POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSID))
+		return EINVAL;
+
+	attr->flags = flags;
+	return 0;
+}
+
+int posix_spawnattr_getpgroup(const posix_spawnattr_t *attr, pid_t *pgroup)
+{
+	*pgroup = attr->pgrp;
+	return 0;
+}
+
+int posix_spawnattr_setpgroup(posix_spawnattr_t *attr, pid_t pgroup)
+{
+	attr->pgrp = pgroup;
+	return 0;
+}
+
+int posix_spawnattr_getsigdefault(const posix_spawnattr_t *attr, sigset_t *sigdefault)
+{
+	*sigdefault = attr->sigdefault;
+	return 0;
+}
+
+int posix_spawnattr_setsigdefault(posix_spawnattr_t *attr, const sigset_t *sigdefault)
+{
+	attr->sigdefault = *sigdefault;
+	return 0;
+}
+
+int posix_spawnattr_getsigmask(const posix_spawnattr_t *attr, sigset_t *sigmask)
+{
+	*sigmask = attr->sigmask;
+	return 0;
+}
+
+int posix_spawnattr_setsigmask(posix_spawnattr_t *attr, const sigset_t *sigmask)
+{
+	attr->sigmask = *sigmask;
+	return 0;
+}
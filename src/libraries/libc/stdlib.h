@@ -104,6 +104,5 @@ size_t wcstombs(char *restrict s, const wchar_t *restrict pwcs,
 				size_t n);
 
 void *reallocarray(void *ptr, size_t nmemb, size_t size);
-void _clear_on_exit();
 
 #endif
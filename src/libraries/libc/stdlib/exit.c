@@ -27,16 +27,6 @@ int atexit(void (*func)())
 	return on_exit(func, NULL);
 }
 
-void _clear_on_exit()
-{
-	struct cleanup_handler *iter, *next;
-	list_for_each_entry_safe(iter, next, &lhandler, sibling)
-	{
-		list_del(&iter->sibling);
-		free(iter);
-	}
-}
-
 void _Exit(int status)
 {
 	exit(status);
@@ -0,0 +1,9 @@
+#include <errno.h>
+#include <sys/futex.h>
+#include <unistd.h>
+
+_syscall5(futex, volatile int *, int, int, const struct timespec *, volatile int *);
+int futex(volatile int *uaddr, int op, int val, const struct timespec *timeout, volatile int *uaddr2)
+{
+	SYSCALL_RETURN_ORIGINAL(syscall_futex(uaddr, op, val, timeout, uaddr2));
+}
@@ -0,0 +1,24 @@
+#ifndef _LIBC_SYS_FUTEX_H
+#define _LIBC_SYS_FUTEX_H 1
+
+#include <time.h>
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+#define FUTEX_LOCK_PI 6
+#define FUTEX_UNLOCK_PI 7
+
+#define FUTEX_WAITERS 0x80000000
+#define FUTEX_OWNER_DIED 0x40000000
+#define FUTEX_TID_MASK 0x3fffffff
+
+#define FUTEX_PRIVATE_FLAG 128
+#define FUTEX_WAIT_PRIVATE (FUTEX_WAIT | FUTEX_PRIVATE_FLAG)
+#define FUTEX_WAKE_PRIVATE (FUTEX_WAKE | FUTEX_PRIVATE_FLAG)
+#define FUTEX_REQUEUE_PRIVATE (FUTEX_REQUEUE | FUTEX_PRIVATE_FLAG)
+
+// FUTEX_REQUEUE takes number of waiters to requeue in place of `timeout`
+int futex(volatile int *uaddr, int op, int val, const struct timespec *timeout, volatile int *uaddr2);
+
+#endif
@@ -1,9 +1,11 @@
-#include <assert.h>
+#include <errno.h>
 #include <sys/select.h>
+#include <sys/time.h>
+#include <unistd.h>
 
+_syscall5(select, int, fd_set *, fd_set *, fd_set *, struct timeval *);
 int select(int nfds, fd_set *readfds, fd_set *writefds,
 		   fd_set *exceptfds, struct timeval *timeout)
 {
-	assert_not_reached();
-	__builtin_unreachable();
+	SYSCALL_RETURN_ORIGINAL(syscall_select(nfds, readfds, writefds, exceptfds, timeout));
 }
@@ -62,6 +62,12 @@ int getpid()
 	SYSCALL_RETURN_ORIGINAL(syscall_getpid());
 }
 
+_syscall0(gettid);
+pid_t gettid()
+{
+	SYSCALL_RETURN_ORIGINAL(syscall_gettid());
+}
+
 _syscall0(getuid);
 int getuid()
 {
@@ -128,12 +134,6 @@ int setsid()
 	SYSCALL_RETURN_ORIGINAL(syscall_setsid());
 }
 
-_syscall1(posix_spawn, char *);
-int posix_spawn(char *path)
-{
-	SYSCALL_RETURN(syscall_posix_spawn(path));
-}
-
 _syscall2(getptsname, int, char *);
 int getptsname(int fdm, char *ptsname)
 {
@@ -177,9 +177,9 @@ int dup2(int oldfd, int newfd)
 }
 
 _syscall3(execve, const char *, char *const *, char *const *);
+// caller's memory is not touched, vfork child shares it with parent
 int execve(const char *pathname, char *const argv[], char *const envp[])
 {
-	_clear_on_exit();
 	SYSCALL_RETURN_ORIGINAL(syscall_execve(pathname, argv, envp));
 }
 
@@ -225,17 +225,23 @@ int read(int fd, char *buf, size_t size)
 	SYSCALL_RETURN_ORIGINAL(syscall_read(fd, buf, size));
 }
 
-_syscall1(exit, int);
+// exit syscall only terminates the calling thread, process exits via exit_group
+_syscall1(exit_group, int);
 void __attribute__((noreturn)) _exit(int code)
 {
-	syscall_exit(code);
+	syscall_exit_group(code);
 	__builtin_unreachable();
 }
 
+extern void __pthread_refresh_tid();
+
 _syscall0(fork);
 int fork()
 {
-	SYSCALL_RETURN_ORIGINAL(syscall_fork());
+	int pid = syscall_fork();
+	if (!pid)
+		__pthread_refresh_tid();
+	SYSCALL_RETURN_ORIGINAL(pid);
 }
 
 _syscall1(alarm, unsigned int);
@@ -167,15 +167,28 @@
 #define __NR_listen 105
 #define __NR_stat 106
 #define __NR_fstat 108
+#define __NR_clone 120
 #define __NR_uname 122
 #define __NR_sigprocmask 126
 #define __NR_fchdir 133
 #define __NR_getpgid 132
 #define __NR_getdents 141
+#define __NR_select 142
 #define __NR_getsid 147
+#define __NR_sched_setscheduler 156
+#define __NR_sched_getscheduler 157
+#define __NR_sched_yield 158
 #define __NR_nanosleep 162
 #define __NR_poll 168
 #define __NR_getcwd 183
+#define __NR_vfork 190
+#define __NR_gettid 224
+#define __NR_futex 240
+#define __NR_set_thread_area 243
+#define __NR_exit_group 252
+#define __NR_epoll_create 254
+#define __NR_epoll_ctl 255
+#define __NR_epoll_wait 256
 #define __NR_clock_gettime 265
 #define __NR_mq_open 277
 #define __NR_mq_close (__NR_mq_open + 1)
@@ -187,6 +200,7 @@
 #define __NR_unlinkat 301
 #define __NR_renameat 302
 #define __NR_faccessat 307
+#define __NR_epoll_create1 329
 #define __NR_sendto 369
 // TODO: MQ 2020-09-05 Use ioctl-FIODGNAME to get pts name
 #define __NR_getptsname 370
@@ -264,6 +278,8 @@
 struct dirent;
 
 int fork();
+// implemented in vfork.S, child may only call execve or _exit
+int vfork();
 void _exit(int code);
 int read(int fd, char *buf, size_t size);
 int write(int fd, const char *buf, size_t size);
@@ -281,6 +297,7 @@ int truncate(const char *name, off_t length);
 int ftruncate(int fd, off_t length);
 char *getcwd(char *buf, size_t size);
 int getpid();
+pid_t gettid();
 int getuid();
 int setuid(uid_t uid);
 int getegid();
@@ -293,7 +310,6 @@ int getppid();
 int setpgid(pid_t pid, pid_t pgid);
 int getsid();
 int setsid();
-int posix_spawn(char *path);
 int getptsname(int fdm, char *ptsname);
 int getdents(unsigned int fd, struct dirent *dirent, unsigned int count);
 
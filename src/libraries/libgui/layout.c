@@ -309,7 +309,7 @@ void enter_event_loop(struct window *win, void (*event_callback)(struct xevent *
 		for (unsigned int i = 0; i < nfds; ++i)
 			pfds[i + 1].fd = fds[i];
 
-		int nr = poll(pfds, MAX_FD);
+		int nr = poll(pfds, MAX_FD, -1);
 		if (nr <= 0)
 			continue;
 
@@ -1,5 +1,7 @@
+LDFLAGS ?= -T linker.ld -ffreestanding -nostdlib -lgcc -g
+
 ${OUTPUT}: ${OBJ}
-	${CC} -o $@ -T linker.ld $^ -ffreestanding -nostdlib -lgcc -g
+	${CC} -o $@ $^ ${LDFLAGS}
 
 %.o: %.c ${HEADERS}
 	${CC} ${CFLAGS} -c $< -o $@
@@ -1,7 +1,10 @@
 ROOTDIR := $(shell cd ../.. && pwd)
 
-C_SOURCES = $(wildcard *.c src/*.c $(ROOTDIR)/libraries/**/*.c $(ROOTDIR)/libraries/**/**/*.c)
-A_SOURCES = $(wildcard *.S src/*.S $(ROOTDIR)/libraries/**/*.S $(ROOTDIR)/libraries/**/**/*.S)
+# apps are linked against libc.so and libgui.so (which bundles libcore), /lib/ld.so maps them at runtime
+CC = i386-mos-gcc
+
+C_SOURCES = $(wildcard *.c src/*.c)
+A_SOURCES = $(wildcard *.S src/*.S)
 HEADERS = $(wildcard *.h src/*.h $(ROOTDIR)/libraries/**/*.h $(ROOTDIR)/libraries/**/**/*.h)
 
 # Nice syntax for file extension replacement
@@ -9,3 +12,4 @@ OBJ =${A_SOURCES:.S=.o} ${C_SOURCES:.c=.o}
 
 # -g: Use debugging symbols in gcc
 CFLAGS = -g -std=gnu18 -ffreestanding -Wall -Wextra -Wno-unused-parameter -Wno-discarded-qualifiers -Wno-comment -Wno-multichar -Wno-sequence-point -Wno-unused-function -Wno-unused-value -Wno-sign-compare -Wno-implicit-fallthrough -I$(ROOTDIR)/libraries/libc -I$(ROOTDIR)/libraries
+LDFLAGS = -g -L$(ROOTDIR)/libraries/libc -L$(ROOTDIR)/libraries/libgui -lgui -lc -Wl,-dynamic-linker,/lib/ld.so -Wl,--hash-style=sysv